@@ -0,0 +1,207 @@
+#include "align.hpp"
+#include "common.hpp"
+#include "clock.hpp"
+#include "log.hpp"
+#include <array>
+#include <atomic>
+#include <cstring>
+
+namespace
+{
+#if TR_OS_LINUX
+    constexpr usize BINS        = 64;
+    constexpr usize MARGIN_BINS = 2;
+
+    constexpr u64 UPDATE_INTERVAL_NS = 5000000000;
+    constexpr u32 MIN_ARRIVALS       = 1024;
+
+    // Only move when the mean wait gets this much shorter (a fraction of the interval), so the phase doesn't chase noise.
+    constexpr f64 MIN_GAIN_FRACTION = 1.0 / 16.0;
+
+    // The engine only reads its sockets from the main thread, but the histogram doesn't rely on it.
+    struct State
+    {
+        std::atomic<u64>                   interval_ns{};
+        std::array<std::atomic<u32>, BINS> bins{};
+        u64                                last_tick_ns{};
+        u64                                next_update_ns{};
+        u64                                target_ns{};
+        bool                               has_target{};
+    } g_align{};
+
+    void record(u64 arrival_ns, const void *data, usize size) noexcept
+    {
+        auto &&state = g_align;
+
+        u64 interval_ns = state.interval_ns.load(std::memory_order_relaxed);
+        if (arrival_ns == 0 || interval_ns == 0)
+        {
+            return;
+        }
+
+        // Connectionless packets start with -1, split packets with -2.
+        u32 header{};
+        if (size >= sizeof(header))
+        {
+            std::memcpy(&header, data, sizeof(header));
+            if (header == 0xFFFFFFFF || header == 0xFFFFFFFE)
+            {
+                return;
+            }
+        }
+
+        usize bin = (usize)(arrival_ns % interval_ns * BINS / interval_ns);
+        state.bins[bin].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Mean wait in bins of the arrivals for a tick at `phase` (in bins), the arrivals are at the center of their bin.
+    [[nodiscard]] f64 mean_wait(const std::array<u32, BINS> &bins, u64 total, f64 phase) noexcept
+    {
+        f64 sum{};
+        for (usize i{}; i < BINS; ++i)
+        {
+            f64 wait = phase - ((f64)i + 0.5);
+            if (wait < 0.0)
+            {
+                wait += (f64)BINS;
+            }
+
+            sum += wait * (f64)bins[i];
+        }
+
+        return sum / (f64)total;
+    }
+
+    void update(u64 now_ns) noexcept
+    {
+        auto &&state       = g_align;
+        u64    interval_ns = state.interval_ns.load(std::memory_order_relaxed);
+
+        std::array<u32, BINS> bins{};
+        u64                   total{};
+        for (usize i{}; i < BINS; ++i)
+        {
+            bins[i] = state.bins[i].load(std::memory_order_relaxed);
+            total += bins[i];
+        }
+
+        if (total < MIN_ARRIVALS)
+        {
+            return;
+        }
+
+        // Older arrivals fade out, so the phase follows players joining and leaving.
+        for (auto &&bin : state.bins)
+        {
+            bin.store(bin.load(std::memory_order_relaxed) / 2, std::memory_order_relaxed);
+        }
+
+        usize best{};
+        f64   best_wait = (f64)BINS;
+        for (usize i{}; i < BINS; ++i)
+        {
+            if (f64 wait = mean_wait(bins, total, (f64)i); wait < best_wait)
+            {
+                best      = i;
+                best_wait = wait;
+            }
+        }
+
+        const auto bin_ns  = (f64)interval_ns / (f64)BINS;
+        f64        current = mean_wait(bins, total, (f64)(now_ns % interval_ns) / bin_ns);
+        if (current - best_wait < (f64)BINS * MIN_GAIN_FRACTION)
+        {
+            return;
+        }
+
+        u64 target_ns = (u64)((f64)((best + MARGIN_BINS) % BINS) * bin_ns);
+        if (state.has_target && target_ns == state.target_ns)
+        {
+            return;
+        }
+
+        state.target_ns  = target_ns;
+        state.has_target = true;
+        clock_set_phase_target(interval_ns, target_ns);
+
+        info(
+            "Aligning ticks to client commands: mean wait {:.0f} us -> {:.0f} us ({} arrivals).\n",
+            current * bin_ns / 1000.0,
+            (best_wait + (f64)MARGIN_BINS) * bin_ns / 1000.0,
+            total);
+    }
+#endif
+} // namespace
+
+tl::expected<void, NetError> align_start([[maybe_unused]] u64 interval_ns) noexcept
+{
+#if TR_OS_LINUX
+    align_stop();
+
+    if (auto result = net_hook(NET_RECV_TIMESTAMPS); !result)
+    {
+        return result;
+    }
+
+    g_align.interval_ns.store(interval_ns, std::memory_order_relaxed);
+
+    net_set_arrival_callback(record);
+    net_enable(NET_RECV_TIMESTAMPS);
+
+    return {};
+#else
+    return tl::unexpected{NetError{NetError::UNSUPPORTED}};
+#endif
+}
+
+void align_stop() noexcept
+{
+#if TR_OS_LINUX
+    auto &&state = g_align;
+
+    // The hooks stay until `net_unhook`, other features may use them.
+    net_disable(NET_RECV_TIMESTAMPS);
+    net_set_arrival_callback(nullptr);
+
+    if (state.has_target)
+    {
+        clock_clear_phase_target();
+    }
+
+    for (auto &&bin : state.bins)
+    {
+        bin.store(0, std::memory_order_relaxed);
+    }
+
+    state.interval_ns.store(0, std::memory_order_relaxed);
+    state.last_tick_ns   = 0;
+    state.next_update_ns = 0;
+    state.target_ns      = 0;
+    state.has_target     = false;
+#endif
+}
+
+void align_update([[maybe_unused]] u64 now_ns) noexcept
+{
+#if TR_OS_LINUX
+    auto &&state       = g_align;
+    u64    interval_ns = state.interval_ns.load(std::memory_order_relaxed);
+    if (interval_ns == 0)
+    {
+        return;
+    }
+
+    // Catch-up ticks don't run at the tick phase.
+    bool catch_up      = now_ns - state.last_tick_ns < interval_ns / 2;
+    state.last_tick_ns = now_ns;
+
+    if (catch_up || now_ns < state.next_update_ns)
+    {
+        return;
+    }
+
+    state.next_update_ns = now_ns + UPDATE_INTERVAL_NS;
+
+    update(now_ns);
+#endif
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "type.hpp"
+#include "net.hpp"
+#include <tl/expected.hpp>
+
+// Moves the tick phase to just after client commands arrive, so a command waits as little as possible before it's simulated.
+// Every datagram's kernel receive time (`NET_RECV_TIMESTAMPS`) goes into a histogram of phases within the tick interval. Every few
+// seconds the tick phase with the lowest mean wait is picked and the clock slews to it (see `clock_set_phase_target`), a few bins
+// later than the arrivals to absorb jitter.
+// Connectionless packets (server browser queries) aren't commands and are left out.
+
+// Hooks the engine's socket reads (`net_hook`).
+tl::expected<void, NetError> align_start(u64 interval_ns) noexcept;
+void                         align_stop() noexcept;
+
+// Called from `GameFrame` on every simulated tick.
+void align_update(u64 now_ns) noexcept;
@@ -0,0 +1,632 @@
+#include "alloc.hpp"
+#include "common.hpp"
+#include "engine.hpp"
+#include "os.hpp"
+#include "vmt.hpp"
+#include "iface.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+#if TR_OS_LINUX
+#include <sys/mman.h>
+#include <malloc.h>
+#include <pthread.h>
+#endif
+
+namespace
+{
+#if TR_OS_LINUX
+    using AllocFn   = void *(TR_THISCALL *)(void *self, usize size);
+    using ReallocFn = void *(TR_THISCALL *)(void *self, void *block, usize size);
+    using FreeFn    = void(TR_THISCALL *)(void *self, void *block);
+    using GetSizeFn = usize(TR_THISCALL *)(void *self, void *block);
+
+    // 16 bytes apart up to 128, then 4 per power of two. All are multiples of 16, so blocks are aligned like `malloc`'s.
+    constexpr std::array<u32, 36> CLASS_SIZES = {
+        16,  32,   48,   64,   80,   96,   112,  128,  160,  192,  224,  256,  320,   384,   448,   512,   640,   768,
+        896, 1024, 1280, 1536, 1792, 2048, 2560, 3072, 3584, 4096, 5120, 6144, 7168, 8192, 10240, 12288, 14336, 16384,
+    };
+
+    constexpr usize CLASS_COUNT = CLASS_SIZES.size();
+    static_assert(CLASS_SIZES.back() == ALLOC_MAX_SMALL, "The largest class must be `ALLOC_MAX_SMALL`.");
+
+    // Class of every size rounded up to 16 bytes.
+    constexpr auto CLASS_LOOKUP = []() noexcept
+    {
+        std::array<u8, ALLOC_MAX_SMALL / 16 + 1> lookup{};
+
+        usize size_class{};
+        for (usize i{}; i < lookup.size(); ++i)
+        {
+            while (CLASS_SIZES[size_class] < i * 16)
+            {
+                ++size_class;
+            }
+
+            lookup[i] = (u8)size_class;
+        }
+
+        return lookup;
+    }();
+
+    // A batch moves about this many bytes between a thread cache and a central pool, a cache holds at most two batches per class.
+    constexpr u32 BATCH_BYTES = 16384;
+    constexpr u32 MAX_BATCH   = 64;
+
+    [[nodiscard]] constexpr u32 batch_size(usize size_class) noexcept
+    {
+        return std::clamp<u32>(BATCH_BYTES / CLASS_SIZES[size_class], 2, MAX_BATCH);
+    }
+
+    // Chunk map: the class + 1 of every chunk we mapped, 0 for everything else. The root covers the whole address space (48 bits on
+    // 64-bit) and its leaves are mapped as chunks land in them.
+    constexpr usize CHUNK_SHIFT  = 18;
+    constexpr usize ADDRESS_BITS = sizeof(void *) == 8 ? 48 : 32;
+    constexpr usize INDEX_BITS   = ADDRESS_BITS - CHUNK_SHIFT;
+    constexpr usize LEAF_BITS    = std::min<usize>(INDEX_BITS, 14);
+    constexpr usize LEAF_SIZE    = (usize)1 << LEAF_BITS;
+    constexpr usize ROOT_SIZE    = (usize)1 << (INDEX_BITS - LEAF_BITS);
+    static_assert(ALLOC_CHUNK_SIZE == (usize)1 << CHUNK_SHIFT, "`CHUNK_SHIFT` doesn't match `ALLOC_CHUNK_SIZE`.");
+
+    struct Leaf
+    {
+        std::array<std::atomic<u8>, LEAF_SIZE> classes;
+    };
+
+    struct FreeBlock
+    {
+        FreeBlock *next;
+    };
+
+    struct Central
+    {
+        std::mutex mutex{};
+        FreeBlock *head{};
+        u8        *cursor{}; // What's left of the last chunk, carved as needed.
+        u8        *end{};
+    };
+
+    // Trivially destructible, thread exit is handled by `release_thread_cache`.
+    struct ThreadCache
+    {
+        std::array<FreeBlock *, CLASS_COUNT> heads;
+        std::array<u32, CLASS_COUNT>         counts;
+        bool                                 registered;
+    };
+
+    void *TR_THISCALL crt_alloc(void *, usize size) noexcept
+    {
+        return std::malloc(size);
+    }
+
+    void *TR_THISCALL crt_realloc(void *, void *block, usize size) noexcept
+    {
+        return std::realloc(block, size);
+    }
+
+    void TR_THISCALL crt_free(void *, void *block) noexcept
+    {
+        std::free(block);
+    }
+
+    usize TR_THISCALL crt_get_size(void *, void *block) noexcept
+    {
+        return block != nullptr ? malloc_usable_size(block) : 0;
+    }
+
+    // Nothing in here may have a destructor that matters: the engine keeps allocating until the process is gone.
+    struct State
+    {
+        std::array<Central, CLASS_COUNT>           centrals{};
+        std::array<std::atomic<Leaf *>, ROOT_SIZE> chunk_map{};
+        std::mutex                                 map_mutex{};
+        std::once_flag                             key_once{};
+        pthread_key_t                              key{};
+        void                                      *mem_alloc{}; // The replaced allocator, or the C runtime's.
+        AllocFn                                    alloc{crt_alloc};
+        ReallocFn                                  realloc{crt_realloc};
+        FreeFn                                     free{crt_free};
+        GetSizeFn                                  get_size{crt_get_size};
+        std::array<VmtSlotHook, 7>                *hooks{}; // Never freed, see `alloc_install`.
+        std::atomic<u64>                           chunks{};
+        std::atomic<u64>                           refills{};
+        std::atomic<u64>                           flushes{};
+        std::atomic<u64>                           large{};
+        std::atomic<u64>                           foreign{};
+        std::atomic<u64>                           threads{};
+    } g_alloc{};
+
+    thread_local ThreadCache g_thread_cache{};
+
+    // Returns `CLASS_COUNT` for blocks we don't own.
+    [[nodiscard]] usize class_of(const void *block) noexcept
+    {
+        auto address = (usize)block;
+        if constexpr (ADDRESS_BITS < sizeof(usize) * 8)
+        {
+            if ((address >> ADDRESS_BITS) != 0)
+            {
+                return CLASS_COUNT;
+            }
+        }
+
+        usize index = address >> CHUNK_SHIFT;
+        auto *leaf  = g_alloc.chunk_map[index >> LEAF_BITS].load(std::memory_order_acquire);
+        if (leaf == nullptr)
+        {
+            return CLASS_COUNT;
+        }
+
+        u8 tag = leaf->classes[index & (LEAF_SIZE - 1)].load(std::memory_order_relaxed);
+        return tag != 0 ? (usize)tag - 1 : CLASS_COUNT;
+    }
+
+    [[nodiscard]] u8 *map_chunk(usize size_class) noexcept
+    {
+        auto &&state = g_alloc;
+
+        // Twice the size so an aligned chunk fits, the rest is given back.
+        auto *mapping = (u8 *)mmap(nullptr, ALLOC_CHUNK_SIZE * 2, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mapping == MAP_FAILED)
+        {
+            return nullptr;
+        }
+
+        auto *chunk = (u8 *)(((usize)mapping + ALLOC_CHUNK_SIZE - 1) & ~(ALLOC_CHUNK_SIZE - 1));
+        if (chunk != mapping)
+        {
+            munmap(mapping, (usize)(chunk - mapping));
+        }
+
+        if (usize tail = ALLOC_CHUNK_SIZE - (usize)(chunk - mapping); tail != 0)
+        {
+            munmap(chunk + ALLOC_CHUNK_SIZE, tail);
+        }
+
+        usize index = (usize)chunk >> CHUNK_SHIFT;
+        if ((index >> LEAF_BITS) >= ROOT_SIZE)
+        {
+            munmap(chunk, ALLOC_CHUNK_SIZE);
+            return nullptr;
+        }
+
+        std::lock_guard lock{state.map_mutex};
+
+        auto &&root = state.chunk_map[index >> LEAF_BITS];
+        auto  *leaf = root.load(std::memory_order_relaxed);
+        if (leaf == nullptr)
+        {
+            // Zeroed pages are a leaf of zero atomics.
+            auto *pages = mmap(nullptr, sizeof(Leaf), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (pages == MAP_FAILED)
+            {
+                munmap(chunk, ALLOC_CHUNK_SIZE);
+                return nullptr;
+            }
+
+            leaf = (Leaf *)pages;
+            root.store(leaf, std::memory_order_release);
+        }
+
+        leaf->classes[index & (LEAF_SIZE - 1)].store((u8)(size_class + 1), std::memory_order_relaxed);
+        state.chunks.fetch_add(1, std::memory_order_relaxed);
+
+        return chunk;
+    }
+
+    // Gives back a thread's cache when it exits.
+    void release_thread_cache(void *data) noexcept;
+
+    void register_thread(ThreadCache &cache) noexcept
+    {
+        auto &&state = g_alloc;
+
+        std::call_once(state.key_once, [&]() noexcept { pthread_key_create(&state.key, release_thread_cache); });
+
+        pthread_setspecific(state.key, &cache);
+        cache.registered = true;
+
+        state.threads.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Moves the first `count` blocks of the cache to the central pool.
+    void flush(ThreadCache &cache, usize size_class, u32 count) noexcept
+    {
+        auto &&central = g_alloc.centrals[size_class];
+
+        FreeBlock *first = cache.heads[size_class];
+        FreeBlock *last  = first;
+        for (u32 i = 1; i < count; ++i)
+        {
+            last = last->next;
+        }
+
+        cache.heads[size_class] = last->next;
+        cache.counts[size_class] -= count;
+
+        {
+            std::lock_guard lock{central.mutex};
+            last->next   = central.head;
+            central.head = first;
+        }
+
+        g_alloc.flushes.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void release_thread_cache(void *data) noexcept
+    {
+        auto &&cache = *(ThreadCache *)data;
+
+        for (usize i{}; i < CLASS_COUNT; ++i)
+        {
+            if (cache.counts[i] != 0)
+            {
+                flush(cache, i, cache.counts[i]);
+            }
+        }
+
+        // Anything the thread allocates from here on (other destructors) registers again, glibc runs destructors a few rounds.
+        cache.registered = false;
+    }
+
+    // Fills the (empty) cache with a batch and returns one block of it, `nullptr` when no chunk can be mapped.
+    [[nodiscard]] FreeBlock *refill(ThreadCache &cache, usize size_class) noexcept
+    {
+        auto &&state   = g_alloc;
+        auto &&central = state.centrals[size_class];
+
+        const usize size  = CLASS_SIZES[size_class];
+        const u32   batch = batch_size(size_class);
+
+        FreeBlock *head{};
+        u32        count{};
+        {
+            std::lock_guard lock{central.mutex};
+
+            for (; count < batch && central.head != nullptr; ++count)
+            {
+                auto *block  = central.head;
+                central.head = block->next;
+                block->next  = head;
+                head         = block;
+            }
+
+            if (count == 0 && central.cursor == central.end)
+            {
+                u8 *chunk = map_chunk(size_class);
+                if (chunk == nullptr)
+                {
+                    return nullptr;
+                }
+
+                central.cursor = chunk;
+                central.end    = chunk + ALLOC_CHUNK_SIZE / size * size;
+            }
+
+            for (; count < batch && central.cursor != central.end; ++count)
+            {
+                auto *block     = (FreeBlock *)central.cursor;
+                central.cursor += size;
+                block->next     = head;
+                head            = block;
+            }
+        }
+
+        state.refills.fetch_add(1, std::memory_order_relaxed);
+
+        cache.heads[size_class]  = head->next;
+        cache.counts[size_class] = count - 1;
+
+        return head;
+    }
+
+    void *TR_THISCALL hooked_Alloc(void *, usize size) noexcept
+    {
+        return alloc_allocate(size);
+    }
+
+    void *TR_THISCALL hooked_Realloc(void *, void *block, usize size) noexcept
+    {
+        return alloc_reallocate(block, size);
+    }
+
+    void TR_THISCALL hooked_Free(void *, void *block) noexcept
+    {
+        alloc_free(block);
+    }
+
+    void *TR_THISCALL hooked_Alloc_debug(void *, usize size, cstr, i32) noexcept
+    {
+        return alloc_allocate(size);
+    }
+
+    void *TR_THISCALL hooked_Realloc_debug(void *, void *block, usize size, cstr, i32) noexcept
+    {
+        return alloc_reallocate(block, size);
+    }
+
+    void TR_THISCALL hooked_Free_debug(void *, void *block, cstr, i32) noexcept
+    {
+        alloc_free(block);
+    }
+
+    usize TR_THISCALL hooked_GetSize(void *, void *block) noexcept
+    {
+        return alloc_size(block);
+    }
+#endif
+} // namespace
+
+tl::expected<void, AllocError> alloc_install() noexcept
+{
+#if TR_OS_LINUX
+    auto &&state = g_alloc;
+    if (state.hooks != nullptr)
+    {
+        return {};
+    }
+
+    u8 *tier0 = iface_get_default_module("tier0");
+    if (tier0 == nullptr)
+    {
+        return tl::unexpected{AllocError{AllocError::NO_TIER0}};
+    }
+
+    // An exported variable, the procedure is its address.
+    auto **mem_alloc = os_get_procedure<void **>(tier0, "g_pMemAlloc");
+    if (mem_alloc == nullptr || *mem_alloc == nullptr)
+    {
+        return tl::unexpected{AllocError{AllocError::NO_MEMALLOC}};
+    }
+
+    auto **vmt = *(u8 ***)*mem_alloc;
+    if (vmt_count_methods(vmt) <= IMEMALLOC_GET_SIZE)
+    {
+        return tl::unexpected{AllocError{AllocError::NO_MEMALLOC}};
+    }
+
+    // Set before any slot is, the hooks fall back to these right away. The release versions stand in for the debug ones.
+    state.mem_alloc = *mem_alloc;
+    state.alloc     = (AllocFn)vmt[IMEMALLOC_ALLOC];
+    state.realloc   = (ReallocFn)vmt[IMEMALLOC_REALLOC];
+    state.free      = (FreeFn)vmt[IMEMALLOC_FREE];
+    state.get_size  = (GetSizeFn)vmt[IMEMALLOC_GET_SIZE];
+
+    auto restore_fallbacks = [&]() noexcept
+    {
+        state.mem_alloc = nullptr;
+        state.alloc     = crt_alloc;
+        state.realloc   = crt_realloc;
+        state.free      = crt_free;
+        state.get_size  = crt_get_size;
+    };
+
+    // Leaked on purpose: restoring the slots at exit (static destructors run while other threads still allocate) would hand our
+    // blocks to the replaced allocator.
+    auto *hooks = new (std::nothrow) std::array<VmtSlotHook, 7>{};
+    if (hooks == nullptr)
+    {
+        restore_fallbacks();
+        return tl::unexpected{AllocError{AllocError::FAILED_TO_HOOK}};
+    }
+
+    auto fail = [&](AllocError::Type type) noexcept
+    {
+        delete hooks;
+        restore_fallbacks();
+        return tl::unexpected{AllocError{type}};
+    };
+
+    // Everything that takes a block goes first. Until `Alloc` is hooked there are no blocks of ours, these only pass calls on and
+    // can still be removed.
+    auto hook = [&](usize slot, usize index, auto fn) noexcept
+    {
+        auto result = VmtSlotHook::create(vmt, index, fn);
+        if (result)
+        {
+            (*hooks)[slot] = std::move(*result);
+        }
+
+        return result.has_value();
+    };
+
+    bool hooked = hook(0, IMEMALLOC_FREE, hooked_Free) && hook(1, IMEMALLOC_FREE_DEBUG, hooked_Free_debug) &&
+                  hook(2, IMEMALLOC_REALLOC, hooked_Realloc) && hook(3, IMEMALLOC_REALLOC_DEBUG, hooked_Realloc_debug) &&
+                  hook(4, IMEMALLOC_GET_SIZE, hooked_GetSize);
+    if (!hooked)
+    {
+        return fail(AllocError::FAILED_TO_HOOK);
+    }
+
+    // Past this point the plugin's code must outlive every block, which is the process.
+    if (!os_pin_module((u8 *)&alloc_install))
+    {
+        return fail(AllocError::FAILED_TO_PIN);
+    }
+
+    if (!hook(5, IMEMALLOC_ALLOC, hooked_Alloc))
+    {
+        return fail(AllocError::FAILED_TO_HOOK);
+    }
+
+    // Only debug builds of the game call it, its blocks are simply the replaced allocator's if it can't be hooked.
+    (void)hook(6, IMEMALLOC_ALLOC_DEBUG, hooked_Alloc_debug);
+
+    state.hooks = hooks;
+
+    return {};
+#else
+    return tl::unexpected{AllocError{AllocError::UNSUPPORTED}};
+#endif
+}
+
+[[nodiscard]] bool alloc_is_installed() noexcept
+{
+#if TR_OS_LINUX
+    return g_alloc.hooks != nullptr;
+#else
+    return false;
+#endif
+}
+
+[[nodiscard]] AllocStats alloc_stats() noexcept
+{
+    AllocStats stats{};
+#if TR_OS_LINUX
+    auto &&state = g_alloc;
+
+    stats.chunks  = state.chunks.load(std::memory_order_relaxed);
+    stats.refills = state.refills.load(std::memory_order_relaxed);
+    stats.flushes = state.flushes.load(std::memory_order_relaxed);
+    stats.large   = state.large.load(std::memory_order_relaxed);
+    stats.foreign = state.foreign.load(std::memory_order_relaxed);
+    stats.threads = state.threads.load(std::memory_order_relaxed);
+#endif
+    return stats;
+}
+
+[[nodiscard]] void *alloc_allocate(usize size) noexcept
+{
+#if TR_OS_LINUX
+    auto &&state = g_alloc;
+
+    if (size > ALLOC_MAX_SMALL)
+    {
+        state.large.fetch_add(1, std::memory_order_relaxed);
+        return state.alloc(state.mem_alloc, size);
+    }
+
+    auto &&cache      = g_thread_cache;
+    usize  size_class = CLASS_LOOKUP[(size + 15) / 16];
+
+    if (auto *block = cache.heads[size_class]; block != nullptr)
+    {
+        cache.heads[size_class] = block->next;
+        --cache.counts[size_class];
+
+        return block;
+    }
+
+    if (!cache.registered)
+    {
+        register_thread(cache);
+    }
+
+    if (auto *block = refill(cache, size_class); block != nullptr)
+    {
+        return block;
+    }
+
+    // Out of address space for another chunk, the replaced allocator may still find room.
+    state.large.fetch_add(1, std::memory_order_relaxed);
+    return state.alloc(state.mem_alloc, size);
+#else
+    return std::malloc(size);
+#endif
+}
+
+[[nodiscard]] void *alloc_reallocate(void *block, usize size) noexcept
+{
+#if TR_OS_LINUX
+    auto &&state = g_alloc;
+
+    if (block == nullptr)
+    {
+        return alloc_allocate(size);
+    }
+
+    usize size_class = class_of(block);
+    if (size_class == CLASS_COUNT)
+    {
+        // The replaced allocator's blocks stay with it.
+        state.foreign.fetch_add(1, std::memory_order_relaxed);
+        return state.realloc(state.mem_alloc, block, size);
+    }
+
+    if (size == 0)
+    {
+        alloc_free(block);
+        return nullptr;
+    }
+
+    // Shrinking keeps the block, like `realloc` does.
+    usize old_size = CLASS_SIZES[size_class];
+    if (size <= old_size)
+    {
+        return block;
+    }
+
+    void *result = alloc_allocate(size);
+    if (result == nullptr)
+    {
+        return nullptr;
+    }
+
+    std::memcpy(result, block, old_size);
+    alloc_free(block);
+
+    return result;
+#else
+    return std::realloc(block, size);
+#endif
+}
+
+void alloc_free([[maybe_unused]] void *block) noexcept
+{
+#if TR_OS_LINUX
+    if (block == nullptr)
+    {
+        return;
+    }
+
+    usize size_class = class_of(block);
+    if (size_class == CLASS_COUNT)
+    {
+        auto &&state = g_alloc;
+        state.foreign.fetch_add(1, std::memory_order_relaxed);
+        state.free(state.mem_alloc, block);
+        return;
+    }
+
+    // Threads that only free (i.e. a job thread releasing what the main thread built) still give their cache back on exit.
+    auto &&cache = g_thread_cache;
+    if (!cache.registered)
+    {
+        register_thread(cache);
+    }
+
+    auto *free_block        = (FreeBlock *)block;
+    free_block->next        = cache.heads[size_class];
+    cache.heads[size_class] = free_block;
+
+    if (u32 batch = batch_size(size_class); ++cache.counts[size_class] > batch * 2)
+    {
+        flush(cache, size_class, batch);
+    }
+#else
+    std::free(block);
+#endif
+}
+
+[[nodiscard]] usize alloc_size([[maybe_unused]] void *block) noexcept
+{
+#if TR_OS_LINUX
+    auto &&state = g_alloc;
+
+    usize size_class = block != nullptr ? class_of(block) : CLASS_COUNT;
+    if (size_class == CLASS_COUNT)
+    {
+        // `GetSize(nullptr)` means something of its own to some allocators, it's passed on too.
+        state.foreign.fetch_add(1, std::memory_order_relaxed);
+        return state.get_size(state.mem_alloc, block);
+    }
+
+    return CLASS_SIZES[size_class];
+#else
+    return 0;
+#endif
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "type.hpp"
+#include <tl/expected.hpp>
+
+// Replaces tier0's allocator (`g_pMemAlloc`, the `IMemAlloc` nearly every engine and game allocation goes through) with a size-class
+// allocator. Blocks up to `ALLOC_MAX_SMALL` bytes are carved from `ALLOC_CHUNK_SIZE` chunks that each hold one size class, and every
+// thread keeps a small cache of free blocks per class that it fills from, and gives back to, a central pool per class in batches. The
+// common path is a thread-local list push or pop, no lock and no atomic.
+// Larger blocks go to the allocator that was replaced. So do frees, reallocs and size queries of blocks it allocated before the swap,
+// a block is only ours if its chunk is (a radix map of chunk addresses tells them apart).
+// NOTE: The engine holds on to our blocks, so once installed the allocator can't be removed and the plugin stays loaded.
+
+constexpr usize ALLOC_MAX_SMALL  = 16384;
+constexpr usize ALLOC_CHUNK_SIZE = 256 * 1024;
+
+struct AllocError
+{
+    enum Type : u8
+    {
+        UNSUPPORTED,
+        NO_TIER0,
+        NO_MEMALLOC,   // tier0 doesn't export `g_pMemAlloc`, or it isn't set.
+        FAILED_TO_PIN, // The plugin couldn't be kept loaded.
+        FAILED_TO_HOOK,
+    } type;
+};
+
+struct AllocStats
+{
+    u64 chunks{};   // Mapped so far, they're never unmapped.
+    u64 refills{};  // Batches a thread cache took from a central pool.
+    u64 flushes{};  // Batches it gave back.
+    u64 large{};    // Allocations handed to the replaced allocator.
+    u64 foreign{};  // Frees, reallocs and size queries of its blocks (allocated before the swap, or large).
+    u64 threads{};  // That ever had a cache.
+};
+
+// Idempotent, must be called from the main thread.
+tl::expected<void, AllocError> alloc_install() noexcept;
+
+[[nodiscard]] bool alloc_is_installed() noexcept;
+
+[[nodiscard]] AllocStats alloc_stats() noexcept;
+
+// The allocator behind the hooks, `IMemAlloc` semantics (a realloc to 0 bytes frees). It can be used without being installed (the
+// benchmark does), blocks it doesn't own and large ones then go to the C runtime.
+[[nodiscard]] void *alloc_allocate(usize size) noexcept;
+[[nodiscard]] void *alloc_reallocate(void *block, usize size) noexcept;
+void                alloc_free(void *block) noexcept;
+[[nodiscard]] usize alloc_size(void *block) noexcept;
@@ -0,0 +1,419 @@
+#include "clock.hpp"
+#include "common.hpp"
+#include "os.hpp"
+#include "iface.hpp"
+#include "log.hpp"
+#include <safetyhook/safetyhook.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <thread>
+
+namespace
+{
+    using Plat_FloatTimeFn = f64(TR_CCALL *)();
+
+    // Largest clock step per tick, and the phase error that's tolerated before moving (both fractions of the interval).
+    constexpr f64 MAX_STEP_FRACTION = 0.05;
+    constexpr f64 DEADBAND_FRACTION = 0.02;
+
+    // Ticks to average before acting, and to wait after a shift before measuring again.
+    constexpr u32 MIN_SAMPLES  = 16;
+    constexpr u32 SETTLE_TICKS = 8;
+
+    // Dilation gives back this much of an interval per tick (the server runs 25% faster until it caught up), and never owes more than
+    // `MAX_DEBT` seconds. Stalls longer than that are dropped either way, clients would rather skip than watch a fast forward.
+    constexpr f64 DILATE_RATE = 0.25;
+    constexpr f64 MAX_DEBT    = 2.0;
+
+    // After `clock_shutdown`, the offset is given back at this fraction of the time that passes (the engine clock runs 10% slow or fast).
+    constexpr f64 DRAIN_RATE = 0.1;
+
+    constexpr u64 REPORT_INTERVAL_NS = 10000000000;
+
+    SafetyHookInline g_Plat_FloatTime_hook{};
+    Plat_FloatTimeFn g_Plat_FloatTime{};
+    std::atomic<f64> g_offset{};
+    std::atomic<u64> g_calls{};
+
+    std::thread::id          g_main_thread{};
+    std::atomic<ClockReadFn> g_read_callback{};
+
+    // Set when the hook outlives `clock_shutdown` to give back the offset, `g_drain_last` is only touched by the main thread.
+    std::atomic<bool> g_draining{};
+    f64               g_drain_last{};
+
+    struct PhaseController
+    {
+        u64 interval_ns{};
+        u64 target_ns{};
+        u64 last_tick_ns{};
+        f64 error_ns{}; // Smoothed `target - phase`.
+        u32 samples{};
+        u32 settle_ticks{};
+        f64 pending{}; // Seconds still to be added to the offset.
+    } g_phase{};
+
+    // Only touched by the main thread.
+    CatchUpLimiter g_catch_up{};
+
+    struct CatchUpReport
+    {
+        u64 reported{};
+        u64 next_report_ns{};
+    } g_catch_up_report{};
+
+    // Moves the offset towards zero by a fraction of the time since the last read, the engine sees slightly longer or shorter frames.
+    void drain(f64 now) noexcept
+    {
+        f64 elapsed  = g_drain_last != 0.0 ? std::max(now - g_drain_last, 0.0) : 0.0;
+        g_drain_last = now;
+
+        f64 offset = g_offset.load(std::memory_order_relaxed);
+        f64 step   = std::min(std::fabs(offset), elapsed * DRAIN_RATE);
+        g_offset.store(offset > 0.0 ? offset - step : offset + step, std::memory_order_relaxed);
+    }
+
+    f64 TR_CCALL hooked_Plat_FloatTime() noexcept
+    {
+        g_calls.fetch_add(1, std::memory_order_relaxed);
+
+        f64 now = g_Plat_FloatTime();
+
+        // The engine reads its frame time on the main thread, which is the only one that can stall the tick loop.
+        if (std::this_thread::get_id() == g_main_thread)
+        {
+            if (g_draining.load(std::memory_order_relaxed))
+            {
+                drain(now);
+            }
+
+            if (g_catch_up.enabled())
+            {
+                if (f64 excess = g_catch_up.on_read(now); excess > 0.0)
+                {
+                    g_offset.store(g_offset.load(std::memory_order_relaxed) - excess, std::memory_order_relaxed);
+                }
+            }
+
+            if (auto callback = g_read_callback.load(std::memory_order_relaxed); callback != nullptr)
+            {
+                callback();
+            }
+        }
+
+        return now + g_offset.load(std::memory_order_relaxed);
+    }
+
+    // Wraps a phase difference to [-interval / 2, interval / 2).
+    [[nodiscard]] f64 wrap_phase(f64 value, f64 interval) noexcept
+    {
+        value = std::fmod(value + interval / 2.0, interval);
+        if (value < 0.0)
+        {
+            value += interval;
+        }
+
+        return value - interval / 2.0;
+    }
+} // namespace
+
+tl::expected<void, ClockError> clock_init() noexcept
+{
+    // Loaded again while the hook of the previous load is still giving back its offset, take it over as it is.
+    if (g_draining.load(std::memory_order_relaxed))
+    {
+        g_catch_up        = {};
+        g_catch_up_report = {};
+        g_main_thread     = std::this_thread::get_id();
+        g_draining.store(false, std::memory_order_relaxed);
+        return {};
+    }
+
+    if (clock_is_hooked())
+    {
+        return {};
+    }
+
+    u8 *tier0 = iface_get_default_module("tier0");
+    if (tier0 == nullptr)
+    {
+        return tl::unexpected{ClockError{ClockError::NO_TIER0}};
+    }
+
+    u8 *Plat_FloatTime = os_get_procedure(tier0, "Plat_FloatTime");
+    if (Plat_FloatTime == nullptr)
+    {
+        return tl::unexpected{ClockError{ClockError::NO_PLAT_FLOATTIME}};
+    }
+
+    // Other threads can still be inside the hook when `clock_shutdown` removes it, and it may never be removed, its code must outlive them.
+    if (!os_pin_module((u8 *)&clock_init))
+    {
+        return tl::unexpected{ClockError{ClockError::FAILED_TO_PIN}};
+    }
+
+    auto hook = SafetyHookInline::create(Plat_FloatTime, hooked_Plat_FloatTime, SafetyHookInline::StartDisabled);
+    if (!hook)
+    {
+        return tl::unexpected{ClockError{ClockError::FAILED_TO_HOOK}};
+    }
+
+    // The hook can be called from any thread as soon as it's enabled, so the trampoline must be known first.
+    g_Plat_FloatTime = hook->original<Plat_FloatTimeFn>();
+    g_offset.store(0.0, std::memory_order_relaxed);
+
+    // Called from `Load`.
+    g_catch_up        = {};
+    g_catch_up_report = {};
+    g_main_thread     = std::this_thread::get_id();
+
+    if (!hook->enable())
+    {
+        return tl::unexpected{ClockError{ClockError::FAILED_TO_HOOK}};
+    }
+
+    g_Plat_FloatTime_hook = std::move(*hook);
+
+    return {};
+}
+
+void clock_shutdown() noexcept
+{
+    if (!clock_is_hooked() || g_draining.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+
+    g_phase           = {};
+    g_catch_up        = {};
+    g_catch_up_report = {};
+    g_read_callback.store(nullptr, std::memory_order_relaxed);
+
+    // Removing the hook now would step the engine clock by the offset: back and the engine waits it out before the next tick, forward
+    // and it runs a burst of catch-up ticks. The hook stays until the process exits instead and gives the offset back frame by frame.
+    if (g_offset.load(std::memory_order_relaxed) != 0.0)
+    {
+        g_drain_last = 0.0;
+        g_draining.store(true, std::memory_order_relaxed);
+        return;
+    }
+
+    g_Plat_FloatTime_hook = {};
+    g_Plat_FloatTime      = nullptr;
+    g_main_thread         = {};
+    g_offset.store(0.0, std::memory_order_relaxed);
+}
+
+[[nodiscard]] bool clock_is_hooked() noexcept
+{
+    return g_Plat_FloatTime != nullptr;
+}
+
+[[nodiscard]] f64 clock_offset() noexcept
+{
+    return g_offset.load(std::memory_order_relaxed);
+}
+
+[[nodiscard]] u64 clock_hook_calls() noexcept
+{
+    return g_calls.load(std::memory_order_relaxed);
+}
+
+void clock_set_read_callback(ClockReadFn fn) noexcept
+{
+    g_read_callback.store(fn, std::memory_order_relaxed);
+}
+
+void clock_set_phase_target(u64 interval_ns, u64 target_ns) noexcept
+{
+    if (interval_ns == 0)
+    {
+        clock_clear_phase_target();
+        return;
+    }
+
+    // Keep a shift that's in progress, only restart the measurement.
+    g_phase.interval_ns = interval_ns;
+    g_phase.target_ns   = target_ns % interval_ns;
+    g_phase.samples     = 0;
+}
+
+void clock_clear_phase_target() noexcept
+{
+    g_phase.interval_ns = 0;
+    g_phase.samples     = 0;
+}
+
+void clock_set_catch_up_limit(u64 interval_ns, u32 max_ticks, ClockCatchUpMode mode) noexcept
+{
+    g_catch_up.configure(interval_ns, max_ticks, mode);
+}
+
+[[nodiscard]] ClockCatchUpStats clock_catch_up_stats() noexcept
+{
+    return g_catch_up.stats();
+}
+
+void clock_on_idle() noexcept
+{
+    g_catch_up.on_idle();
+}
+
+void clock_on_tick(u64 now_ns) noexcept
+{
+    if (!clock_is_hooked())
+    {
+        return;
+    }
+
+    if (f64 step = g_catch_up.on_tick(); step > 0.0)
+    {
+        g_offset.store(g_offset.load(std::memory_order_relaxed) + step, std::memory_order_relaxed);
+    }
+
+    auto &&report = g_catch_up_report;
+    if (auto stats = g_catch_up.stats(); stats.limited != report.reported && now_ns >= report.next_report_ns)
+    {
+        info(
+            "Catch-up limited after {} stall(s) (last {:.1f} ms): {:.0f} ticks dropped, {:.0f} owed so far.\n",
+            stats.limited - report.reported,
+            stats.last_stall * 1000.0,
+            stats.dropped_ticks,
+            stats.debt_ticks);
+
+        report.reported       = stats.limited;
+        report.next_report_ns = now_ns + REPORT_INTERVAL_NS;
+    }
+
+    auto &&phase = g_phase;
+    if (phase.interval_ns == 0)
+    {
+        return;
+    }
+
+    const auto interval = (f64)phase.interval_ns;
+
+    // Catch-up ticks run back to back inside one frame, only the first tick of a frame says anything about the phase.
+    bool catch_up      = now_ns - phase.last_tick_ns < phase.interval_ns / 2;
+    phase.last_tick_ns = now_ns;
+
+    if (phase.pending > 0.0)
+    {
+        f64 step = std::min(phase.pending, interval * MAX_STEP_FRACTION / 1e9);
+        g_offset.store(g_offset.load(std::memory_order_relaxed) + step, std::memory_order_relaxed);
+
+        phase.pending -= step;
+        if (phase.pending <= 0.0)
+        {
+            phase.pending      = 0.0;
+            phase.settle_ticks = SETTLE_TICKS;
+        }
+
+        return;
+    }
+
+    if (catch_up)
+    {
+        return;
+    }
+
+    if (phase.settle_ticks != 0)
+    {
+        --phase.settle_ticks;
+        return;
+    }
+
+    // Unwrap around the running estimate so errors close to half an interval don't average out to zero.
+    f64 error = wrap_phase((f64)phase.target_ns - (f64)(now_ns % phase.interval_ns), interval);
+    if (phase.samples == 0)
+    {
+        phase.error_ns = error;
+    }
+    else
+    {
+        error = phase.error_ns + wrap_phase(error - phase.error_ns, interval);
+        phase.error_ns += (error - phase.error_ns) / 8.0;
+    }
+
+    f64 error_ns = wrap_phase(phase.error_ns, interval);
+    if (++phase.samples < MIN_SAMPLES || std::fabs(error_ns) <= interval * DEADBAND_FRACTION)
+    {
+        return;
+    }
+
+    // A positive error means ticks should happen later, which is the same as happening earlier by the rest of the interval.
+    f64 shift_ns  = error_ns > 0.0 ? interval - error_ns : -error_ns;
+    phase.pending = shift_ns / 1e9;
+    phase.samples = 0;
+}
+
+void CatchUpLimiter::configure(u64 interval_ns, u32 max_ticks, ClockCatchUpMode mode) noexcept
+{
+    m_interval = (f64)interval_ns / 1e9;
+    m_limit    = m_interval * (f64)max_ticks;
+    m_mode     = mode;
+}
+
+[[nodiscard]] f64 CatchUpLimiter::on_read(f64 now) noexcept
+{
+    f64  gap     = now - m_last_read;
+    bool stalled = m_armed && m_last_read != 0.0 && m_limit > 0.0 && gap > m_limit;
+
+    m_last_read = now;
+
+    if (!stalled)
+    {
+        return 0.0;
+    }
+
+    // Hold the clock back so the engine only sees `limit` pass, the rest is dropped or owed.
+    f64 excess = gap - m_limit;
+
+    ++m_limited;
+    m_last_stall = gap;
+
+    f64 dropped = excess;
+    if (m_mode == CLOCK_CATCHUP_DILATE)
+    {
+        f64 owed = std::min(excess, std::max(MAX_DEBT - m_debt, 0.0));
+
+        m_debt  += owed;
+        dropped -= owed;
+    }
+
+    m_dropped += dropped;
+
+    return excess;
+}
+
+[[nodiscard]] f64 CatchUpLimiter::on_tick() noexcept
+{
+    m_armed = true;
+
+    if (m_debt <= 0.0)
+    {
+        return 0.0;
+    }
+
+    f64 step  = std::min(m_debt, m_interval * DILATE_RATE);
+    m_debt   -= step;
+
+    return step;
+}
+
+[[nodiscard]] ClockCatchUpStats CatchUpLimiter::stats() const noexcept
+{
+    if (m_interval == 0.0)
+    {
+        return {};
+    }
+
+    ClockCatchUpStats stats{};
+    stats.limited       = m_limited;
+    stats.dropped_ticks = m_dropped / m_interval;
+    stats.debt_ticks    = m_debt / m_interval;
+    stats.last_stall    = m_last_stall;
+
+    return stats;
+}
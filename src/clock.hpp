@@ -0,0 +1,114 @@
+#pragma once
+
+#include "type.hpp"
+#include <tl/expected.hpp>
+
+// Hook on tier0's `Plat_FloatTime`, the clock the engine paces frames and accumulates ticks with.
+// Adding an offset to it shifts when ticks happen (the tick phase) without changing the tickrate. Phase shifts only ever grow the
+// offset, a phase is periodic so a later phase is reached by moving earlier by the rest of the interval. They're applied in steps
+// of a fraction of a tick so the engine just sees a few slightly longer frames.
+// The same hook limits catch-up: the engine runs as many ticks in a frame as its clock says it's behind, so after a stall it runs a
+// burst of them and the next frame overruns too. Lowering the offset holds the clock back instead (see `clock_set_catch_up_limit`).
+
+struct ClockError
+{
+    enum Type : u8
+    {
+        NO_TIER0,
+        NO_PLAT_FLOATTIME,
+        FAILED_TO_PIN, // The plugin couldn't be kept loaded.
+        FAILED_TO_HOOK,
+    } type;
+};
+
+tl::expected<void, ClockError> clock_init() noexcept;
+
+// Removes the hook if the offset is zero. Otherwise the hook stays installed until the process exits and gives the offset back a bit
+// every frame, so the engine clock never steps. `clock_init` takes it over if the plugin is loaded again. Either way the module
+// stays loaded, `clock_init` pins it.
+void clock_shutdown() noexcept;
+
+// Also true while the offset is given back after `clock_shutdown`.
+[[nodiscard]] bool clock_is_hooked() noexcept;
+
+// Total seconds added to `Plat_FloatTime` so far.
+[[nodiscard]] f64 clock_offset() noexcept;
+
+// Calls to `Plat_FloatTime` (from any thread) since the hook was installed.
+[[nodiscard]] u64 clock_hook_calls() noexcept;
+
+// Called on every read of the clock from the main thread (the one `clock_init` was called from), before the value is returned.
+// The engine reads it first thing every frame, which makes it the earliest point after the previous frame's work is done.
+using ClockReadFn = void (*)() noexcept;
+
+void clock_set_read_callback(ClockReadFn fn) noexcept;
+
+// Sets the phase (nanoseconds into each interval on the monotonic clock) ticks should happen at.
+void clock_set_phase_target(u64 interval_ns, u64 target_ns) noexcept;
+void clock_clear_phase_target() noexcept;
+
+enum ClockCatchUpMode : u8
+{
+    CLOCK_CATCHUP_DROP,   // The stalled time is never simulated, the game clock falls behind for good.
+    CLOCK_CATCHUP_DILATE, // It's given back a fraction of a tick at a time, so the game clock catches up over a few seconds.
+};
+
+// Lets the engine clock advance by at most `max_ticks` intervals between two reads on the main thread (0 disables it).
+// Every longer gap counts, so with 1 the ordinary jitter of frames that end just past an interval is dropped too.
+// NOTE: Other threads that read the clock during a stall see it step back once.
+void clock_set_catch_up_limit(u64 interval_ns, u32 max_ticks, ClockCatchUpMode mode) noexcept;
+
+struct ClockCatchUpStats
+{
+    u64 limited{};       // Stalls the limit was applied to.
+    f64 dropped_ticks{}; // Ticks that will never be simulated.
+    f64 debt_ticks{};    // Ticks still to be given back when dilating.
+    f64 last_stall{};    // Seconds.
+};
+
+[[nodiscard]] ClockCatchUpStats clock_catch_up_stats() noexcept;
+
+// The catch-up limit on its own, in seconds of the engine clock. The hook runs one on `Plat_FloatTime`, `tickrate_replay` runs them on
+// recorded traces.
+class CatchUpLimiter final
+{
+public:
+    // Keeps what's owed, it's given back even if the limit is turned off (`max_ticks` 0).
+    void configure(u64 interval_ns, u32 max_ticks, ClockCatchUpMode mode) noexcept;
+
+    // A read of the clock on the main thread, returns the seconds to take off it.
+    [[nodiscard]] f64 on_read(f64 now) noexcept;
+
+    // A simulated tick, returns the seconds to give back.
+    [[nodiscard]] f64 on_tick() noexcept;
+
+    // Not simulating, a hibernating server sleeps a lot longer than a few ticks.
+    void on_idle() noexcept
+    {
+        m_armed = false;
+    }
+
+    [[nodiscard]] bool enabled() const noexcept
+    {
+        return m_limit > 0.0;
+    }
+
+    [[nodiscard]] ClockCatchUpStats stats() const noexcept;
+
+private:
+    f64              m_interval{};
+    f64              m_limit{}; // Seconds, 0 when disabled.
+    ClockCatchUpMode m_mode{};
+    bool             m_armed{};
+    f64              m_last_read{};
+    f64              m_last_stall{};
+    u64              m_limited{};
+    f64              m_dropped{};
+    f64              m_debt{};
+};
+
+// Called from `GameFrame` on every simulated tick. Measures the current phase and slews the clock towards the target.
+void clock_on_tick(u64 now_ns) noexcept;
+
+// Called from `GameFrame` when the server isn't simulating, the catch-up limit only applies while it is.
+void clock_on_idle() noexcept;
@@ -0,0 +1,39 @@
+#include "config.hpp"
+#include <utility>
+
+namespace
+{
+    std::vector<std::string> g_cmdline{};
+} // namespace
+
+void config_init(std::vector<std::string> cmdline) noexcept
+{
+    g_cmdline = std::move(cmdline);
+}
+
+[[nodiscard]] bool config_has(std::string_view param) noexcept
+{
+    for (auto &&arg : g_cmdline)
+    {
+        if (arg == param)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+[[nodiscard]] std::optional<std::string_view> config_value(std::string_view param) noexcept
+{
+    for (usize i{}; i < g_cmdline.size(); ++i)
+    {
+        // Next entry should be the value.
+        if (g_cmdline[i] == param && i + 1 < g_cmdline.size())
+        {
+            return g_cmdline[i + 1];
+        }
+    }
+
+    return std::nullopt;
+}
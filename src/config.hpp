@@ -0,0 +1,38 @@
+#pragma once
+
+#include "type.hpp"
+#include <charconv>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Command line options. Everything is configured through the server's command line (i.e. `-tickrate 128 -tickrate_norates`).
+
+// Stores the command line, called once from `Load`.
+void config_init(std::vector<std::string> cmdline) noexcept;
+
+// Checks if a parameter is present.
+[[nodiscard]] bool config_has(std::string_view param) noexcept;
+
+// Returns the value following a parameter.
+[[nodiscard]] std::optional<std::string_view> config_value(std::string_view param) noexcept;
+
+// Returns the numeric value following a parameter, or `default_value` if it's missing or malformed.
+template <class T>
+[[nodiscard]] T config_get(std::string_view param, T default_value) noexcept
+{
+    auto value = config_value(param);
+    if (!value)
+    {
+        return default_value;
+    }
+
+    T result{};
+    if (auto [ptr, ec] = std::from_chars(value->data(), value->data() + value->size(), result); ec != std::errc{})
+    {
+        return default_value;
+    }
+
+    return result;
+}
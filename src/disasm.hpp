@@ -0,0 +1,58 @@
+#pragma once
+
+#include "type.hpp"
+#include <tl/expected.hpp>
+#include <Zycore/Status.h>
+#include <Zydis/Zydis.h>
+#include <string_view>
+
+[[nodiscard]] std::string_view zyan_status_str(ZyanStatus status) noexcept;
+
+struct Disasm
+{
+    struct Error
+    {
+        u8        *ip{};
+        ZyanStatus status{ZYAN_STATUS_FAILED};
+
+        [[nodiscard]] auto status_str() const noexcept
+        {
+            return zyan_status_str(status);
+        }
+    };
+
+    u8                     *ip{};
+    ZydisDecodedInstruction ix;
+    ZydisDecodedOperand     operands[ZYDIS_MAX_OPERAND_COUNT];
+};
+
+[[nodiscard]] tl::expected<Disasm, Disasm::Error> disasm(u8 *ip, usize len = ZYDIS_MAX_INSTRUCTION_LENGTH) noexcept;
+
+template <class Pred>
+tl::expected<Disasm, Disasm::Error> disasm_for_each(u8 *ip, usize len, Pred &&pred) noexcept
+{
+    u8 *end = ip + len;
+
+    for (u8 *i = ip; i < end;)
+    {
+        auto result = disasm(i, end - i);
+        if (!result)
+        {
+            return tl::unexpected{result.error()};
+        }
+
+        auto &&value = *result;
+        if (pred(value))
+        {
+            return value;
+        }
+
+        i += value.ix.length;
+    }
+
+    // This means we've scanned everything successfully but the predicate didn't return.
+    return tl::unexpected{Disasm::Error{ip}};
+}
+
+// Resolves the address of a memory operand. `pic_reg`/`pic_value` is a register holding a known address (x86-32 PIC base).
+[[nodiscard]] u8 *disasm_mem_address(const Disasm &result, const ZydisDecodedOperand &op, ZydisRegister pic_reg, u8 *pic_value) noexcept;
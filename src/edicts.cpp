@@ -0,0 +1,269 @@
+#include "edicts.hpp"
+#include "common.hpp"
+#include "log.hpp"
+#include <fmt/format.h>
+#include <algorithm>
+#include <array>
+#include <string>
+
+namespace
+{
+    // An edict that's free, or was allocated before tracking started.
+    constexpr u32 NOT_LIVE = ~0u;
+
+    struct State
+    {
+        bool                                     running{};
+        std::string                              map{};
+        std::array<u32, MAX_EDICTS>              allocated_tick{}; // `NOT_LIVE` or the tick the edict was allocated on.
+        u32                                      ticks{};
+        u32                                      live{};
+        u32                                      peak_live{};
+        u64                                      spawned{}; // Before the first tick (the map's entities).
+        u64                                      removed{}; // Freed before the first tick, the map load's own churn.
+        u64                                      allocs{};
+        u64                                      frees{};
+        u32                                      tick_allocs{}; // Since the last tick.
+        u32                                      tick_frees{};
+        u32                                      max_tick_allocs{};
+        u32                                      max_tick_frees{};
+        u64                                      bad_edicts{}; // Out of range indices, the layout isn't the 2013 SDK's.
+        std::array<u64, EDICTS_LIFETIME_BUCKETS> lifetimes{};
+    } g_edicts{};
+
+    void reset(State &state) noexcept
+    {
+        state.allocated_tick.fill(NOT_LIVE);
+        state.ticks           = 0;
+        state.live            = 0;
+        state.peak_live       = 0;
+        state.spawned         = 0;
+        state.removed         = 0;
+        state.allocs          = 0;
+        state.frees           = 0;
+        state.tick_allocs     = 0;
+        state.tick_frees      = 0;
+        state.max_tick_allocs = 0;
+        state.max_tick_frees  = 0;
+        state.bad_edicts      = 0;
+        state.lifetimes       = {};
+    }
+
+    // -1 when it isn't one of the engine's edicts.
+    [[nodiscard]] i32 edict_index(State &state, const edict_t *edict) noexcept
+    {
+        i32 index = edict != nullptr ? edict->m_EdictIndex : -1;
+        if (index < 0 || index >= MAX_EDICTS)
+        {
+            ++state.bad_edicts;
+            return -1;
+        }
+
+        return index;
+    }
+
+    // 0, 1, 2-3, 4-7, ...
+    [[nodiscard]] usize lifetime_bucket(u32 ticks) noexcept
+    {
+        usize bucket{};
+        while (ticks != 0 && bucket + 1 < EDICTS_LIFETIME_BUCKETS)
+        {
+            ticks >>= 1;
+            ++bucket;
+        }
+
+        return bucket;
+    }
+
+    [[nodiscard]] std::string lifetime_label(usize bucket) noexcept
+    {
+        u32 low  = bucket == 0 ? 0 : 1u << (bucket - 1);
+        u32 high = bucket == 0 ? 0 : (1u << bucket) - 1;
+
+        if (bucket + 1 == EDICTS_LIFETIME_BUCKETS)
+        {
+            return fmt::format("{}+", low);
+        }
+
+        return low == high ? fmt::format("{}", low) : fmt::format("{}-{}", low, high);
+    }
+} // namespace
+
+void edicts_start() noexcept
+{
+    auto &&state = g_edicts;
+
+    reset(state);
+    state.running = true;
+    state.map.clear();
+}
+
+void edicts_stop() noexcept
+{
+    g_edicts.running = false;
+}
+
+[[nodiscard]] bool edicts_is_running() noexcept
+{
+    return g_edicts.running;
+}
+
+void edicts_begin_map(std::string_view map_name) noexcept
+{
+    auto &&state = g_edicts;
+    if (!state.running)
+    {
+        return;
+    }
+
+    // The previous map's edicts were freed after `LevelShutdown`, and the new map's entities are allocated after this.
+    reset(state);
+    state.map = map_name;
+}
+
+void edicts_end_map() noexcept
+{
+    auto &&state = g_edicts;
+
+    // `LevelShutdown` can be called more than once per map.
+    if (!state.running || state.ticks == 0)
+    {
+        return;
+    }
+
+    // Loaded in the middle of a map.
+    std::string_view map = state.map.empty() ? std::string_view{"this map"} : std::string_view{state.map};
+
+    const auto ticks = (f64)state.ticks;
+
+    info(
+        "Edicts for {} over {} ticks: {} spawned ({} removed during the load), peak {}/{} ({:.1f}%), {} live at the end, {:.2f} "
+        "allocated (max {}) and {:.2f} freed (max {}) per tick.\n",
+        map,
+        state.ticks,
+        state.spawned,
+        state.removed,
+        state.peak_live,
+        MAX_EDICTS,
+        (f64)state.peak_live * 100.0 / (f64)MAX_EDICTS,
+        state.live,
+        (f64)state.allocs / ticks,
+        state.max_tick_allocs,
+        (f64)state.frees / ticks,
+        state.max_tick_frees);
+
+    u64 freed{};
+    for (auto &&count : state.lifetimes)
+    {
+        freed += count;
+    }
+
+    if (freed != 0)
+    {
+        info("  Lifetimes of {} freed edicts:\n", freed);
+
+        for (usize bucket{}; bucket < EDICTS_LIFETIME_BUCKETS; ++bucket)
+        {
+            if (auto count = state.lifetimes[bucket]; count != 0)
+            {
+                info("  {:>11} ticks {:>9} ({:.1f}%)\n", lifetime_label(bucket), count, (f64)count * 100.0 / (f64)freed);
+            }
+        }
+    }
+
+    if (state.bad_edicts != 0)
+    {
+        warn("  {} edicts had an index out of range and weren't counted.\n", state.bad_edicts);
+    }
+
+    // The map's entities are freed next, none of it counts until the next `LevelInit`.
+    reset(state);
+}
+
+void edicts_on_allocated(const edict_t *edict) noexcept
+{
+    auto &&state = g_edicts;
+    if (!state.running)
+    {
+        return;
+    }
+
+    i32 index = edict_index(state, edict);
+    if (index < 0)
+    {
+        return;
+    }
+
+    // Still live means its free was missed, don't count it twice.
+    if (state.allocated_tick[index] == NOT_LIVE)
+    {
+        ++state.live;
+        state.peak_live = std::max(state.peak_live, state.live);
+    }
+
+    state.allocated_tick[index] = state.ticks;
+
+    // The map load isn't a tick.
+    if (state.ticks == 0)
+    {
+        ++state.spawned;
+        return;
+    }
+
+    ++state.allocs;
+    ++state.tick_allocs;
+}
+
+void edicts_on_freed(const edict_t *edict) noexcept
+{
+    auto &&state = g_edicts;
+    if (!state.running)
+    {
+        return;
+    }
+
+    i32 index = edict_index(state, edict);
+    if (index < 0)
+    {
+        return;
+    }
+
+    auto &&allocated_tick = state.allocated_tick[index];
+    bool   was_live       = allocated_tick != NOT_LIVE;
+    if (was_live)
+    {
+        --state.live;
+    }
+
+    // Like allocations, the map load isn't a tick and its edicts don't have a lifetime in ticks yet.
+    if (state.ticks == 0)
+    {
+        ++state.removed;
+        allocated_tick = NOT_LIVE;
+        return;
+    }
+
+    ++state.frees;
+    ++state.tick_frees;
+
+    if (was_live)
+    {
+        ++state.lifetimes[lifetime_bucket(state.ticks - allocated_tick)];
+        allocated_tick = NOT_LIVE;
+    }
+}
+
+void edicts_on_tick() noexcept
+{
+    auto &&state = g_edicts;
+    if (!state.running)
+    {
+        return;
+    }
+
+    state.max_tick_allocs = std::max(state.max_tick_allocs, state.tick_allocs);
+    state.max_tick_frees  = std::max(state.max_tick_frees, state.tick_frees);
+    state.tick_allocs     = 0;
+    state.tick_frees      = 0;
+    ++state.ticks;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "type.hpp"
+#include "engine.hpp"
+#include <string_view>
+
+// Edict churn per map: live edicts, allocations and frees per tick, the peak against `MAX_EDICTS` and how many ticks edicts live
+// (projectiles, ragdolls and temporary effects come and go every few ticks, each one costs a spawn, a network state and a delete).
+// The map's entities (allocated or freed before the first tick) are counted apart from the per-tick rates.
+// Every slot keeps the tick it was allocated on, edicts allocated before tracking started (a plugin loaded in the middle of a map)
+// are left out of the lifetimes and the live count.
+// Reset at `LevelInit` and logged at `LevelShutdown`, the entities of the map are freed after that and aren't counted.
+
+constexpr usize EDICTS_LIFETIME_BUCKETS = 16; // Powers of two ticks, the last one is everything longer.
+
+// Must be called from the main thread.
+void edicts_start() noexcept;
+void edicts_stop() noexcept;
+
+[[nodiscard]] bool edicts_is_running() noexcept;
+
+// Called from `LevelInit`/`LevelShutdown`.
+void edicts_begin_map(std::string_view map_name) noexcept;
+void edicts_end_map() noexcept;
+
+// Called from `OnEdictAllocated`/`OnEdictFreed`.
+void edicts_on_allocated(const edict_t *edict) noexcept;
+void edicts_on_freed(const edict_t *edict) noexcept;
+
+// Called from `GameFrame` on every simulated tick, allocations and frees since the last call go to the tick that just ended.
+void edicts_on_tick() noexcept;
@@ -0,0 +1,243 @@
+#pragma once
+
+#include "common.hpp"
+#include "type.hpp"
+
+// Source Engine SDK declarations (only what we use).
+using CreateInterfaceFn      = void *(TR_CCALL *)(cstr name, i32 *return_code);
+using InstantiateInterfaceFn = void *(TR_CCALL *)();
+
+class KeyValues;
+class CCommand;
+
+using QueryCvarCookie_t   = i32;
+using CVarDLLIdentifier_t = i32;
+
+constexpr f32 MINIMUM_TICK_INTERVAL = 0.001f;
+constexpr f32 MAXIMUM_TICK_INTERVAL = 0.1f;
+
+constexpr i32 MAX_EDICTS = 1 << 11;
+
+enum : i32
+{
+    IFACE_OK = 0,
+    IFACE_FAILED,
+};
+
+enum PLUGIN_RESULT : i32
+{
+    PLUGIN_CONTINUE = 0,
+    PLUGIN_OVERRIDE,
+    PLUGIN_STOP,
+};
+
+enum InitReturnVal_t : i32
+{
+    INIT_FAILED = 0,
+    INIT_OK,
+};
+
+enum SpewType_t : i32
+{
+    SPEW_MESSAGE = 0,
+    SPEW_WARNING,
+    SPEW_ASSERT,
+    SPEW_ERROR,
+    SPEW_LOG,
+};
+
+enum SpewRetval_t : i32
+{
+    SPEW_DEBUGGER = 0,
+    SPEW_CONTINUE,
+    SPEW_ABORT,
+};
+
+// tier0's console output function, behind `Msg`, `Warning`, `DevMsg` and friends.
+using SpewOutputFunc_t = SpewRetval_t(TR_CCALL *)(SpewType_t type, cstr message);
+
+enum EQueryCvarValueStatus : i32
+{
+    eQueryCvarValueStatus_ValueIntact = 0,
+    eQueryCvarValueStatus_CvarNotFound,
+    eQueryCvarValueStatus_NotACvar,
+    eQueryCvarValueStatus_CvarProtected,
+};
+
+// `CBaseEdict`, only the members up to the index (the 2013 SDK's layout, older branches don't have it).
+struct edict_t
+{
+    i32 m_fStateFlags;
+    i16 m_NetworkSerialNumber;
+    i16 m_EdictIndex;
+};
+
+class InterfaceReg
+{
+public:
+    InstantiateInterfaceFn m_CreateFn;
+    cstr                   m_pName;
+    InterfaceReg          *m_pNext;
+};
+
+class CServerGameDLL
+{
+public:
+};
+
+// ISERVERPLUGINCALLBACKS003
+class IServerPluginCallbacks
+{
+public:
+    virtual bool          Load(CreateInterfaceFn interface_factory, CreateInterfaceFn gameserver_factory)                               = 0;
+    virtual void          Unload()                                                                                                      = 0;
+    virtual void          Pause()                                                                                                       = 0;
+    virtual void          UnPause()                                                                                                     = 0;
+    virtual cstr          GetPluginDescription()                                                                                        = 0;
+    virtual void          LevelInit(cstr map_name)                                                                                      = 0;
+    virtual void          ServerActivate(edict_t *edict_list, i32 edict_count, i32 client_max)                                          = 0;
+    virtual void          GameFrame(bool simulating)                                                                                    = 0;
+    virtual void          LevelShutdown()                                                                                               = 0;
+    virtual void          ClientActive(edict_t *edict)                                                                                  = 0;
+    virtual void          ClientDisconnect(edict_t *edict)                                                                              = 0;
+    virtual void          ClientPutInServer(edict_t *edict, cstr player_name)                                                           = 0;
+    virtual void          SetCommandClient(i32 index)                                                                                   = 0;
+    virtual void          ClientSettingsChanged(edict_t *edict)                                                                         = 0;
+    virtual PLUGIN_RESULT ClientConnect(bool *allow_connect, edict_t *edict, cstr name, cstr address, char *reject, i32 max_reject_len) = 0;
+    virtual PLUGIN_RESULT ClientCommand(edict_t *edict, const CCommand &args)                                                           = 0;
+    virtual PLUGIN_RESULT NetworkIDValidated(cstr username, cstr network_id)                                                            = 0;
+    virtual void
+    OnQueryCvarValueFinished(QueryCvarCookie_t cookie, edict_t *edict, EQueryCvarValueStatus status, cstr cvar_name, cstr cvar_value) = 0;
+    virtual void OnEdictAllocated(edict_t *edict)                                                                                     = 0;
+    virtual void OnEdictFreed(edict_t *edict)                                                                                         = 0;
+};
+
+template <class T>
+class CUtlVector
+{
+public:
+    T  *m_pMemory;
+    i32 m_nAllocationCount;
+    i32 m_nGrowSize;
+    i32 m_Size;
+    T  *m_pElements;
+};
+
+// One loaded plugin in the engine's list.
+class CPlugin
+{
+public:
+    char                    m_szName[128]; // `GetPluginDescription` when it was loaded.
+    bool                    m_bDisable;
+    IServerPluginCallbacks *m_pPlugin;
+    i32                     m_iPluginInterfaceVersion; // 3 for `ISERVERPLUGINCALLBACKS003`.
+    void                   *m_pPluginModule;
+};
+
+// ISERVERPLUGINHELPERS001, only the plugin list.
+class CServerPlugin
+{
+public:
+    void                 *m_vmt; // `IServerPluginHelpers`.
+    CUtlVector<CPlugin *> m_Plugins;
+};
+
+class IGameEventListener
+{
+public:
+    virtual ~IGameEventListener() noexcept       = default;
+    virtual void FireGameEvent(KeyValues *event) = 0;
+};
+
+class IAppSystem
+{
+public:
+    virtual bool            Connect(CreateInterfaceFn factory)  = 0;
+    virtual void            Disconnect()                        = 0;
+    virtual void           *QueryInterface(cstr interface_name) = 0;
+    virtual InitReturnVal_t Init()                              = 0;
+    virtual void            Shutdown()                          = 0;
+};
+
+// tier0's `g_pMemAlloc`, only the methods up to `GetSize`.
+// NOTE: Overloads must stay in the SDK's declaration order, MSVC lays them out differently than GCC/Clang.
+class IMemAlloc
+{
+public:
+    virtual void *Alloc(usize size)                                                           = 0;
+    virtual void *Realloc(void *block, usize size)                                            = 0;
+    virtual void  Free(void *block)                                                           = 0;
+    virtual void *Expand_NoLongerSupported(void *block, usize size)                           = 0;
+    virtual void *Alloc(usize size, cstr file_name, i32 line)                                 = 0;
+    virtual void *Realloc(void *block, usize size, cstr file_name, i32 line)                  = 0;
+    virtual void  Free(void *block, cstr file_name, i32 line)                                 = 0;
+    virtual void *Expand_NoLongerSupported(void *block, usize size, cstr file_name, i32 line) = 0;
+    virtual usize GetSize(void *block)                                                        = 0;
+};
+
+// `IMemAlloc` VMT slots with the GCC/Clang layout, for the Linux hooks.
+constexpr usize IMEMALLOC_ALLOC         = 0;
+constexpr usize IMEMALLOC_REALLOC       = 1;
+constexpr usize IMEMALLOC_FREE          = 2;
+constexpr usize IMEMALLOC_ALLOC_DEBUG   = 4;
+constexpr usize IMEMALLOC_REALLOC_DEBUG = 5;
+constexpr usize IMEMALLOC_FREE_DEBUG    = 6;
+constexpr usize IMEMALLOC_GET_SIZE      = 8;
+
+class ConCommandBase;
+class ConVar;
+
+// VEngineCvar004
+// NOTE: Overloads must stay in the SDK's declaration order, MSVC lays them out differently than GCC/Clang.
+class ICvar : public IAppSystem
+{
+public:
+    virtual CVarDLLIdentifier_t   AllocateDLLIdentifier()                       = 0;
+    virtual void                  RegisterConCommand(ConCommandBase *command)   = 0;
+    virtual void                  UnregisterConCommand(ConCommandBase *command) = 0;
+    virtual void                  UnregisterConCommands(CVarDLLIdentifier_t id) = 0;
+    virtual cstr                  GetCommandLineValue(cstr variable_name)       = 0;
+    virtual ConCommandBase       *FindCommandBase(cstr name)                    = 0;
+    virtual const ConCommandBase *FindCommandBase(cstr name) const              = 0;
+    virtual ConVar               *FindVar(cstr name)                            = 0;
+    virtual const ConVar         *FindVar(cstr name) const                      = 0;
+};
+
+class IConVar
+{
+public:
+    virtual void SetValue(cstr value)      = 0;
+    virtual void SetValue(f32 value)       = 0;
+    virtual void SetValue(i32 value)       = 0;
+    virtual cstr GetName() const           = 0;
+    virtual bool IsFlagSet(i32 flag) const = 0;
+};
+
+class ConCommandBase
+{
+public:
+    virtual ~ConCommandBase() noexcept = default;
+
+    ConCommandBase *m_pNext;
+    bool            m_bRegistered;
+    cstr            m_pszName;
+    cstr            m_pszHelpString;
+    i32             m_nFlags;
+};
+
+// Only the members up to the bounds are declared, the rest differ between branches.
+class ConVar : public ConCommandBase,
+               public IConVar
+{
+public:
+    ConVar *m_pParent;
+    cstr    m_pszDefaultValue;
+    char   *m_pszString;
+    i32     m_StringLength;
+    f32     m_fValue;
+    i32     m_nValue;
+    bool    m_bHasMin;
+    f32     m_fMinVal;
+    bool    m_bHasMax;
+    f32     m_fMaxVal;
+};
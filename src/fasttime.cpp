@@ -0,0 +1,497 @@
+#include "fasttime.hpp"
+#include "common.hpp"
+#include "os.hpp"
+#include "iface.hpp"
+#include <safetyhook/safetyhook.hpp>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <thread>
+#include <utility>
+#if TR_OS_LINUX
+#include <cpuid.h>
+#include <ctime>
+#endif
+
+namespace
+{
+#if TR_OS_LINUX
+    using Plat_FloatTimeFn = f64(TR_CCALL *)();
+    using Plat_MSTimeFn    = usize(TR_CCALL *)(); // `unsigned long`, pointer sized on Linux.
+    using ClockGettimeFn   = int (*)(clockid_t clock, timespec *ts);
+
+    // Reads of the TSC around one of the clock, the tightest pair is kept (an interrupt in between throws one off).
+    constexpr usize SAMPLE_TRIES = 16;
+
+    // A comparison with tier0's clock that took longer than this was interrupted, it's retried on the next read.
+    constexpr u64 MAX_COMPARE_NS = 20000;
+
+    // The offset from tier0 is taken out over about this long (on top of following its drift), within `FASTTIME_MAX_SLEW_PPM`.
+    constexpr f64 SLEW_HORIZON_SECONDS = 4.0;
+
+    struct Sample
+    {
+        u64 tsc{};
+        u64 ns{};
+    };
+
+    // Engine time is a line through the source's nanoseconds. Changing its rate starts a new one where the old one is, so it never steps.
+    struct Segment
+    {
+        u64 ns{};         // Source nanoseconds the segment starts at.
+        f64 float_time{}; // Engine time there.
+        f64 rate{1.0};    // Engine seconds per source second.
+    };
+
+    struct State
+    {
+        // Immutable while the hooks are installed, they're called from every thread.
+        ClockGettimeFn      clock_gettime{}; // The vDSO's, or libc's if it isn't found.
+        bool                calibrated{};
+        FastTimeCalibration calibration{};
+        u64                 tsc0{};
+        u64                 ns0{};
+        f64                 ns_per_tick{};
+        f64                 float_time_base{}; // tier0's values when the hooks were installed.
+        usize               ms_time_base{};
+        std::thread::id     main_thread{};
+
+        // Seqlock, `sequence` is odd while the main thread moves to a new segment.
+        std::atomic<u32> sequence{};
+        Segment          segment{};
+        std::atomic<u64> next_slew_ns{};
+
+        // Main thread only.
+        u64 last_compare_ns{}; // 0 before the first comparison.
+        f64 last_offset{};     // Seconds ahead of tier0.
+        f64 drift{};           // Of the source against tier0, smoothed.
+
+        SafetyHookInline float_time_hook{};
+        SafetyHookInline ms_time_hook{};
+    } g_fasttime{};
+
+    [[nodiscard]] inline u64 rdtsc() noexcept
+    {
+        u32 lo;
+        u32 hi;
+        asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+        return (u64)hi << 32 | lo;
+    }
+
+    [[nodiscard]] inline u64 raw_now_ns(const State &state) noexcept
+    {
+        timespec ts{};
+        state.clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+        return (u64)ts.tv_sec * 1000000000 + (u64)ts.tv_nsec;
+    }
+
+    [[nodiscard]] inline u64 now_ns(const State &state) noexcept
+    {
+        if (state.calibration.source == FASTTIME_TSC)
+        {
+            // Signed, another core's TSC can be a few cycles behind the one that calibrated.
+            return state.ns0 + (u64)(i64)((f64)(i64)(rdtsc() - state.tsc0) * state.ns_per_tick);
+        }
+
+        return raw_now_ns(state);
+    }
+
+    [[nodiscard]] inline Segment load_segment(const State &state) noexcept
+    {
+        while (true)
+        {
+            u32 before = state.sequence.load(std::memory_order_acquire);
+
+            Segment segment = state.segment;
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+            if ((before & 1) == 0 && state.sequence.load(std::memory_order_relaxed) == before)
+            {
+                return segment;
+            }
+        }
+    }
+
+    [[nodiscard]] inline f64 float_time_at(const Segment &segment, u64 ns) noexcept
+    {
+        return segment.float_time + (f64)(i64)(ns - segment.ns) / 1e9 * segment.rate;
+    }
+
+    // Compares engine time with tier0's clock and sets the rate that follows it, main thread only.
+    void slew(State &state) noexcept
+    {
+        u64 before = now_ns(state);
+        f64 tier0  = state.float_time_hook.original<Plat_FloatTimeFn>()();
+        u64 after  = now_ns(state);
+
+        if (after - before > MAX_COMPARE_NS)
+        {
+            return;
+        }
+
+        state.next_slew_ns.store(after + FASTTIME_SLEW_INTERVAL_NS, std::memory_order_relaxed);
+
+        u64  ns      = before + (after - before) / 2;
+        auto segment = state.segment;
+        f64  time    = float_time_at(segment, ns);
+        f64  offset  = time - tier0;
+
+        // The source's own drift (NTP slewing tier0's clock, the TSC calibration), what the last rate did taken out of it.
+        if (state.last_compare_ns != 0 && ns > state.last_compare_ns)
+        {
+            f64 elapsed = (f64)(ns - state.last_compare_ns) / 1e9;
+            f64 drift   = (offset - state.last_offset) / elapsed - (segment.rate - 1.0);
+            state.drift += (drift - state.drift) / 4.0;
+        }
+
+        state.last_compare_ns = ns;
+        state.last_offset     = offset;
+
+        constexpr f64 max_slew   = FASTTIME_MAX_SLEW_PPM / 1e6;
+        f64           correction = std::clamp(-state.drift - offset / SLEW_HORIZON_SECONDS, -max_slew, max_slew);
+
+        u32 sequence = state.sequence.load(std::memory_order_relaxed);
+        state.sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        state.segment = Segment{ns, time, 1.0 + correction};
+
+        state.sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    [[nodiscard]] inline f64 float_time(State &state) noexcept
+    {
+        u64 ns = now_ns(state);
+
+        // The main thread reads the clock many times per frame, it keeps engine time close to tier0's about once a second.
+        if (ns >= state.next_slew_ns.load(std::memory_order_relaxed) && std::this_thread::get_id() == state.main_thread)
+        {
+            slew(state);
+        }
+
+        return float_time_at(load_segment(state), ns);
+    }
+
+    f64 TR_CCALL hooked_Plat_FloatTime() noexcept
+    {
+        return float_time(g_fasttime);
+    }
+
+    usize TR_CCALL hooked_Plat_MSTime() noexcept
+    {
+        auto &&state = g_fasttime;
+        return state.ms_time_base + (usize)((float_time(state) - state.float_time_base) * 1000.0);
+    }
+
+    [[nodiscard]] ClockGettimeFn find_clock_gettime() noexcept
+    {
+        if (u8 *vdso = os_get_module("linux-vdso.so.1"); vdso != nullptr)
+        {
+            if (auto fn = os_get_procedure<ClockGettimeFn>(vdso, "__vdso_clock_gettime"); fn != nullptr)
+            {
+                return fn;
+            }
+        }
+
+        return ::clock_gettime;
+    }
+
+    [[nodiscard]] bool tsc_is_invariant() noexcept
+    {
+        u32 eax{};
+        u32 ebx{};
+        u32 ecx{};
+        u32 edx{};
+        if (__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) == 0)
+        {
+            return false;
+        }
+
+        return (edx & (1u << 8)) != 0;
+    }
+
+    [[nodiscard]] bool tsc_is_clocksource() noexcept
+    {
+        auto data = os_read_binary_file("/sys/devices/system/clocksource/clocksource0/current_clocksource");
+
+        std::string_view name{(cstr)data.data(), data.size()};
+        while (!name.empty() && (name.back() == '\n' || name.back() == ' '))
+        {
+            name.remove_suffix(1);
+        }
+
+        return name == "tsc";
+    }
+
+    [[nodiscard]] Sample sample(const State &state) noexcept
+    {
+        Sample best{};
+        u64    best_window = ~0ull;
+
+        for (usize i{}; i < SAMPLE_TRIES; ++i)
+        {
+            u64 before = rdtsc();
+            u64 ns     = raw_now_ns(state);
+            u64 after  = rdtsc();
+
+            if (after - before < best_window)
+            {
+                best_window = after - before;
+                best        = {before + (after - before) / 2, ns};
+            }
+        }
+
+        return best;
+    }
+#endif
+} // namespace
+
+[[nodiscard]] std::string_view fasttime_source_str(FastTimeSource source) noexcept
+{
+    return source == FASTTIME_TSC ? "TSC" : "vDSO";
+}
+
+[[nodiscard]] std::string_view fasttime_tsc_status_str(FastTimeTscStatus status) noexcept
+{
+    constexpr std::array<std::string_view, 4> strings = {
+        "OK",
+        "Not invariant",
+        "Not the kernel's clock source",
+        "Failed the self-test",
+    };
+
+    return status < strings.size() ? strings[status] : "unknown";
+}
+
+tl::expected<FastTimeCalibration, FastTimeError> fasttime_calibrate([[maybe_unused]] u64 duration_ns) noexcept
+{
+#if TR_OS_LINUX
+    auto &&state = g_fasttime;
+    if (fasttime_is_installed())
+    {
+        return state.calibration;
+    }
+
+    state.calibrated    = false;
+    state.clock_gettime = find_clock_gettime();
+
+    timespec ts{};
+    if (state.clock_gettime(CLOCK_MONOTONIC_RAW, &ts) != 0)
+    {
+        return tl::unexpected{FastTimeError{FastTimeError::NO_CLOCK}};
+    }
+
+    FastTimeCalibration calibration{};
+    calibration.source = FASTTIME_VDSO;
+
+    if (!tsc_is_invariant())
+    {
+        calibration.tsc_status = FASTTIME_TSC_NOT_INVARIANT;
+    }
+    else
+    {
+        // Calibrate over the first interval, check the rate over the second one.
+        auto start = sample(state);
+        std::this_thread::sleep_for(std::chrono::nanoseconds{duration_ns});
+        auto middle = sample(state);
+        std::this_thread::sleep_for(std::chrono::nanoseconds{duration_ns / 2});
+        auto end = sample(state);
+
+        f64 ns_per_tick = (f64)(middle.ns - start.ns) / (f64)(middle.tsc - start.tsc);
+        f64 predicted   = (f64)(end.tsc - middle.tsc) * ns_per_tick;
+        f64 actual      = (f64)(end.ns - middle.ns);
+
+        calibration.tsc_hz    = 1e9 / ns_per_tick;
+        calibration.error_ppm = std::fabs(predicted - actual) / actual * 1e6;
+
+        if (!tsc_is_clocksource())
+        {
+            calibration.tsc_status = FASTTIME_TSC_NOT_CLOCKSOURCE;
+        }
+        else if (!(calibration.error_ppm <= FASTTIME_MAX_ERROR_PPM))
+        {
+            calibration.tsc_status = FASTTIME_TSC_SELF_TEST_FAILED;
+        }
+        else
+        {
+            // The whole span is the better estimate once both halves agree.
+            calibration.source = FASTTIME_TSC;
+            state.ns_per_tick  = (f64)(end.ns - start.ns) / (f64)(end.tsc - start.tsc);
+            state.tsc0         = end.tsc;
+            state.ns0          = end.ns;
+        }
+    }
+
+    if (calibration.source != FASTTIME_TSC)
+    {
+        state.ns0 = raw_now_ns(state);
+    }
+
+    state.calibration = calibration;
+    state.calibrated  = true;
+
+    return calibration;
+#else
+    return tl::unexpected{FastTimeError{FastTimeError::UNSUPPORTED}};
+#endif
+}
+
+[[nodiscard]] u64 fasttime_now_ns() noexcept
+{
+#if TR_OS_LINUX
+    return g_fasttime.calibrated ? now_ns(g_fasttime) : 0;
+#else
+    return 0;
+#endif
+}
+
+[[nodiscard]] u64 fasttime_raw_now_ns() noexcept
+{
+#if TR_OS_LINUX
+    return g_fasttime.calibrated ? raw_now_ns(g_fasttime) : 0;
+#else
+    return 0;
+#endif
+}
+
+[[nodiscard]] f64 fasttime_drift_ppm() noexcept
+{
+#if TR_OS_LINUX
+    auto &&state = g_fasttime;
+    if (!state.calibrated || state.calibration.source != FASTTIME_TSC)
+    {
+        return 0.0;
+    }
+
+    u64 raw  = raw_now_ns(state);
+    u64 fast = now_ns(state);
+    if (raw <= state.ns0)
+    {
+        return 0.0;
+    }
+
+    return (f64)(i64)(fast - raw) / (f64)(raw - state.ns0) * 1e6;
+#else
+    return 0.0;
+#endif
+}
+
+tl::expected<FastTimeCalibration, FastTimeError> fasttime_install() noexcept
+{
+#if TR_OS_LINUX
+    auto &&state = g_fasttime;
+    if (fasttime_is_installed())
+    {
+        return state.calibration;
+    }
+
+    u8 *tier0 = iface_get_default_module("tier0");
+    if (tier0 == nullptr)
+    {
+        return tl::unexpected{FastTimeError{FastTimeError::NO_TIER0}};
+    }
+
+    auto *Plat_FloatTime = os_get_procedure<Plat_FloatTimeFn>(tier0, "Plat_FloatTime");
+    if (Plat_FloatTime == nullptr)
+    {
+        return tl::unexpected{FastTimeError{FastTimeError::NO_PLAT_FLOATTIME}};
+    }
+
+    // Optional, the engine uses it far less.
+    auto *Plat_MSTime = os_get_procedure<Plat_MSTimeFn>(tier0, "Plat_MSTime");
+
+    auto calibration = fasttime_calibrate();
+    if (!calibration)
+    {
+        return calibration;
+    }
+
+    // Other threads can still be inside a hook when `fasttime_uninstall` removes it, its code must outlive them.
+    if (!os_pin_module((u8 *)&fasttime_install))
+    {
+        return tl::unexpected{FastTimeError{FastTimeError::FAILED_TO_PIN}};
+    }
+
+    auto float_time_hook = SafetyHookInline::create((void *)Plat_FloatTime, hooked_Plat_FloatTime, SafetyHookInline::StartDisabled);
+    if (!float_time_hook)
+    {
+        return tl::unexpected{FastTimeError{FastTimeError::FAILED_TO_HOOK}};
+    }
+
+    SafetyHookInline ms_time_hook{};
+    if (Plat_MSTime != nullptr)
+    {
+        auto hook = SafetyHookInline::create((void *)Plat_MSTime, hooked_Plat_MSTime, SafetyHookInline::StartDisabled);
+        if (!hook)
+        {
+            return tl::unexpected{FastTimeError{FastTimeError::FAILED_TO_HOOK}};
+        }
+
+        ms_time_hook = std::move(*hook);
+    }
+
+    // Pick up where tier0 is, right before the switch.
+    state.float_time_base = Plat_FloatTime();
+    state.ms_time_base    = Plat_MSTime != nullptr ? Plat_MSTime() : 0;
+    state.main_thread     = std::this_thread::get_id();
+    state.segment         = Segment{now_ns(state), state.float_time_base, 1.0};
+    state.last_compare_ns = 0;
+    state.last_offset     = 0.0;
+    state.drift           = 0.0;
+    state.next_slew_ns.store(state.segment.ns + FASTTIME_SLEW_INTERVAL_NS, std::memory_order_relaxed);
+
+    if (Plat_MSTime != nullptr && !ms_time_hook.enable())
+    {
+        return tl::unexpected{FastTimeError{FastTimeError::FAILED_TO_HOOK}};
+    }
+
+    if (!float_time_hook->enable())
+    {
+        return tl::unexpected{FastTimeError{FastTimeError::FAILED_TO_HOOK}};
+    }
+
+    state.float_time_hook = std::move(*float_time_hook);
+    state.ms_time_hook    = std::move(ms_time_hook);
+
+    return *calibration;
+#else
+    return tl::unexpected{FastTimeError{FastTimeError::UNSUPPORTED}};
+#endif
+}
+
+[[nodiscard]] f64 fasttime_tier0_offset() noexcept
+{
+#if TR_OS_LINUX
+    auto &&state = g_fasttime;
+    if (!fasttime_is_installed())
+    {
+        return 0.0;
+    }
+
+    f64 tier0 = state.float_time_hook.original<Plat_FloatTimeFn>()();
+    return hooked_Plat_FloatTime() - tier0;
+#else
+    return 0.0;
+#endif
+}
+
+void fasttime_uninstall() noexcept
+{
+#if TR_OS_LINUX
+    auto &&state = g_fasttime;
+
+    state.float_time_hook = {};
+    state.ms_time_hook    = {};
+#endif
+}
+
+[[nodiscard]] bool fasttime_is_installed() noexcept
+{
+#if TR_OS_LINUX
+    return (bool)g_fasttime.float_time_hook;
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "type.hpp"
+#include <tl/expected.hpp>
+#include <string_view>
+
+// Engine time from the TSC. tier0's `Plat_FloatTime`/`Plat_MSTime` go through libc on every call (many times per tick, from every
+// thread), they're replaced with inline hooks that scale the TSC instead.
+// The TSC is only used when it's invariant (constant rate in every power state) and the kernel uses it as its own clock source
+// (so it's synchronized between cores), and when a second measurement agrees with the calibration. Otherwise the hooks read
+// `CLOCK_MONOTONIC_RAW` straight from the vDSO.
+// The hooks continue from the values tier0 returned when they were installed, so engine time doesn't jump. tier0's clock is slewed by
+// NTP and the source isn't, so about once a second the main thread compares the two and adjusts the rate of engine time to follow
+// tier0's (within `FASTTIME_MAX_SLEW_PPM`). The offset stays small, and removing the hooks doesn't step engine time back.
+// `clock.cpp` hooks `Plat_FloatTime` on top of this, it must be installed after and removed before.
+
+constexpr u64 FASTTIME_CALIBRATION_NS   = 50000000;
+constexpr f64 FASTTIME_MAX_ERROR_PPM    = 100.0;      // The self-test fails past this.
+constexpr u64 FASTTIME_SLEW_INTERVAL_NS = 1000000000; // How often engine time is compared with tier0's.
+constexpr f64 FASTTIME_MAX_SLEW_PPM     = 1000.0;     // NTP slews by 500 ppm at most, the calibration is off by 100 at most.
+
+enum FastTimeSource : u8
+{
+    FASTTIME_TSC,
+    FASTTIME_VDSO,
+};
+
+// Why the TSC isn't used.
+enum FastTimeTscStatus : u8
+{
+    FASTTIME_TSC_OK,
+    FASTTIME_TSC_NOT_INVARIANT,
+    FASTTIME_TSC_NOT_CLOCKSOURCE, // The kernel doesn't trust it (i.e. not synchronized between sockets).
+    FASTTIME_TSC_SELF_TEST_FAILED,
+};
+
+struct FastTimeError
+{
+    enum Type : u8
+    {
+        UNSUPPORTED,
+        NO_CLOCK,      // `CLOCK_MONOTONIC_RAW` doesn't work.
+        NO_TIER0,
+        NO_PLAT_FLOATTIME,
+        FAILED_TO_PIN, // The plugin couldn't be kept loaded.
+        FAILED_TO_HOOK,
+    } type;
+};
+
+struct FastTimeCalibration
+{
+    FastTimeSource    source{};
+    FastTimeTscStatus tsc_status{};
+    f64               tsc_hz{};    // Measured even when the TSC isn't used, 0 if it isn't invariant.
+    f64               error_ppm{}; // Self-test, the TSC rate against `CLOCK_MONOTONIC_RAW` over a second interval.
+};
+
+[[nodiscard]] std::string_view fasttime_source_str(FastTimeSource source) noexcept;
+[[nodiscard]] std::string_view fasttime_tsc_status_str(FastTimeTscStatus status) noexcept;
+
+// Picks the source and calibrates the TSC over `duration_ns` (twice, the second one is the self-test). Blocks for 1.5x `duration_ns`.
+// Must not be called while the hooks are installed.
+tl::expected<FastTimeCalibration, FastTimeError> fasttime_calibrate(u64 duration_ns = FASTTIME_CALIBRATION_NS) noexcept;
+
+// `CLOCK_MONOTONIC_RAW` nanoseconds from the calibrated source, `fasttime_calibrate` must have succeeded.
+[[nodiscard]] u64 fasttime_now_ns() noexcept;
+
+// `CLOCK_MONOTONIC_RAW` nanoseconds from the vDSO.
+[[nodiscard]] u64 fasttime_raw_now_ns() noexcept;
+
+// How far `fasttime_now_ns` drifted from `CLOCK_MONOTONIC_RAW` since the calibration, in ppm.
+[[nodiscard]] f64 fasttime_drift_ppm() noexcept;
+
+// Calibrates and hooks tier0's `Plat_FloatTime` (and `Plat_MSTime` if it's exported). Must be called from the main thread, the one
+// whose reads keep engine time close to tier0's. Keeps the plugin loaded until the process exits.
+tl::expected<FastTimeCalibration, FastTimeError> fasttime_install() noexcept;
+void                                             fasttime_uninstall() noexcept;
+
+[[nodiscard]] bool fasttime_is_installed() noexcept;
+
+// How far ahead of tier0's own `Plat_FloatTime` the hook is, in seconds. Engine time steps back by this much when the hooks are removed,
+// slewing keeps it within a few microseconds once the drift is known (within a minute of installing).
+[[nodiscard]] f64 fasttime_tier0_offset() noexcept;
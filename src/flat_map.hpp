@@ -0,0 +1,182 @@
+#pragma once
+
+#include "type.hpp"
+#include <memory>
+#include <utility>
+
+// Open-addressing hash map keyed by pointers (linear probing, backward-shift deletion).
+// `nullptr` is reserved as the empty key. Lookups touch one contiguous array, which matters when tracking thousands of objects.
+template <class V>
+class FlatPtrMap
+{
+public:
+    struct Slot
+    {
+        const void *key{};
+        V           value{};
+    };
+
+    FlatPtrMap() noexcept = default;
+
+    [[nodiscard]] usize size() const noexcept
+    {
+        return m_size;
+    }
+
+    [[nodiscard]] bool empty() const noexcept
+    {
+        return m_size == 0;
+    }
+
+    [[nodiscard]] V *find(const void *key) noexcept
+    {
+        if (key == nullptr || m_size == 0)
+        {
+            return nullptr;
+        }
+
+        for (usize i = index_of(key);; i = (i + 1) & m_mask)
+        {
+            auto &slot = m_slots[i];
+            if (slot.key == key)
+            {
+                return &slot.value;
+            }
+
+            if (slot.key == nullptr)
+            {
+                return nullptr;
+            }
+        }
+    }
+
+    [[nodiscard]] const V *find(const void *key) const noexcept
+    {
+        return const_cast<FlatPtrMap *>(this)->find(key);
+    }
+
+    // Returns false if the key already existed (the value is overwritten either way).
+    bool insert(const void *key, V value) noexcept
+    {
+        if (key == nullptr)
+        {
+            return false;
+        }
+
+        // Keep the load factor at or below 1/2 so probe sequences stay short.
+        if ((m_size + 1) * 2 > m_capacity)
+        {
+            grow(m_capacity == 0 ? 64 : m_capacity * 2);
+        }
+
+        for (usize i = index_of(key);; i = (i + 1) & m_mask)
+        {
+            auto &slot = m_slots[i];
+            if (slot.key == key)
+            {
+                slot.value = std::move(value);
+                return false;
+            }
+
+            if (slot.key == nullptr)
+            {
+                slot.key   = key;
+                slot.value = std::move(value);
+                ++m_size;
+                return true;
+            }
+        }
+    }
+
+    bool erase(const void *key) noexcept
+    {
+        if (key == nullptr || m_size == 0)
+        {
+            return false;
+        }
+
+        usize i = index_of(key);
+        for (;; i = (i + 1) & m_mask)
+        {
+            if (m_slots[i].key == key)
+            {
+                break;
+            }
+
+            if (m_slots[i].key == nullptr)
+            {
+                return false;
+            }
+        }
+
+        // Shift following entries of the cluster back so no tombstones are needed.
+        for (usize j = (i + 1) & m_mask; m_slots[j].key != nullptr; j = (j + 1) & m_mask)
+        {
+            usize home = index_of(m_slots[j].key);
+            if (((j - home) & m_mask) >= ((j - i) & m_mask))
+            {
+                m_slots[i] = std::move(m_slots[j]);
+                i          = j;
+            }
+        }
+
+        m_slots[i] = {};
+        --m_size;
+
+        return true;
+    }
+
+    void clear() noexcept
+    {
+        for (usize i{}; i < m_capacity; ++i)
+        {
+            m_slots[i] = {};
+        }
+
+        m_size = 0;
+    }
+
+    template <class Fn>
+    void for_each(Fn &&fn) noexcept
+    {
+        for (usize i{}; i < m_capacity; ++i)
+        {
+            if (m_slots[i].key != nullptr)
+            {
+                fn(m_slots[i].key, m_slots[i].value);
+            }
+        }
+    }
+
+private:
+    std::unique_ptr<Slot[]> m_slots{};
+    usize                   m_capacity{};
+    usize                   m_mask{};
+    usize                   m_size{};
+
+    [[nodiscard]] usize index_of(const void *key) const noexcept
+    {
+        // Objects are at least 8/16 byte aligned, drop the low bits before mixing (Fibonacci hashing).
+        u64 h = (u64)((usize)key >> 3) * 0x9E3779B97F4A7C15ull;
+        return (usize)(h >> 32) & m_mask;
+    }
+
+    void grow(usize capacity) noexcept
+    {
+        auto  old_slots    = std::move(m_slots);
+        usize old_capacity = m_capacity;
+
+        m_slots    = std::make_unique<Slot[]>(capacity);
+        m_capacity = capacity;
+        m_mask     = capacity - 1;
+        m_size     = 0;
+
+        for (usize i{}; i < old_capacity; ++i)
+        {
+            if (old_slots[i].key != nullptr)
+            {
+                insert(old_slots[i].key, std::move(old_slots[i].value));
+            }
+        }
+    }
+};
@@ -0,0 +1,286 @@
+#include "iface.hpp"
+#include "common.hpp"
+#include "os.hpp"
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+    std::vector<u8 *>                                             g_iface_modules{};
+    std::unordered_map<std::string_view, std::vector<IfaceEntry>> g_iface_index{};
+
+    struct DefaultModule
+    {
+        std::string_view    base_name;
+        std::array<cstr, 2> file_names;
+    };
+
+#if TR_OS_WINDOWS
+    // Dedicated servers on some branches use `_srv` suffixed modules, so every candidate is tried.
+    constexpr std::array<DefaultModule, 5> default_modules = {{
+        {"engine", {"engine.dll", nullptr}},
+        {"server", {"server.dll", nullptr}},
+        {"tier0", {"tier0.dll", nullptr}},
+        {"vstdlib", {"vstdlib.dll", nullptr}},
+        {"dedicated", {"dedicated.dll", nullptr}},
+    }};
+#else
+    constexpr std::array<DefaultModule, 5> default_modules = {{
+        {"engine", {"engine_srv.so", "engine.so"}},
+        {"server", {"server_srv.so", "server.so"}},
+        {"tier0", {"libtier0_srv.so", "libtier0.so"}},
+        {"vstdlib", {"libvstdlib_srv.so", "libvstdlib.so"}},
+        {"dedicated", {"dedicated_srv.so", "dedicated.so"}},
+    }};
+#endif
+
+    [[nodiscard]] u8 *get_default_module(const DefaultModule &module) noexcept
+    {
+        for (cstr name : module.file_names)
+        {
+            if (name == nullptr)
+            {
+                continue;
+            }
+
+            if (u8 *handle = os_get_module(name); handle != nullptr)
+            {
+                return handle;
+            }
+        }
+
+        return nullptr;
+    }
+} // namespace
+
+[[nodiscard]] tl::expected<InterfaceReg *, IfaceError> iface_find_regs(u8 *module, u8 *createinterface) noexcept
+{
+    // Check for the `s_pInterfaceRegs` symbol first.
+    if (u8 *regs_symbol = os_get_procedure(module, "s_pInterfaceRegs"); regs_symbol != nullptr)
+    {
+        if (auto *regs = *(InterfaceReg **)regs_symbol; regs != nullptr)
+        {
+            return regs;
+        }
+
+        return tl::unexpected{IfaceError{IfaceError::NULL_REGS}};
+    }
+
+    if (createinterface == nullptr)
+    {
+        createinterface = os_get_procedure(module, "CreateInterface");
+    }
+
+    if (createinterface == nullptr)
+    {
+        return tl::unexpected{IfaceError{IfaceError::NO_CREATEINTERFACE}};
+    }
+
+    // No symbol was found so we have to disasm manually.
+    // First we check for a jump thunk. Some versions of the game have this for some reason. If there isn't one then we don't worry about it.
+    for (;;)
+    {
+        auto thunk_disasm_result = disasm(createinterface);
+        if (!thunk_disasm_result)
+        {
+            return tl::unexpected{IfaceError{IfaceError::BAD_THUNK, thunk_disasm_result.error()}};
+        }
+
+        auto &&thunk_disasm = *thunk_disasm_result;
+        if (thunk_disasm.ix.mnemonic != ZYDIS_MNEMONIC_JMP)
+        {
+            break;
+        }
+
+        createinterface += thunk_disasm.ix.length + (i32)thunk_disasm.operands[0].imm.value.s;
+    }
+
+    // Find the first `mov reg, mem`.
+    auto regs_disasm_result = disasm_for_each(
+        createinterface,
+        ZYDIS_MAX_INSTRUCTION_LENGTH * 25, // I hope this is enough :P
+        [](auto &&result) noexcept
+        {
+            // x86-64 is RIP-relative. x86-32 is absolute.
+            constexpr ZyanU16 op_size  = TR_ARCH_X86_64 == 1 ? 64 : 32;
+            constexpr auto    mem_base = TR_ARCH_X86_64 == 1 ? ZYDIS_REGISTER_RIP : ZYDIS_REGISTER_NONE;
+
+            return result.ix.mnemonic == ZYDIS_MNEMONIC_MOV && result.ix.operand_count_visible == 2
+                && result.operands[0].type == ZYDIS_OPERAND_TYPE_REGISTER && result.operands[0].size == op_size
+                && result.operands[1].type == ZYDIS_OPERAND_TYPE_MEMORY && result.operands[1].size == op_size
+                && result.operands[1].mem.segment == ZYDIS_REGISTER_DS && result.operands[1].mem.base == mem_base;
+        });
+    if (!regs_disasm_result)
+    {
+        return tl::unexpected{IfaceError{IfaceError::NO_REGS_INSTRUCTION, regs_disasm_result.error()}};
+    }
+
+    auto &&regs_disasm = *regs_disasm_result;
+
+    // x86-64 is RIP-relative. x86-32 is absolute.
+#if TR_ARCH_X86_64
+    auto *regs = *(InterfaceReg **)(regs_disasm.ip + regs_disasm.ix.length + (i32)regs_disasm.operands[1].mem.disp.value);
+#else
+    auto *regs = *(InterfaceReg **)((usize)regs_disasm.operands[1].mem.disp.value);
+#endif
+
+    if (regs == nullptr)
+    {
+        return tl::unexpected{IfaceError{IfaceError::NULL_REGS}};
+    }
+
+    return regs;
+}
+
+tl::expected<usize, IfaceError> iface_add_module(u8 *module, u8 *createinterface) noexcept
+{
+    if (module == nullptr)
+    {
+        return tl::unexpected{IfaceError{IfaceError::NO_CREATEINTERFACE}};
+    }
+
+    if (std::find(g_iface_modules.begin(), g_iface_modules.end(), module) != g_iface_modules.end())
+    {
+        return 0;
+    }
+
+    auto regs = iface_find_regs(module, createinterface);
+    if (!regs)
+    {
+        return tl::unexpected{regs.error()};
+    }
+
+    g_iface_modules.push_back(module);
+
+    // Lists this module added to, sorted once it's indexed. Map nodes don't move so the pointers stay valid.
+    std::vector<std::vector<IfaceEntry> *> touched{};
+
+    usize count{};
+    for (auto *it = *regs; it != nullptr; it = it->m_pNext)
+    {
+        if (it->m_pName == nullptr || it->m_CreateFn == nullptr)
+        {
+            continue;
+        }
+
+        auto [base_name, version] = iface_split_name(it->m_pName);
+
+        auto &entries = g_iface_index[base_name];
+        if (std::find(touched.begin(), touched.end(), &entries) == touched.end())
+        {
+            touched.push_back(&entries);
+        }
+
+        entries.push_back(IfaceEntry{it->m_pName, base_name, version, module, it, nullptr});
+
+        ++count;
+    }
+
+    // Newest first. Stable so the first module added wins between equal versions.
+    for (auto *entries : touched)
+    {
+        std::stable_sort(
+            entries->begin(),
+            entries->end(),
+            [](const IfaceEntry &lhs, const IfaceEntry &rhs) noexcept { return lhs.version > rhs.version; });
+    }
+
+    return count;
+}
+
+void iface_add_default_modules() noexcept
+{
+    for (auto &&module : default_modules)
+    {
+        if (u8 *handle = get_default_module(module); handle != nullptr)
+        {
+            (void)iface_add_module(handle);
+        }
+    }
+}
+
+[[nodiscard]] u8 *iface_get_default_module(std::string_view base_name) noexcept
+{
+    for (auto &&module : default_modules)
+    {
+        if (module.base_name == base_name)
+        {
+            return get_default_module(module);
+        }
+    }
+
+    return nullptr;
+}
+
+[[nodiscard]] const IfaceEntry *iface_find_entry(std::string_view base_name, u32 version) noexcept
+{
+    auto it = g_iface_index.find(base_name);
+    if (it == g_iface_index.end() || it->second.empty())
+    {
+        return nullptr;
+    }
+
+    if (version == IFACE_LATEST)
+    {
+        return &it->second.front();
+    }
+
+    for (auto &&entry : it->second)
+    {
+        if (entry.version == version)
+        {
+            return &entry;
+        }
+    }
+
+    return nullptr;
+}
+
+[[nodiscard]] void *iface_get(std::string_view base_name, u32 version) noexcept
+{
+    auto *entry = const_cast<IfaceEntry *>(iface_find_entry(base_name, version));
+    if (entry == nullptr)
+    {
+        return nullptr;
+    }
+
+    if (entry->instance == nullptr)
+    {
+        entry->instance = entry->reg->m_CreateFn();
+    }
+
+    return entry->instance;
+}
+
+[[nodiscard]] std::pair<std::string_view, u32> iface_split_name(std::string_view name) noexcept
+{
+    usize digits{};
+    while (digits < name.size() && name[name.size() - digits - 1] >= '0' && name[name.size() - digits - 1] <= '9')
+    {
+        ++digits;
+    }
+
+    // Every character is a digit, don't produce an empty base name.
+    if (digits == 0 || digits == name.size())
+    {
+        return {name, 0};
+    }
+
+    u32  version{};
+    auto version_str = name.substr(name.size() - digits);
+    if (auto [ptr, ec] = std::from_chars(version_str.data(), version_str.data() + version_str.size(), version); ec != std::errc{})
+    {
+        return {name, 0};
+    }
+
+    return {name.substr(0, name.size() - digits), version};
+}
+
+void iface_clear() noexcept
+{
+    g_iface_index.clear();
+    g_iface_modules.clear();
+}
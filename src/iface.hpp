@@ -0,0 +1,68 @@
+#pragma once
+
+#include "type.hpp"
+#include "engine.hpp"
+#include "disasm.hpp"
+#include <tl/expected.hpp>
+#include <string_view>
+#include <utility>
+
+// Index of every `InterfaceReg` in the loaded Source modules, keyed by base name and version
+// (i.e. `VEngineCvar004` is `VEngineCvar` version 4).
+
+constexpr u32 IFACE_LATEST = ~0u;
+
+struct IfaceError
+{
+    enum Type : u8
+    {
+        NO_CREATEINTERFACE,
+        BAD_THUNK,
+        NO_REGS_INSTRUCTION,
+        NULL_REGS,
+    } type;
+
+    Disasm::Error disasm{};
+};
+
+struct IfaceEntry
+{
+    cstr             name{};
+    std::string_view base_name{};
+    u32              version{};
+    u8              *module{};
+    InterfaceReg    *reg{};
+    void            *instance{}; // Created on first lookup.
+};
+
+// Returns a module's `s_pInterfaceRegs` list, using the symbol if it's exported or disassembling `CreateInterface` otherwise.
+// `createinterface` is optional, it's looked up from the module's exports when null.
+[[nodiscard]] tl::expected<InterfaceReg *, IfaceError> iface_find_regs(u8 *module, u8 *createinterface = nullptr) noexcept;
+
+// Adds every interface of a module to the index. Adding a module twice does nothing.
+tl::expected<usize, IfaceError> iface_add_module(u8 *module, u8 *createinterface = nullptr) noexcept;
+
+// Adds engine, server, tier0, vstdlib and dedicated (whichever are loaded). Errors from individual modules are ignored since not
+// every module exposes interfaces.
+void iface_add_default_modules() noexcept;
+
+// Returns one of the default modules by base name (`engine`, `server`, `tier0`, `vstdlib` or `dedicated`), whichever file name is loaded.
+[[nodiscard]] u8 *iface_get_default_module(std::string_view base_name) noexcept;
+
+// Returns an entry by base name, either the newest version or an exact one.
+// The pointer is only valid until the next `iface_add_module` or `iface_clear`, don't keep it.
+[[nodiscard]] const IfaceEntry *iface_find_entry(std::string_view base_name, u32 version = IFACE_LATEST) noexcept;
+
+// Returns an interface instance by base name, either the newest version or an exact one.
+[[nodiscard]] void *iface_get(std::string_view base_name, u32 version = IFACE_LATEST) noexcept;
+
+template <class T>
+[[nodiscard]] T *iface_get(std::string_view base_name, u32 version = IFACE_LATEST) noexcept
+{
+    return (T *)iface_get(base_name, version);
+}
+
+// Splits `VEngineCvar004` into `VEngineCvar` and 4. Names without a version get version 0.
+[[nodiscard]] std::pair<std::string_view, u32> iface_split_name(std::string_view name) noexcept;
+
+void iface_clear() noexcept;
@@ -0,0 +1,91 @@
+#include "import.hpp"
+#include "os.hpp"
+#include <safetyhook/safetyhook.hpp>
+#include <utility>
+
+namespace
+{
+    // Writes a pointer into memory that's (probably) read-only and restores the old protection.
+    [[nodiscard]] bool write_protected(u8 **address, u8 *value) noexcept
+    {
+        auto old_protect = safetyhook::vm_protect((u8 *)address, sizeof(u8 *), safetyhook::VM_ACCESS_RW);
+        if (!old_protect)
+        {
+            return false;
+        }
+
+        *address = value;
+
+        (void)safetyhook::vm_protect((u8 *)address, sizeof(u8 *), *old_protect);
+
+        return true;
+    }
+} // namespace
+
+[[nodiscard]] tl::expected<ImportHook, ImportHook::Error> ImportHook::create_raw(
+    u8 *module, std::string_view proc_name, u8 *proc, u8 *fn) noexcept
+{
+    auto slots = os_find_import_slots(module, proc_name, proc);
+    if (proc == nullptr || slots.empty())
+    {
+        return tl::unexpected{Error{Error::NOT_IMPORTED}};
+    }
+
+    // The original is called directly, a lazily bound slot would only lead back to the dynamic linker.
+    ImportHook hook{};
+    hook.m_original = proc;
+    hook.m_new      = fn;
+
+    for (u8 **entry : slots)
+    {
+        Slot slot{entry, *entry};
+        if (!write_protected(slot.entry, hook.m_new))
+        {
+            // Undoes the slots written so far.
+            return tl::unexpected{Error{Error::FAILED_TO_UNPROTECT}};
+        }
+
+        hook.m_slots.push_back(slot);
+    }
+
+    return hook;
+}
+
+ImportHook::ImportHook(ImportHook &&other) noexcept
+{
+    *this = std::move(other);
+}
+
+ImportHook &ImportHook::operator=(ImportHook &&other) noexcept
+{
+    if (this != &other)
+    {
+        reset();
+        m_slots    = std::exchange(other.m_slots, {});
+        m_original = std::exchange(other.m_original, nullptr);
+        m_new      = std::exchange(other.m_new, nullptr);
+    }
+
+    return *this;
+}
+
+ImportHook::~ImportHook() noexcept
+{
+    reset();
+}
+
+void ImportHook::reset() noexcept
+{
+    for (auto &&slot : m_slots)
+    {
+        // Don't clobber whoever hooked the slot after us.
+        if (*slot.entry == m_new)
+        {
+            (void)write_protected(slot.entry, slot.original);
+        }
+    }
+
+    m_slots.clear();
+    m_original = nullptr;
+    m_new      = nullptr;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "type.hpp"
+#include <tl/expected.hpp>
+#include <string_view>
+#include <vector>
+
+// Redirects the calls one module makes to an imported function (i.e. the engine's `recvfrom`) by rewriting its import slots, see
+// `os_find_import_slots`. Other modules, and the function itself, are untouched. Like `VmtSlotHook` it's a protected pointer write
+// per slot, no code is patched.
+class ImportHook final
+{
+public:
+    struct Error
+    {
+        enum Type : u8
+        {
+            NOT_IMPORTED,
+            FAILED_TO_UNPROTECT,
+        } type;
+    };
+
+    // `proc` is the function the module imports, the hook calls it through `original`.
+    template <class T>
+    [[nodiscard]] static tl::expected<ImportHook, Error> create(u8 *module, std::string_view proc_name, u8 *proc, T fn) noexcept
+    {
+        return create_raw(module, proc_name, proc, (u8 *)fn);
+    }
+
+    ImportHook() noexcept          = default;
+    ImportHook(const ImportHook &) = delete;
+    ImportHook(ImportHook &&other) noexcept;
+    ImportHook &operator=(const ImportHook &) = delete;
+    ImportHook &operator=(ImportHook &&other) noexcept;
+    ~ImportHook() noexcept;
+
+    // Restores the original slots.
+    void reset() noexcept;
+
+    template <class T>
+    [[nodiscard]] T original() const noexcept
+    {
+        return (T)m_original;
+    }
+
+    explicit operator bool() const noexcept
+    {
+        return !m_slots.empty();
+    }
+
+private:
+    struct Slot
+    {
+        u8 **entry{};
+        u8  *original{}; // Can be the PLT stub of a function that wasn't bound yet.
+    };
+
+    std::vector<Slot> m_slots{};
+    u8               *m_original{};
+    u8               *m_new{};
+
+    [[nodiscard]] static tl::expected<ImportHook, Error> create_raw(u8 *module, std::string_view proc_name, u8 *proc, u8 *fn) noexcept;
+};
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <fmt/format.h>
+#include <cstdio>
+#include <utility>
+
+template <class... Args>
+void error(fmt::format_string<Args...> fmt, Args &&...args) noexcept
+{
+    std::fprintf(stderr, "[Tickrate] [error] %s", fmt::format(fmt, std::forward<Args>(args)...).c_str());
+    std::fflush(stderr);
+}
+
+template <class... Args>
+void warn(fmt::format_string<Args...> fmt, Args &&...args) noexcept
+{
+    std::fprintf(stdout, "[Tickrate] [warn] %s", fmt::format(fmt, std::forward<Args>(args)...).c_str());
+    std::fflush(stdout);
+}
+
+template <class... Args>
+void info(fmt::format_string<Args...> fmt, Args &&...args) noexcept
+{
+    std::fprintf(stdout, "[Tickrate] [info] %s", fmt::format(fmt, std::forward<Args>(args)...).c_str());
+    std::fflush(stdout);
+}
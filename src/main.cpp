@@ -2,272 +2,615 @@
 #include "type.hpp"
 #include "string.hpp"
 #include "os.hpp"
+#include "log.hpp"
+#include "engine.hpp"
+#include "disasm.hpp"
+#include "vmt.hpp"
+#include "rtti.hpp"
+#include "iface.hpp"
+#include "config.hpp"
+#include "rates.hpp"
+#include "timing.hpp"
+#include "clock.hpp"
+#include "stagger.hpp"
+#include "align.hpp"
+#include "net.hpp"
+#include "numa.hpp"
+#include "tickstats.hpp"
+#include "metrics.hpp"
+#include "sampler.hpp"
+#include "pmu.hpp"
+#include "alloc.hpp"
+#include "memprof.hpp"
+#include "spew.hpp"
+#include "trace.hpp"
+#include "plugincost.hpp"
+#include "edicts.hpp"
+#include "fasttime.hpp"
+#include "residency.hpp"
+#include "flat_map.hpp"
 #include <tl/expected.hpp>
-#include <fmt/format.h>
-#include <Zycore/Status.h>
-#include <Zydis/Zydis.h>
 #include <safetyhook/safetyhook.hpp>
 #include <cstdio>
 #include <utility>
 #include <array>
+#include <algorithm>
 #include <string_view>
 #include <charconv>
+#include <cstring>
+#include <optional>
+#include <atomic>
+
+// Checks if a function looks like `CServerGameDLL::GetTickInterval`.
+// CS:S and TF2 compile out the `-tickrate` parameter, so it's a leaf function returning `DEFAULT_TICK_INTERVAL`:
+// - x86-64: `movss xmm0, [rip+x]; ret`
+// - x86-32 (Windows): `fld [x]; ret`
+// - x86-32 (Linux, PIC): `call get_pc_thunk; add reg, GOT; fld [reg+x]; ret`
+[[nodiscard]] bool is_tick_interval_getter(u8 *fn) noexcept
+{
+    constexpr usize max_instructions = 12;
+
+    ZydisRegister pic_reg{ZYDIS_REGISTER_NONE};
+    u8           *pic_value{};
+    ZydisRegister imm_reg{ZYDIS_REGISTER_NONE};
+    u32           imm_value{};
+    bool          found_interval{};
+
+    auto is_tick_interval = [](f32 value) noexcept { return value >= MINIMUM_TICK_INTERVAL && value <= MAXIMUM_TICK_INTERVAL; };
+
+    u8 *ip = fn;
+    for (usize i{}; i < max_instructions; ++i)
+    {
+        auto result = disasm(ip);
+        if (!result)
+        {
+            return false;
+        }
+
+        auto &&ix  = result->ix;
+        auto &&ops = result->operands;
+        u8     *next = ip + ix.length;
+
+        switch (ix.mnemonic)
+        {
+            case ZYDIS_MNEMONIC_RET:
+                return found_interval;
+
+            case ZYDIS_MNEMONIC_JMP:
+                // Only follow jump thunks at the very start (incremental linking, etc).
+                if (ip != fn || ops[0].type != ZYDIS_OPERAND_TYPE_IMMEDIATE)
+                {
+                    return false;
+                }
+
+                fn = ip = next + (isize)ops[0].imm.value.s;
+                continue;
+
+            case ZYDIS_MNEMONIC_CALL:
+            {
+                // Only PC thunks are allowed: `call next; pop reg` or `call thunk` where thunk is `mov reg, [esp]; ret`.
+                if (TR_ARCH_X86_64 == 1 || ops[0].type != ZYDIS_OPERAND_TYPE_IMMEDIATE)
+                {
+                    return false;
+                }
+
+                u8 *target = next + (isize)ops[0].imm.value.s;
+                if (target == next)
+                {
+                    auto pop = disasm(next);
+                    if (!pop || pop->ix.mnemonic != ZYDIS_MNEMONIC_POP)
+                    {
+                        return false;
+                    }
+
+                    pic_reg   = pop->operands[0].reg.value;
+                    pic_value = next;
+                    ip        = next + pop->ix.length;
+                    continue;
+                }
+
+                auto load = disasm(target);
+                if (!load || load->ix.mnemonic != ZYDIS_MNEMONIC_MOV || load->operands[1].type != ZYDIS_OPERAND_TYPE_MEMORY
+                    || load->operands[1].mem.base != ZYDIS_REGISTER_ESP || load->operands[1].mem.disp.value != 0)
+                {
+                    return false;
+                }
+
+                pic_reg   = load->operands[0].reg.value;
+                pic_value = next;
+                break;
+            }
+
+            case ZYDIS_MNEMONIC_ADD:
+                if (pic_reg != ZYDIS_REGISTER_NONE && ops[0].type == ZYDIS_OPERAND_TYPE_REGISTER && ops[0].reg.value == pic_reg
+                    && ops[1].type == ZYDIS_OPERAND_TYPE_IMMEDIATE)
+                {
+                    pic_value += (isize)ops[1].imm.value.s;
+                }
+                break;
+
+            case ZYDIS_MNEMONIC_MOV:
+                // Some compilers materialize the constant in a GPR and `movd` it into xmm0.
+                if (ops[0].type == ZYDIS_OPERAND_TYPE_REGISTER && ops[1].type == ZYDIS_OPERAND_TYPE_IMMEDIATE && ops[0].size == 32)
+                {
+                    imm_reg   = ops[0].reg.value;
+                    imm_value = (u32)ops[1].imm.value.u;
+                }
+                break;
+
+            case ZYDIS_MNEMONIC_MOVD:
+                if (ops[1].type == ZYDIS_OPERAND_TYPE_REGISTER && ops[1].reg.value == imm_reg && imm_reg != ZYDIS_REGISTER_NONE)
+                {
+                    f32 value;
+                    std::memcpy(&value, &imm_value, sizeof(value));
+                    found_interval = is_tick_interval(value);
+                }
+                break;
 
-using CreateInterfaceFn      = void *(TR_CCALL *)(cstr name, i32 *return_code);
-using InstantiateInterfaceFn = void *(TR_CCALL *)();
+            case ZYDIS_MNEMONIC_FLD:
+            case ZYDIS_MNEMONIC_MOVSS:
+            {
+                const auto &src = ix.mnemonic == ZYDIS_MNEMONIC_FLD ? ops[0] : ops[1];
+                if (src.type != ZYDIS_OPERAND_TYPE_MEMORY || src.size != 32)
+                {
+                    break;
+                }
 
-struct edict_t;
-class KeyValues;
-class CCommand;
+                if (u8 *address = disasm_mem_address(*result, src, pic_reg, pic_value); address != nullptr)
+                {
+                    f32 value;
+                    std::memcpy(&value, address, sizeof(value));
+                    found_interval = is_tick_interval(value);
+                }
+                break;
+            }
 
-using QueryCvarCookie_t = i32;
+            default:
+                // Any other control flow means this isn't a trivial getter.
+                if (ix.meta.category == ZYDIS_CATEGORY_COND_BR || ix.meta.category == ZYDIS_CATEGORY_UNCOND_BR)
+                {
+                    return false;
+                }
+                break;
+        }
+
+        ip = next;
+    }
 
-constexpr f32 MINIMUM_TICK_INTERVAL = 0.001f;
-constexpr f32 MAXIMUM_TICK_INTERVAL = 0.1f;
+    return false;
+}
 
-enum : i32
+// Finds the index of a method matching `pred`, searching outwards from `hint` (the index it's expected to be at).
+template <class Pred>
+[[nodiscard]] std::optional<usize> find_virtual_index(u8 **vmt, usize method_count, usize hint, Pred &&pred) noexcept
 {
-    IFACE_OK = 0,
-    IFACE_FAILED,
-};
+    for (usize distance{}; distance < method_count; ++distance)
+    {
+        if (hint + distance < method_count && pred(vmt[hint + distance]))
+        {
+            return hint + distance;
+        }
 
-enum PLUGIN_RESULT : i32
+        if (distance != 0 && distance <= hint && pred(vmt[hint - distance]))
+        {
+            return hint - distance;
+        }
+    }
+
+    return std::nullopt;
+}
+
+// Global variables, etc.
+u16              g_desired_tickrate{};
+VmtSlotHook      g_GetTickInterval_hook{};
+VmtSlotHook      g_GameFrame_hook{};
+std::atomic<u64> g_GetTickInterval_calls{};
+ICvar           *g_cvar{};
+FlatPtrMap<bool> g_active_clients{};
+i32              g_max_clients{};
+
+class Hooked_CServerGameDLL : public CServerGameDLL
 {
-    PLUGIN_CONTINUE = 0,
-    PLUGIN_OVERRIDE,
-    PLUGIN_STOP,
+public:
+    static f32 TR_THISCALL hooked_GetTickInterval([[maybe_unused]] CServerGameDLL *instance) noexcept
+    {
+        g_GetTickInterval_calls.fetch_add(1, std::memory_order_relaxed);
+
+        f32 interval = 1.0f / (f32)g_desired_tickrate;
+
+        return interval;
+    }
+
+    // The engine calls plugins' `GameFrame` right before the game's, so this ends the tick our `GameFrame` started.
+    static void TR_THISCALL hooked_GameFrame(CServerGameDLL *instance, bool simulating) noexcept
+    {
+        using GameFrameFn = void(TR_THISCALL *)(CServerGameDLL *, bool);
+        g_GameFrame_hook.original<GameFrameFn>()(instance, simulating);
+
+        if (simulating)
+        {
+            tickstats_on_tick_end(timing_now_ns());
+        }
+    }
 };
 
-enum EQueryCvarValueStatus : i32
+// `Plat_FloatTime` hook, needed by `-tickrate_stagger`, `-tickrate_align`, `-tickrate_maxticks` and `-tickrate_batchsend`.
+[[nodiscard]] bool enable_clock() noexcept
 {
-    eQueryCvarValueStatus_ValueIntact = 0,
-    eQueryCvarValueStatus_CvarNotFound,
-    eQueryCvarValueStatus_NotACvar,
-    eQueryCvarValueStatus_CvarProtected,
-};
+    if (auto result = clock_init(); !result)
+    {
+        constexpr std::array<std::string_view, 4> strings = {
+            "Failed to find tier0",
+            "Failed to find `Plat_FloatTime`",
+            "Failed to keep the plugin loaded",
+            "Failed to hook `Plat_FloatTime`",
+        };
+
+        warn("Tick staggering, alignment, catch-up limiting and batched sends disabled: {}.\n", strings[result.error().type]);
+        return false;
+    }
 
-// Misc utils.
-template <class... Args>
-void error(fmt::format_string<Args...> fmt, Args &&...args) noexcept
+    return true;
+}
+
+[[nodiscard]] bool enable_stagger() noexcept
 {
-    std::fprintf(stderr, "[Tickrate] [error] %s", fmt::format(fmt, std::forward<Args>(args)...).c_str());
-    std::fflush(stderr);
+    if (auto result = stagger_join(1000000000 / g_desired_tickrate); !result)
+    {
+        constexpr std::array<std::string_view, 4> strings = {
+            "Not supported on this platform",
+            "Failed to open the shared segment",
+            "The shared segment was created by an incompatible version",
+            "Too many instances on this host",
+        };
+
+        warn("Tick staggering disabled: {}.\n", strings[result.error().type]);
+        return false;
+    }
+
+    return true;
 }
 
-template <class... Args>
-void info(fmt::format_string<Args...> fmt, Args &&...args) noexcept
+[[nodiscard]] std::string_view net_error_str(NetError error) noexcept
 {
-    std::fprintf(stdout, "[Tickrate] [info] %s", fmt::format(fmt, std::forward<Args>(args)...).c_str());
-    std::fflush(stdout);
+    constexpr std::array<std::string_view, 5> strings = {
+        "Not supported on this platform",
+        "Neither the engine nor tier0 imports `recvfrom` or `sendto`",
+        "Failed to hook `recvfrom` or `sendto`",
+        "`recvfrom` isn't imported by the engine or tier0, or couldn't be hooked",
+        "`sendto` isn't imported by the engine or tier0, or couldn't be hooked",
+    };
+
+    return strings[error.type];
 }
 
-template <class T = u8 *>
-T get_virtual(const void *object, u16 index) noexcept
+[[nodiscard]] bool enable_align() noexcept
 {
-    return (*(T **)object)[index];
+    if (auto result = align_start(1000000000 / g_desired_tickrate); !result)
+    {
+        warn("Tick alignment disabled: {}.\n", net_error_str(result.error()));
+        return false;
+    }
+
+    info("Aligning ticks to client command arrival.\n");
+    return true;
 }
 
-[[nodiscard]] std::string_view safetyhookinline_error_str(const SafetyHookInline::Error &error) noexcept
+void enable_batch_receive() noexcept
 {
-    constexpr std::array<std::string_view, 7> strings_inline_hook = {
-        "BAD_ALLOCATION",
-        "FAILED_TO_DECODE_INSTRUCTION",
-        "SHORT_JUMP_IN_TRAMPOLINE",
-        "IP_RELATIVE_INSTRUCTION_OUT_OF_RANGE",
-        "UNSUPPORTED_INSTRUCTION_IN_TRAMPOLINE",
-        "FAILED_TO_UNPROTECT",
-        "NOT_ENOUGH_SPACE",
-    };
+    if (auto result = net_hook(NET_RECV_BATCH); !result)
+    {
+        warn("Batched receive disabled: {}.\n", net_error_str(result.error()));
+        return;
+    }
+
+    net_enable(NET_RECV_BATCH);
 
-    return strings_inline_hook[error.type];
+    info("Receiving up to {} datagrams per syscall.\n", NET_BATCH_SIZE);
 }
 
-[[nodiscard]] std::string_view zyan_status_str(ZyanStatus status) noexcept
+// The queue is flushed on the first clock read after the engine sent its snapshots, `GameFrame` runs before they're sent.
+[[nodiscard]] bool enable_batch_send() noexcept
 {
-    // Taken from: https://github.com/zyantific/zydis/blob/v4.1.1/tools/ZydisToolsShared.c#L79-L151
-    constexpr std::array<std::string_view, 12> strings_zycore = {/* 00 */ "SUCCESS",
-                                                                 /* 01 */ "FAILED",
-                                                                 /* 02 */ "TRUE",
-                                                                 /* 03 */ "FALSE",
-                                                                 /* 04 */ "INVALID_ARGUMENT",
-                                                                 /* 05 */ "INVALID_OPERATION",
-                                                                 /* 06 */ "NOT_FOUND",
-                                                                 /* 07 */ "OUT_OF_RANGE",
-                                                                 /* 08 */ "INSUFFICIENT_BUFFER_SIZE",
-                                                                 /* 09 */ "NOT_ENOUGH_MEMORY",
-                                                                 /* 0A */ "NOT_ENOUGH_MEMORY",
-                                                                 /* 0B */ "BAD_SYSTEMCALL"};
-
-    constexpr std::array<std::string_view, 13> strings_zydis = {/* 00 */ "NO_MORE_DATA",
-                                                                /* 01 */ "DECODING_ERROR",
-                                                                /* 02 */ "INSTRUCTION_TOO_LONG",
-                                                                /* 03 */ "BAD_REGISTER",
-                                                                /* 04 */ "ILLEGAL_LOCK",
-                                                                /* 05 */ "ILLEGAL_LEGACY_PFX",
-                                                                /* 06 */ "ILLEGAL_REX",
-                                                                /* 07 */ "INVALID_MAP",
-                                                                /* 08 */ "MALFORMED_EVEX",
-                                                                /* 09 */ "MALFORMED_MVEX",
-                                                                /* 0A */ "INVALID_MASK",
-                                                                /* 0B */ "SKIP_TOKEN",
-                                                                /* 0C */ "IMPOSSIBLE_INSTRUCTION"};
-
-    // if (ZYAN_STATUS_MODULE(status) >= ZYAN_MODULE_USER)
-    // {
-    //     return "User";
-    // }
-
-    if (ZYAN_STATUS_MODULE(status) == ZYAN_MODULE_ZYCORE)
-    {
-        status = ZYAN_STATUS_CODE(status);
-        return status < strings_zycore.size() ? strings_zycore[status] : "";
-    }
-
-    if (ZYAN_STATUS_MODULE(status) == ZYAN_MODULE_ZYDIS)
-    {
-        status = ZYAN_STATUS_CODE(status);
-        return status < strings_zydis.size() ? strings_zydis[status] : "";
-    }
-
-    return {};
+    if (auto result = net_hook(NET_SEND_BATCH); !result)
+    {
+        warn("Batched sends disabled: {}.\n", net_error_str(result.error()));
+        return false;
+    }
+
+    net_enable(NET_SEND_BATCH);
+    clock_set_read_callback(net_flush);
+
+    info("Sending up to {} datagrams per syscall.\n", NET_BATCH_SIZE);
+    return true;
 }
 
-struct Disasm
+[[nodiscard]] bool enable_catch_up_limit() noexcept
 {
-    struct Error
+    auto max_ticks = config_get<u32>("-tickrate_maxticks", 0);
+    if (max_ticks == 0)
     {
-        u8        *ip{};
-        ZyanStatus status{ZYAN_STATUS_FAILED};
+        warn("Catch-up limit disabled: `-tickrate_maxticks` must be at least 1.\n");
+        return false;
+    }
 
-        [[nodiscard]] auto status_str() const noexcept
-        {
-            return zyan_status_str(status);
-        }
-    };
+    auto mode_name = config_value("-tickrate_catchup").value_or("drop");
+    auto mode      = CLOCK_CATCHUP_DROP;
+    if (mode_name == "dilate")
+    {
+        mode = CLOCK_CATCHUP_DILATE;
+    }
+    else if (mode_name != "drop")
+    {
+        warn("Unknown `-tickrate_catchup` mode `{}`, using `drop`.\n", mode_name);
+        mode_name = "drop";
+    }
 
-    u8                     *ip{};
-    ZydisDecodedInstruction ix;
-    ZydisDecodedOperand     operands[ZYDIS_MAX_OPERAND_COUNT];
-};
+    clock_set_catch_up_limit(1000000000 / g_desired_tickrate, max_ticks, mode);
+
+    info("Catch-up limited to {} ticks per frame ({}).\n", max_ticks, mode_name);
+    return true;
+}
+
+void enable_allocator() noexcept
+{
+    if (auto result = alloc_install(); !result)
+    {
+        constexpr std::array<std::string_view, 5> strings = {
+            "Not supported on this platform",
+            "Failed to find tier0",
+            "Failed to find `g_pMemAlloc`",
+            "Failed to keep the plugin loaded",
+            "Failed to hook `g_pMemAlloc`",
+        };
+
+        warn("Allocator disabled: {}.\n", strings[result.error().type]);
+        return;
+    }
+
+    info("Replaced tier0's allocator, blocks up to {} bytes come from per-thread caches.\n", ALLOC_MAX_SMALL);
+}
+
+void enable_memprof() noexcept
+{
+    auto interval = std::max<u32>(config_get<u32>("-tickrate_memprof_interval", 10), 1);
+    auto top      = config_get<u32>("-tickrate_memprof_top", 10);
+
+    if (auto result = memprof_start((u64)interval * 1000000000, top); !result)
+    {
+        constexpr std::array<std::string_view, 5> strings = {
+            "Not supported on this platform",
+            "Failed to find tier0",
+            "Failed to find `g_pMemAlloc`",
+            "Failed to keep the plugin loaded",
+            "Failed to hook `g_pMemAlloc`",
+        };
+
+        warn("Allocation profiler disabled: {}.\n", strings[result.error().type]);
+        return;
+    }
+
+    info("Profiling allocations, the top {} sites are logged every {} s.\n", top, interval);
+}
 
-[[nodiscard]] tl::expected<Disasm, Disasm::Error> disasm(u8 *ip, usize len = ZYDIS_MAX_INSTRUCTION_LENGTH) noexcept
+void enable_async_spew() noexcept
 {
-    static ZydisDecoder decoder;
-    if (static bool once{}; !once)
+    std::vector<std::string> groups{};
+    for (auto &&group : str_split(config_value("-tickrate_spewfilter").value_or(""), ','))
     {
-#if TR_ARCH_X86_64
-        auto status = ZydisDecoderInit(&decoder, ZYDIS_MACHINE_MODE_LONG_64, ZYDIS_STACK_WIDTH_64);
-#else
-        auto status = ZydisDecoderInit(&decoder, ZYDIS_MACHINE_MODE_LEGACY_32, ZYDIS_STACK_WIDTH_32);
-#endif
-        if (ZYAN_SUCCESS(status) == ZYAN_FALSE)
+        if (!group.empty())
         {
-            return tl::unexpected{Disasm::Error{ip, status}};
+            groups.emplace_back(std::move(group));
         }
+    }
 
-        once = true;
+    usize filtered = groups.size();
+    if (auto result = spew_start(std::move(groups)); !result)
+    {
+        constexpr std::array<std::string_view, 4> strings = {
+            "Not supported on this platform",
+            "Failed to find tier0",
+            "Failed to find `SpewOutputFunc`",
+            "Failed to redirect stdout",
+        };
+
+        warn("Asynchronous console output disabled: {}.\n", strings[result.error().type]);
+        return;
     }
 
-    Disasm result{};
-    auto   status = ZydisDecoderDecodeFull(&decoder, ip, len, &result.ix, result.operands);
-    if (ZYAN_SUCCESS(status) == ZYAN_FALSE)
+    info("Console output is written by a background thread ({} MiB buffer, {} groups filtered).\n", SPEW_BUFFER_SIZE >> 20, filtered);
+}
+
+void enable_fasttime() noexcept
+{
+    auto result = fasttime_install();
+    if (!result)
     {
-        return tl::unexpected{Disasm::Error{ip, status}};
+        constexpr std::array<std::string_view, 6> strings = {
+            "Not supported on this platform",
+            "`CLOCK_MONOTONIC_RAW` isn't available",
+            "Failed to find tier0",
+            "Failed to find `Plat_FloatTime`",
+            "Failed to keep the plugin loaded",
+            "Failed to hook `Plat_FloatTime`",
+        };
+
+        warn("Fast engine time disabled: {}.\n", strings[result.error().type]);
+        return;
     }
 
-    result.ip = ip;
+    if (result->source == FASTTIME_TSC)
+    {
+        info("Engine time comes from the TSC ({:.3f} GHz, self-test {:.1f} ppm).\n", result->tsc_hz / 1e9, result->error_ppm);
+    }
+    else
+    {
+        info("Engine time comes from the vDSO (`CLOCK_MONOTONIC_RAW`), the TSC isn't used: {}.\n", fasttime_tsc_status_str(result->tsc_status));
+    }
+}
 
-    return result;
+void enable_plugin_cost(const IServerPluginCallbacks *self) noexcept
+{
+    auto interval = std::max<u32>(config_get<u32>("-tickrate_plugincost_interval", 60), 1);
+
+    if (auto result = plugincost_start(self, (u64)interval * 1000000000); !result)
+    {
+        constexpr std::array<std::string_view, 2> strings = {
+            "Failed to find `ISERVERPLUGINHELPERS001` interface",
+            "The engine's plugin list isn't laid out as expected",
+        };
+
+        warn("Plugin callback cost disabled: {}.\n", strings[result.error().type]);
+        return;
+    }
+
+    info("Timing the callbacks of other plugins, logged every {} s.\n", interval);
 }
 
-template <class Pred>
-tl::expected<Disasm, Disasm::Error> disasm_for_each(u8 *ip, usize len, Pred &&pred) noexcept
+void apply_numa_placement() noexcept
+{
+    auto result = numa_place();
+    if (!result)
+    {
+        constexpr std::array<std::string_view, 5> strings = {
+            "Not supported on this platform",
+            "Only one node",
+            "The main thread isn't pinned to a single node",
+            "Failed to read `/proc/self/maps`",
+            "Failed to set the memory policy",
+        };
+
+        warn("NUMA placement skipped: {}.\n", strings[result.error().type]);
+        return;
+    }
+
+    info(
+        "NUMA placement: node {}, moved {}/{} resident pages ({} failed), remote {:.1f}% -> {:.1f}% ({:.2f} ms).\n",
+        result->node,
+        result->pages_moved,
+        result->pages,
+        result->pages_failed,
+        result->remote_before * 100.0,
+        result->remote_after * 100.0,
+        result->ms);
+}
+
+void enable_memory_lock() noexcept
 {
-    u8 *end = ip + len;
+    auto limit = (u64)std::max<u32>(config_get<u32>("-tickrate_mlock_limit", 4096), 1) << 20;
 
-    for (u8 *i = ip; i < end;)
+    auto result = residency_lock(limit);
+    if (!result)
     {
-        auto result = disasm(i, end - i);
+        warn("Memory lock disabled: {}.\n", residency_error_str(result.error()));
+        return;
+    }
+
+    info(
+        "Locked the server's memory, {} MiB mapped with a limit of {} MiB{}.\n",
+        result->mapped >> 20,
+        result->limit >> 20,
+        result->on_fault ? "" : " (no `MCL_ONFAULT`, everything mapped was made resident)");
+}
+
+// Huge pages first, so the prefault gets them.
+void apply_memory_residency() noexcept
+{
+    if (config_has("-tickrate_hugepages"))
+    {
+        auto min_size = (u64)std::max<u32>(config_get<u32>("-tickrate_hugepages_min", 8), 4) << 20;
+
+        auto result = residency_advise_huge_pages(min_size);
         if (!result)
         {
-            return tl::unexpected{result.error()};
+            warn("Transparent huge pages skipped: {}.\n", residency_error_str(result.error()));
         }
-
-        auto &&value = *result;
-        if (pred(value))
+        else
         {
-            return value;
+            info(
+                "Advised transparent huge pages on {} regions ({} MiB, {} failed){}.\n",
+                result->regions,
+                result->bytes >> 20,
+                result->failed,
+                result->always ? ", they're enabled for everything anyway" : "");
         }
-
-        i += value.ix.length;
     }
 
-    // This means we've scanned everything successfully but the predicate didn't return.
-    return tl::unexpected{Disasm::Error{ip}};
+    if (config_has("-tickrate_prefault"))
+    {
+        auto limit = (u64)config_get<u32>("-tickrate_prefault_limit", 1024) << 20;
+
+        auto result = residency_prefault(limit);
+        if (!result)
+        {
+            warn("Prefault skipped: {}.\n", residency_error_str(result.error()));
+        }
+        else
+        {
+            info(
+                "Prefaulted the stack and {} MiB in {} regions ({} failed), {} pages weren't resident ({:.2f} ms){}{}.\n",
+                result->bytes >> 20,
+                result->regions,
+                result->failed,
+                result->faults,
+                result->ms,
+                result->truncated ? ", stopped at `-tickrate_prefault_limit`" : "",
+                result->populated ? "" : ", only swapped out pages were read back (populating needs Linux 5.14)");
+        }
+    }
 }
 
-// Engine.
-class InterfaceReg
+void enable_fault_counting() noexcept
 {
-public:
-    InstantiateInterfaceFn m_CreateFn;
-    cstr                   m_pName;
-    InterfaceReg          *m_pNext;
-};
+    auto interval = std::max<u32>(config_get<u32>("-tickrate_faults_interval", 10), 1);
 
-class CServerGameDLL
-{
-public:
-};
+    if (auto result = residency_start((u64)interval * 1000000000); !result)
+    {
+        warn("Page fault counting disabled: {}.\n", residency_error_str(result.error()));
+        return;
+    }
 
-// ISERVERPLUGINCALLBACKS003
-class IServerPluginCallbacks
-{
-public:
-    virtual bool          Load(CreateInterfaceFn interface_factory, CreateInterfaceFn gameserver_factory)                               = 0;
-    virtual void          Unload()                                                                                                      = 0;
-    virtual void          Pause()                                                                                                       = 0;
-    virtual void          UnPause()                                                                                                     = 0;
-    virtual cstr          GetPluginDescription()                                                                                        = 0;
-    virtual void          LevelInit(cstr map_name)                                                                                      = 0;
-    virtual void          ServerActivate(edict_t *edict_list, i32 edict_count, i32 client_max)                                          = 0;
-    virtual void          GameFrame(bool simulating)                                                                                    = 0;
-    virtual void          LevelShutdown()                                                                                               = 0;
-    virtual void          ClientActive(edict_t *edict)                                                                                  = 0;
-    virtual void          ClientDisconnect(edict_t *edict)                                                                              = 0;
-    virtual void          ClientPutInServer(edict_t *edict, cstr player_name)                                                           = 0;
-    virtual void          SetCommandClient(i32 index)                                                                                   = 0;
-    virtual void          ClientSettingsChanged(edict_t *edict)                                                                         = 0;
-    virtual PLUGIN_RESULT ClientConnect(bool *allow_connect, edict_t *edict, cstr name, cstr address, char *reject, i32 max_reject_len) = 0;
-    virtual PLUGIN_RESULT ClientCommand(edict_t *edict, const CCommand &args)                                                           = 0;
-    virtual PLUGIN_RESULT NetworkIDValidated(cstr username, cstr network_id)                                                            = 0;
-    virtual void
-    OnQueryCvarValueFinished(QueryCvarCookie_t cookie, edict_t *edict, EQueryCvarValueStatus status, cstr cvar_name, cstr cvar_value) = 0;
-    virtual void OnEdictAllocated(edict_t *edict)                                                                                     = 0;
-    virtual void OnEdictFreed(edict_t *edict)                                                                                         = 0;
-};
+    info("Counting page faults of the main thread, logged every {} s that had any.\n", interval);
+}
 
-class IGameEventListener
+void enable_sampler() noexcept
 {
-public:
-    virtual ~IGameEventListener() noexcept       = default;
-    virtual void FireGameEvent(KeyValues *event) = 0;
-};
+    auto hz     = config_get<u32>("-tickrate_sampler_hz", 1000);
+    auto output = config_value("-tickrate_sampler_output").value_or("tickrate_overruns.folded");
 
-// Global variables, etc.
-u16              g_desired_tickrate{};
-SafetyHookInline g_GetTickInterval_hook{};
+    if (auto result = sampler_start(hz, std::string{output}); !result)
+    {
+        constexpr std::array<std::string_view, 5> strings = {
+            "Not supported on this platform",
+            "`perf_event_open` isn't allowed (check `kernel.perf_event_paranoid`, or the container's seccomp profile)",
+            "Failed to open the perf event",
+            "Failed to map the perf buffer",
+            "Failed to enable the perf event",
+        };
+
+        warn("Overrun sampler disabled: {}.\n", strings[result.error().type]);
+        return;
+    }
 
-class Hooked_CServerGameDLL : public CServerGameDLL
+    info("Sampling the main thread at {} Hz, overrun stacks go to `{}`.\n", hz, output);
+}
+
+void enable_pmu() noexcept
 {
-public:
-    static f32 TR_THISCALL hooked_GetTickInterval([[maybe_unused]] CServerGameDLL *instance) noexcept
+    if (auto result = pmu_open(); !result)
     {
-        f32 interval = 1.0f / (f32)g_desired_tickrate;
-
-        return interval;
+        constexpr std::array<std::string_view, 3> strings = {
+            "No hardware counters (not Linux, or a VM without a virtual PMU)",
+            "`perf_event_open` isn't allowed (check `kernel.perf_event_paranoid`, or the container's seccomp profile)",
+            "Failed to open the counters",
+        };
+
+        warn("Hardware counters disabled: {}.\n", strings[result.error().type]);
+        return;
     }
-};
+
+    info("Hardware counters enabled ({}).\n", pmu_uses_rdpmc() ? "read with `rdpmc`" : "read with a syscall per tick");
+}
 
 class TickratePlugin final : public IServerPluginCallbacks,
                              public IGameEventListener
@@ -280,6 +623,8 @@ public:
     {
         info("Loading...\n");
 
+        u64 load_start = timing_now_ns();
+
         u8 *server_createinterface = (u8 *)gameserver_factory;
         u8 *server_module          = os_get_module(server_createinterface);
         if (server_module == nullptr)
@@ -295,17 +640,9 @@ public:
             return false;
         }
 
-        std::string_view tickrate_value{};
-        for (usize i{}; i < cmdline.size(); ++i)
-        {
-            // Next entry should be the value.
-            if (cmdline[i] == "-tickrate" && i + 1 < cmdline.size())
-            {
-                tickrate_value = cmdline[i + 1];
-                break;
-            }
-        }
+        config_init(std::move(cmdline));
 
+        std::string_view tickrate_value = config_value("-tickrate").value_or(std::string_view{});
         if (tickrate_value.empty())
         {
             error("Bad tickrate: Failed to find `-tickrate` command line string.\n");
@@ -344,120 +681,307 @@ public:
 
         info("Desired tickrate is {}.\n", g_desired_tickrate);
 
-        InterfaceReg *regs;
+        // The server module must work, the others are best effort.
+        if (auto result = iface_add_module(server_module, server_createinterface); !result)
+        {
+            auto &&err = result.error();
+            switch (err.type)
+            {
+                case IfaceError::BAD_THUNK:
+                    error("Failed to decode first instruction in `CreateInterface`: {}\n", err.disasm.status_str());
+                    break;
+                case IfaceError::NO_REGS_INSTRUCTION:
+                    error("Failed to find instruction containing `s_pInterfaceRegs`: {}\n", err.disasm.status_str());
+                    break;
+                default:
+                    error("Failed to find `s_pInterfaceRegs` (null).\n");
+                    break;
+            }
+
+            return false;
+        }
+
+        (void)iface_add_module(os_get_module((u8 *)interface_factory), (u8 *)interface_factory);
+        iface_add_default_modules();
 
-        // Check for the `s_pInterfaceRegs` symbol first.
-        if (u8 *regs_symbol = os_get_procedure(server_module, "s_pInterfaceRegs"); regs_symbol != nullptr)
+        // Newest version wins if a module ever registers more than one.
+        auto *servergame = iface_get<CServerGameDLL>("ServerGameDLL");
+        if (servergame == nullptr)
         {
-            regs = *(InterfaceReg **)regs_symbol;
+            error("Failed to find `ServerGameDLL` interface.\n");
+            return false;
         }
-        else
+
+        // Only needed for the rate ConVars, so it's not fatal. Our declaration matches version 4 exactly.
+        g_cvar = (ICvar *)interface_factory("VEngineCvar004", nullptr);
+        if (g_cvar == nullptr)
         {
-            // No symbol was found so we have to disasm manually.
-            // First we check for a jump thunk. Some versions of the game have this for some reason. If there isn't one then we don't worry about it.
-            for (;;)
-            {
-                auto thunk_disasm_result = disasm(server_createinterface);
-                if (!thunk_disasm_result)
-                {
-                    error("Failed to decode first instruction in `CreateInterface`: {}\n", thunk_disasm_result.error().status_str());
-                    return false;
-                }
+            g_cvar = iface_get<ICvar>("VEngineCvar", 4);
+        }
 
-                auto &&thunk_disasm = *thunk_disasm_result;
-                if (thunk_disasm.ix.mnemonic != ZYDIS_MNEMONIC_JMP)
-                {
-                    break;
-                }
+        if (g_cvar == nullptr)
+        {
+            warn("Failed to find `VEngineCvar004` interface, rate ConVars won't be adjusted.\n");
+        }
 
-                server_createinterface += thunk_disasm.ix.length + (i32)thunk_disasm.operands[0].imm.value.s;
-            }
+        info("Applying hooks...\n");
 
-            // Find the first `mov reg, mem`.
-            auto regs_disasm_result = disasm_for_each(
-                server_createinterface,
-                ZYDIS_MAX_INSTRUCTION_LENGTH * 25, // I hope this is enough :P
-                [](auto &&result) noexcept
-                {
-                    // x86-64 is RIP-relative. x86-32 is absolute.
-                    constexpr ZyanU16 op_size  = TR_ARCH_X86_64 == 1 ? 64 : 32;
-                    constexpr auto    mem_base = TR_ARCH_X86_64 == 1 ? ZYDIS_REGISTER_RIP : ZYDIS_REGISTER_NONE;
-
-                    return result.ix.mnemonic == ZYDIS_MNEMONIC_MOV && result.ix.operand_count_visible == 2
-                        && result.operands[0].type == ZYDIS_OPERAND_TYPE_REGISTER && result.operands[0].size == op_size
-                        && result.operands[1].type == ZYDIS_OPERAND_TYPE_MEMORY && result.operands[1].size == op_size
-                        && result.operands[1].mem.segment == ZYDIS_REGISTER_DS && result.operands[1].mem.base == mem_base;
-                });
-            if (!regs_disasm_result)
+        // The engine only calls `GetTickInterval` through the VMT, so patching the slot is enough.
+        // It's expected to be index 10, but verify it (and look around it) instead of trusting that.
+        constexpr usize GetTickInterval_index_hint = 10;
+        constexpr usize max_method_count           = 64;
+
+        u8  **servergame_vmt = *(u8 ***)servergame;
+        usize method_count{};
+
+        // Prefer the RTTI catalog's method count, counting by hand has to query memory protection.
+        if (auto *catalog = rtti_get_catalog(server_module); catalog != nullptr)
+        {
+            if (auto *vtable = catalog->find_by_vmt(servergame_vmt); vtable != nullptr)
             {
-                error("Failed to find instruction containing `s_pInterfaceRegs`: {}\n", regs_disasm_result.error().status_str());
-                return false;
+                method_count = vtable->method_count;
             }
+        }
+
+        if (method_count == 0)
+        {
+            method_count = vmt_count_methods(servergame_vmt);
+        }
 
-            auto &&regs_disasm = *regs_disasm_result;
+        method_count = std::min(method_count, max_method_count);
 
-            // x86-64 is RIP-relative. x86-32 is absolute.
-#if TR_ARCH_X86_64
-            regs = *(InterfaceReg **)(regs_disasm.ip + regs_disasm.ix.length + (i32)regs_disasm.operands[1].mem.disp.value);
-#else
-            regs = *(InterfaceReg **)((usize)regs_disasm.operands[1].mem.disp.value);
-#endif
+        auto GetTickInterval_index = find_virtual_index(servergame_vmt, method_count, GetTickInterval_index_hint, is_tick_interval_getter);
+        if (!GetTickInterval_index)
+        {
+            error("Failed to find `CServerGameDLL::GetTickInterval` in the VMT ({} methods).\n", method_count);
+            return false;
         }
 
-        if (regs == nullptr)
+        if (*GetTickInterval_index != GetTickInterval_index_hint)
         {
-            error("Failed to find `s_pInterfaceRegs` (null).\n");
+            info("Found `CServerGameDLL::GetTickInterval` at VMT index {} (expected {}).\n", *GetTickInterval_index, GetTickInterval_index_hint);
+        }
+
+        auto hook_result = VmtSlotHook::create(servergame_vmt, *GetTickInterval_index, Hooked_CServerGameDLL::hooked_GetTickInterval);
+        if (!hook_result)
+        {
+            error("Failed to hook `CServerGameDLL::GetTickInterval` VMT entry (index {}).\n", *GetTickInterval_index);
             return false;
         }
 
-        // TODO: If this becomes an issue, we can just search for latest version... but for now, only the latest should be exist.
-        CServerGameDLL *servergame{};
+        g_GetTickInterval_hook = std::move(*hook_result);
 
-        for (auto *it = regs; it != nullptr; it = it->m_pNext)
+        // `GameFrame` is 5 slots before `GetTickInterval` in every version of the interface, only used to time the tick's work.
+        constexpr usize GameFrame_offset = 5;
+        if (*GetTickInterval_index >= GameFrame_offset)
         {
-            if (it->m_pName == nullptr)
+            usize GameFrame_index = *GetTickInterval_index - GameFrame_offset;
+            if (auto result = VmtSlotHook::create(servergame_vmt, GameFrame_index, Hooked_CServerGameDLL::hooked_GameFrame))
             {
-                continue;
+                g_GameFrame_hook = std::move(*result);
+            }
+            else
+            {
+                warn("Failed to hook `CServerGameDLL::GameFrame` VMT entry (index {}), tick work won't be measured.\n", GameFrame_index);
+            }
+        }
+
+        tickstats_reset(1000000000 / g_desired_tickrate);
+
+        // As early as possible, blocks allocated before the swap stay with tier0's allocator.
+        if (config_has("-tickrate_alloc"))
+        {
+            enable_allocator();
+        }
+
+        // After the allocator, it wraps whatever is in the slots.
+        if (config_has("-tickrate_memprof"))
+        {
+            enable_memprof();
+        }
+
+        if (config_has("-tickrate_asyncspew"))
+        {
+            enable_async_spew();
+        }
+
+        // Must be on the main thread, which `Load` is.
+        if (config_has("-tickrate_sampler"))
+        {
+            enable_sampler();
+        }
+
+        if (config_has("-tickrate_pmu"))
+        {
+            enable_pmu();
+        }
+
+        if (config_has("-tickrate_trace"))
+        {
+            auto path = config_value("-tickrate_trace_output").value_or("tickrate.trace");
+            if (auto result = trace_open(std::string{path}, 1000000000 / g_desired_tickrate); !result)
+            {
+                warn("Tick trace disabled: Failed to create `{}`.\n", path);
+            }
+            else
+            {
+                info("Recording tick timing to `{}`.\n", path);
             }
+        }
+
+        // The plugins are wrapped on the first tick, the engine adds us to its list after `Load`.
+        if (config_has("-tickrate_plugincost"))
+        {
+            enable_plugin_cost(this);
+        }
 
-            if (str_sv_contains(it->m_pName, "ServerGameDLL"))
+        if (config_has("-tickrate_edicts"))
+        {
+            edicts_start();
+            info("Tracking edict churn, summarized at the end of every map.\n");
+        }
+
+        if (config_has("-tickrate_metrics"))
+        {
+            // One page per server, named after the port it's on.
+            if (auto result = metrics_open(config_get<u16>("-port", 27015)); !result)
             {
-                servergame = (CServerGameDLL *)it->m_CreateFn();
-                break;
+                warn(
+                    "Metrics disabled: {}.\n",
+                    result.error().type == MetricsError::UNSUPPORTED ? "Not supported on this platform" : "Failed to create the metrics page");
             }
         }
 
-        if (servergame == nullptr)
+        // Before the clock, which hooks `Plat_FloatTime` on top of it.
+        if (config_has("-tickrate_fasttime"))
         {
-            error("Failed to find `ServerGameDLL` interface.\n");
-            return false;
+            enable_fasttime();
         }
 
-        info("Applying hooks...\n");
+        // Optional, the tickrate works without them.
+        bool stagger    = config_has("-tickrate_stagger");
+        bool align      = config_has("-tickrate_align");
+        bool catch_up   = config_has("-tickrate_maxticks");
+        bool batch_send = config_has("-tickrate_batchsend");
+        if ((stagger || align || catch_up || batch_send) && enable_clock())
+        {
+            bool staggered = stagger && enable_stagger();
+            bool aligned   = false;
+            if (align && staggered)
+            {
+                // Both set the tick phase.
+                warn("Tick alignment disabled: `-tickrate_stagger` is in use.\n");
+            }
+            else
+            {
+                aligned = align && enable_align();
+            }
 
-        // TODO: There's a chance that this virtual function might not always be index 10. Will need testing.
-        u8 *fn = get_virtual(servergame, 10);
+            bool limited = catch_up && enable_catch_up_limit();
+            bool batched = batch_send && enable_batch_send();
+            if (!staggered && !aligned && !limited && !batched)
+            {
+                clock_shutdown();
+            }
+        }
 
-        // TODO: Switch to global VMT hooks when it's available.
-        auto hook_result = safetyhook::InlineHook::create(fn, Hooked_CServerGameDLL::hooked_GetTickInterval);
-        if (!hook_result)
+        if (config_has("-tickrate_batchrecv"))
         {
-            auto &&err = hook_result.error();
-            error("Failed to hook `CServerGameDLL::GetTickInterval` function: {} @ 0x{:X}\n", safetyhookinline_error_str(err), (usize)err.ip);
+            enable_batch_receive();
+        }
 
-            return false;
+        if (config_has("-tickrate_numa"))
+        {
+            apply_numa_placement();
         }
 
-        g_GetTickInterval_hook = std::move(*hook_result);
+        // After NUMA placement, the pages faulted in land on the preferred node.
+        if (config_has("-tickrate_mlock"))
+        {
+            enable_memory_lock();
+        }
 
-        info("Loaded!\n");
+        apply_memory_residency();
+
+        if (config_has("-tickrate_faults"))
+        {
+            enable_fault_counting();
+        }
+
+        info("Loaded! ({:.2f} ms)\n", (f64)(timing_now_ns() - load_start) / 1e6);
 
         return true;
     }
 
     void Unload() noexcept override
     {
+        metrics_close();
+        trace_close();
+        plugincost_stop();
+        edicts_stop();
+        residency_stop();
+        memprof_stop();
+        sampler_stop();
+        pmu_end_map();
+        pmu_close();
+        stagger_leave();
+        align_stop();
+        net_unhook();
+        clock_shutdown();
+
+        if (clock_is_hooked())
+        {
+            info("The engine clock hook stays installed until the server exits, giving back its {:.2f} ms offset.\n", clock_offset() * 1000.0);
+        }
+
+        // After the clock, its hook calls this one, it stays under a clock hook that's still installed.
+        if (fasttime_is_installed() && !clock_is_hooked())
+        {
+            info(
+                "Engine time goes back to tier0's, stepping by {:.1f} us (TSC drift {:.2f} ppm).\n",
+                -fasttime_tier0_offset() * 1e6,
+                fasttime_drift_ppm());
+
+            fasttime_uninstall();
+        }
+
+        if (residency_is_locked())
+        {
+            residency_unlock();
+            info("Unlocked the server's memory.\n");
+        }
+
+        if (alloc_is_installed())
+        {
+            auto stats = alloc_stats();
+            info(
+                "The allocator stays installed until the server exits: {} chunks in {} threads, {} large and {} foreign blocks passed on.\n",
+                stats.chunks,
+                stats.threads,
+                stats.large,
+                stats.foreign);
+        }
+
+        // Last, so everything above is logged before stdout is put back.
+        if (spew_is_running())
+        {
+            spew_stop();
+
+            auto stats = spew_stats();
+            info(
+                "Console output: {} KiB written, {} KiB dropped in {} overflows, {} of {} messages filtered.\n",
+                stats.bytes / 1024,
+                stats.dropped_bytes / 1024,
+                stats.overflows,
+                stats.filtered,
+                stats.messages + stats.filtered);
+        }
+
         g_GetTickInterval_hook = {};
+        g_GameFrame_hook       = {};
+        g_cvar                 = nullptr;
+        iface_clear();
+        g_active_clients.clear();
 
         info("Unloaded.\n");
     }
@@ -471,17 +995,85 @@ public:
         return "Tickrate (angelfor3v3r)";
     }
 
-    void LevelInit(cstr map_name) noexcept override {}
+    void LevelInit(cstr map_name) noexcept override
+    {
+        tickstats_on_idle();
+        pmu_begin_map(map_name);
+        edicts_begin_map(map_name);
+
+        // Memory mapped since the last placement (other threads aren't covered by the policy), what was placed before isn't walked again.
+        if (config_has("-tickrate_numa"))
+        {
+            apply_numa_placement();
+        }
+    }
+
+    void ServerActivate(edict_t *edict_list, i32 edict_count, i32 client_max) noexcept override
+    {
+        g_max_clients = client_max;
+
+        // Server configs have been executed by now, so this sees (and fixes) the operator's values.
+        if (!config_has("-tickrate_norates"))
+        {
+            rates_apply(g_cvar, g_desired_tickrate, client_max);
+        }
+
+        // The map is loaded, much of what it allocated hasn't been touched yet.
+        apply_memory_residency();
+        residency_skip_faults();
+    }
+
+    void GameFrame(bool simulating) noexcept override
+    {
+        if (!simulating)
+        {
+            tickstats_on_idle();
+            clock_on_idle();
+            trace_record_idle(timing_now_ns());
+            return;
+        }
 
-    void ServerActivate(edict_t *edict_list, i32 edict_count, i32 client_max) noexcept override {}
+        u64 now = timing_now_ns();
+        auto tick = tickstats_on_tick(now);
+        sampler_on_tick(tick, now);
+        trace_record_tick(now, tick, (u32)g_active_clients.size());
+        pmu_on_tick((u32)g_active_clients.size());
+        edicts_on_tick();
+        net_on_tick(now);
+        memprof_on_tick(now);
+        plugincost_on_tick(now);
+        residency_on_tick(now);
+
+        if (clock_is_hooked())
+        {
+            stagger_update(now);
+            align_update(now);
+            clock_on_tick(now);
+        }
 
-    void GameFrame(bool simulating) noexcept override {}
+        MetricsSample sample{};
+        sample.tickrate                = (f64)g_desired_tickrate;
+        sample.players                 = (u32)g_active_clients.size();
+        sample.max_players             = (u32)std::max(g_max_clients, 0);
+        sample.get_tick_interval_calls = g_GetTickInterval_calls.load(std::memory_order_relaxed);
+        metrics_publish(now, sample);
+    }
 
-    void LevelShutdown() noexcept override {}
+    void LevelShutdown() noexcept override
+    {
+        pmu_end_map();
+        edicts_end_map();
+    }
 
-    void ClientActive(edict_t *edict) noexcept override {}
+    void ClientActive(edict_t *edict) noexcept override
+    {
+        g_active_clients.insert(edict, true);
+    }
 
-    void ClientDisconnect(edict_t *edict) noexcept override {}
+    void ClientDisconnect(edict_t *edict) noexcept override
+    {
+        g_active_clients.erase(edict);
+    }
 
     void ClientPutInServer(edict_t *edict, cstr player_name) noexcept override {}
 
@@ -509,9 +1101,16 @@ public:
         QueryCvarCookie_t cookie, edict_t *edict, EQueryCvarValueStatus status, cstr cvar_name, cstr cvar_value) noexcept override
     {}
 
-    void OnEdictAllocated(edict_t *edict) noexcept override {}
+    void OnEdictAllocated(edict_t *edict) noexcept override
+    {
+        edicts_on_allocated(edict);
+    }
 
-    void OnEdictFreed(edict_t *edict) noexcept override {}
+    void OnEdictFreed(edict_t *edict) noexcept override
+    {
+        vmt_forget_owner(edict);
+        edicts_on_freed(edict);
+    }
 
     void FireGameEvent(KeyValues *event) noexcept override {}
 };
@@ -0,0 +1,488 @@
+#include "memprof.hpp"
+#include "common.hpp"
+#include "engine.hpp"
+#include "os.hpp"
+#include "vmt.hpp"
+#include "iface.hpp"
+#include "log.hpp"
+#include "timing.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace
+{
+#if TR_OS_LINUX
+    using AllocFn        = void *(TR_THISCALL *)(void *self, usize size);
+    using ReallocFn      = void *(TR_THISCALL *)(void *self, void *block, usize size);
+    using FreeFn         = void(TR_THISCALL *)(void *self, void *block);
+    using AllocDebugFn   = void *(TR_THISCALL *)(void *self, usize size, cstr file_name, i32 line);
+    using ReallocDebugFn = void *(TR_THISCALL *)(void *self, void *block, usize size, cstr file_name, i32 line);
+    using FreeDebugFn    = void(TR_THISCALL *)(void *self, void *block, cstr file_name, i32 line);
+
+    // Open addressing, a site that doesn't find a slot within this many is only counted in the totals.
+    constexpr usize MAX_PROBES = 16;
+
+    struct Site
+    {
+        std::atomic<usize> address;
+        std::atomic<u64>   allocs;
+        std::atomic<u64>   frees;
+        std::atomic<u64>   bytes;
+    };
+
+    // Only written by the thread that claimed it, the main thread reads it.
+    struct ThreadCounters
+    {
+        std::atomic<u64>                    allocs;
+        std::atomic<u64>                    frees;
+        std::atomic<u64>                    bytes;
+        std::array<Site, MEMPROF_MAX_SITES> sites;
+    };
+
+    struct Counts
+    {
+        u64 allocs{};
+        u64 frees{};
+        u64 bytes{};
+    };
+
+    struct State
+    {
+        std::array<VmtSlotHook, 6>                      hooks{};
+        AllocFn                                         alloc{};
+        ReallocFn                                       realloc{};
+        FreeFn                                          free{};
+        AllocDebugFn                                    alloc_debug{};
+        ReallocDebugFn                                  realloc_debug{};
+        FreeDebugFn                                     free_debug{};
+        std::array<ThreadCounters, MEMPROF_MAX_THREADS> threads{};
+        std::atomic<u32>                                thread_count{}; // Claimed, can go past `MEMPROF_MAX_THREADS`.
+        std::atomic<u64>                                shared_allocs{}; // Threads without counters of their own.
+        std::atomic<u64>                                shared_frees{};
+        std::atomic<u64>                                shared_bytes{};
+
+        // Main thread only.
+        bool                                   running{};
+        u64                                    interval_ns{};
+        u32                                    top{};
+        u64                                    next_report_ns{};
+        MemprofTick                            totals{};
+        MemprofTick                            last_tick{};
+        MemprofTick                            window{};
+        MemprofTick                            window_max{};
+        u64                                    window_ticks{};
+        std::unordered_map<usize, Counts>      reported{}; // Site counts at the last report.
+        std::unordered_map<usize, std::string> names{};
+    } g_memprof{};
+
+    // Claimed on a thread's first allocation, slots are never given back (the engine's threads live as long as it does).
+    thread_local ThreadCounters *g_thread_counters{};
+    thread_local bool            g_thread_claimed{};
+
+    // There's a single writer, a locked add isn't needed.
+    void bump(std::atomic<u64> &counter, u64 value) noexcept
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] ThreadCounters *thread_counters() noexcept
+    {
+        if (!g_thread_claimed)
+        {
+            g_thread_claimed = true;
+
+            u32 index         = g_memprof.thread_count.fetch_add(1, std::memory_order_acq_rel);
+            g_thread_counters = index < MEMPROF_MAX_THREADS ? &g_memprof.threads[index] : nullptr;
+        }
+
+        return g_thread_counters;
+    }
+
+    [[nodiscard]] Site *find_site(ThreadCounters &counters, usize address) noexcept
+    {
+        auto hash = (usize)(((u64)address * 0x9E3779B97F4A7C15) >> 32);
+        for (usize i{}; i < MAX_PROBES; ++i)
+        {
+            auto &&site    = counters.sites[(hash + i) % MEMPROF_MAX_SITES];
+            usize  current = site.address.load(std::memory_order_relaxed);
+            if (current == address)
+            {
+                return &site;
+            }
+
+            if (current == 0)
+            {
+                site.address.store(address, std::memory_order_release);
+                return &site;
+            }
+        }
+
+        return nullptr;
+    }
+
+    void record(void *return_address, u64 allocs, u64 frees, u64 bytes) noexcept
+    {
+        auto *counters = thread_counters();
+        if (counters == nullptr)
+        {
+            auto &&state = g_memprof;
+            state.shared_allocs.fetch_add(allocs, std::memory_order_relaxed);
+            state.shared_frees.fetch_add(frees, std::memory_order_relaxed);
+            state.shared_bytes.fetch_add(bytes, std::memory_order_relaxed);
+            return;
+        }
+
+        bump(counters->allocs, allocs);
+        bump(counters->frees, frees);
+        bump(counters->bytes, bytes);
+
+        if (auto *site = find_site(*counters, (usize)return_address); site != nullptr)
+        {
+            bump(site->allocs, allocs);
+            bump(site->frees, frees);
+            bump(site->bytes, bytes);
+        }
+    }
+
+    void *TR_THISCALL hooked_Alloc(void *self, usize size) noexcept
+    {
+        record(__builtin_return_address(0), 1, 0, size);
+        return g_memprof.alloc(self, size);
+    }
+
+    void *TR_THISCALL hooked_Realloc(void *self, void *block, usize size) noexcept
+    {
+        record(__builtin_return_address(0), size != 0 ? 1 : 0, block != nullptr ? 1 : 0, size);
+        return g_memprof.realloc(self, block, size);
+    }
+
+    void TR_THISCALL hooked_Free(void *self, void *block) noexcept
+    {
+        if (block != nullptr)
+        {
+            record(__builtin_return_address(0), 0, 1, 0);
+        }
+
+        g_memprof.free(self, block);
+    }
+
+    void *TR_THISCALL hooked_Alloc_debug(void *self, usize size, cstr file_name, i32 line) noexcept
+    {
+        record(__builtin_return_address(0), 1, 0, size);
+        return g_memprof.alloc_debug(self, size, file_name, line);
+    }
+
+    void *TR_THISCALL hooked_Realloc_debug(void *self, void *block, usize size, cstr file_name, i32 line) noexcept
+    {
+        record(__builtin_return_address(0), size != 0 ? 1 : 0, block != nullptr ? 1 : 0, size);
+        return g_memprof.realloc_debug(self, block, size, file_name, line);
+    }
+
+    void TR_THISCALL hooked_Free_debug(void *self, void *block, cstr file_name, i32 line) noexcept
+    {
+        if (block != nullptr)
+        {
+            record(__builtin_return_address(0), 0, 1, 0);
+        }
+
+        g_memprof.free_debug(self, block, file_name, line);
+    }
+
+    [[nodiscard]] usize claimed_threads() noexcept
+    {
+        return std::min<usize>(g_memprof.thread_count.load(std::memory_order_acquire), MEMPROF_MAX_THREADS);
+    }
+
+    [[nodiscard]] MemprofTick sum_totals() noexcept
+    {
+        auto &&state = g_memprof;
+
+        MemprofTick totals{};
+        totals.allocs = state.shared_allocs.load(std::memory_order_relaxed);
+        totals.frees  = state.shared_frees.load(std::memory_order_relaxed);
+        totals.bytes  = state.shared_bytes.load(std::memory_order_relaxed);
+
+        for (usize i{}; i < claimed_threads(); ++i)
+        {
+            auto &&counters = state.threads[i];
+            totals.allocs += counters.allocs.load(std::memory_order_relaxed);
+            totals.frees  += counters.frees.load(std::memory_order_relaxed);
+            totals.bytes  += counters.bytes.load(std::memory_order_relaxed);
+        }
+
+        return totals;
+    }
+
+    // Sites with a symbol are bucketed by it, the offset only tells call sites within a function apart.
+    [[nodiscard]] const std::string &site_name(usize address) noexcept
+    {
+        auto [it, inserted] = g_memprof.names.try_emplace(address);
+        if (inserted)
+        {
+            // The return address is right after the call, which can be the last instruction of the function.
+            auto name = os_describe_address((u8 *)address - 1);
+            if (auto plus = name.rfind("+0x"); plus != std::string::npos && name.find('!') != std::string::npos)
+            {
+                name.resize(plus);
+            }
+
+            it->second = std::move(name);
+        }
+
+        return it->second;
+    }
+
+    void report() noexcept
+    {
+        auto &&state = g_memprof;
+        if (state.window_ticks == 0)
+        {
+            return;
+        }
+
+        const auto ticks = (f64)state.window_ticks;
+
+        info(
+            "Allocations over {} ticks: {:.1f} per tick (max {}), {:.1f} frees, {:.1f} KiB (max {:.1f}).\n",
+            state.window_ticks,
+            (f64)state.window.allocs / ticks,
+            state.window_max.allocs,
+            (f64)state.window.frees / ticks,
+            (f64)state.window.bytes / ticks / 1024.0,
+            (f64)state.window_max.bytes / 1024.0);
+
+        // Every thread's sites, then what changed since the last report per bucket.
+        std::unordered_map<usize, Counts> current{};
+        for (usize i{}; i < claimed_threads(); ++i)
+        {
+            for (auto &&site : state.threads[i].sites)
+            {
+                usize address = site.address.load(std::memory_order_acquire);
+                if (address == 0)
+                {
+                    continue;
+                }
+
+                auto &&counts  = current[address];
+                counts.allocs += site.allocs.load(std::memory_order_relaxed);
+                counts.frees  += site.frees.load(std::memory_order_relaxed);
+                counts.bytes  += site.bytes.load(std::memory_order_relaxed);
+            }
+        }
+
+        std::unordered_map<std::string_view, Counts> buckets{};
+        for (auto &&[address, counts] : current)
+        {
+            auto &&previous = state.reported[address];
+            if (counts.allocs == previous.allocs && counts.frees == previous.frees)
+            {
+                continue;
+            }
+
+            auto &&bucket  = buckets[site_name(address)];
+            bucket.allocs += counts.allocs - previous.allocs;
+            bucket.frees  += counts.frees - previous.frees;
+            bucket.bytes  += counts.bytes - previous.bytes;
+        }
+
+        state.reported = std::move(current);
+
+        std::vector<std::pair<std::string_view, Counts>> sites{buckets.begin(), buckets.end()};
+        std::sort(
+            sites.begin(),
+            sites.end(),
+            [](const auto &lhs, const auto &rhs) noexcept { return lhs.second.allocs > rhs.second.allocs; });
+
+        sites.resize(std::min<usize>(sites.size(), state.top));
+        for (auto &&[name, counts] : sites)
+        {
+            info(
+                "  {:>9.1f} allocs {:>9.1f} frees {:>9.1f} KiB per tick  {}\n",
+                (f64)counts.allocs / ticks,
+                (f64)counts.frees / ticks,
+                (f64)counts.bytes / ticks / 1024.0,
+                name);
+        }
+    }
+#endif
+} // namespace
+
+tl::expected<void, MemprofError> memprof_start([[maybe_unused]] u64 report_interval_ns, [[maybe_unused]] u32 top_sites) noexcept
+{
+#if TR_OS_LINUX
+    memprof_stop();
+
+    auto &&state = g_memprof;
+
+    u8 *tier0 = iface_get_default_module("tier0");
+    if (tier0 == nullptr)
+    {
+        return tl::unexpected{MemprofError{MemprofError::NO_TIER0}};
+    }
+
+    // An exported variable, the procedure is its address.
+    auto **mem_alloc = os_get_procedure<void **>(tier0, "g_pMemAlloc");
+    if (mem_alloc == nullptr || *mem_alloc == nullptr)
+    {
+        return tl::unexpected{MemprofError{MemprofError::NO_MEMALLOC}};
+    }
+
+    auto **vmt = *(u8 ***)*mem_alloc;
+    if (vmt_count_methods(vmt) <= IMEMALLOC_FREE_DEBUG)
+    {
+        return tl::unexpected{MemprofError{MemprofError::NO_MEMALLOC}};
+    }
+
+    // Other threads can still be inside a hook when `memprof_stop` puts the slots back, its code must outlive them.
+    if (!os_pin_module((u8 *)&memprof_start))
+    {
+        return tl::unexpected{MemprofError{MemprofError::FAILED_TO_PIN}};
+    }
+
+    // Threads keep their counters across restarts, only the counts start over. Nothing else writes them while unhooked.
+    for (usize i{}; i < claimed_threads(); ++i)
+    {
+        auto &&counters = state.threads[i];
+        counters.allocs.store(0, std::memory_order_relaxed);
+        counters.frees.store(0, std::memory_order_relaxed);
+        counters.bytes.store(0, std::memory_order_relaxed);
+
+        for (auto &&site : counters.sites)
+        {
+            site.address.store(0, std::memory_order_relaxed);
+            site.allocs.store(0, std::memory_order_relaxed);
+            site.frees.store(0, std::memory_order_relaxed);
+            site.bytes.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    state.shared_allocs.store(0, std::memory_order_relaxed);
+    state.shared_frees.store(0, std::memory_order_relaxed);
+    state.shared_bytes.store(0, std::memory_order_relaxed);
+
+    // The hooks call these as soon as they're in.
+    state.alloc         = (AllocFn)vmt[IMEMALLOC_ALLOC];
+    state.realloc       = (ReallocFn)vmt[IMEMALLOC_REALLOC];
+    state.free          = (FreeFn)vmt[IMEMALLOC_FREE];
+    state.alloc_debug   = (AllocDebugFn)vmt[IMEMALLOC_ALLOC_DEBUG];
+    state.realloc_debug = (ReallocDebugFn)vmt[IMEMALLOC_REALLOC_DEBUG];
+    state.free_debug    = (FreeDebugFn)vmt[IMEMALLOC_FREE_DEBUG];
+
+    auto hook = [&](usize slot, usize index, auto fn) noexcept
+    {
+        auto result = VmtSlotHook::create(vmt, index, fn);
+        if (result)
+        {
+            state.hooks[slot] = std::move(*result);
+        }
+
+        return result.has_value();
+    };
+
+    bool hooked = hook(0, IMEMALLOC_ALLOC, hooked_Alloc) && hook(1, IMEMALLOC_REALLOC, hooked_Realloc) &&
+                  hook(2, IMEMALLOC_FREE, hooked_Free) && hook(3, IMEMALLOC_ALLOC_DEBUG, hooked_Alloc_debug) &&
+                  hook(4, IMEMALLOC_REALLOC_DEBUG, hooked_Realloc_debug) && hook(5, IMEMALLOC_FREE_DEBUG, hooked_Free_debug);
+    if (!hooked)
+    {
+        for (auto &&slot : state.hooks)
+        {
+            slot = {};
+        }
+
+        return tl::unexpected{MemprofError{MemprofError::FAILED_TO_HOOK}};
+    }
+
+    state.running        = true;
+    state.interval_ns    = report_interval_ns;
+    state.top            = top_sites;
+    state.next_report_ns = timing_now_ns() + report_interval_ns;
+    state.totals         = {};
+    state.last_tick      = {};
+    state.window         = {};
+    state.window_max     = {};
+    state.window_ticks   = 0;
+    state.reported.clear();
+    state.names.clear();
+
+    return {};
+#else
+    return tl::unexpected{MemprofError{MemprofError::UNSUPPORTED}};
+#endif
+}
+
+void memprof_stop() noexcept
+{
+#if TR_OS_LINUX
+    auto &&state = g_memprof;
+    if (!state.running)
+    {
+        return;
+    }
+
+    for (auto &&hook : state.hooks)
+    {
+        hook = {};
+    }
+
+    // Whatever the last window has.
+    report();
+
+    state.running   = false;
+    state.last_tick = {};
+#endif
+}
+
+void memprof_on_tick([[maybe_unused]] u64 now_ns) noexcept
+{
+#if TR_OS_LINUX
+    auto &&state = g_memprof;
+    if (!state.running)
+    {
+        return;
+    }
+
+    auto totals = sum_totals();
+
+    MemprofTick tick{};
+    tick.allocs = totals.allocs - state.totals.allocs;
+    tick.frees  = totals.frees - state.totals.frees;
+    tick.bytes  = totals.bytes - state.totals.bytes;
+
+    state.totals    = totals;
+    state.last_tick = tick;
+
+    state.window.allocs     += tick.allocs;
+    state.window.frees      += tick.frees;
+    state.window.bytes      += tick.bytes;
+    state.window_max.allocs  = std::max(state.window_max.allocs, tick.allocs);
+    state.window_max.frees   = std::max(state.window_max.frees, tick.frees);
+    state.window_max.bytes   = std::max(state.window_max.bytes, tick.bytes);
+    ++state.window_ticks;
+
+    if (now_ns < state.next_report_ns)
+    {
+        return;
+    }
+
+    report();
+
+    state.next_report_ns = now_ns + state.interval_ns;
+    state.window         = {};
+    state.window_max     = {};
+    state.window_ticks   = 0;
+#endif
+}
+
+[[nodiscard]] MemprofTick memprof_last_tick() noexcept
+{
+#if TR_OS_LINUX
+    return g_memprof.last_tick;
+#else
+    return {};
+#endif
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "type.hpp"
+#include <tl/expected.hpp>
+
+// Allocation profiler. Hooks tier0's allocator (`g_pMemAlloc`) and counts allocations, frees and bytes per tick and per call site.
+// A call site is the return address of the `Alloc`/`Realloc`/`Free` call, so code that allocates through a wrapper (a module's
+// `malloc` override, `MemAlloc_AllocAligned`) shows up as the wrapper.
+// Every thread counts into its own table with plain stores (it's the only writer), the main thread sums the tables once per tick.
+// Every report interval the per-tick rates and the sites that allocated the most are logged, bucketed by module and symbol (sites
+// in code without exported symbols are listed by module offset).
+// NOTE: It wraps whatever is in the slots when it starts, with `-tickrate_alloc` it must start after the allocator is installed.
+// Once started, the plugin stays loaded until the process exits (stopping can't wait for other threads to leave the hooks).
+
+constexpr usize MEMPROF_MAX_THREADS = 64;  // Later threads only count towards the totals.
+constexpr usize MEMPROF_MAX_SITES   = 1024; // Per thread, a full table only counts towards the totals.
+
+struct MemprofError
+{
+    enum Type : u8
+    {
+        UNSUPPORTED,
+        NO_TIER0,
+        NO_MEMALLOC,   // tier0 doesn't export `g_pMemAlloc`, or it isn't set.
+        FAILED_TO_PIN, // The plugin couldn't be kept loaded.
+        FAILED_TO_HOOK,
+    } type;
+};
+
+struct MemprofTick
+{
+    u64 allocs{}; // Reallocs count as an allocation and a free.
+    u64 frees{};
+    u64 bytes{};  // Allocated.
+};
+
+// Must be called from the main thread.
+tl::expected<void, MemprofError> memprof_start(u64 report_interval_ns, u32 top_sites) noexcept;
+void                             memprof_stop() noexcept;
+
+// Called from `GameFrame` on every simulated tick, counts everything since the previous call as this tick's.
+void memprof_on_tick(u64 now_ns) noexcept;
+
+// Counts of the last tick.
+[[nodiscard]] MemprofTick memprof_last_tick() noexcept;
@@ -0,0 +1,174 @@
+#include "metrics.hpp"
+#include "common.hpp"
+#include "clock.hpp"
+#include "tickstats.hpp"
+#include <fmt/format.h>
+#include <algorithm>
+#include <charconv>
+#include <string>
+#if TR_OS_LINUX
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+#if TR_OS_LINUX
+    constexpr u64 RSS_INTERVAL_NS = 1000000000;
+
+    struct State
+    {
+        MetricsPage *page{};
+        std::string  path{};
+        int          statm_fd{-1};
+        u64          rss_bytes{};
+        u64          next_rss_ns{};
+    } g_metrics{};
+
+    // `/proc/self/statm` is kept open, refreshing it is a single `pread`.
+    [[nodiscard]] u64 read_rss(int fd) noexcept
+    {
+        char buf[128];
+        auto size = pread(fd, buf, sizeof(buf) - 1, 0);
+        if (size <= 0)
+        {
+            return 0;
+        }
+
+        // "size resident shared text lib data dt", in pages.
+        cstr end      = buf + size;
+        cstr resident = std::find((cstr)buf, end, ' ');
+
+        u64 pages{};
+        if (resident == end || std::from_chars(resident + 1, end, pages).ec != std::errc{})
+        {
+            return 0;
+        }
+
+        return pages * (u64)sysconf(_SC_PAGESIZE);
+    }
+
+    [[nodiscard]] MetricsDurations to_metrics(const TickDurations &durations) noexcept
+    {
+        return MetricsDurations{
+            durations.count,
+            durations.sum,
+            durations.window.p50,
+            durations.window.p99,
+            durations.window.p999,
+            durations.window.max,
+        };
+    }
+#endif
+} // namespace
+
+tl::expected<void, MetricsError> metrics_open([[maybe_unused]] u16 port) noexcept
+{
+#if TR_OS_LINUX
+    metrics_close();
+
+    auto path = fmt::format("{}/{}{}{}", METRICS_DIR, METRICS_PREFIX, port, METRICS_SUFFIX);
+
+    // Readable by everyone, scrapers usually don't run as the server's user.
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        return tl::unexpected{MetricsError{MetricsError::FAILED_TO_OPEN}};
+    }
+
+    void *mapping = MAP_FAILED;
+    if (ftruncate(fd, sizeof(MetricsPage)) == 0)
+    {
+        mapping = mmap(nullptr, sizeof(MetricsPage), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+
+    // The mapping keeps the file alive.
+    close(fd);
+
+    if (mapping == MAP_FAILED)
+    {
+        return tl::unexpected{MetricsError{MetricsError::FAILED_TO_OPEN}};
+    }
+
+    auto *page = (MetricsPage *)mapping;
+    page->magic.store(0, std::memory_order_relaxed);
+    page->version = METRICS_VERSION;
+    page->sequence.store(0, std::memory_order_relaxed);
+    page->pid = (u32)getpid();
+    std::memset((void *)&page->values, 0, sizeof(page->values));
+    page->magic.store(METRICS_MAGIC, std::memory_order_release);
+
+    g_metrics.page     = page;
+    g_metrics.path     = std::move(path);
+    g_metrics.statm_fd = open("/proc/self/statm", O_RDONLY | O_CLOEXEC);
+
+    return {};
+#else
+    return tl::unexpected{MetricsError{MetricsError::UNSUPPORTED}};
+#endif
+}
+
+void metrics_close() noexcept
+{
+#if TR_OS_LINUX
+    auto &&state = g_metrics;
+    if (state.page == nullptr)
+    {
+        return;
+    }
+
+    munmap(state.page, sizeof(MetricsPage));
+    unlink(state.path.c_str());
+
+    if (state.statm_fd >= 0)
+    {
+        close(state.statm_fd);
+    }
+
+    state = {};
+#endif
+}
+
+void metrics_publish([[maybe_unused]] u64 now_ns, [[maybe_unused]] const MetricsSample &sample) noexcept
+{
+#if TR_OS_LINUX
+    auto &&state = g_metrics;
+    if (state.page == nullptr)
+    {
+        return;
+    }
+
+    if (now_ns >= state.next_rss_ns && state.statm_fd >= 0)
+    {
+        state.next_rss_ns = now_ns + RSS_INTERVAL_NS;
+        state.rss_bytes   = read_rss(state.statm_fd);
+    }
+
+    const auto catch_up = clock_catch_up_stats();
+
+    auto &&page     = *state.page;
+    u32    sequence = page.sequence.load(std::memory_order_relaxed);
+
+    page.sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    auto &&values                  = page.values;
+    values.updated_ns              = now_ns;
+    values.ticks                   = tickstats_ticks();
+    values.overruns                = tickstats_overruns();
+    values.catch_up_ticks          = tickstats_catch_up_ticks();
+    values.catch_up_limited        = catch_up.limited;
+    values.catch_up_dropped        = (u64)catch_up.dropped_ticks;
+    values.get_tick_interval_calls = sample.get_tick_interval_calls;
+    values.plat_floattime_calls    = clock_hook_calls();
+    values.rss_bytes               = state.rss_bytes;
+    values.tickrate                = sample.tickrate;
+    values.tick_spacing            = to_metrics(tickstats_spacing());
+    values.tick_work               = to_metrics(tickstats_work());
+    values.players                 = sample.players;
+    values.max_players             = sample.max_players;
+
+    page.sequence.store(sequence + 2, std::memory_order_release);
+#endif
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include "type.hpp"
+#include <tl/expected.hpp>
+#include <atomic>
+#include <cstring>
+
+// Metrics page for external scrapers, so monitoring never has to talk to the server (see `tools/metrics.cpp`).
+// Each server maps one page at `/dev/shm/source-tickrate-<port>.metrics` and updates it from `GameFrame` with plain stores under a
+// seqlock: `sequence` is odd while an update is in progress, readers copy `values` and retry if the sequence was odd or changed.
+// The layout is shared between 32 and 64-bit builds (every 8 byte field is 8 byte aligned), bump `METRICS_VERSION` when it changes.
+
+constexpr u32  METRICS_MAGIC   = 0x4D525454; // "TTRM"
+constexpr u32  METRICS_VERSION = 3;
+constexpr cstr METRICS_DIR     = "/dev/shm";
+constexpr cstr METRICS_PREFIX  = "source-tickrate-";
+constexpr cstr METRICS_SUFFIX  = ".metrics";
+
+// A Prometheus summary: `count` and `sum` since the server started, quantiles over the last few thousand ticks.
+struct MetricsDurations
+{
+    u64 count;
+    f64 sum_us;
+    f64 p50_us;
+    f64 p99_us;
+    f64 p999_us;
+    f64 max_us;
+};
+
+struct MetricsValues
+{
+    u64              updated_ns; // Monotonic clock (`timing_now_ns`).
+    u64              ticks;
+    u64              overruns;
+    u64              catch_up_ticks;   // Ticks run back to back to catch up.
+    u64              catch_up_limited; // Stalls the catch-up limit held the clock back for (`-tickrate_maxticks`).
+    u64              catch_up_dropped; // Ticks the limit dropped.
+    u64              get_tick_interval_calls;
+    u64              plat_floattime_calls; // Only counted with `-tickrate_stagger` or `-tickrate_maxticks`.
+    u64              rss_bytes;            // Refreshed about once a second.
+    f64              tickrate;
+    MetricsDurations tick_spacing; // Between the starts of two ticks.
+    MetricsDurations tick_work;    // From the start to the end of the game's `GameFrame`.
+    u32              players;
+    u32              max_players;
+};
+
+struct MetricsPage
+{
+    std::atomic<u32> magic; // Written last, a page without it is still being set up.
+    u32              version;
+    std::atomic<u32> sequence;
+    u32              pid;
+    MetricsValues    values;
+};
+
+static_assert(sizeof(MetricsValues) == 184, "The metrics layout must be the same on every architecture.");
+static_assert(sizeof(MetricsPage) == 200, "The metrics layout must be the same on every architecture.");
+static_assert(std::atomic<u32>::is_always_lock_free, "The metrics page is shared between processes.");
+
+// Copies a consistent snapshot of the values. Fails if the page isn't ready or a writer stayed in the middle of an update (it died).
+[[nodiscard]] inline bool metrics_read(const MetricsPage *page, MetricsValues &out) noexcept
+{
+    constexpr usize max_attempts = 1000;
+
+    if (page->magic.load(std::memory_order_acquire) != METRICS_MAGIC || page->version != METRICS_VERSION)
+    {
+        return false;
+    }
+
+    for (usize i{}; i < max_attempts; ++i)
+    {
+        u32 before = page->sequence.load(std::memory_order_acquire);
+        if ((before & 1) != 0)
+        {
+            continue;
+        }
+
+        std::memcpy(&out, (const void *)&page->values, sizeof(out));
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        if (page->sequence.load(std::memory_order_relaxed) == before)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+struct MetricsError
+{
+    enum Type : u8
+    {
+        UNSUPPORTED,
+        FAILED_TO_OPEN,
+    } type;
+};
+
+// Values the metrics module can't get by itself.
+struct MetricsSample
+{
+    f64 tickrate{};
+    u32 players{};
+    u32 max_players{};
+    u64 get_tick_interval_calls{};
+};
+
+tl::expected<void, MetricsError> metrics_open(u16 port) noexcept;
+
+// Removes the page, a page left behind by a crash is reported as down by the reader.
+void metrics_close() noexcept;
+
+// Called from `GameFrame` on every simulated tick.
+void metrics_publish(u64 now_ns, const MetricsSample &sample) noexcept;
@@ -0,0 +1,675 @@
+#include "net.hpp"
+#include "common.hpp"
+#include "import.hpp"
+#include "iface.hpp"
+#include "log.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <thread>
+#if TR_OS_LINUX
+#include <sys/socket.h>
+#include <ctime>
+#endif
+
+namespace
+{
+#if TR_OS_LINUX
+    static_assert(sizeof(socklen_t) == sizeof(u32), "`net_recvfrom` passes `socklen_t *` as `u32 *`.");
+
+    constexpr std::array<cstr, 2> MODULES = {"engine", "tier0"};
+
+    constexpr u64 OFFSET_REFRESH_NS = 1000000000;
+
+    struct Datagram
+    {
+        u8                  data[NET_MAX_DATAGRAM];
+        sockaddr_storage    from;
+        alignas(cmsghdr) u8 control[CMSG_SPACE(sizeof(timespec))];
+    };
+
+    struct Ring
+    {
+        int                                 fd{-1};
+        std::unique_ptr<Datagram[]>         datagrams{};
+        std::array<mmsghdr, NET_BATCH_SIZE> headers{};
+        std::array<iovec, NET_BATCH_SIZE>   iovecs{};
+        usize                               count{};
+        usize                               next{};
+    };
+
+    struct Outgoing
+    {
+        u8               data[NET_MAX_DATAGRAM];
+        sockaddr_storage to;
+    };
+
+    // Datagrams are copied in the order the engine sent them and go out in runs per socket.
+    struct SendQueue
+    {
+        std::unique_ptr<Outgoing[]>         datagrams{};
+        std::array<int, NET_BATCH_SIZE>     fds{};
+        std::array<mmsghdr, NET_BATCH_SIZE> headers{};
+        std::array<iovec, NET_BATCH_SIZE>   iovecs{};
+        usize                               count{};
+    };
+
+    struct State
+    {
+        std::array<ImportHook, 2>         receive_hooks{};
+        std::array<ImportHook, 2>         send_hooks{};
+        std::atomic<u32>                  features{};
+        std::atomic<NetArrivalFn>         arrival{};
+        std::thread::id                   main_thread{};
+        std::atomic<i64>                  realtime_offset_ns{}; // `CLOCK_REALTIME` - `CLOCK_MONOTONIC`.
+        u64                               next_offset_ns{};
+        std::array<Ring, NET_MAX_SOCKETS> rings{}; // Main thread only.
+        SendQueue                         queue{}; // Main thread only.
+        std::atomic<u64>                  datagrams{};
+        std::atomic<u64>                  syscalls{};
+        std::atomic<u64>                  batched_reads{};
+        std::atomic<u64>                  dropped{};
+        std::atomic<u64>                  sent{};
+        std::atomic<u64>                  send_syscalls{};
+        std::atomic<u64>                  queued_sends{};
+        std::atomic<u64>                  failed_sends{};
+        u64                               ticks{};
+    } g_net{};
+
+    [[nodiscard]] i64 clock_ns(clockid_t clock) noexcept
+    {
+        timespec ts{};
+        clock_gettime(clock, &ts);
+        return (i64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    }
+
+    void refresh_offset() noexcept
+    {
+        g_net.realtime_offset_ns.store(clock_ns(CLOCK_REALTIME) - clock_ns(CLOCK_MONOTONIC), std::memory_order_relaxed);
+    }
+
+    // Passes the datagram to the arrival callback, or turns timestamps on for its socket if it came without one.
+    void arrived(int fd, const msghdr &msg, const void *data, usize size) noexcept
+    {
+        auto &&state = g_net;
+
+        auto arrival = state.arrival.load(std::memory_order_relaxed);
+        if (arrival == nullptr)
+        {
+            return;
+        }
+
+        for (auto *cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR((msghdr *)&msg, cmsg))
+        {
+            if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_TIMESTAMPNS)
+            {
+                continue;
+            }
+
+            timespec ts;
+            std::memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+
+            i64 arrival_ns = (i64)ts.tv_sec * 1000000000 + ts.tv_nsec - state.realtime_offset_ns.load(std::memory_order_relaxed);
+            arrival((u64)std::max<i64>(arrival_ns, 0), data, size);
+            return;
+        }
+
+        // Timestamps are turned on the first time a socket is read from, only that one datagram goes without.
+        int enable = 1;
+        setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable));
+
+        arrival(0, data, size);
+    }
+
+    [[nodiscard]] isize receive_one(int fd, void *buf, usize size, int flags, sockaddr *from, socklen_t *from_size) noexcept
+    {
+        auto &&state = g_net;
+        state.syscalls.fetch_add(1, std::memory_order_relaxed);
+
+        if ((state.features.load(std::memory_order_relaxed) & NET_RECV_TIMESTAMPS) == 0)
+        {
+            isize result = recvfrom(fd, buf, size, flags, from, from_size);
+            if (result >= 0)
+            {
+                state.datagrams.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            return result;
+        }
+
+        // Same call through `recvmsg`, which also returns the receive timestamp.
+        alignas(cmsghdr) u8 control[CMSG_SPACE(sizeof(timespec))];
+        iovec               io{buf, size};
+
+        msghdr msg{};
+        msg.msg_name       = from;
+        msg.msg_namelen    = from_size != nullptr ? *from_size : 0;
+        msg.msg_iov        = &io;
+        msg.msg_iovlen     = 1;
+        msg.msg_control    = control;
+        msg.msg_controllen = sizeof(control);
+
+        isize result = recvmsg(fd, &msg, flags);
+        if (result < 0)
+        {
+            return result;
+        }
+
+        if (from_size != nullptr)
+        {
+            *from_size = msg.msg_namelen;
+        }
+
+        state.datagrams.fetch_add(1, std::memory_order_relaxed);
+        arrived(fd, msg, buf, (usize)result);
+
+        return result;
+    }
+
+    [[nodiscard]] Ring *find_ring(int fd, bool create) noexcept
+    {
+        auto &&rings = g_net.rings;
+
+        auto it = std::find_if(rings.begin(), rings.end(), [fd](const Ring &ring) noexcept { return ring.fd == fd; });
+        if (it != rings.end())
+        {
+            return &*it;
+        }
+
+        if (!create)
+        {
+            return nullptr;
+        }
+
+        it = std::find_if(rings.begin(), rings.end(), [](const Ring &ring) noexcept { return ring.fd < 0; });
+        if (it == rings.end())
+        {
+            return nullptr;
+        }
+
+        auto &&ring = *it;
+        ring.fd     = fd;
+        if (ring.datagrams == nullptr)
+        {
+            ring.datagrams = std::make_unique<Datagram[]>(NET_BATCH_SIZE);
+        }
+
+        return &ring;
+    }
+
+    // Returns the number of datagrams read, or -1 with `errno` set like `recvfrom`.
+    [[nodiscard]] isize fill(Ring &ring, int flags) noexcept
+    {
+        auto &&state = g_net;
+
+        const bool timestamps = (state.features.load(std::memory_order_relaxed) & NET_RECV_TIMESTAMPS) != 0;
+        for (usize i{}; i < NET_BATCH_SIZE; ++i)
+        {
+            auto &&datagram = ring.datagrams[i];
+            auto &&header   = ring.headers[i].msg_hdr;
+
+            ring.iovecs[i]        = {datagram.data, sizeof(datagram.data)};
+            header.msg_name       = &datagram.from;
+            header.msg_namelen    = sizeof(datagram.from);
+            header.msg_iov        = &ring.iovecs[i];
+            header.msg_iovlen     = 1;
+            header.msg_control    = timestamps ? datagram.control : nullptr;
+            header.msg_controllen = timestamps ? sizeof(datagram.control) : 0;
+            header.msg_flags      = 0;
+        }
+
+        state.syscalls.fetch_add(1, std::memory_order_relaxed);
+
+        // Blocks (on a blocking socket) for the first datagram only, like `recvfrom` would.
+        int count = recvmmsg(ring.fd, ring.headers.data(), NET_BATCH_SIZE, flags | MSG_WAITFORONE, nullptr);
+        if (count < 0)
+        {
+            return -1;
+        }
+
+        ring.count = (usize)count;
+        ring.next  = 0;
+
+        return count;
+    }
+
+    [[nodiscard]] isize receive_batched(Ring &ring, void *buf, usize size, int flags, sockaddr *from, socklen_t *from_size) noexcept
+    {
+        auto &&state = g_net;
+
+        while (true)
+        {
+            if (ring.next == ring.count)
+            {
+                if (isize count = fill(ring, flags); count <= 0)
+                {
+                    return count;
+                }
+            }
+            else
+            {
+                state.batched_reads.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            auto &&datagram = ring.datagrams[ring.next];
+            auto &&header   = ring.headers[ring.next];
+            ++ring.next;
+
+            if ((header.msg_hdr.msg_flags & MSG_TRUNC) != 0)
+            {
+                state.dropped.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+
+            // `recvfrom` truncates to the caller's buffer without saying so.
+            usize length = std::min<usize>(header.msg_len, size);
+            std::memcpy(buf, datagram.data, length);
+
+            if (from != nullptr && from_size != nullptr)
+            {
+                std::memcpy(from, &datagram.from, std::min<usize>(*from_size, header.msg_hdr.msg_namelen));
+                *from_size = header.msg_hdr.msg_namelen;
+            }
+
+            state.datagrams.fetch_add(1, std::memory_order_relaxed);
+            if (header.msg_hdr.msg_control != nullptr)
+            {
+                arrived(ring.fd, header.msg_hdr, datagram.data, header.msg_len);
+            }
+
+            return (isize)length;
+        }
+    }
+
+    [[nodiscard]] isize send_one(int fd, const void *buf, usize size, int flags, const sockaddr *to, socklen_t to_size) noexcept
+    {
+        auto &&state = g_net;
+        state.send_syscalls.fetch_add(1, std::memory_order_relaxed);
+
+        isize result = sendto(fd, buf, size, flags, to, to_size);
+        if (result >= 0)
+        {
+            state.sent.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        return result;
+    }
+
+    // Sends `queue.headers[first, last)`, which are all for `fd`.
+    void send_run(int fd, usize first, usize last) noexcept
+    {
+        auto &&state = g_net;
+        auto &&queue = state.queue;
+
+        while (first < last)
+        {
+            state.send_syscalls.fetch_add(1, std::memory_order_relaxed);
+
+            int count = sendmmsg(fd, &queue.headers[first], (unsigned int)(last - first), 0);
+            if (count > 0)
+            {
+                first += (usize)count;
+                continue;
+            }
+
+            // The first datagram failed, the engine would have ignored the error of its `sendto` too. Go on with the next one.
+            state.failed_sends.fetch_add(1, std::memory_order_relaxed);
+            ++first;
+        }
+    }
+
+    [[nodiscard]] bool should_queue(const void *buf, usize size, int flags, socklen_t to_size) noexcept
+    {
+        auto &&state = g_net;
+
+        if ((state.features.load(std::memory_order_relaxed) & NET_SEND_BATCH) == 0 || flags != 0 || size > NET_MAX_DATAGRAM ||
+            to_size > sizeof(sockaddr_storage) || std::this_thread::get_id() != state.main_thread)
+        {
+            return false;
+        }
+
+        // Split packets come in bursts of large fragments that would fill the queue on their own.
+        u32 header{};
+        if (size >= sizeof(header))
+        {
+            std::memcpy(&header, buf, sizeof(header));
+            if (header == 0xFFFFFFFE)
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    void enqueue(int fd, const void *buf, usize size, const sockaddr *to, socklen_t to_size) noexcept
+    {
+        auto &&state = g_net;
+        auto &&queue = state.queue;
+
+        if (queue.datagrams == nullptr)
+        {
+            queue.datagrams = std::make_unique<Outgoing[]>(NET_BATCH_SIZE);
+        }
+
+        usize i = queue.count++;
+
+        auto &&datagram = queue.datagrams[i];
+        auto &&header   = queue.headers[i].msg_hdr;
+
+        std::memcpy(datagram.data, buf, size);
+        if (to != nullptr)
+        {
+            std::memcpy(&datagram.to, to, to_size);
+        }
+
+        queue.fds[i]       = fd;
+        queue.iovecs[i]    = {datagram.data, size};
+        header             = {};
+        header.msg_name    = to != nullptr ? &datagram.to : nullptr;
+        header.msg_namelen = to != nullptr ? to_size : 0;
+        header.msg_iov     = &queue.iovecs[i];
+        header.msg_iovlen  = 1;
+
+        state.sent.fetch_add(1, std::memory_order_relaxed);
+        state.queued_sends.fetch_add(1, std::memory_order_relaxed);
+
+        if (queue.count == NET_BATCH_SIZE)
+        {
+            net_flush();
+        }
+    }
+
+    ssize_t hooked_recvfrom(int fd, void *buf, size_t size, int flags, sockaddr *from, socklen_t *from_size) noexcept
+    {
+        return net_recvfrom(fd, buf, size, flags, from, from_size);
+    }
+
+    ssize_t hooked_sendto(int fd, const void *buf, size_t size, int flags, const sockaddr *to, socklen_t to_size) noexcept
+    {
+        return net_sendto(fd, buf, size, flags, to, to_size);
+    }
+
+    // Installs `fn` over every module's import of `proc`, returns whether one was hooked and sets `failed` if one couldn't be.
+    template <class T>
+    [[nodiscard]] bool hook_imports(std::array<ImportHook, 2> &hooks, cstr proc_name, u8 *proc, T fn, bool &failed) noexcept
+    {
+        bool hooked{};
+        for (usize i{}; i < MODULES.size(); ++i)
+        {
+            auto hook = ImportHook::create(iface_get_default_module(MODULES[i]), proc_name, proc, fn);
+            if (hook)
+            {
+                hooks[i] = std::move(*hook);
+                hooked   = true;
+            }
+            else
+            {
+                failed = failed || hook.error().type == ImportHook::Error::FAILED_TO_UNPROTECT;
+            }
+        }
+
+        return hooked;
+    }
+#endif
+} // namespace
+
+tl::expected<void, NetError> net_hook([[maybe_unused]] u32 features) noexcept
+{
+#if TR_OS_LINUX
+    auto hooked = [](const ImportHook &hook) noexcept { return (bool)hook; };
+
+    auto &&state = g_net;
+
+    // Each import is hooked on its own, a module that only imports one of them still gets the features that need it.
+    if (!net_is_hooked())
+    {
+        bool failed{};
+        bool receives = hook_imports(state.receive_hooks, "recvfrom", (u8 *)&recvfrom, hooked_recvfrom, failed);
+        bool sends    = hook_imports(state.send_hooks, "sendto", (u8 *)&sendto, hooked_sendto, failed);
+
+        if (!receives && !sends)
+        {
+            return tl::unexpected{NetError{failed ? NetError::FAILED_TO_HOOK : NetError::NOT_IMPORTED}};
+        }
+    }
+
+    constexpr u32 receive_features = NET_RECV_TIMESTAMPS | NET_RECV_BATCH;
+    if ((features & receive_features) != 0 && std::none_of(state.receive_hooks.begin(), state.receive_hooks.end(), hooked))
+    {
+        return tl::unexpected{NetError{NetError::RECVFROM_NOT_HOOKED}};
+    }
+
+    if ((features & NET_SEND_BATCH) != 0 && std::none_of(state.send_hooks.begin(), state.send_hooks.end(), hooked))
+    {
+        return tl::unexpected{NetError{NetError::SENDTO_NOT_HOOKED}};
+    }
+
+    return {};
+#else
+    return tl::unexpected{NetError{NetError::UNSUPPORTED}};
+#endif
+}
+
+void net_unhook() noexcept
+{
+#if TR_OS_LINUX
+    auto &&state = g_net;
+
+    if (net_is_hooked() && state.datagrams.load(std::memory_order_relaxed) != 0)
+    {
+        auto datagrams = state.datagrams.load(std::memory_order_relaxed);
+        auto syscalls  = state.syscalls.load(std::memory_order_relaxed);
+
+        info(
+            "Received {} datagrams in {} syscalls ({:.1f} per syscall), {} dropped.\n",
+            datagrams,
+            syscalls,
+            (f64)datagrams / (f64)std::max<u64>(syscalls, 1),
+            state.dropped.load(std::memory_order_relaxed));
+    }
+
+    // Whatever the last frame queued still goes out.
+    net_flush();
+
+    if (net_is_hooked() && state.queued_sends.load(std::memory_order_relaxed) != 0)
+    {
+        auto sent          = state.sent.load(std::memory_order_relaxed);
+        auto send_syscalls = state.send_syscalls.load(std::memory_order_relaxed);
+
+        info(
+            "Sent {} datagrams in {} syscalls ({:.1f} saved per tick), {} failed after being queued.\n",
+            sent,
+            send_syscalls,
+            (f64)(sent - std::min(sent, send_syscalls)) / (f64)std::max<u64>(state.ticks, 1),
+            state.failed_sends.load(std::memory_order_relaxed));
+    }
+
+    for (auto &&hook : state.receive_hooks)
+    {
+        hook = {};
+    }
+
+    for (auto &&hook : state.send_hooks)
+    {
+        hook = {};
+    }
+
+    // Anything still in a ring is lost, the engine reads its sockets directly from now on. Sockets keep their timestamps.
+    for (auto &&ring : state.rings)
+    {
+        ring = {};
+    }
+
+    state.features.store(0, std::memory_order_relaxed);
+    state.arrival.store(nullptr, std::memory_order_relaxed);
+    state.datagrams.store(0, std::memory_order_relaxed);
+    state.syscalls.store(0, std::memory_order_relaxed);
+    state.batched_reads.store(0, std::memory_order_relaxed);
+    state.dropped.store(0, std::memory_order_relaxed);
+    state.sent.store(0, std::memory_order_relaxed);
+    state.send_syscalls.store(0, std::memory_order_relaxed);
+    state.queued_sends.store(0, std::memory_order_relaxed);
+    state.failed_sends.store(0, std::memory_order_relaxed);
+    state.ticks = 0;
+#endif
+}
+
+[[nodiscard]] bool net_is_hooked() noexcept
+{
+#if TR_OS_LINUX
+    auto hooked = [](const ImportHook &hook) noexcept { return (bool)hook; };
+
+    auto &&state = g_net;
+    return std::any_of(state.receive_hooks.begin(), state.receive_hooks.end(), hooked) ||
+           std::any_of(state.send_hooks.begin(), state.send_hooks.end(), hooked);
+#else
+    return false;
+#endif
+}
+
+void net_enable([[maybe_unused]] u32 features) noexcept
+{
+#if TR_OS_LINUX
+    auto &&state = g_net;
+
+    state.main_thread = std::this_thread::get_id();
+    refresh_offset();
+
+    state.features.fetch_or(features, std::memory_order_relaxed);
+#endif
+}
+
+void net_disable([[maybe_unused]] u32 features) noexcept
+{
+#if TR_OS_LINUX
+    // Rings keep serving what they hold, the queue is sent now.
+    g_net.features.fetch_and(~features, std::memory_order_relaxed);
+
+    if ((features & NET_SEND_BATCH) != 0)
+    {
+        net_flush();
+    }
+#endif
+}
+
+[[nodiscard]] u32 net_features() noexcept
+{
+#if TR_OS_LINUX
+    return g_net.features.load(std::memory_order_relaxed);
+#else
+    return 0;
+#endif
+}
+
+void net_set_arrival_callback([[maybe_unused]] NetArrivalFn fn) noexcept
+{
+#if TR_OS_LINUX
+    g_net.arrival.store(fn, std::memory_order_relaxed);
+#endif
+}
+
+void net_on_tick([[maybe_unused]] u64 now_ns) noexcept
+{
+#if TR_OS_LINUX
+    auto &&state = g_net;
+
+    ++state.ticks;
+
+    // A frame that didn't read the clock after sending.
+    net_flush();
+
+    // NTP can step the realtime clock the timestamps are on.
+    if ((state.features.load(std::memory_order_relaxed) & NET_RECV_TIMESTAMPS) != 0 && now_ns >= state.next_offset_ns)
+    {
+        refresh_offset();
+        state.next_offset_ns = now_ns + OFFSET_REFRESH_NS;
+    }
+#endif
+}
+
+void net_flush() noexcept
+{
+#if TR_OS_LINUX
+    auto &&queue = g_net.queue;
+
+    usize first{};
+    for (usize i = 1; i <= queue.count; ++i)
+    {
+        if (i == queue.count || queue.fds[i] != queue.fds[first])
+        {
+            send_run(queue.fds[first], first, i);
+            first = i;
+        }
+    }
+
+    queue.count = 0;
+#endif
+}
+
+[[nodiscard]] NetStats net_stats() noexcept
+{
+    NetStats stats{};
+#if TR_OS_LINUX
+    auto &&state = g_net;
+
+    stats.datagrams     = state.datagrams.load(std::memory_order_relaxed);
+    stats.syscalls      = state.syscalls.load(std::memory_order_relaxed);
+    stats.batched_reads = state.batched_reads.load(std::memory_order_relaxed);
+    stats.dropped       = state.dropped.load(std::memory_order_relaxed);
+    stats.sent          = state.sent.load(std::memory_order_relaxed);
+    stats.send_syscalls = state.send_syscalls.load(std::memory_order_relaxed);
+    stats.queued_sends  = state.queued_sends.load(std::memory_order_relaxed);
+    stats.failed_sends  = state.failed_sends.load(std::memory_order_relaxed);
+    stats.ticks         = state.ticks;
+#endif
+    return stats;
+}
+
+[[nodiscard]] isize net_recvfrom(int fd, void *buf, usize size, int flags, void *from, u32 *from_size) noexcept
+{
+#if TR_OS_LINUX
+    auto &&state = g_net;
+
+    // Anything but `MSG_DONTWAIT` (i.e. `MSG_PEEK`) and other threads go straight to the socket.
+    if ((flags & ~MSG_DONTWAIT) != 0 || std::this_thread::get_id() != state.main_thread)
+    {
+        return receive_one(fd, buf, size, flags, (sockaddr *)from, from_size);
+    }
+
+    // A ring is drained before reads go back to the socket, even after batching was turned off.
+    bool  batch = (state.features.load(std::memory_order_relaxed) & NET_RECV_BATCH) != 0;
+    Ring *ring  = find_ring(fd, batch);
+    if (ring == nullptr || (!batch && ring->next == ring->count))
+    {
+        return receive_one(fd, buf, size, flags, (sockaddr *)from, from_size);
+    }
+
+    return receive_batched(*ring, buf, size, flags, (sockaddr *)from, from_size);
+#else
+    return -1;
+#endif
+}
+
+[[nodiscard]] isize net_sendto(int fd, const void *buf, usize size, int flags, const void *to, u32 to_size) noexcept
+{
+#if TR_OS_LINUX
+    if (should_queue(buf, size, flags, to_size))
+    {
+        enqueue(fd, buf, size, (const sockaddr *)to, to_size);
+        return (isize)size;
+    }
+
+    // Datagrams that go out right away still go out after the ones queued before them.
+    if (std::this_thread::get_id() == g_net.main_thread)
+    {
+        net_flush();
+    }
+
+    return send_one(fd, buf, size, flags, (const sockaddr *)to, to_size);
+#else
+    return -1;
+#endif
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "type.hpp"
+#include <tl/expected.hpp>
+
+// Socket path of the engine. The `recvfrom` and `sendto` imports of the engine and tier0 (the VCR layer some branches read through)
+// are redirected to `net_recvfrom` and `net_sendto`, which add the enabled features:
+// * `NET_RECV_TIMESTAMPS`: datagrams are read with `recvmsg` and their kernel receive time (`SO_TIMESTAMPNS`) is passed to the
+//   arrival callback.
+// * `NET_RECV_BATCH`: the engine drains its socket one `recvfrom` per datagram until it would block. Instead, one `recvmmsg`
+//   fills a ring of `NET_BATCH_SIZE` datagrams and the following reads are served from it, so a full drain costs a syscall per batch.
+//   Only the main thread's reads are batched, datagrams above `NET_MAX_DATAGRAM` are dropped (the engine splits its packets at
+//   `net_maxroutable`, 1260 bytes at most).
+// * `NET_SEND_BATCH`: the engine sends every client's snapshot with its own `sendto`. Instead, the main thread's datagrams are copied
+//   to a queue and `net_flush` sends it with one `sendmmsg` per socket and `NET_BATCH_SIZE` datagrams. The engine is told they were
+//   sent, a datagram the kernel refuses later is counted and lost, like one it would have dropped on `EWOULDBLOCK`. Split packets,
+//   datagrams above `NET_MAX_DATAGRAM` and calls with flags go out right away, after the queue so nothing is reordered.
+
+constexpr usize NET_BATCH_SIZE   = 64;
+constexpr usize NET_MAX_DATAGRAM = 2048;
+constexpr usize NET_MAX_SOCKETS  = 4; // Sockets with a ring, the engine has one per game port (server, SourceTV).
+
+enum NetFeature : u32
+{
+    NET_RECV_TIMESTAMPS = 1 << 0,
+    NET_RECV_BATCH      = 1 << 1,
+    NET_SEND_BATCH      = 1 << 2,
+};
+
+struct NetError
+{
+    enum Type : u8
+    {
+        UNSUPPORTED,
+        NOT_IMPORTED, // Neither the engine nor tier0 imports `recvfrom` or `sendto`.
+        FAILED_TO_HOOK,
+        RECVFROM_NOT_HOOKED, // Only `sendto` could be hooked, the features need `recvfrom`.
+        SENDTO_NOT_HOOKED,   // Only `recvfrom` could be hooked, the features need `sendto`.
+    } type;
+};
+
+struct NetStats
+{
+    u64 datagrams{};     // Handed to the engine.
+    u64 syscalls{};      // Receive syscalls, including the ones that found nothing.
+    u64 batched_reads{}; // Reads served from a ring.
+    u64 dropped{};       // Larger than `NET_MAX_DATAGRAM`.
+
+    u64 sent{};          // Datagrams the engine sent, queued or not.
+    u64 send_syscalls{}; // `sendto` and `sendmmsg` calls.
+    u64 queued_sends{};  // Sent through the queue.
+    u64 failed_sends{};  // Queued and then refused by the kernel.
+    u64 ticks{};         // Simulated ticks since the hooks were installed, to put the above per tick.
+};
+
+// `arrival_ns` is on the monotonic clock (`timing_now_ns`), 0 if the datagram has no timestamp.
+using NetArrivalFn = void (*)(u64 arrival_ns, const void *data, usize size) noexcept;
+
+// Installs the import hooks, idempotent. Reads only change once a feature is enabled.
+// Fails if neither import could be hooked, or if one that `features` (about to be enabled) need couldn't.
+tl::expected<void, NetError> net_hook(u32 features) noexcept;
+void                         net_unhook() noexcept;
+
+[[nodiscard]] bool net_is_hooked() noexcept;
+
+// Features also apply to direct `net_recvfrom` calls, with or without the hooks (the load generator uses that).
+// Must be called from the main thread, which is the one batched reads are served to.
+void              net_enable(u32 features) noexcept;
+void              net_disable(u32 features) noexcept;
+[[nodiscard]] u32 net_features() noexcept;
+void              net_set_arrival_callback(NetArrivalFn fn) noexcept;
+
+// Called from `GameFrame` on every simulated tick. Sends anything still queued.
+void net_on_tick(u64 now_ns) noexcept;
+
+// Sends the queue, main thread only. Must run after the engine sent its snapshots and before the frame sleeps, which is the next read
+// of the engine clock (see `clock_set_read_callback`). A full queue and datagrams that bypass it flush it as well.
+void net_flush() noexcept;
+
+[[nodiscard]] NetStats net_stats() noexcept;
+
+// `recvfrom` with the enabled features (`from` is a `sockaddr *`, `from_size` a `socklen_t *`).
+[[nodiscard]] isize net_recvfrom(int fd, void *buf, usize size, int flags, void *from, u32 *from_size) noexcept;
+
+// `sendto` with the enabled features (`to` is a `const sockaddr *`).
+[[nodiscard]] isize net_sendto(int fd, const void *buf, usize size, int flags, const void *to, u32 to_size) noexcept;
@@ -0,0 +1,350 @@
+#include "numa.hpp"
+#include "common.hpp"
+#include "os.hpp"
+#include "string.hpp"
+#include "timing.hpp"
+#include <fmt/format.h>
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <string_view>
+#include <vector>
+#if TR_OS_LINUX
+#include <linux/mempolicy.h>
+#include <sys/syscall.h>
+#include <sched.h>
+#include <unistd.h>
+#include <cinttypes>
+#include <cstdio>
+#endif
+
+namespace
+{
+#if TR_OS_LINUX
+    constexpr usize MAX_NODES  = 1024;
+    constexpr usize BATCH_SIZE = 1024;
+
+    using NodeMask = std::array<unsigned long, MAX_NODES / (8 * sizeof(unsigned long))>;
+
+    [[nodiscard]] std::string_view read_text(cstr path, std::vector<u8> &buf) noexcept
+    {
+        buf = os_read_binary_file(path);
+        return {(cstr)buf.data(), buf.size()};
+    }
+
+    // Calls `fn(first, last)` for each range of a kernel list ("0-3,8,10-11").
+    template <class Fn>
+    void for_each_range(std::string_view list, Fn &&fn) noexcept
+    {
+        for (auto &&item : str_split(list, ','))
+        {
+            u32  first{};
+            u32  last{};
+            auto end    = item.data() + item.size();
+            auto result = std::from_chars(item.data(), end, first);
+            if (result.ec != std::errc{})
+            {
+                continue;
+            }
+
+            last = first;
+            if (result.ptr != end && *result.ptr == '-')
+            {
+                (void)std::from_chars(result.ptr + 1, end, last);
+            }
+
+            fn(first, last);
+        }
+    }
+
+    // Returns the only node the calling thread can run on, or an error if there's no such node.
+    [[nodiscard]] tl::expected<u32, NumaError> get_pinned_node() noexcept
+    {
+        std::vector<u8> buf{};
+
+        std::vector<u32> nodes{};
+        for_each_range(read_text("/sys/devices/system/node/online", buf), [&](u32 first, u32 last) noexcept {
+            for (u32 node = first; node <= last && node < MAX_NODES; ++node)
+            {
+                nodes.push_back(node);
+            }
+        });
+
+        if (nodes.size() <= 1)
+        {
+            return tl::unexpected{NumaError{NumaError::SINGLE_NODE}};
+        }
+
+        cpu_set_t affinity;
+        CPU_ZERO(&affinity);
+        if (sched_getaffinity(0, sizeof(affinity), &affinity) != 0)
+        {
+            return tl::unexpected{NumaError{NumaError::NOT_PINNED}};
+        }
+
+        u32   result{};
+        usize matches{};
+        for (u32 node : nodes)
+        {
+            auto path = fmt::format("/sys/devices/system/node/node{}/cpulist", node);
+
+            bool used{};
+            for_each_range(read_text(path.c_str(), buf), [&](u32 first, u32 last) noexcept {
+                for (u32 cpu = first; cpu <= last && cpu < CPU_SETSIZE; ++cpu)
+                {
+                    used |= CPU_ISSET(cpu, &affinity) != 0;
+                }
+            });
+
+            if (used)
+            {
+                result = node;
+                ++matches;
+            }
+        }
+
+        if (matches != 1)
+        {
+            return tl::unexpected{NumaError{NumaError::NOT_PINNED}};
+        }
+
+        return result;
+    }
+
+    struct Region
+    {
+        uintptr_t begin;
+        uintptr_t end;
+    };
+
+    struct State
+    {
+        u32                 node{};
+        std::vector<Region> walked{}; // The regions of the last call, in address order.
+    } g_numa{};
+
+    struct Counts
+    {
+        usize remote{};       // Before moving.
+        usize remote_after{}; // Queried again after moving.
+    };
+
+    // Private readable mappings: the heap, anonymous memory, stacks and module pages. Shared mappings belong to other processes too.
+    [[nodiscard]] std::vector<Region> get_regions() noexcept
+    {
+        std::vector<Region> result{};
+
+        std::vector<u8> buf{};
+        for (auto &&line : str_split(read_text("/proc/self/maps", buf), '\n'))
+        {
+            uintptr_t begin{};
+            uintptr_t end{};
+            char      perms[5]{};
+            int       path_offset{};
+
+            if (std::sscanf(line.c_str(), "%" SCNxPTR "-%" SCNxPTR " %4s %*s %*s %*s %n", &begin, &end, perms, &path_offset) < 3)
+            {
+                continue;
+            }
+
+            std::string_view path = std::string_view{line}.substr((usize)path_offset);
+            if (perms[0] != 'r' || perms[3] != 'p' || path == "[vvar]" || path == "[vdso]" || path == "[vsyscall]")
+            {
+                continue;
+            }
+
+            result.push_back({begin, end});
+        }
+
+        return result;
+    }
+
+    // Moves a batch of pages to `node`, counting only the ones that are resident.
+    void move_batch(std::vector<void *> &pages, u32 node, NumaReport &report, Counts &counts) noexcept
+    {
+        const auto count = (unsigned long)pages.size();
+
+        std::vector<int> status(count);
+        if (syscall(SYS_move_pages, 0, count, pages.data(), nullptr, status.data(), 0) != 0)
+        {
+            pages.clear();
+            return;
+        }
+
+        // Only ask to move the ones that are resident somewhere else.
+        std::vector<void *> candidates{};
+        for (unsigned long i{}; i < count; ++i)
+        {
+            if (status[i] < 0)
+            {
+                continue;
+            }
+
+            ++report.pages;
+            if ((u32)status[i] != node)
+            {
+                ++counts.remote;
+                candidates.push_back(pages[i]);
+            }
+        }
+
+        pages.clear();
+
+        if (candidates.empty())
+        {
+            return;
+        }
+
+        const auto       moves = (unsigned long)candidates.size();
+        std::vector<int> nodes(moves, (int)node);
+        status.assign(moves, 0);
+
+        // A partial failure still fills `status`, a negative return means nothing was done.
+        if (syscall(SYS_move_pages, 0, moves, candidates.data(), nodes.data(), status.data(), MPOL_MF_MOVE) < 0)
+        {
+            report.pages_failed += moves;
+            counts.remote_after += moves;
+            return;
+        }
+
+        for (int result : status)
+        {
+            if (result == (int)node)
+            {
+                ++report.pages_moved;
+            }
+            else
+            {
+                ++report.pages_failed;
+            }
+        }
+
+        // Where they are now, the kernel may have put some elsewhere. Pages that went away since don't count.
+        status.assign(moves, 0);
+        if (syscall(SYS_move_pages, 0, moves, candidates.data(), nullptr, status.data(), 0) != 0)
+        {
+            counts.remote_after += moves;
+            return;
+        }
+
+        for (int result : status)
+        {
+            if (result >= 0 && (u32)result != node)
+            {
+                ++counts.remote_after;
+            }
+        }
+    }
+
+    // Calls `fn(begin, end)` for the parts of `region` that aren't in `walked` (sorted, non-overlapping).
+    template <class Fn>
+    void for_each_new_range(const Region &region, const std::vector<Region> &walked, Fn &&fn) noexcept
+    {
+        uintptr_t begin = region.begin;
+
+        auto it = std::lower_bound(
+            walked.begin(),
+            walked.end(),
+            region.begin,
+            [](const Region &walked_region, uintptr_t address) noexcept { return walked_region.end <= address; });
+
+        for (; it != walked.end() && it->begin < region.end; ++it)
+        {
+            if (it->begin > begin)
+            {
+                fn(begin, it->begin);
+            }
+
+            begin = std::max(begin, it->end);
+        }
+
+        if (begin < region.end)
+        {
+            fn(begin, region.end);
+        }
+    }
+#endif
+} // namespace
+
+[[nodiscard]] tl::expected<NumaReport, NumaError> numa_place() noexcept
+{
+#if TR_OS_LINUX
+    u64 start = timing_now_ns();
+
+    auto node = get_pinned_node();
+    if (!node)
+    {
+        return tl::unexpected{node.error()};
+    }
+
+    auto regions = get_regions();
+    if (regions.empty())
+    {
+        return tl::unexpected{NumaError{NumaError::FAILED_TO_READ_MAPS}};
+    }
+
+    NumaReport report{};
+    report.node = *node;
+
+    // Only what's new since the last call is walked, the rest was placed already (and later pages follow the policy).
+    auto &&state = g_numa;
+    if (state.node != *node)
+    {
+        state.walked.clear();
+    }
+
+    const auto page_size = (uintptr_t)sysconf(_SC_PAGESIZE);
+
+    Counts              counts{};
+    std::vector<void *> pages{};
+    pages.reserve(BATCH_SIZE);
+
+    for (auto &&region : regions)
+    {
+        for_each_new_range(
+            region,
+            state.walked,
+            [&](uintptr_t begin, uintptr_t end) noexcept
+            {
+                for (uintptr_t page = begin; page < end; page += page_size)
+                {
+                    pages.push_back((void *)page);
+                    if (pages.size() == BATCH_SIZE)
+                    {
+                        move_batch(pages, *node, report, counts);
+                    }
+                }
+            });
+    }
+
+    if (!pages.empty())
+    {
+        move_batch(pages, *node, report, counts);
+    }
+
+    if (report.pages != 0)
+    {
+        report.remote_before = (f64)counts.remote / (f64)report.pages;
+        report.remote_after  = (f64)counts.remote_after / (f64)report.pages;
+    }
+
+    state.node   = *node;
+    state.walked = std::move(regions);
+
+    // Prefer, don't bind: running out of memory on one node should spill over instead of failing allocations.
+    NodeMask mask{};
+    mask[*node / (8 * sizeof(unsigned long))] |= 1ul << (*node % (8 * sizeof(unsigned long)));
+
+    // The kernel ignores the last bit of `maxnode`.
+    if (syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask.data(), (unsigned long)MAX_NODES + 1) != 0)
+    {
+        return tl::unexpected{NumaError{NumaError::FAILED_TO_SET_POLICY}};
+    }
+
+    report.ms = (f64)(timing_now_ns() - start) / 1e6;
+
+    return report;
+#else
+    return tl::unexpected{NumaError{NumaError::UNSUPPORTED}};
+#endif
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "type.hpp"
+#include <tl/expected.hpp>
+
+// Keeps the server's memory on the NUMA node its main thread is pinned to (`taskset`, `numactl --cpunodebind`, etc).
+// Pinning only moves the threads, the heap and module pages stay wherever they were first touched, which is often the other socket.
+// This talks to the kernel directly (`move_pages`, `set_mempolicy`), libnuma isn't needed.
+
+struct NumaError
+{
+    enum Type : u8
+    {
+        UNSUPPORTED,
+        SINGLE_NODE,         // Nothing to do.
+        NOT_PINNED,          // The main thread can run on more than one node.
+        FAILED_TO_READ_MAPS,
+        FAILED_TO_SET_POLICY,
+    } type;
+};
+
+struct NumaReport
+{
+    u32   node{};
+    usize pages{};        // Resident pages that were looked at.
+    usize pages_moved{};
+    usize pages_failed{}; // Mostly file pages that other processes have mapped too, those can't be moved by us.
+    f64   remote_before{};
+    f64   remote_after{}; // Ratio of `pages` on another node, queried again after moving.
+    f64   ms{};
+};
+
+// Must be called from the main thread. Migrates the process' private pages to the main thread's node and makes that node the
+// preferred one for future allocations of the main thread (and threads it creates afterwards).
+// Later calls only walk the address ranges that weren't mapped at the previous call (the heap's growth, new mappings).
+[[nodiscard]] tl::expected<NumaReport, NumaError> numa_place() noexcept;
@@ -37,11 +37,15 @@
     if (file_size > 0)
     {
         std::vector<u8> result(file_size);
-        if (std::fread(result.data(), 1, file_size, file) != (usize)file_size)
+
+        // sysfs files report a whole page as their size, a short read at the end isn't an error.
+        auto read_amount = std::fread(result.data(), 1, file_size, file);
+        if (read_amount == 0 || std::ferror(file) != 0)
         {
             return {};
         }
 
+        result.resize(read_amount);
         return result;
     }
 
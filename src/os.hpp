@@ -15,12 +15,36 @@
 [[nodiscard]] u8 *os_get_module(std::string_view module_name) noexcept;
 [[nodiscard]] u8 *os_get_module(u8 *address) noexcept;
 
+// Keeps the module containing `address` loaded until the process exits, i.e. because code outside it keeps calling into it.
+[[nodiscard]] bool os_pin_module(u8 *address) noexcept;
+
 // On Windows: Returns the input module handle.
 // On Linux: Returns the base address for a module handle.
 [[nodiscard]] u8 *os_get_module_base(u8 *handle) noexcept;
 
+struct OsModuleSegment
+{
+    u8  *begin{};
+    u8  *end{};
+    bool readable{};
+    bool writable{};
+    bool executable{};
+    bool relro{}; // Writable at load time, read-only after relocation (Linux `PT_GNU_RELRO`).
+};
+
+// Returns the mapped segments (Linux: program headers, Windows: sections) of a module handle.
+[[nodiscard]] std::vector<OsModuleSegment> os_get_module_segments(u8 *handle) noexcept;
+
 [[nodiscard]] u8 *os_get_procedure(u8 *handle, std::string_view proc_name) noexcept;
 
+// Returns the import slots (Linux: GOT entries, Windows: IAT entries) a module calls an imported function through.
+// Linux matches the relocations by symbol name, slots of lazily bound functions may still point at the PLT.
+// Windows matches the slots by the address they were bound to (`proc`), which also covers imports by ordinal.
+[[nodiscard]] std::vector<u8 **> os_find_import_slots(u8 *handle, std::string_view proc_name, u8 *proc) noexcept;
+
+// Describes a code address for stack dumps: `module!symbol+0x12`, or `module+0x1234` without a symbol (only exported symbols are known).
+[[nodiscard]] std::string os_describe_address(u8 *address) noexcept;
+
 [[nodiscard]] inline u8 *os_get_procedure(std::string_view module_name, std::string_view proc_name) noexcept
 {
     return os_get_procedure(os_get_module(module_name), proc_name);
@@ -1,7 +1,14 @@
 #include "os.hpp"
+#include "common.hpp"
 #include "string.hpp"
+#include <fmt/format.h>
+#include <scope_guard.hpp>
 #include <link.h>
 #include <dlfcn.h>
+#include <cxxabi.h>
+#include <cstdlib>
+#include <algorithm>
+#include <cstring>
 
 [[nodiscard]] std::vector<std::string> os_get_command_line() noexcept
 {
@@ -25,7 +32,48 @@
     auto *result = dlopen(module_name.empty() ? nullptr : module_name.data(), RTLD_NOW | RTLD_NOLOAD);
     if (result == nullptr)
     {
-        return nullptr;
+        // A bare file name only matches modules by soname, so look for a loaded module with that file name instead.
+        if (module_name.empty() || str_sv_contains(module_name, '/'))
+        {
+            return nullptr;
+        }
+
+        struct Context
+        {
+            std::string_view name;
+            std::string      path;
+        } context{module_name, {}};
+
+        dl_iterate_phdr(
+            [](dl_phdr_info *info, usize, void *data) noexcept -> int
+            {
+                auto *ctx = (Context *)data;
+                if (info->dlpi_name == nullptr)
+                {
+                    return 0;
+                }
+
+                std::string_view path = info->dlpi_name;
+                if (auto slash = path.rfind('/'); slash != std::string_view::npos && path.substr(slash + 1) == ctx->name)
+                {
+                    ctx->path = path;
+                    return 1;
+                }
+
+                return 0;
+            },
+            &context);
+
+        if (context.path.empty())
+        {
+            return nullptr;
+        }
+
+        result = dlopen(context.path.c_str(), RTLD_NOW | RTLD_NOLOAD);
+        if (result == nullptr)
+        {
+            return nullptr;
+        }
     }
 
     dlclose(result);
@@ -40,15 +88,42 @@
         return nullptr;
     }
 
-    Dl_info info;
-    if (dladdr(address, &info) == 0 || info.dli_fname == nullptr)
+    Dl_info   info;
+    link_map *link{};
+    if (dladdr1(address, &info, (void **)&link, RTLD_DL_LINKMAP) == 0 || info.dli_fname == nullptr)
     {
         return nullptr;
     }
 
+    // The main program can't be opened by path, only through a null name (i.e. a host that exports `CreateInterface` itself).
+    if (link != nullptr && (link->l_name == nullptr || link->l_name[0] == '\0'))
+    {
+        return os_get_module(std::string_view{});
+    }
+
     return os_get_module(info.dli_fname);
 }
 
+[[nodiscard]] bool os_pin_module(u8 *address) noexcept
+{
+    Dl_info info;
+    if (address == nullptr || dladdr(address, &info) == 0 || info.dli_fname == nullptr)
+    {
+        return false;
+    }
+
+    // `RTLD_NODELETE` sticks to the module, the reference taken here isn't needed.
+    auto *handle = dlopen(info.dli_fname, RTLD_NOW | RTLD_NOLOAD | RTLD_NODELETE);
+    if (handle == nullptr)
+    {
+        return false;
+    }
+
+    dlclose(handle);
+
+    return true;
+}
+
 [[nodiscard]] u8 *os_get_module_base(u8 *handle) noexcept
 {
     if (handle == nullptr)
@@ -56,13 +131,72 @@
         return nullptr;
     }
 
-    link_map link;
-    if (dlinfo(handle, RTLD_DI_LINKMAP, &link) != 0)
+    link_map *link;
+    if (dlinfo(handle, RTLD_DI_LINKMAP, &link) != 0 || link == nullptr)
     {
         return nullptr;
     }
 
-    return (u8 *)link.l_addr;
+    return (u8 *)link->l_addr;
+}
+
+[[nodiscard]] std::vector<OsModuleSegment> os_get_module_segments(u8 *handle) noexcept
+{
+    if (handle == nullptr)
+    {
+        return {};
+    }
+
+    link_map *link;
+    if (dlinfo(handle, RTLD_DI_LINKMAP, &link) != 0 || link == nullptr)
+    {
+        return {};
+    }
+
+    struct Context
+    {
+        const link_map              *link;
+        std::vector<OsModuleSegment> segments;
+    } context{link, {}};
+
+    dl_iterate_phdr(
+        [](dl_phdr_info *info, usize, void *data) noexcept -> int
+        {
+            auto *ctx = (Context *)data;
+
+            // The main program has an empty name in both.
+            cstr name      = info->dlpi_name != nullptr ? info->dlpi_name : "";
+            cstr link_name = ctx->link->l_name != nullptr ? ctx->link->l_name : "";
+            if (info->dlpi_addr != ctx->link->l_addr || std::strcmp(name, link_name) != 0)
+            {
+                return 0;
+            }
+
+            for (usize i{}; i < info->dlpi_phnum; ++i)
+            {
+                auto &&phdr = info->dlpi_phdr[i];
+                if (phdr.p_type != PT_LOAD && phdr.p_type != PT_GNU_RELRO)
+                {
+                    continue;
+                }
+
+                OsModuleSegment segment{};
+                segment.begin      = (u8 *)(info->dlpi_addr + phdr.p_vaddr);
+                segment.end        = segment.begin + phdr.p_memsz;
+                segment.readable   = (phdr.p_flags & PF_R) != 0;
+                segment.writable   = phdr.p_type != PT_GNU_RELRO && (phdr.p_flags & PF_W) != 0;
+                segment.executable = (phdr.p_flags & PF_X) != 0;
+                segment.relro      = phdr.p_type == PT_GNU_RELRO;
+
+                ctx->segments.push_back(segment);
+            }
+
+            // Found it, stop iterating.
+            return 1;
+        },
+        &context);
+
+    return context.segments;
 }
 
 [[nodiscard]] u8 *os_get_procedure(u8 *handle, std::string_view proc_name) noexcept
@@ -74,3 +208,139 @@
 
     return (u8 *)dlsym(handle, proc_name.data());
 }
+
+[[nodiscard]] std::vector<u8 **> os_find_import_slots(u8 *handle, std::string_view proc_name, [[maybe_unused]] u8 *proc) noexcept
+{
+#if TR_ARCH_X86_64
+    using Reloc                   = ElfW(Rela);
+    constexpr auto DT_RELOCS      = DT_RELA;
+    constexpr auto DT_RELOCS_SIZE = DT_RELASZ;
+    constexpr auto R_JUMP_SLOT    = R_X86_64_JUMP_SLOT;
+    constexpr auto R_GLOB_DAT     = R_X86_64_GLOB_DAT;
+
+    auto symbol_of = [](const Reloc &reloc) noexcept { return (usize)ELF64_R_SYM(reloc.r_info); };
+    auto type_of   = [](const Reloc &reloc) noexcept { return (u32)ELF64_R_TYPE(reloc.r_info); };
+#else
+    using Reloc                   = ElfW(Rel);
+    constexpr auto DT_RELOCS      = DT_REL;
+    constexpr auto DT_RELOCS_SIZE = DT_RELSZ;
+    constexpr auto R_JUMP_SLOT    = R_386_JMP_SLOT;
+    constexpr auto R_GLOB_DAT     = R_386_GLOB_DAT;
+
+    auto symbol_of = [](const Reloc &reloc) noexcept { return (usize)ELF32_R_SYM(reloc.r_info); };
+    auto type_of   = [](const Reloc &reloc) noexcept { return (u32)ELF32_R_TYPE(reloc.r_info); };
+#endif
+
+    if (handle == nullptr || proc_name.empty())
+    {
+        return {};
+    }
+
+    link_map *link;
+    if (dlinfo(handle, RTLD_DI_LINKMAP, &link) != 0 || link == nullptr || link->l_ld == nullptr)
+    {
+        return {};
+    }
+
+    // glibc relocates the dynamic section's pointers in place on x86, don't count on it.
+    const auto base    = (usize)link->l_addr;
+    auto       address = [base](ElfW(Addr) value) noexcept { return (u8 *)(value < base ? base + value : value); };
+
+    const ElfW(Sym) *symbols{};
+    cstr             strings{};
+    const Reloc     *plt_relocs{};
+    usize            plt_size{};
+    const Reloc     *relocs{};
+    usize            relocs_size{};
+
+    for (auto *dyn = link->l_ld; dyn->d_tag != DT_NULL; ++dyn)
+    {
+        switch (dyn->d_tag)
+        {
+        case DT_SYMTAB:
+            symbols = (const ElfW(Sym) *)address(dyn->d_un.d_ptr);
+            break;
+        case DT_STRTAB:
+            strings = (cstr)address(dyn->d_un.d_ptr);
+            break;
+        case DT_JMPREL:
+            plt_relocs = (const Reloc *)address(dyn->d_un.d_ptr);
+            break;
+        case DT_PLTRELSZ:
+            plt_size = dyn->d_un.d_val;
+            break;
+        case DT_RELOCS:
+            relocs = (const Reloc *)address(dyn->d_un.d_ptr);
+            break;
+        case DT_RELOCS_SIZE:
+            relocs_size = dyn->d_un.d_val;
+            break;
+        default:
+            break;
+        }
+    }
+
+    if (symbols == nullptr || strings == nullptr)
+    {
+        return {};
+    }
+
+    std::vector<u8 **> result{};
+
+    // Calls go through the PLT (`JUMP_SLOT`), taking the address goes through a `GLOB_DAT` entry.
+    auto scan = [&](const Reloc *table, usize size) noexcept
+    {
+        for (usize i{}; table != nullptr && i < size / sizeof(Reloc); ++i)
+        {
+            auto &&reloc  = table[i];
+            auto   type   = type_of(reloc);
+            auto   symbol = symbol_of(reloc);
+            if ((type != R_JUMP_SLOT && type != R_GLOB_DAT) || symbol == 0)
+            {
+                continue;
+            }
+
+            if (strings + symbols[symbol].st_name != proc_name)
+            {
+                continue;
+            }
+
+            auto **slot = (u8 **)(base + reloc.r_offset);
+            if (std::find(result.begin(), result.end(), slot) == result.end())
+            {
+                result.push_back(slot);
+            }
+        }
+    };
+
+    scan(plt_relocs, plt_size);
+    scan(relocs, relocs_size);
+
+    return result;
+}
+
+[[nodiscard]] std::string os_describe_address(u8 *address) noexcept
+{
+    Dl_info info;
+    if (address == nullptr || dladdr(address, &info) == 0 || info.dli_fname == nullptr)
+    {
+        return fmt::format("{}", (void *)address);
+    }
+
+    std::string_view module = info.dli_fname;
+    if (auto slash = module.rfind('/'); slash != std::string_view::npos)
+    {
+        module.remove_prefix(slash + 1);
+    }
+
+    if (info.dli_sname == nullptr || info.dli_saddr == nullptr)
+    {
+        return fmt::format("{}+{:#x}", module, (usize)(address - (u8 *)info.dli_fbase));
+    }
+
+    int   status{};
+    char *demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+    auto  guard     = sg::make_scope_guard([demangled]() noexcept { std::free(demangled); });
+
+    return fmt::format("{}!{}+{:#x}", module, status == 0 ? demangled : info.dli_sname, (usize)(address - (u8 *)info.dli_saddr));
+}
@@ -1,5 +1,6 @@
 #include "os.hpp"
 #include "string.hpp"
+#include <fmt/format.h>
 #include <Windows.h>
 
 [[nodiscard]] std::vector<std::string> os_get_command_line() noexcept
@@ -23,11 +24,54 @@
     return (u8 *)result;
 }
 
+[[nodiscard]] bool os_pin_module(u8 *address) noexcept
+{
+    HMODULE result;
+    return GetModuleHandleEx(GET_MODULE_HANDLE_EX_FLAG_PIN | GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS, (LPCSTR)address, &result) != FALSE;
+}
+
 [[nodiscard]] u8 *os_get_module_base(u8 *handle) noexcept
 {
     return handle;
 }
 
+[[nodiscard]] std::vector<OsModuleSegment> os_get_module_segments(u8 *handle) noexcept
+{
+    if (handle == nullptr)
+    {
+        return {};
+    }
+
+    auto *dos = (IMAGE_DOS_HEADER *)handle;
+    if (dos->e_magic != IMAGE_DOS_SIGNATURE)
+    {
+        return {};
+    }
+
+    auto *nt = (IMAGE_NT_HEADERS *)(handle + dos->e_lfanew);
+    if (nt->Signature != IMAGE_NT_SIGNATURE)
+    {
+        return {};
+    }
+
+    std::vector<OsModuleSegment> result{};
+
+    auto *section = IMAGE_FIRST_SECTION(nt);
+    for (WORD i{}; i < nt->FileHeader.NumberOfSections; ++i, ++section)
+    {
+        OsModuleSegment segment{};
+        segment.begin      = handle + section->VirtualAddress;
+        segment.end        = segment.begin + section->Misc.VirtualSize;
+        segment.readable   = (section->Characteristics & IMAGE_SCN_MEM_READ) != 0;
+        segment.writable   = (section->Characteristics & IMAGE_SCN_MEM_WRITE) != 0;
+        segment.executable = (section->Characteristics & IMAGE_SCN_MEM_EXECUTE) != 0;
+
+        result.push_back(segment);
+    }
+
+    return result;
+}
+
 [[nodiscard]] u8 *os_get_procedure(u8 *handle, std::string_view proc_name) noexcept
 {
     if (handle == nullptr || proc_name.empty())
@@ -37,3 +81,64 @@
 
     return (u8 *)GetProcAddress((HMODULE)handle, proc_name.data());
 }
+
+[[nodiscard]] std::vector<u8 **> os_find_import_slots(u8 *handle, [[maybe_unused]] std::string_view proc_name, u8 *proc) noexcept
+{
+    if (handle == nullptr || proc == nullptr)
+    {
+        return {};
+    }
+
+    auto *dos = (IMAGE_DOS_HEADER *)handle;
+    if (dos->e_magic != IMAGE_DOS_SIGNATURE)
+    {
+        return {};
+    }
+
+    auto *nt = (IMAGE_NT_HEADERS *)(handle + dos->e_lfanew);
+    if (nt->Signature != IMAGE_NT_SIGNATURE)
+    {
+        return {};
+    }
+
+    auto &&directory = nt->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_IMPORT];
+    if (directory.VirtualAddress == 0 || directory.Size == 0)
+    {
+        return {};
+    }
+
+    std::vector<u8 **> result{};
+
+    // The bound IAT holds the final address of every import, whether it was imported by name or by ordinal.
+    for (auto *descriptor = (IMAGE_IMPORT_DESCRIPTOR *)(handle + directory.VirtualAddress); descriptor->Name != 0; ++descriptor)
+    {
+        for (auto *thunk = (IMAGE_THUNK_DATA *)(handle + descriptor->FirstThunk); thunk->u1.Function != 0; ++thunk)
+        {
+            if ((u8 *)thunk->u1.Function == proc)
+            {
+                result.push_back((u8 **)&thunk->u1.Function);
+            }
+        }
+    }
+
+    return result;
+}
+
+[[nodiscard]] std::string os_describe_address(u8 *address) noexcept
+{
+    // Symbols would need dbghelp and the PDBs, the module offset is enough to look them up offline.
+    u8  *module = os_get_module(address);
+    char path[MAX_PATH];
+    if (module == nullptr || GetModuleFileName((HMODULE)module, path, MAX_PATH) == 0)
+    {
+        return fmt::format("{}", (void *)address);
+    }
+
+    std::string_view name = path;
+    if (auto slash = name.find_last_of("\\/"); slash != std::string_view::npos)
+    {
+        name.remove_prefix(slash + 1);
+    }
+
+    return fmt::format("{}+{:#x}", name, (usize)(address - module));
+}
@@ -0,0 +1,544 @@
+#include "plugincost.hpp"
+#include "common.hpp"
+#include "iface.hpp"
+#include "log.hpp"
+#include "timing.hpp"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace
+{
+    enum Callback : u8
+    {
+        CALLBACK_LOAD,
+        CALLBACK_UNLOAD,
+        CALLBACK_PAUSE,
+        CALLBACK_UNPAUSE,
+        CALLBACK_GET_PLUGIN_DESCRIPTION,
+        CALLBACK_LEVEL_INIT,
+        CALLBACK_SERVER_ACTIVATE,
+        CALLBACK_GAME_FRAME,
+        CALLBACK_LEVEL_SHUTDOWN,
+        CALLBACK_CLIENT_ACTIVE,
+        CALLBACK_CLIENT_DISCONNECT,
+        CALLBACK_CLIENT_PUT_IN_SERVER,
+        CALLBACK_SET_COMMAND_CLIENT,
+        CALLBACK_CLIENT_SETTINGS_CHANGED,
+        CALLBACK_CLIENT_CONNECT,
+        CALLBACK_CLIENT_COMMAND,
+        CALLBACK_NETWORK_ID_VALIDATED,
+        CALLBACK_ON_QUERY_CVAR_VALUE_FINISHED,
+        CALLBACK_ON_EDICT_ALLOCATED,
+        CALLBACK_ON_EDICT_FREED,
+        CALLBACK_COUNT,
+    };
+
+    constexpr std::array<std::string_view, CALLBACK_COUNT> CALLBACK_NAMES = {
+        "Load",
+        "Unload",
+        "Pause",
+        "UnPause",
+        "GetPluginDescription",
+        "LevelInit",
+        "ServerActivate",
+        "GameFrame",
+        "LevelShutdown",
+        "ClientActive",
+        "ClientDisconnect",
+        "ClientPutInServer",
+        "SetCommandClient",
+        "ClientSettingsChanged",
+        "ClientConnect",
+        "ClientCommand",
+        "NetworkIDValidated",
+        "OnQueryCvarValueFinished",
+        "OnEdictAllocated",
+        "OnEdictFreed",
+    };
+
+    // The engine only calls what a plugin's interface version has, the proxy has nothing past version 3.
+    constexpr i32 MAX_INTERFACE_VERSION = 3;
+
+    // More than any server loads, a bigger list isn't a plugin list.
+    constexpr i32 MAX_LIST_SIZE = 256;
+
+    struct CallbackCost
+    {
+        u64 calls{};
+        u64 ns{};
+        u64 tick_ns{}; // Since the last tick.
+        u64 max_tick_ns{};
+    };
+
+    class ScopedCost final
+    {
+    public:
+        explicit ScopedCost(CallbackCost &cost) noexcept
+            : m_cost{cost},
+              m_start{timing_now_ns()}
+        {}
+
+        ~ScopedCost() noexcept
+        {
+            ++m_cost.calls;
+            m_cost.tick_ns += timing_now_ns() - m_start;
+        }
+
+        ScopedCost(const ScopedCost &)            = delete;
+        ScopedCost &operator=(const ScopedCost &) = delete;
+
+    private:
+        CallbackCost &m_cost;
+        u64           m_start;
+    };
+
+    // Stands in for a plugin in the engine's list. Only the main thread calls plugins.
+    class PluginProxy final : public IServerPluginCallbacks
+    {
+    public:
+        CPlugin                                 *m_entry{};
+        IServerPluginCallbacks                  *m_plugin{};
+        std::string                              m_name{};
+        bool                                     m_in_use{};
+        bool                                     m_unloaded{}; // The engine freed `m_entry`, the slot is free after the next report.
+        std::array<CallbackCost, CALLBACK_COUNT> m_costs{};
+        u64                                      m_max_tick_ns{};
+
+        bool Load(CreateInterfaceFn interface_factory, CreateInterfaceFn gameserver_factory) noexcept override
+        {
+            ScopedCost cost{m_costs[CALLBACK_LOAD]};
+            return m_plugin->Load(interface_factory, gameserver_factory);
+        }
+
+        void Unload() noexcept override
+        {
+            {
+                ScopedCost cost{m_costs[CALLBACK_UNLOAD]};
+                m_plugin->Unload();
+            }
+
+            m_unloaded = true;
+        }
+
+        void Pause() noexcept override
+        {
+            ScopedCost cost{m_costs[CALLBACK_PAUSE]};
+            m_plugin->Pause();
+        }
+
+        void UnPause() noexcept override
+        {
+            ScopedCost cost{m_costs[CALLBACK_UNPAUSE]};
+            m_plugin->UnPause();
+        }
+
+        cstr GetPluginDescription() noexcept override
+        {
+            ScopedCost cost{m_costs[CALLBACK_GET_PLUGIN_DESCRIPTION]};
+            return m_plugin->GetPluginDescription();
+        }
+
+        void LevelInit(cstr map_name) noexcept override
+        {
+            ScopedCost cost{m_costs[CALLBACK_LEVEL_INIT]};
+            m_plugin->LevelInit(map_name);
+        }
+
+        void ServerActivate(edict_t *edict_list, i32 edict_count, i32 client_max) noexcept override
+        {
+            ScopedCost cost{m_costs[CALLBACK_SERVER_ACTIVATE]};
+            m_plugin->ServerActivate(edict_list, edict_count, client_max);
+        }
+
+        void GameFrame(bool simulating) noexcept override
+        {
+            ScopedCost cost{m_costs[CALLBACK_GAME_FRAME]};
+            m_plugin->GameFrame(simulating);
+        }
+
+        void LevelShutdown() noexcept override
+        {
+            ScopedCost cost{m_costs[CALLBACK_LEVEL_SHUTDOWN]};
+            m_plugin->LevelShutdown();
+        }
+
+        void ClientActive(edict_t *edict) noexcept override
+        {
+            ScopedCost cost{m_costs[CALLBACK_CLIENT_ACTIVE]};
+            m_plugin->ClientActive(edict);
+        }
+
+        void ClientDisconnect(edict_t *edict) noexcept override
+        {
+            ScopedCost cost{m_costs[CALLBACK_CLIENT_DISCONNECT]};
+            m_plugin->ClientDisconnect(edict);
+        }
+
+        void ClientPutInServer(edict_t *edict, cstr player_name) noexcept override
+        {
+            ScopedCost cost{m_costs[CALLBACK_CLIENT_PUT_IN_SERVER]};
+            m_plugin->ClientPutInServer(edict, player_name);
+        }
+
+        void SetCommandClient(i32 index) noexcept override
+        {
+            ScopedCost cost{m_costs[CALLBACK_SET_COMMAND_CLIENT]};
+            m_plugin->SetCommandClient(index);
+        }
+
+        void ClientSettingsChanged(edict_t *edict) noexcept override
+        {
+            ScopedCost cost{m_costs[CALLBACK_CLIENT_SETTINGS_CHANGED]};
+            m_plugin->ClientSettingsChanged(edict);
+        }
+
+        PLUGIN_RESULT
+        ClientConnect(bool *allow_connect, edict_t *edict, cstr name, cstr address, char *reject, i32 max_reject_len) noexcept override
+        {
+            ScopedCost cost{m_costs[CALLBACK_CLIENT_CONNECT]};
+            return m_plugin->ClientConnect(allow_connect, edict, name, address, reject, max_reject_len);
+        }
+
+        PLUGIN_RESULT ClientCommand(edict_t *edict, const CCommand &args) noexcept override
+        {
+            ScopedCost cost{m_costs[CALLBACK_CLIENT_COMMAND]};
+            return m_plugin->ClientCommand(edict, args);
+        }
+
+        PLUGIN_RESULT NetworkIDValidated(cstr username, cstr network_id) noexcept override
+        {
+            ScopedCost cost{m_costs[CALLBACK_NETWORK_ID_VALIDATED]};
+            return m_plugin->NetworkIDValidated(username, network_id);
+        }
+
+        void OnQueryCvarValueFinished(
+            QueryCvarCookie_t cookie, edict_t *edict, EQueryCvarValueStatus status, cstr cvar_name, cstr cvar_value) noexcept override
+        {
+            ScopedCost cost{m_costs[CALLBACK_ON_QUERY_CVAR_VALUE_FINISHED]};
+            m_plugin->OnQueryCvarValueFinished(cookie, edict, status, cvar_name, cvar_value);
+        }
+
+        void OnEdictAllocated(edict_t *edict) noexcept override
+        {
+            ScopedCost cost{m_costs[CALLBACK_ON_EDICT_ALLOCATED]};
+            m_plugin->OnEdictAllocated(edict);
+        }
+
+        void OnEdictFreed(edict_t *edict) noexcept override
+        {
+            ScopedCost cost{m_costs[CALLBACK_ON_EDICT_FREED]};
+            m_plugin->OnEdictFreed(edict);
+        }
+    };
+
+    struct State
+    {
+        bool                                            running{};
+        const IServerPluginCallbacks                   *self{};
+        CServerPlugin                                  *helpers{};
+        u64                                             interval_ns{};
+        u64                                             next_report_ns{};
+        u64                                             window_ticks{};
+        std::array<PluginProxy, PLUGINCOST_MAX_PLUGINS> proxies{};
+        std::vector<const IServerPluginCallbacks *>     skipped{}; // Already warned about.
+    } g_plugincost{};
+
+    [[nodiscard]] bool is_proxy(const State &state, const IServerPluginCallbacks *plugin) noexcept
+    {
+        return std::any_of(
+            state.proxies.begin(),
+            state.proxies.end(),
+            [&](const PluginProxy &proxy) noexcept { return proxy.m_in_use && plugin == &proxy; });
+    }
+
+    // Checks what can be checked without knowing where our own entry is.
+    [[nodiscard]] bool is_plugin_list(const CUtlVector<CPlugin *> &list) noexcept
+    {
+        if (list.m_Size < 0 || list.m_Size > MAX_LIST_SIZE || list.m_Size > list.m_nAllocationCount || list.m_pElements != list.m_pMemory)
+        {
+            return false;
+        }
+
+        if (list.m_Size != 0 && list.m_pMemory == nullptr)
+        {
+            return false;
+        }
+
+        for (i32 i{}; i < list.m_Size; ++i)
+        {
+            auto *entry = list.m_pMemory[i];
+            if (entry == nullptr || std::memchr(entry->m_szName, 0, sizeof(entry->m_szName)) == nullptr)
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    void skip(State &state, const CPlugin *entry, std::string_view reason) noexcept
+    {
+        if (std::find(state.skipped.begin(), state.skipped.end(), entry->m_pPlugin) != state.skipped.end())
+        {
+            return;
+        }
+
+        state.skipped.push_back(entry->m_pPlugin);
+
+        warn("Plugin callback cost: `{}` isn't timed ({}).\n", entry->m_szName, reason);
+    }
+
+    void wrap(State &state, CPlugin *entry) noexcept
+    {
+        if (entry->m_iPluginInterfaceVersion > MAX_INTERFACE_VERSION)
+        {
+            skip(state, entry, "newer interface version");
+            return;
+        }
+
+        auto it = std::find_if(state.proxies.begin(), state.proxies.end(), [](const PluginProxy &proxy) noexcept { return !proxy.m_in_use; });
+        if (it == state.proxies.end())
+        {
+            skip(state, entry, "too many plugins");
+            return;
+        }
+
+        auto &&proxy        = *it;
+        proxy.m_entry       = entry;
+        proxy.m_plugin      = entry->m_pPlugin;
+        proxy.m_name        = entry->m_szName;
+        proxy.m_in_use      = true;
+        proxy.m_unloaded    = false;
+        proxy.m_costs       = {};
+        proxy.m_max_tick_ns = 0;
+
+        // The engine reads the pointer on every call, the next one goes through the proxy.
+        entry->m_pPlugin = &proxy;
+
+        info("Plugin callback cost: timing `{}`.\n", proxy.m_name);
+    }
+
+    // Wraps plugins that aren't yet. Returns false when the list isn't what it's assumed to be.
+    [[nodiscard]] bool scan(State &state) noexcept
+    {
+        auto &&list = state.helpers->m_Plugins;
+        if (!is_plugin_list(list))
+        {
+            return false;
+        }
+
+        // Our own entry is the only one that can be recognized, without it nothing else can be trusted.
+        bool found_self = std::any_of(
+            list.m_pMemory,
+            list.m_pMemory + list.m_Size,
+            [&](const CPlugin *entry) noexcept { return entry->m_pPlugin == state.self; });
+        if (!found_self)
+        {
+            return false;
+        }
+
+        for (i32 i{}; i < list.m_Size; ++i)
+        {
+            auto *entry = list.m_pMemory[i];
+            if (entry->m_pPlugin != nullptr && entry->m_pPlugin != state.self && !is_proxy(state, entry->m_pPlugin))
+            {
+                wrap(state, entry);
+            }
+        }
+
+        return true;
+    }
+} // namespace
+
+tl::expected<void, PluginCostError> plugincost_start(const IServerPluginCallbacks *self, u64 report_interval_ns) noexcept
+{
+    plugincost_stop();
+
+    auto &&state = g_plugincost;
+
+    auto *helpers = iface_get<CServerPlugin>("ISERVERPLUGINHELPERS", 1);
+    if (helpers == nullptr)
+    {
+        return tl::unexpected{PluginCostError{PluginCostError::NO_HELPERS}};
+    }
+
+    // The engine adds our entry after `Load` returns, the first tick checks the rest.
+    if (!is_plugin_list(helpers->m_Plugins))
+    {
+        return tl::unexpected{PluginCostError{PluginCostError::BAD_LAYOUT}};
+    }
+
+    state.running        = true;
+    state.self           = self;
+    state.helpers        = helpers;
+    state.interval_ns    = report_interval_ns;
+    state.next_report_ns = timing_now_ns() + report_interval_ns;
+    state.window_ticks   = 0;
+    state.skipped.clear();
+
+    return {};
+}
+
+void plugincost_stop() noexcept
+{
+    auto &&state = g_plugincost;
+    if (!state.running)
+    {
+        return;
+    }
+
+    // Plugins the engine already unloaded are gone, their entries with them (on shutdown they're still in the list, freed).
+    for (auto &&proxy : state.proxies)
+    {
+        if (proxy.m_in_use && !proxy.m_unloaded && proxy.m_entry->m_pPlugin == &proxy)
+        {
+            proxy.m_entry->m_pPlugin = proxy.m_plugin;
+        }
+    }
+
+    plugincost_report();
+
+    for (auto &&proxy : state.proxies)
+    {
+        proxy.m_in_use = false;
+        proxy.m_entry  = nullptr;
+        proxy.m_plugin = nullptr;
+    }
+
+    state.running = false;
+    state.self    = nullptr;
+    state.helpers = nullptr;
+}
+
+void plugincost_on_tick(u64 now_ns) noexcept
+{
+    auto &&state = g_plugincost;
+    if (!state.running)
+    {
+        return;
+    }
+
+    if (!scan(state))
+    {
+        warn("Plugin callback cost stopped: The engine's plugin list isn't laid out as expected.\n");
+
+        plugincost_stop();
+        return;
+    }
+
+    for (auto &&proxy : state.proxies)
+    {
+        if (!proxy.m_in_use)
+        {
+            continue;
+        }
+
+        u64 tick_ns{};
+        for (auto &&cost : proxy.m_costs)
+        {
+            cost.ns          += cost.tick_ns;
+            cost.max_tick_ns  = std::max(cost.max_tick_ns, cost.tick_ns);
+            tick_ns          += cost.tick_ns;
+            cost.tick_ns      = 0;
+        }
+
+        proxy.m_max_tick_ns = std::max(proxy.m_max_tick_ns, tick_ns);
+    }
+
+    ++state.window_ticks;
+
+    if (now_ns < state.next_report_ns)
+    {
+        return;
+    }
+
+    plugincost_report();
+
+    state.next_report_ns = now_ns + state.interval_ns;
+}
+
+void plugincost_report() noexcept
+{
+    auto &&state = g_plugincost;
+    if (!state.running)
+    {
+        return;
+    }
+
+    std::vector<std::pair<const PluginProxy *, u64>> plugins{};
+    for (auto &&proxy : state.proxies)
+    {
+        if (!proxy.m_in_use)
+        {
+            continue;
+        }
+
+        u64 ns{};
+        for (auto &&cost : proxy.m_costs)
+        {
+            ns += cost.ns;
+        }
+
+        plugins.emplace_back(&proxy, ns);
+    }
+
+    if (state.window_ticks != 0 && !plugins.empty())
+    {
+        const auto ticks = (f64)state.window_ticks;
+
+        std::sort(plugins.begin(), plugins.end(), [](const auto &lhs, const auto &rhs) noexcept { return lhs.second > rhs.second; });
+
+        info("Plugin callback cost over {} ticks:\n", state.window_ticks);
+        for (auto &&[proxy, ns] : plugins)
+        {
+            info(
+                "  {:>9.1f} us per tick (max {:>9.1f})  {}{}\n",
+                (f64)ns / ticks / 1e3,
+                (f64)proxy->m_max_tick_ns / 1e3,
+                proxy->m_name,
+                proxy->m_unloaded ? " (unloaded)" : "");
+
+            for (usize i{}; i < proxy->m_costs.size(); ++i)
+            {
+                auto &&cost = proxy->m_costs[i];
+                if (cost.calls == 0)
+                {
+                    continue;
+                }
+
+                info(
+                    "    {:>9.1f} us per tick (max {:>9.1f}) {:>8.2f} calls  {}\n",
+                    (f64)cost.ns / ticks / 1e3,
+                    (f64)cost.max_tick_ns / 1e3,
+                    (f64)cost.calls / ticks,
+                    CALLBACK_NAMES[i]);
+            }
+        }
+    }
+
+    for (auto &&proxy : state.proxies)
+    {
+        for (auto &&cost : proxy.m_costs)
+        {
+            cost.calls       = 0;
+            cost.ns          = 0;
+            cost.max_tick_ns = 0;
+        }
+
+        proxy.m_max_tick_ns = 0;
+
+        if (proxy.m_unloaded)
+        {
+            proxy.m_in_use   = false;
+            proxy.m_unloaded = false;
+            proxy.m_entry    = nullptr;
+            proxy.m_plugin   = nullptr;
+        }
+    }
+
+    state.window_ticks = 0;
+}
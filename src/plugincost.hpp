@@ -0,0 +1,36 @@
+#pragma once
+
+#include "type.hpp"
+#include "engine.hpp"
+#include <tl/expected.hpp>
+
+// Callback cost per plugin. Every other plugin in the engine's list gets a proxy in front of it that times each callback, the
+// engine calls the proxy and it forwards to the plugin. Calls and time are counted per plugin and per callback, a tick goes from
+// one of our `GameFrame`s to the next.
+// Times are inclusive, a callback that ends up in another plugin's (a `ClientCommand` that kicks someone) pays for both.
+// Metamod:Source is one plugin, its own plugins are counted as its callbacks.
+// Plugins loaded later (`plugin_load`) are picked up on the next tick, plugins unloaded while wrapped are reported once more.
+
+constexpr usize PLUGINCOST_MAX_PLUGINS = 32; // Later plugins aren't wrapped.
+
+struct PluginCostError
+{
+    enum Type : u8
+    {
+        NO_HELPERS, // The engine doesn't expose `ISERVERPLUGINHELPERS001`.
+        BAD_LAYOUT, // Its plugin list doesn't look like one.
+    } type;
+};
+
+// `self` is our own plugin, which is left alone (and must be in the list on the first tick, or the list isn't what it's assumed to be).
+// Must be called from the main thread.
+tl::expected<void, PluginCostError> plugincost_start(const IServerPluginCallbacks *self, u64 report_interval_ns) noexcept;
+
+// Puts the plugins back in the list and reports the last window.
+void plugincost_stop() noexcept;
+
+// Called from `GameFrame` on every simulated tick, wraps new plugins and reports every interval.
+void plugincost_on_tick(u64 now_ns) noexcept;
+
+// Logs the cost since the last report and starts a new window.
+void plugincost_report() noexcept;
@@ -0,0 +1,386 @@
+#include "pmu.hpp"
+#include "common.hpp"
+#include "log.hpp"
+#include <algorithm>
+#include <array>
+#include <string>
+#include <vector>
+#if TR_OS_LINUX
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+namespace
+{
+#if TR_OS_LINUX
+    enum Counter : u8
+    {
+        COUNTER_CYCLES, // Group leader.
+        COUNTER_INSTRUCTIONS,
+        COUNTER_LLC_MISSES,
+        COUNTER_BRANCH_MISSES,
+        COUNTER_COUNT,
+    };
+
+    constexpr std::array<u64, COUNTER_COUNT> COUNTER_CONFIGS = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES, // The last level cache on every x86 PMU.
+        PERF_COUNT_HW_BRANCH_MISSES,
+    };
+
+    // Player counts above this share the last bucket.
+    constexpr usize MAX_PLAYER_BUCKETS = 65;
+
+    using Counts = std::array<u64, COUNTER_COUNT>;
+
+    struct Totals
+    {
+        u64    ticks{};
+        Counts sums{};
+        u64    max_cycles{};
+
+        void add(const Counts &counts) noexcept
+        {
+            ++ticks;
+            for (usize i{}; i < COUNTER_COUNT; ++i)
+            {
+                sums[i] += counts[i];
+            }
+
+            max_cycles = std::max(max_cycles, counts[COUNTER_CYCLES]);
+        }
+    };
+
+    struct State
+    {
+        std::array<int, COUNTER_COUNT>                    fds{-1, -1, -1, -1};
+        std::array<perf_event_mmap_page *, COUNTER_COUNT> pages{};
+        bool                                              rdpmc{};
+        Counts                                            last{};
+        bool                                              have_last{};
+
+        std::string                            map{};
+        Totals                                 totals{};
+        std::array<Totals, MAX_PLAYER_BUCKETS> by_players{};
+    } g_pmu{};
+
+    [[nodiscard]] u64 rdpmc(u32 index) noexcept
+    {
+#if TR_ARCH_X86_64 || TR_ARCH_X86_32
+        u32 lo;
+        u32 hi;
+        asm volatile("rdpmc" : "=a"(lo), "=d"(hi) : "c"(index));
+        return ((u64)hi << 32) | lo;
+#else
+        return 0;
+#endif
+    }
+
+    // The self-monitoring protocol from `perf_event.h`: retry if the kernel rescheduled the event while we were reading.
+    // Returns false if the counter isn't on the PMU right now (multiplexed out), the caller falls back to `read`.
+    [[nodiscard]] bool read_user(const perf_event_mmap_page *page, u64 &out) noexcept
+    {
+        u32 sequence;
+        u64 count;
+        u32 index;
+
+        do
+        {
+            sequence = __atomic_load_n(&page->lock, __ATOMIC_ACQUIRE);
+
+            index = page->index;
+            count = (u64)page->offset;
+            if (index == 0 || page->cap_user_rdpmc == 0)
+            {
+                return false;
+            }
+
+            // Sign extend the raw value to the counter's width, the offset compensates for it.
+            u64  raw   = rdpmc(index - 1);
+            u16  width = page->pmc_width;
+            auto value = (i64)(raw << (64 - width)) >> (64 - width);
+
+            count += (u64)value;
+
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        } while (__atomic_load_n(&page->lock, __ATOMIC_RELAXED) != sequence);
+
+        out = count;
+        return true;
+    }
+
+    [[nodiscard]] bool read_group(const State &state, Counts &out) noexcept
+    {
+        // `PERF_FORMAT_GROUP`: u64 nr, u64 values[nr] in the order the events were opened.
+        std::array<u64, 1 + COUNTER_COUNT> buf{};
+        if (read(state.fds[COUNTER_CYCLES], buf.data(), sizeof(buf)) != (ssize_t)sizeof(buf) || buf[0] != COUNTER_COUNT)
+        {
+            return false;
+        }
+
+        std::copy(buf.begin() + 1, buf.end(), out.begin());
+        return true;
+    }
+
+    [[nodiscard]] bool read_counters(const State &state, Counts &out) noexcept
+    {
+        if (state.rdpmc)
+        {
+            bool ok = true;
+            for (usize i{}; i < COUNTER_COUNT && ok; ++i)
+            {
+                ok = read_user(state.pages[i], out[i]);
+            }
+
+            if (ok)
+            {
+                return true;
+            }
+        }
+
+        return read_group(state, out);
+    }
+
+    // "1.23M" etc, for log lines.
+    [[nodiscard]] std::string si(f64 value) noexcept
+    {
+        if (value >= 1e9)
+        {
+            return fmt::format("{:.2f}G", value / 1e9);
+        }
+        if (value >= 1e6)
+        {
+            return fmt::format("{:.2f}M", value / 1e6);
+        }
+        if (value >= 1e3)
+        {
+            return fmt::format("{:.1f}k", value / 1e3);
+        }
+
+        return fmt::format("{:.0f}", value);
+    }
+
+    [[nodiscard]] std::string describe(const Totals &totals) noexcept
+    {
+        const auto ticks        = (f64)totals.ticks;
+        const auto cycles       = (f64)totals.sums[COUNTER_CYCLES];
+        const auto instructions = (f64)totals.sums[COUNTER_INSTRUCTIONS];
+        const auto kilo_instr   = std::max(instructions / 1000.0, 1.0);
+
+        return fmt::format(
+            "{} ticks, per tick {} instructions, {} cycles (IPC {:.2f}, max {}), {} LLC misses ({:.2f} MPKI), {} branch misses "
+            "({:.2f} MPKI)",
+            totals.ticks,
+            si(instructions / ticks),
+            si(cycles / ticks),
+            cycles > 0.0 ? instructions / cycles : 0.0,
+            si((f64)totals.max_cycles),
+            si((f64)totals.sums[COUNTER_LLC_MISSES] / ticks),
+            (f64)totals.sums[COUNTER_LLC_MISSES] / kilo_instr,
+            si((f64)totals.sums[COUNTER_BRANCH_MISSES] / ticks),
+            (f64)totals.sums[COUNTER_BRANCH_MISSES] / kilo_instr);
+    }
+#endif
+} // namespace
+
+tl::expected<void, PmuError> pmu_open() noexcept
+{
+#if TR_OS_LINUX
+    pmu_close();
+
+    auto &&state = g_pmu;
+    auto   fail  = [](int err) noexcept
+    {
+        pmu_close();
+
+        if (err == EACCES || err == EPERM)
+        {
+            return tl::unexpected{PmuError{PmuError::NO_PERMISSION}};
+        }
+
+        // No PMU, or this event isn't supported by it.
+        if (err == ENOENT || err == EOPNOTSUPP || err == ENODEV)
+        {
+            return tl::unexpected{PmuError{PmuError::UNSUPPORTED}};
+        }
+
+        return tl::unexpected{PmuError{PmuError::FAILED_TO_OPEN}};
+    };
+
+    for (usize i{}; i < COUNTER_COUNT; ++i)
+    {
+        perf_event_attr attr{};
+        attr.size           = sizeof(attr);
+        attr.type           = PERF_TYPE_HARDWARE;
+        attr.config         = COUNTER_CONFIGS[i];
+        attr.read_format    = PERF_FORMAT_GROUP;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv     = 1;
+        attr.disabled       = i == COUNTER_CYCLES ? 1 : 0; // Members follow the leader.
+
+        int group = i == COUNTER_CYCLES ? -1 : state.fds[COUNTER_CYCLES];
+        int fd    = (int)syscall(SYS_perf_event_open, &attr, 0, -1, group, PERF_FLAG_FD_CLOEXEC);
+        if (fd < 0)
+        {
+            return fail(errno);
+        }
+
+        state.fds[i] = fd;
+    }
+
+    // The user page of each event tells if and where it can be read with `rdpmc`.
+    const auto page_size = (usize)sysconf(_SC_PAGESIZE);
+
+    state.rdpmc = TR_ARCH_X86_64 || TR_ARCH_X86_32;
+    for (usize i{}; i < COUNTER_COUNT; ++i)
+    {
+        void *page = mmap(nullptr, page_size, PROT_READ, MAP_SHARED, state.fds[i], 0);
+        if (page == MAP_FAILED)
+        {
+            state.rdpmc = false;
+            continue;
+        }
+
+        state.pages[i] = (perf_event_mmap_page *)page;
+    }
+
+    if (ioctl(state.fds[COUNTER_CYCLES], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP) != 0)
+    {
+        return fail(errno);
+    }
+
+    // `cap_user_rdpmc` is only known once the events are scheduled.
+    Counts counts{};
+    for (usize i{}; i < COUNTER_COUNT && state.rdpmc; ++i)
+    {
+        state.rdpmc = read_user(state.pages[i], counts[i]);
+    }
+
+    return {};
+#else
+    return tl::unexpected{PmuError{PmuError::UNSUPPORTED}};
+#endif
+}
+
+void pmu_close() noexcept
+{
+#if TR_OS_LINUX
+    auto &&state = g_pmu;
+
+    const auto page_size = (usize)sysconf(_SC_PAGESIZE);
+    for (usize i{}; i < COUNTER_COUNT; ++i)
+    {
+        if (state.pages[i] != nullptr)
+        {
+            munmap(state.pages[i], page_size);
+        }
+
+        // Members first doesn't matter, closing the leader turns them into singletons.
+        if (state.fds[i] >= 0)
+        {
+            close(state.fds[i]);
+        }
+    }
+
+    state = {};
+#endif
+}
+
+[[nodiscard]] bool pmu_is_open() noexcept
+{
+#if TR_OS_LINUX
+    return g_pmu.fds[COUNTER_CYCLES] >= 0;
+#else
+    return false;
+#endif
+}
+
+[[nodiscard]] bool pmu_uses_rdpmc() noexcept
+{
+#if TR_OS_LINUX
+    return g_pmu.rdpmc;
+#else
+    return false;
+#endif
+}
+
+void pmu_begin_map([[maybe_unused]] std::string_view map_name) noexcept
+{
+#if TR_OS_LINUX
+    auto &&state = g_pmu;
+
+    state.map        = map_name;
+    state.totals     = {};
+    state.by_players = {};
+
+    // The map load isn't a tick.
+    state.have_last = false;
+#endif
+}
+
+void pmu_end_map() noexcept
+{
+#if TR_OS_LINUX
+    auto &&state = g_pmu;
+
+    // `LevelShutdown` can be called more than once per map.
+    if (!pmu_is_open() || state.totals.ticks == 0)
+    {
+        return;
+    }
+
+    // Loaded in the middle of a map.
+    std::string_view map = state.map.empty() ? std::string_view{"this map"} : std::string_view{state.map};
+
+    info("Counters for {}: {}.\n", map, describe(state.totals));
+
+    for (usize players{}; players < MAX_PLAYER_BUCKETS; ++players)
+    {
+        if (auto &&totals = state.by_players[players]; totals.ticks != 0)
+        {
+            info("  {}{} players: {}.\n", players, players + 1 == MAX_PLAYER_BUCKETS ? "+" : "", describe(totals));
+        }
+    }
+
+    state.totals     = {};
+    state.by_players = {};
+#endif
+}
+
+void pmu_on_tick([[maybe_unused]] u32 players) noexcept
+{
+#if TR_OS_LINUX
+    auto &&state = g_pmu;
+    if (!pmu_is_open())
+    {
+        return;
+    }
+
+    Counts now{};
+    if (!read_counters(state, now))
+    {
+        state.have_last = false;
+        return;
+    }
+
+    if (state.have_last)
+    {
+        Counts delta{};
+        for (usize i{}; i < COUNTER_COUNT; ++i)
+        {
+            delta[i] = now[i] - state.last[i];
+        }
+
+        state.totals.add(delta);
+        state.by_players[std::min<usize>(players, MAX_PLAYER_BUCKETS - 1)].add(delta);
+    }
+
+    state.last      = now;
+    state.have_last = true;
+#endif
+}
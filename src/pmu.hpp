@@ -0,0 +1,35 @@
+#pragma once
+
+#include "type.hpp"
+#include <tl/expected.hpp>
+#include <string_view>
+
+// Hardware performance counters for the main thread: instructions, cycles, LLC misses and branch misses per tick, to tell whether a
+// server is limited by the work it does, by memory or by branchy code. Opened as one `perf_event_open` group (user space only) and
+// read with `rdpmc` when the kernel allows it (`/sys/devices/cpu/rdpmc`), so a tick costs no syscalls. Otherwise the group is read
+// with a single `read`.
+// Ticks are summarized per map and per player count, reset at `LevelInit` and logged at `LevelShutdown`.
+
+struct PmuError
+{
+    enum Type : u8
+    {
+        UNSUPPORTED,   // Not Linux, or no hardware counters (most VMs).
+        NO_PERMISSION, // `perf_event_paranoid` is above 2, or seccomp blocks it (containers).
+        FAILED_TO_OPEN,
+    } type;
+};
+
+// Must be called from the main thread, only that thread is counted.
+tl::expected<void, PmuError> pmu_open() noexcept;
+void                         pmu_close() noexcept;
+
+[[nodiscard]] bool pmu_is_open() noexcept;
+[[nodiscard]] bool pmu_uses_rdpmc() noexcept;
+
+// Called from `LevelInit`/`LevelShutdown`.
+void pmu_begin_map(std::string_view map_name) noexcept;
+void pmu_end_map() noexcept;
+
+// Called from `GameFrame` on every simulated tick, the counts since the last call go to the tick that just ended.
+void pmu_on_tick(u32 players) noexcept;
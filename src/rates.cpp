@@ -0,0 +1,121 @@
+#include "rates.hpp"
+#include "log.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    // Rough per-snapshot size: fixed overhead (headers, tick/string tables) plus the delta-compressed state of each player.
+    // These are deliberately on the generous side, a choked client is a lot worse than a few unused KB/s.
+    constexpr u32 SNAPSHOT_BASE_BYTES       = 128;
+    constexpr u32 SNAPSHOT_BYTES_PER_PLAYER = 48;
+
+    [[nodiscard]] f32 get_value(const ConVar *var) noexcept
+    {
+        return var->m_pParent != nullptr ? var->m_pParent->m_fValue : var->m_fValue;
+    }
+
+    void set_value(ConVar *var, f32 value) noexcept
+    {
+        // Values are integers in practice, the string setter keeps `m_pszString` readable for `cvarlist` etc.
+        auto str = fmt::format("{}", (i64)std::lround(value));
+        static_cast<IConVar *>(var)->SetValue(str.c_str());
+    }
+
+    // Raises/lowers a ConVar towards `target` and reports whether the engine accepted it (ConVar bounds can clamp it).
+    void set_checked(ConVar *var, cstr name, f32 target) noexcept
+    {
+        set_value(var, target);
+
+        if (f32 result = get_value(var); std::fabs(result - target) >= 0.5f)
+        {
+            warn("`{}` was clamped to {} by its bounds (wanted {}).\n", name, result, target);
+        }
+    }
+} // namespace
+
+[[nodiscard]] u32 rates_required_bandwidth(u16 tickrate, i32 client_max) noexcept
+{
+    u32 players = (u32)std::max(client_max, 1);
+    return (u32)tickrate * (SNAPSHOT_BASE_BYTES + SNAPSHOT_BYTES_PER_PLAYER * players);
+}
+
+void rates_apply(ICvar *cvar, u16 tickrate, i32 client_max) noexcept
+{
+    if (cvar == nullptr || tickrate == 0)
+    {
+        return;
+    }
+
+    auto find = [cvar](cstr name) noexcept -> ConVar *
+    {
+        auto *var = cvar->FindVar(name);
+        if (var == nullptr)
+        {
+            info("`{}` doesn't exist, skipping.\n", name);
+        }
+
+        return var;
+    };
+
+    const auto rate = (f32)tickrate;
+
+    // Max rates below the tickrate cap every client. Above it they're left as they are, the engine clamps to the tickrate anyway.
+    for (cstr name : {"sv_maxupdaterate", "sv_maxcmdrate"})
+    {
+        auto *var = find(name);
+        if (var == nullptr)
+        {
+            continue;
+        }
+
+        if (f32 value = get_value(var); value < rate)
+        {
+            warn("`{} {}` caps clients below the tickrate ({}), raising it.\n", name, value, tickrate);
+            set_checked(var, name, rate);
+        }
+    }
+
+    // Min rates above the tickrate can't be honored.
+    for (cstr name : {"sv_minupdaterate", "sv_mincmdrate"})
+    {
+        auto *var = find(name);
+        if (var == nullptr)
+        {
+            continue;
+        }
+
+        if (f32 value = get_value(var); value > rate)
+        {
+            info("`{} {}` is above the tickrate, lowering it to {}.\n", name, value, tickrate);
+            set_checked(var, name, rate);
+        }
+    }
+
+    // Bandwidth (bytes per second per client). Zero means unlimited for `sv_maxrate`.
+    const auto required = (f32)rates_required_bandwidth(tickrate, client_max);
+
+    // Only ever raised, `sv_minrate` is the operator's call (raising it forces the bandwidth on clients that can't take it).
+    if (auto *var = find("sv_maxrate"); var != nullptr)
+    {
+        if (f32 max_rate = get_value(var); max_rate > 0.0f && max_rate < required)
+        {
+            warn(
+                "`sv_maxrate {}` can't carry a snapshot every tick for {} players (needs ~{}), raising it.\n",
+                max_rate,
+                client_max,
+                (u32)required);
+            set_checked(var, "sv_maxrate", required);
+        }
+    }
+
+    // Large snapshots are split, and split packets have their own (low) rate limit.
+    if (auto *var = find("net_splitpacket_maxrate"); var != nullptr)
+    {
+        if (f32 value = get_value(var); value < required)
+        {
+            warn("`net_splitpacket_maxrate {}` limits split snapshots (needs ~{}), raising it.\n", value, (u32)required);
+            set_checked(var, "net_splitpacket_maxrate", required);
+        }
+    }
+}
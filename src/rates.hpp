@@ -0,0 +1,13 @@
+#pragma once
+
+#include "type.hpp"
+#include "engine.hpp"
+
+// Network rate ConVars that have to follow the tickrate. Without them the engine silently caps updates/commands below the tickrate.
+
+// Raises the update/command rate ConVars that are below the tickrate and the bandwidth limits (`sv_maxrate`, split packets) that can't
+// carry a full snapshot every tick for `client_max` players. Operator values that would bottleneck the server are logged.
+void rates_apply(ICvar *cvar, u16 tickrate, i32 client_max) noexcept;
+
+// Estimated snapshot bandwidth (bytes per second) a single client needs at a tickrate with `client_max` players.
+[[nodiscard]] u32 rates_required_bandwidth(u16 tickrate, i32 client_max) noexcept;
@@ -0,0 +1,505 @@
+#include "residency.hpp"
+#include "common.hpp"
+#include "os.hpp"
+#include "string.hpp"
+#include "timing.hpp"
+#include "log.hpp"
+#include <algorithm>
+#include <array>
+#include <string>
+#include <string_view>
+#include <vector>
+#if TR_OS_LINUX
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <alloca.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#endif
+
+namespace
+{
+#if TR_OS_LINUX
+    // Linux 5.14 and 4.4, older headers don't have them.
+    constexpr int POPULATE_WRITE = 23;
+    constexpr int LOCK_ON_FAULT  = 4;
+
+    // The kernel fails allocations once the locked size reaches the limit, it's unlocked before that.
+    constexpr u64 UNLOCK_PERCENT = 90;
+
+    struct Faults
+    {
+        u64 minor{};
+        u64 major{};
+    };
+
+    struct State
+    {
+        bool locked{};
+        u64  lock_limit{};
+        u64  next_lock_check_ns{};
+
+        bool   counting{};
+        u64    interval_ns{};
+        u64    next_report_ns{};
+        Faults totals{}; // At the previous tick.
+        Faults window{};
+        Faults window_max{};
+        u32    window_ticks{};
+        u32    faulted_ticks{}; // Had at least one.
+    } g_residency{};
+
+    struct Region
+    {
+        uintptr_t begin;
+        uintptr_t end;
+        bool      heap; // `[heap]`, anonymous otherwise.
+    };
+
+    [[nodiscard]] Faults thread_faults() noexcept
+    {
+        rusage usage{};
+        getrusage(RUSAGE_THREAD, &usage);
+        return {(u64)usage.ru_minflt, (u64)usage.ru_majflt};
+    }
+
+    [[nodiscard]] std::string_view read_text(cstr path, std::vector<u8> &buf) noexcept
+    {
+        buf = os_read_binary_file(path);
+        return {(cstr)buf.data(), buf.size()};
+    }
+
+    // The value of a `/proc/self/status` field, empty if it's missing.
+    [[nodiscard]] std::string status_value(std::string_view key) noexcept
+    {
+        std::vector<u8> buf{};
+        for (auto &&line : str_split(read_text("/proc/self/status", buf), '\n'))
+        {
+            if (line.size() > key.size() && line.compare(0, key.size(), key) == 0 && line[key.size()] == ':')
+            {
+                return line.substr(key.size() + 1);
+            }
+        }
+
+        return {};
+    }
+
+    // A `kB` field in bytes, 0 if it's missing.
+    [[nodiscard]] u64 status_bytes(std::string_view key) noexcept
+    {
+        unsigned long long kib{};
+        return std::sscanf(status_value(key).c_str(), "%llu", &kib) == 1 ? (u64)kib * 1024 : 0;
+    }
+
+    // The kernel doesn't apply `RLIMIT_MEMLOCK` with `CAP_IPC_LOCK` (root, or granted to the server).
+    [[nodiscard]] bool has_ipc_lock() noexcept
+    {
+        constexpr u32 CAP_IPC_LOCK = 14;
+
+        unsigned long long caps{};
+        return std::sscanf(status_value("CapEff").c_str(), "%llx", &caps) == 1 && (caps >> CAP_IPC_LOCK & 1) != 0;
+    }
+
+    [[nodiscard]] u64 from_rlim(rlim_t value) noexcept
+    {
+        return value == RLIM_INFINITY ? ~0ull : (u64)value;
+    }
+
+    // `rlim_t` is 32-bit on 32-bit builds, anything that doesn't fit is unlimited.
+    [[nodiscard]] rlim_t to_rlim(u64 value) noexcept
+    {
+        return value >= (u64)RLIM_INFINITY ? RLIM_INFINITY : (rlim_t)value;
+    }
+
+    // The heap and anonymous private writable mappings. Thread stacks are left out, they're right above their guard mapping (`---p`),
+    // glibc's arenas have theirs above. The main thread's stack is `[stack]`.
+    [[nodiscard]] std::vector<Region> get_regions() noexcept
+    {
+        std::vector<Region> result{};
+        uintptr_t           guard_end{};
+
+        std::vector<u8> buf{};
+        for (auto &&line : str_split(read_text("/proc/self/maps", buf), '\n'))
+        {
+            uintptr_t begin{};
+            uintptr_t end{};
+            char      perms[5]{};
+            int       path_offset{};
+
+            if (std::sscanf(line.c_str(), "%" SCNxPTR "-%" SCNxPTR " %4s %*s %*s %*s %n", &begin, &end, perms, &path_offset) < 3)
+            {
+                continue;
+            }
+
+            std::string_view access{perms};
+            if (access == "---p")
+            {
+                guard_end = end;
+                continue;
+            }
+
+            std::string_view path = std::string_view{line}.substr((usize)path_offset);
+            bool             heap = path == "[heap]";
+            if (access != "rw-p" || (!heap && (!path.empty() || begin == guard_end)))
+            {
+                continue;
+            }
+
+            result.push_back({begin, end, heap});
+        }
+
+        return result;
+    }
+
+    // Writes a byte per page below the caller's frame, the stack only grows when it's touched.
+    [[gnu::noinline]] void touch_stack(usize bytes) noexcept
+    {
+        const auto page_size = (usize)sysconf(_SC_PAGESIZE);
+
+        auto *stack = (volatile u8 *)alloca(bytes);
+        for (usize offset{}; offset < bytes; offset += page_size)
+        {
+            stack[offset] = 0;
+        }
+    }
+
+    void check_lock(State &state) noexcept
+    {
+        u64 locked = status_bytes("VmLck");
+        if (locked * 100 <= state.lock_limit * UNLOCK_PERCENT)
+        {
+            return;
+        }
+
+        munlockall();
+        state.locked = false;
+
+        warn(
+            "Unlocked the server's memory, {} MiB is locked and the limit is {} MiB (`-tickrate_mlock_limit`).\n",
+            locked >> 20,
+            state.lock_limit >> 20);
+    }
+
+    void report(const State &state) noexcept
+    {
+        const auto ticks = (f64)state.window_ticks;
+
+        info(
+            "Page faults of the main thread over {} ticks: {:.2f} minor (max {}) and {:.2f} major (max {}) per tick, {} ticks had any.\n",
+            state.window_ticks,
+            (f64)state.window.minor / ticks,
+            state.window_max.minor,
+            (f64)state.window.major / ticks,
+            state.window_max.major,
+            state.faulted_ticks);
+    }
+#endif
+} // namespace
+
+[[nodiscard]] std::string_view residency_error_str(ResidencyError error) noexcept
+{
+    constexpr std::array<std::string_view, 5> strings = {
+        "Not supported on this platform",
+        "Failed to read `/proc/self/maps`",
+        "Less than twice the mapped memory can be locked (raise `ulimit -l` or `-tickrate_mlock_limit`)",
+        "`mlockall` failed",
+        "Transparent huge pages are disabled",
+    };
+
+    return error.type < strings.size() ? strings[error.type] : "unknown";
+}
+
+tl::expected<ResidencyLock, ResidencyError> residency_lock([[maybe_unused]] u64 limit_bytes) noexcept
+{
+#if TR_OS_LINUX
+    auto &&state = g_residency;
+    if (state.locked)
+    {
+        residency_unlock();
+    }
+
+    rlimit memlock{};
+    if (getrlimit(RLIMIT_MEMLOCK, &memlock) != 0)
+    {
+        return tl::unexpected{ResidencyError{ResidencyError::FAILED_TO_LOCK}};
+    }
+
+    // The soft limit can go up to the hard one, raising the hard one needs `CAP_SYS_RESOURCE`.
+    rlimit wanted   = memlock;
+    wanted.rlim_cur = to_rlim(limit_bytes);
+    if (from_rlim(memlock.rlim_max) < limit_bytes)
+    {
+        wanted.rlim_max = wanted.rlim_cur;
+    }
+
+    if (setrlimit(RLIMIT_MEMLOCK, &wanted) != 0)
+    {
+        wanted.rlim_cur = memlock.rlim_max;
+        wanted.rlim_max = memlock.rlim_max;
+        (void)setrlimit(RLIMIT_MEMLOCK, &wanted);
+    }
+
+    if (getrlimit(RLIMIT_MEMLOCK, &memlock) != 0)
+    {
+        return tl::unexpected{ResidencyError{ResidencyError::FAILED_TO_LOCK}};
+    }
+
+    // Without a limit from the kernel, `limit_bytes` is only enforced by `check_lock`.
+    ResidencyLock result{};
+    result.limit  = has_ipc_lock() ? limit_bytes : std::min(limit_bytes, from_rlim(memlock.rlim_cur));
+    result.mapped = status_bytes("VmSize");
+
+    // Everything that's mapped counts, reserved address space included. Room to grow, future mappings are locked too.
+    if (result.mapped == 0 || result.mapped > result.limit / 2)
+    {
+        return tl::unexpected{ResidencyError{ResidencyError::LIMIT_TOO_LOW}};
+    }
+
+    result.on_fault = true;
+
+    int rc = mlockall(MCL_CURRENT | MCL_FUTURE | LOCK_ON_FAULT);
+    if (rc != 0 && errno == EINVAL)
+    {
+        result.on_fault = false;
+        rc              = mlockall(MCL_CURRENT | MCL_FUTURE);
+    }
+
+    if (rc != 0)
+    {
+        // Some of it may be locked.
+        munlockall();
+        return tl::unexpected{ResidencyError{ResidencyError::FAILED_TO_LOCK}};
+    }
+
+    state.locked             = true;
+    state.lock_limit         = result.limit;
+    state.next_lock_check_ns = timing_now_ns() + RESIDENCY_LOCK_CHECK_NS;
+
+    return result;
+#else
+    return tl::unexpected{ResidencyError{ResidencyError::UNSUPPORTED}};
+#endif
+}
+
+void residency_unlock() noexcept
+{
+#if TR_OS_LINUX
+    auto &&state = g_residency;
+    if (!state.locked)
+    {
+        return;
+    }
+
+    munlockall();
+    state.locked = false;
+#endif
+}
+
+[[nodiscard]] bool residency_is_locked() noexcept
+{
+#if TR_OS_LINUX
+    return g_residency.locked;
+#else
+    return false;
+#endif
+}
+
+tl::expected<ResidencyHugePages, ResidencyError> residency_advise_huge_pages([[maybe_unused]] u64 min_region_bytes) noexcept
+{
+#if TR_OS_LINUX
+    // "always [madvise] never", missing when the kernel is built without them.
+    std::vector<u8> buf{};
+    auto            mode = read_text("/sys/kernel/mm/transparent_hugepage/enabled", buf);
+    if (mode.empty() || str_sv_contains(mode, "[never]"))
+    {
+        return tl::unexpected{ResidencyError{ResidencyError::THP_DISABLED}};
+    }
+
+    auto regions = get_regions();
+    if (regions.empty())
+    {
+        return tl::unexpected{ResidencyError{ResidencyError::FAILED_TO_READ_MAPS}};
+    }
+
+    ResidencyHugePages result{};
+    result.always = str_sv_contains(mode, "[always]");
+
+    for (auto &&region : regions)
+    {
+        const auto size = (u64)(region.end - region.begin);
+        if (size < min_region_bytes)
+        {
+            continue;
+        }
+
+        // The whole mapping, so it isn't split. Only the aligned 2 MiB blocks inside it get huge pages.
+        if (madvise((void *)region.begin, (usize)size, MADV_HUGEPAGE) != 0)
+        {
+            ++result.failed;
+            continue;
+        }
+
+        ++result.regions;
+        result.bytes += size;
+    }
+
+    return result;
+#else
+    return tl::unexpected{ResidencyError{ResidencyError::UNSUPPORTED}};
+#endif
+}
+
+tl::expected<ResidencyPrefault, ResidencyError> residency_prefault([[maybe_unused]] u64 limit_bytes) noexcept
+{
+#if TR_OS_LINUX
+    u64 start = timing_now_ns();
+
+    // Leave most of the stack to the engine if the limit is small.
+    usize  stack_bytes = RESIDENCY_STACK_BYTES;
+    rlimit stack{};
+    if (getrlimit(RLIMIT_STACK, &stack) == 0 && stack.rlim_cur != RLIM_INFINITY)
+    {
+        stack_bytes = std::min<usize>(stack_bytes, (usize)stack.rlim_cur / 4);
+    }
+
+    touch_stack(stack_bytes);
+
+    auto regions = get_regions();
+    if (regions.empty())
+    {
+        return tl::unexpected{ResidencyError{ResidencyError::FAILED_TO_READ_MAPS}};
+    }
+
+    // The heap first, it's what the engine allocates from.
+    std::stable_partition(regions.begin(), regions.end(), [](const Region &region) { return region.heap; });
+
+    ResidencyPrefault result{};
+    result.populated = true;
+
+    auto before = thread_faults();
+
+    for (auto &&region : regions)
+    {
+        const auto size = (u64)(region.end - region.begin);
+        if (result.bytes + size > limit_bytes)
+        {
+            result.truncated = true;
+            continue;
+        }
+
+        // Populating writable pages doesn't change what's in them, other threads can be using them.
+        int rc = madvise((void *)region.begin, (usize)size, result.populated ? POPULATE_WRITE : MADV_WILLNEED);
+        if (rc != 0 && errno == EINVAL && result.populated)
+        {
+            // Older kernel, the best it can do is read back what was swapped out.
+            result.populated = false;
+            rc               = madvise((void *)region.begin, (usize)size, MADV_WILLNEED);
+        }
+
+        // Mostly regions that were unmapped since `/proc/self/maps` was read.
+        if (rc != 0)
+        {
+            ++result.failed;
+            continue;
+        }
+
+        ++result.regions;
+        result.bytes += size;
+    }
+
+    auto after = thread_faults();
+
+    result.faults = (after.minor - before.minor) + (after.major - before.major);
+    result.ms     = (f64)(timing_now_ns() - start) / 1e6;
+
+    return result;
+#else
+    return tl::unexpected{ResidencyError{ResidencyError::UNSUPPORTED}};
+#endif
+}
+
+tl::expected<void, ResidencyError> residency_start([[maybe_unused]] u64 report_interval_ns) noexcept
+{
+#if TR_OS_LINUX
+    auto &&state = g_residency;
+
+    state.counting       = true;
+    state.interval_ns    = report_interval_ns;
+    state.next_report_ns = timing_now_ns() + report_interval_ns;
+    state.totals         = thread_faults();
+    state.window         = {};
+    state.window_max     = {};
+    state.window_ticks   = 0;
+    state.faulted_ticks  = 0;
+
+    return {};
+#else
+    return tl::unexpected{ResidencyError{ResidencyError::UNSUPPORTED}};
+#endif
+}
+
+void residency_stop() noexcept
+{
+#if TR_OS_LINUX
+    g_residency.counting = false;
+#endif
+}
+
+void residency_on_tick([[maybe_unused]] u64 now_ns) noexcept
+{
+#if TR_OS_LINUX
+    auto &&state = g_residency;
+
+    if (state.counting)
+    {
+        auto totals = thread_faults();
+
+        Faults tick{};
+        tick.minor = totals.minor - state.totals.minor;
+        tick.major = totals.major - state.totals.major;
+
+        state.totals            = totals;
+        state.window.minor     += tick.minor;
+        state.window.major     += tick.major;
+        state.window_max.minor  = std::max(state.window_max.minor, tick.minor);
+        state.window_max.major  = std::max(state.window_max.major, tick.major);
+        state.faulted_ticks    += tick.minor + tick.major != 0 ? 1 : 0;
+        ++state.window_ticks;
+
+        if (now_ns >= state.next_report_ns)
+        {
+            // Quiet intervals aren't logged.
+            if (state.faulted_ticks != 0)
+            {
+                report(state);
+            }
+
+            state.next_report_ns = now_ns + state.interval_ns;
+            state.window         = {};
+            state.window_max     = {};
+            state.window_ticks   = 0;
+            state.faulted_ticks  = 0;
+        }
+    }
+
+    // After the counting, reading `/proc` faults too.
+    if (state.locked && now_ns >= state.next_lock_check_ns)
+    {
+        check_lock(state);
+        state.next_lock_check_ns = now_ns + RESIDENCY_LOCK_CHECK_NS;
+    }
+#endif
+}
+
+void residency_skip_faults() noexcept
+{
+#if TR_OS_LINUX
+    auto &&state = g_residency;
+    if (state.counting)
+    {
+        state.totals = thread_faults();
+    }
+#endif
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "type.hpp"
+#include <tl/expected.hpp>
+#include <string_view>
+
+// Keeps the server's memory resident. Faults on memory the map load reserved but didn't touch show up as tick spikes in the first
+// rounds, and after the host was under memory pressure, pages that were swapped out or dropped come back as major faults.
+// - `residency_lock` locks the process' memory (`mlockall`). Past `RLIMIT_MEMLOCK` the kernel fails allocations instead of evicting
+//   pages, so it's only done with room to grow and undone when the locked size gets close to the limit.
+// - `residency_advise_huge_pages` asks for transparent huge pages on large anonymous regions (`MADV_HUGEPAGE`).
+// - `residency_prefault` makes the main thread's stack and the heap resident without touching their contents.
+// Fault counts of the main thread (`getrusage`) are tracked per tick and logged every report interval that had any.
+
+constexpr usize RESIDENCY_STACK_BYTES   = 1 << 20;    // Of the main thread's stack prefaulted below the caller.
+constexpr u64   RESIDENCY_LOCK_CHECK_NS = 1000000000; // How often the locked size is checked against the limit.
+
+struct ResidencyError
+{
+    enum Type : u8
+    {
+        UNSUPPORTED,
+        FAILED_TO_READ_MAPS,
+        LIMIT_TOO_LOW, // Less than twice the mapped size can be locked.
+        FAILED_TO_LOCK,
+        THP_DISABLED,  // `/sys/kernel/mm/transparent_hugepage/enabled` is `never`.
+    } type;
+};
+
+struct ResidencyLock
+{
+    u64  limit{};    // Bytes, unlocked past 90% of this.
+    u64  mapped{};   // Bytes mapped when locked.
+    bool on_fault{}; // `MCL_ONFAULT`, only pages that are faulted in are locked. Older kernels populate everything that's mapped.
+};
+
+struct ResidencyHugePages
+{
+    usize regions{};
+    u64   bytes{};
+    usize failed{};
+    bool  always{}; // Huge pages are used everywhere anyway, the advice only matters for defragmentation.
+};
+
+struct ResidencyPrefault
+{
+    usize regions{};
+    u64   bytes{};     // Heap and anonymous memory, the stack isn't included.
+    u64   faults{};    // Pages that weren't resident.
+    usize failed{};    // Regions that went away, or that the kernel couldn't populate.
+    bool  populated{}; // `MADV_POPULATE_WRITE` (Linux 5.14), older kernels only read back pages that were swapped out.
+    bool  truncated{}; // Stopped at the limit.
+    f64   ms{};
+};
+
+[[nodiscard]] std::string_view residency_error_str(ResidencyError error) noexcept;
+
+// Locks current and future pages, at most `limit_bytes` (raises the soft `RLIMIT_MEMLOCK` up to the hard one).
+// Must be called from the main thread.
+tl::expected<ResidencyLock, ResidencyError> residency_lock(u64 limit_bytes) noexcept;
+void                                        residency_unlock() noexcept;
+
+[[nodiscard]] bool residency_is_locked() noexcept;
+
+// Advises anonymous writable regions of at least `min_region_bytes`, thread stacks are left out.
+tl::expected<ResidencyHugePages, ResidencyError> residency_advise_huge_pages(u64 min_region_bytes) noexcept;
+
+// Prefaults `RESIDENCY_STACK_BYTES` of the calling thread's stack, then the heap and anonymous writable regions up to `limit_bytes`
+// (the heap first), thread stacks are left out. Must be called from the main thread, ideally after `residency_advise_huge_pages`.
+tl::expected<ResidencyPrefault, ResidencyError> residency_prefault(u64 limit_bytes) noexcept;
+
+// Must be called from the main thread.
+tl::expected<void, ResidencyError> residency_start(u64 report_interval_ns) noexcept;
+void                               residency_stop() noexcept;
+
+// Called from `GameFrame` on every simulated tick, faults since the previous call are this tick's. Also checks the locked size.
+void residency_on_tick(u64 now_ns) noexcept;
+
+// Called from `ServerActivate`, the faults of the map load (and the prefault) don't go to the first tick.
+void residency_skip_faults() noexcept;
@@ -0,0 +1,289 @@
+#include "rtti.hpp"
+#include "common.hpp"
+#include "os.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#if TR_OS_LINUX
+#include <cxxabi.h>
+#include <link.h>
+#endif
+
+namespace
+{
+#if TR_OS_LINUX
+    struct Range
+    {
+        u8 *begin{};
+        u8 *end{};
+
+        [[nodiscard]] bool contains(const void *address, usize size = 1) const noexcept
+        {
+            auto addr = (usize)address;
+            return addr >= (usize)begin && addr <= (usize)end && size <= (usize)end - addr;
+        }
+    };
+
+    [[nodiscard]] bool contains_any(const std::vector<Range> &ranges, const void *address, usize size = 1) noexcept
+    {
+        return std::any_of(ranges.begin(), ranges.end(), [&](const Range &range) noexcept { return range.contains(address, size); });
+    }
+
+    // Executable segments of every loaded module (methods can be `__cxa_pure_virtual` from libstdc++, etc).
+    [[nodiscard]] std::vector<Range> get_all_code_ranges() noexcept
+    {
+        std::vector<Range> result{};
+
+        dl_iterate_phdr(
+            [](dl_phdr_info *info, usize, void *data) noexcept -> int
+            {
+                auto *ranges = (std::vector<Range> *)data;
+
+                for (usize i{}; i < info->dlpi_phnum; ++i)
+                {
+                    auto &&phdr = info->dlpi_phdr[i];
+                    if (phdr.p_type == PT_LOAD && (phdr.p_flags & PF_X) != 0)
+                    {
+                        u8 *begin = (u8 *)(info->dlpi_addr + phdr.p_vaddr);
+                        ranges->push_back({begin, begin + phdr.p_memsz});
+                    }
+                }
+
+                return 0;
+            },
+            &result);
+
+        return result;
+    }
+
+    // Checks if a string is a plausible mangled type name (`15CServerGameDLL`, `N3foo3barE`, ...) without walking off the segment.
+    [[nodiscard]] bool is_mangled_type_name(cstr name, const Range &range) noexcept
+    {
+        constexpr usize max_length = 1024;
+
+        usize length{};
+        while (range.contains(name + length) && name[length] != '\0')
+        {
+            char c = name[length];
+            if (c < 0x20 || c > 0x7E || ++length > max_length)
+            {
+                return false;
+            }
+        }
+
+        if (length == 0 || !range.contains(name + length))
+        {
+            return false;
+        }
+
+        return (name[0] >= '1' && name[0] <= '9') || name[0] == 'N' || name[0] == 'S' || name[0] == 'Z';
+    }
+
+    [[nodiscard]] std::string demangle_type_name(cstr name) noexcept
+    {
+        int  status{};
+        auto demangled = std::unique_ptr<char, decltype(&std::free)>{abi::__cxa_demangle(name, nullptr, nullptr, &status), &std::free};
+        if (status != 0 || demangled == nullptr)
+        {
+            return name;
+        }
+
+        return demangled.get();
+    }
+#endif
+} // namespace
+
+[[nodiscard]] const RttiVtable *RttiCatalog::find(std::string_view class_name) const noexcept
+{
+    auto *vtables = find_all(class_name);
+    return vtables != nullptr && !vtables->empty() ? &vtables->front() : nullptr;
+}
+
+[[nodiscard]] const std::vector<RttiVtable> *RttiCatalog::find_all(std::string_view class_name) const noexcept
+{
+    auto it = m_classes.find(class_name);
+    return it != m_classes.end() ? &it->second : nullptr;
+}
+
+[[nodiscard]] const RttiVtable *RttiCatalog::find_by_vmt(u8 **vmt) const noexcept
+{
+    auto *result = m_vmts.find(vmt);
+    return result != nullptr ? *result : nullptr;
+}
+
+void RttiCatalog::build([[maybe_unused]] u8 *module) noexcept
+{
+#if TR_OS_LINUX
+    // A VMT in the Itanium ABI looks like this:
+    //     [offset to top] [typeinfo *] [method 0] [method 1] ...
+    // and the typeinfo object:
+    //     [typeinfo VMT] [const char *name] ...
+    // Both live in read-only data: `.data.rel.ro` in a PIC module (`PT_GNU_RELRO`, read-only once relocated) or `.rodata`.
+    // Older linkers put `.rodata` (type names) in the executable segment, so names and typeinfo objects may be in any segment.
+    std::vector<Range> module_ranges{};
+    std::vector<Range> data_ranges{};
+    std::vector<Range> writable_ranges{};
+    bool               has_relro{};
+
+    for (auto &&segment : os_get_module_segments(module))
+    {
+        if (!segment.readable)
+        {
+            continue;
+        }
+
+        // `PT_GNU_RELRO` overlaps the writable `PT_LOAD` segment, it is scanned instead of it.
+        if (segment.relro)
+        {
+            has_relro = true;
+            data_ranges.push_back({segment.begin, segment.end});
+            continue;
+        }
+
+        module_ranges.push_back({segment.begin, segment.end});
+        if (segment.writable)
+        {
+            writable_ranges.push_back({segment.begin, segment.end});
+        }
+        else if (!segment.executable)
+        {
+            data_ranges.push_back({segment.begin, segment.end});
+        }
+    }
+
+    // Without `PT_GNU_RELRO` (linked without `-z relro`), `.data.rel.ro` is plain writable data.
+    if (!has_relro)
+    {
+        data_ranges.insert(data_ranges.end(), writable_ranges.begin(), writable_ranges.end());
+    }
+
+    if (data_ranges.empty())
+    {
+        return;
+    }
+
+    auto code_ranges = get_all_code_ranges();
+
+    // Remember the typeinfo objects we've already checked, a class with N VMTs shares one.
+    FlatPtrMap<std::string_view> typeinfo_names{};
+    FlatPtrMap<bool>             bad_typeinfos{};
+
+    auto get_class_name = [&](u8 **typeinfo) noexcept -> std::string_view
+    {
+        if (auto *name = typeinfo_names.find(typeinfo); name != nullptr)
+        {
+            return *name;
+        }
+
+        if (bad_typeinfos.find(typeinfo) != nullptr)
+        {
+            return {};
+        }
+
+        cstr mangled = (cstr)typeinfo[1];
+
+        const Range *name_range{};
+        for (auto &&range : module_ranges)
+        {
+            if (range.contains(mangled))
+            {
+                name_range = &range;
+                break;
+            }
+        }
+
+        if (typeinfo[0] == nullptr || name_range == nullptr || !is_mangled_type_name(mangled, *name_range))
+        {
+            bad_typeinfos.insert(typeinfo, true);
+            return {};
+        }
+
+        std::string_view name = m_names.emplace_back(demangle_type_name(mangled));
+        typeinfo_names.insert(typeinfo, name);
+
+        return name;
+    };
+
+    constexpr isize max_offset_to_top = 0x10000;
+
+    for (auto &&range : data_ranges)
+    {
+        auto **begin = (u8 **)(((usize)range.begin + sizeof(u8 *) - 1) & ~(sizeof(u8 *) - 1));
+        auto **end   = (u8 **)range.end;
+
+        for (u8 **it = begin; it + 3 <= end; ++it)
+        {
+            auto offset_to_top = (isize)it[0];
+            if (offset_to_top > 0 || offset_to_top < -max_offset_to_top || offset_to_top % (isize)sizeof(u8 *) != 0)
+            {
+                continue;
+            }
+
+            auto **typeinfo = (u8 **)it[1];
+            if (!contains_any(module_ranges, typeinfo, sizeof(u8 *) * 2) || !contains_any(code_ranges, it[2]))
+            {
+                continue;
+            }
+
+            auto name = get_class_name(typeinfo);
+            if (name.empty())
+            {
+                continue;
+            }
+
+            RttiVtable vtable{};
+            vtable.vmt           = it + 2;
+            vtable.offset_to_top = offset_to_top;
+
+            while (vtable.vmt + vtable.method_count < end && contains_any(code_ranges, vtable.vmt[vtable.method_count]))
+            {
+                ++vtable.method_count;
+            }
+
+            m_classes[name].push_back(vtable);
+
+            // Skip past the methods, they can't start another VMT.
+            it += 1 + vtable.method_count;
+        }
+    }
+
+    for (auto &&[name, vtables] : m_classes)
+    {
+        // Primary VMT first.
+        std::stable_sort(
+            vtables.begin(),
+            vtables.end(),
+            [](const RttiVtable &lhs, const RttiVtable &rhs) noexcept { return lhs.offset_to_top > rhs.offset_to_top; });
+
+        for (auto &&vtable : vtables)
+        {
+            m_vmts.insert(vtable.vmt, &vtable);
+        }
+    }
+#endif
+}
+
+[[nodiscard]] const RttiCatalog *rtti_get_catalog(u8 *module) noexcept
+{
+    if (module == nullptr)
+    {
+        return nullptr;
+    }
+
+    static FlatPtrMap<std::unique_ptr<RttiCatalog>> catalogs{};
+
+    // Modules that couldn't be parsed are cached too, so they aren't scanned again.
+    if (auto *catalog = catalogs.find(module); catalog != nullptr)
+    {
+        return (*catalog)->class_count() != 0 ? catalog->get() : nullptr;
+    }
+
+    auto catalog = std::make_unique<RttiCatalog>();
+    catalog->build(module);
+
+    auto *result = catalog->class_count() != 0 ? catalog.get() : nullptr;
+    catalogs.insert(module, std::move(catalog));
+
+    return result;
+}
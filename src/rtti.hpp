@@ -0,0 +1,52 @@
+#pragma once
+
+#include "type.hpp"
+#include "flat_map.hpp"
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+struct RttiVtable
+{
+    u8  **vmt{};           // Points at the first method, like an object's VMT pointer.
+    usize method_count{};
+    isize offset_to_top{}; // Zero for the primary VMT, negative for secondary VMTs (multiple inheritance).
+};
+
+// Every VMT of a module, indexed by class name (Itanium ABI RTTI, found by scanning the module's data segments).
+class RttiCatalog
+{
+public:
+    // Returns the primary VMT of a class.
+    [[nodiscard]] const RttiVtable *find(std::string_view class_name) const noexcept;
+
+    // Returns every VMT of a class, primary first.
+    [[nodiscard]] const std::vector<RttiVtable> *find_all(std::string_view class_name) const noexcept;
+
+    // Returns the VMT starting at `vmt` (i.e. an object's VMT pointer).
+    [[nodiscard]] const RttiVtable *find_by_vmt(u8 **vmt) const noexcept;
+
+    [[nodiscard]] usize class_count() const noexcept
+    {
+        return m_classes.size();
+    }
+
+private:
+    friend const RttiCatalog *rtti_get_catalog(u8 *module) noexcept;
+
+    // Demangled names, the map keys view into these.
+    std::deque<std::string> m_names{};
+
+    std::unordered_map<std::string_view, std::vector<RttiVtable>> m_classes{};
+
+    // VMT -> its entry in `m_classes`. Filled in once all classes are known, so the pointers stay valid.
+    FlatPtrMap<const RttiVtable *> m_vmts{};
+
+    void build(u8 *module) noexcept;
+};
+
+// Returns the catalog of a module handle, building it on first use. The result lives until the process exits.
+// Returns null if the module couldn't be parsed (or on Windows, where MSVC RTTI isn't supported).
+[[nodiscard]] const RttiCatalog *rtti_get_catalog(u8 *module) noexcept;
@@ -0,0 +1,448 @@
+#include "sampler.hpp"
+#include "common.hpp"
+#include "os.hpp"
+#include "log.hpp"
+#include "flat_map.hpp"
+#include "timing.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#if TR_OS_LINUX
+#include <linux/perf_event.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <ctime>
+#endif
+
+namespace
+{
+#if TR_OS_LINUX
+    constexpr usize MAX_DEPTH  = 64;
+    constexpr usize HISTORY    = 512;
+    constexpr usize DATA_PAGES = 64; // Must be a power of 2.
+
+    // A string of hitches would otherwise write the same stacks over and over.
+    constexpr u64 MIN_DUMP_INTERVAL_NS = 5000000000;
+
+    // Symbol names are cached between dumps, but not forever.
+    constexpr usize MAX_CACHED_SYMBOLS = 65536;
+
+    struct Sample
+    {
+        u64 time_ns{};
+        u32 depth{};
+        u64 frames[MAX_DEPTH]{}; // Leaf first.
+    };
+
+    // An overrun's samples, copied out of the history for the writer.
+    struct Dump
+    {
+        std::vector<Sample> samples{};
+        u64                 tick_number{};
+        u64                 duration_ns{};
+    };
+
+    struct State
+    {
+        int                       fd{-1};
+        perf_event_mmap_page     *meta{};
+        u8                       *data{};
+        usize                     data_size{};
+        usize                     mapping_size{};
+        std::unique_ptr<Sample[]> history{};
+        usize                     count{};
+        usize                     next{};
+        std::vector<u8>           record{}; // Copy of the current record, it can wrap around the end of the ring.
+        u64                       next_dump_ns{};
+        u64                       lost{};
+        u64                       skipped{};
+
+        // Symbolizing and writing happen on the writer thread, the main thread only copies the samples.
+        // `dump` belongs to the main thread while `busy` is clear and to the writer while it's set.
+        std::thread             writer{};
+        std::mutex              mutex{};
+        std::condition_variable wake{};
+        bool                    pending{};  // Guarded by `mutex`.
+        bool                    stopping{}; // Guarded by `mutex`.
+        std::atomic<bool>       busy{};
+        Dump                    dump{};
+
+        // Writer only.
+        std::string             output_path{};
+        FILE                   *output{};
+        FlatPtrMap<std::string> symbols{};
+    } g_sampler{};
+
+    void copy_from_ring(const State &state, u64 offset, void *dest, usize size) noexcept
+    {
+        usize begin = (usize)(offset & (state.data_size - 1));
+        usize first = std::min(size, state.data_size - begin);
+
+        std::copy_n(state.data + begin, first, (u8 *)dest);
+        std::copy_n(state.data, size - first, (u8 *)dest + first);
+    }
+
+    // Moves the kernel's records into the history. Syscall free, the ring is shared memory.
+    void drain(State &state) noexcept
+    {
+        u64 head = __atomic_load_n(&state.meta->data_head, __ATOMIC_ACQUIRE);
+        u64 tail = state.meta->data_tail;
+
+        while (tail < head)
+        {
+            perf_event_header header;
+            copy_from_ring(state, tail, &header, sizeof(header));
+            if (header.size < sizeof(header))
+            {
+                break;
+            }
+
+            state.record.resize(header.size);
+            copy_from_ring(state, tail, state.record.data(), header.size);
+
+            const u8 *body = state.record.data() + sizeof(header);
+            if (header.type == PERF_RECORD_SAMPLE)
+            {
+                // `PERF_SAMPLE_TIME | PERF_SAMPLE_CALLCHAIN`: u64 time, u64 nr, u64 ips[nr].
+                u64 nr{};
+                auto &&sample = state.history[state.next];
+                std::copy_n(body, sizeof(u64), (u8 *)&sample.time_ns);
+                std::copy_n(body + sizeof(u64), sizeof(u64), (u8 *)&nr);
+
+                const u8 *ips = body + 2 * sizeof(u64);
+                nr            = std::min<u64>(nr, (header.size - sizeof(header) - 2 * sizeof(u64)) / sizeof(u64));
+
+                sample.depth = 0;
+                for (u64 i{}; i < nr && sample.depth < MAX_DEPTH; ++i)
+                {
+                    u64 ip;
+                    std::copy_n(ips + i * sizeof(u64), sizeof(u64), (u8 *)&ip);
+
+                    // Context markers (`PERF_CONTEXT_USER`, etc).
+                    if (ip >= (u64)PERF_CONTEXT_MAX)
+                    {
+                        continue;
+                    }
+
+                    sample.frames[sample.depth++] = ip;
+                }
+
+                state.next  = (state.next + 1) % HISTORY;
+                state.count = std::min(state.count + 1, HISTORY);
+            }
+            else if (header.type == PERF_RECORD_LOST)
+            {
+                // u64 id, u64 lost.
+                u64 lost;
+                std::copy_n(body + sizeof(u64), sizeof(u64), (u8 *)&lost);
+                state.lost += lost;
+            }
+
+            tail += header.size;
+        }
+
+        __atomic_store_n(&state.meta->data_tail, tail, __ATOMIC_RELEASE);
+    }
+
+    [[nodiscard]] const std::string &describe(State &state, u64 address) noexcept
+    {
+        if (state.symbols.size() >= MAX_CACHED_SYMBOLS)
+        {
+            state.symbols.clear();
+        }
+
+        auto *key = (const void *)(usize)address;
+        if (auto *name = state.symbols.find(key); name != nullptr)
+        {
+            return *name;
+        }
+
+        // Samples only aggregate by function if the offset is dropped, it's kept when there's nothing else to go on.
+        auto name = os_describe_address((u8 *)(usize)address);
+        if (auto offset = name.rfind("+0x"); offset != std::string::npos && name.find('!') != std::string::npos)
+        {
+            name.resize(offset);
+        }
+
+        // `;` separates frames in the folded format.
+        std::replace(name.begin(), name.end(), ';', ':');
+
+        state.symbols.insert(key, std::move(name));
+        return *state.symbols.find(key);
+    }
+
+    void write_dump(State &state) noexcept
+    {
+        auto &&dump = state.dump;
+
+        if (state.output == nullptr)
+        {
+            state.output = std::fopen(state.output_path.c_str(), "a");
+            if (state.output == nullptr)
+            {
+                return;
+            }
+        }
+
+        auto root = fmt::format("overrun_tick_{}_{:.1f}ms", dump.tick_number, (f64)dump.duration_ns / 1e6);
+
+        std::vector<std::string> stacks{};
+        for (auto &&sample : dump.samples)
+        {
+            std::string stack = root;
+            for (u32 depth = sample.depth; depth-- > 0;)
+            {
+                // Return addresses point after the call, which can already be the next function.
+                u64 address = depth == 0 ? sample.frames[depth] : sample.frames[depth] - 1;
+
+                stack += ';';
+                stack += describe(state, address);
+            }
+
+            stacks.push_back(std::move(stack));
+        }
+
+        std::sort(stacks.begin(), stacks.end());
+
+        for (usize i{}; i < stacks.size();)
+        {
+            usize j = i + 1;
+            while (j < stacks.size() && stacks[j] == stacks[i])
+            {
+                ++j;
+            }
+
+            fmt::print(state.output, "{} {}\n", stacks[i], j - i);
+            i = j;
+        }
+
+        std::fflush(state.output);
+
+        info(
+            "Tick {} took {:.2f} ms, {} stack samples written to `{}`.\n",
+            dump.tick_number,
+            (f64)dump.duration_ns / 1e6,
+            stacks.size(),
+            state.output_path);
+    }
+
+    void write_dumps() noexcept
+    {
+        auto &&state = g_sampler;
+
+        // Only runs on otherwise idle CPU time, waking it up must not preempt the main thread on a busy (or single) core.
+        sched_param param{};
+        (void)pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+
+        while (true)
+        {
+            {
+                std::unique_lock lock{state.mutex};
+                state.wake.wait(lock, [&state] { return state.pending || state.stopping; });
+
+                // A dump handed over before stopping is still written.
+                if (!state.pending)
+                {
+                    break;
+                }
+
+                state.pending = false;
+            }
+
+            write_dump(state);
+            state.busy.store(false, std::memory_order_release);
+        }
+    }
+
+    // Copies the samples taken during the tick and hands them to the writer. Returns false if there were none.
+    [[nodiscard]] bool hand_over(State &state, const TickSample &tick, u64 now_ns, u64 tick_number) noexcept
+    {
+        auto &&dump = state.dump;
+        dump.samples.clear();
+
+        for (usize i{}; i < state.count; ++i)
+        {
+            auto &&sample = state.history[i];
+            if (sample.time_ns >= tick.begin_ns && sample.time_ns <= now_ns && sample.depth != 0)
+            {
+                dump.samples.push_back(sample);
+            }
+        }
+
+        if (dump.samples.empty())
+        {
+            return false;
+        }
+
+        dump.tick_number = tick_number;
+        dump.duration_ns = tick.duration_ns;
+
+        state.busy.store(true, std::memory_order_relaxed);
+        {
+            std::lock_guard lock{state.mutex};
+            state.pending = true;
+        }
+
+        state.wake.notify_one();
+
+        return true;
+    }
+#endif
+} // namespace
+
+tl::expected<void, SamplerError> sampler_start([[maybe_unused]] u32 frequency_hz, [[maybe_unused]] std::string output_path) noexcept
+{
+#if TR_OS_LINUX
+    sampler_stop();
+
+    perf_event_attr attr{};
+    attr.size             = sizeof(attr);
+    attr.type             = PERF_TYPE_SOFTWARE;
+    attr.config           = PERF_COUNT_SW_TASK_CLOCK; // Works in VMs without a PMU, and only counts while the thread runs.
+    attr.freq             = 1;
+    attr.sample_freq      = std::max<u32>(frequency_hz, 1);
+    attr.sample_type      = PERF_SAMPLE_TIME | PERF_SAMPLE_CALLCHAIN;
+    attr.sample_max_stack = MAX_DEPTH;
+    attr.exclude_kernel   = 1;
+    attr.exclude_hv       = 1;
+    attr.use_clockid      = 1;
+    attr.clockid          = CLOCK_MONOTONIC; // Same clock as `timing_now_ns`.
+    attr.disabled         = 1;
+
+    // The calling thread only, on any CPU.
+    int fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+    if (fd < 0)
+    {
+        bool denied = errno == EACCES || errno == EPERM;
+        return tl::unexpected{SamplerError{denied ? SamplerError::NO_PERMISSION : SamplerError::FAILED_TO_OPEN}};
+    }
+
+    const auto page_size    = (usize)sysconf(_SC_PAGESIZE);
+    const auto mapping_size = (1 + DATA_PAGES) * page_size;
+
+    void *mapping = mmap(nullptr, mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED)
+    {
+        close(fd);
+        return tl::unexpected{SamplerError{SamplerError::FAILED_TO_MAP}};
+    }
+
+    auto &&state       = g_sampler;
+    state.fd           = fd;
+    state.meta         = (perf_event_mmap_page *)mapping;
+    state.data         = (u8 *)mapping + page_size;
+    state.data_size    = DATA_PAGES * page_size;
+    state.mapping_size = mapping_size;
+    state.history      = std::make_unique<Sample[]>(HISTORY);
+    state.output_path  = std::move(output_path);
+    state.record.reserve(sizeof(perf_event_header) + (2 + MAX_DEPTH + 8) * sizeof(u64));
+    state.dump.samples.reserve(HISTORY);
+
+    if (ioctl(fd, PERF_EVENT_IOC_ENABLE, 0) == -1)
+    {
+        sampler_stop();
+        return tl::unexpected{SamplerError{SamplerError::FAILED_TO_ENABLE}};
+    }
+
+    state.pending  = false;
+    state.stopping = false;
+    state.writer   = std::thread{write_dumps};
+
+    return {};
+#else
+    return tl::unexpected{SamplerError{SamplerError::UNSUPPORTED}};
+#endif
+}
+
+void sampler_stop() noexcept
+{
+#if TR_OS_LINUX
+    auto &&state = g_sampler;
+    if (state.fd < 0)
+    {
+        return;
+    }
+
+    if (state.lost != 0 || state.skipped != 0)
+    {
+        info("Sampler: {} samples lost, {} overruns not dumped (rate limited).\n", state.lost, state.skipped);
+    }
+
+    if (state.writer.joinable())
+    {
+        {
+            std::lock_guard lock{state.mutex};
+            state.stopping = true;
+        }
+
+        state.wake.notify_one();
+        state.writer.join();
+    }
+
+    munmap(state.meta, state.mapping_size);
+    close(state.fd);
+
+    if (state.output != nullptr)
+    {
+        std::fclose(state.output);
+    }
+
+    state.fd           = -1;
+    state.meta         = nullptr;
+    state.data         = nullptr;
+    state.data_size    = 0;
+    state.mapping_size = 0;
+    state.history      = nullptr;
+    state.count        = 0;
+    state.next         = 0;
+    state.next_dump_ns = 0;
+    state.lost         = 0;
+    state.skipped      = 0;
+    state.busy.store(false, std::memory_order_relaxed);
+    state.dump        = {};
+    state.output_path = {};
+    state.output      = nullptr;
+    state.symbols.clear();
+#endif
+}
+
+void sampler_on_tick([[maybe_unused]] const TickSample &tick, [[maybe_unused]] u64 now_ns) noexcept
+{
+#if TR_OS_LINUX
+    auto &&state = g_sampler;
+    if (state.fd < 0)
+    {
+        return;
+    }
+
+    drain(state);
+
+    if (!tick.overrun)
+    {
+        return;
+    }
+
+    // The writer still being busy with the previous dump only happens with a slow disk, the limit usually applies first.
+    if (now_ns < state.next_dump_ns || state.busy.load(std::memory_order_acquire))
+    {
+        ++state.skipped;
+        return;
+    }
+
+    if (hand_over(state, tick, now_ns, tickstats_ticks() - 1))
+    {
+        state.next_dump_ns = now_ns + MIN_DUMP_INTERVAL_NS;
+    }
+#endif
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "type.hpp"
+#include "tickstats.hpp"
+#include <tl/expected.hpp>
+#include <string>
+
+// Always-on, low rate stack sampler for the main thread (`perf_event_open`, user space only so it works with the default
+// `perf_event_paranoid`). The last few hundred callchains are kept, and when a tick overruns the ones taken during that tick are
+// appended to a file as folded stacks (`flamegraph.pl`, speedscope, etc). Each stack is rooted at a frame naming the tick.
+// The main thread only copies the overrun's samples, a background thread symbolizes and writes them.
+// Callchains are unwound by the kernel with frame pointers, code built without them only shows the sampled function and its caller.
+
+struct SamplerError
+{
+    enum Type : u8
+    {
+        UNSUPPORTED,
+        NO_PERMISSION, // `perf_event_paranoid` is above 2, or seccomp blocks it (containers).
+        FAILED_TO_OPEN,
+        FAILED_TO_MAP,
+        FAILED_TO_ENABLE,
+    } type;
+};
+
+// Must be called from the main thread, only that thread is sampled.
+tl::expected<void, SamplerError> sampler_start(u32 frequency_hz, std::string output_path) noexcept;
+void                             sampler_stop() noexcept;
+
+// Called from `GameFrame` on every simulated tick with the tick that just ended.
+void sampler_on_tick(const TickSample &tick, u64 now_ns) noexcept;
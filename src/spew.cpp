@@ -0,0 +1,431 @@
+#include "spew.hpp"
+#include "common.hpp"
+#include "engine.hpp"
+#include "os.hpp"
+#include "iface.hpp"
+#include "timing.hpp"
+#include <fmt/format.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <string_view>
+#include <thread>
+#include <utility>
+#if TR_OS_LINUX
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <cerrno>
+#include <ctime>
+#endif
+
+namespace
+{
+#if TR_OS_LINUX
+    using SetSpewOutputFuncFn  = void(TR_CCALL *)(SpewOutputFunc_t func);
+    using GetSpewOutputFuncFn  = SpewOutputFunc_t(TR_CCALL *)();
+    using GetSpewOutputGroupFn = cstr(TR_CCALL *)();
+
+    // How long stopping (and an error) waits for the buffered output to be written.
+    constexpr u64 DRAIN_TIMEOUT_NS = 1000000000;
+
+    // The background threads check for the stop deadline this often while idle.
+    constexpr int POLL_INTERVAL_MS = 100;
+
+    struct State
+    {
+        SetSpewOutputFuncFn      set_func{};
+        GetSpewOutputFuncFn      get_func{};
+        GetSpewOutputGroupFn     get_group{};
+        SpewOutputFunc_t         original{};
+        std::vector<std::string> filtered_groups{}; // Read-only while active.
+        std::atomic<bool>        active{};          // Our spew function passes everything on when not.
+        bool                     running{};
+
+        int                     stdout_fd{-1}; // The real stdout.
+        int                     pipe_fd{-1};   // Read end, the write end is stdout.
+        int                     wake_fd{-1};   // eventfd the writer sleeps on while the ring is empty.
+        std::unique_ptr<u8[]>   ring{};
+        std::atomic<u64>        head{}; // Only written by the reader.
+        std::atomic<u64>        tail{}; // Only written by the writer.
+        std::atomic<bool>       reader_done{};
+        std::atomic<u64>        deadline_ns{}; // Set when stopping, past it what's left is dropped.
+        std::thread             reader{};
+        std::thread             writer{};
+
+        std::atomic<u64> messages{};
+        std::atomic<u64> filtered{};
+        std::atomic<u64> bytes{};
+        std::atomic<u64> dropped_bytes{};
+        std::atomic<u64> overflows{};
+    } g_spew{};
+
+    void wake(State &state) noexcept
+    {
+        u64 one = 1;
+        (void)!write(state.wake_fd, &one, sizeof(one));
+    }
+
+    [[nodiscard]] bool past_deadline(const State &state) noexcept
+    {
+        u64 deadline = state.deadline_ns.load(std::memory_order_acquire);
+        return deadline != 0 && timing_now_ns() >= deadline;
+    }
+
+    // All or nothing, so reads (usually whole messages) aren't cut in half.
+    [[nodiscard]] bool push(State &state, const void *data, usize size) noexcept
+    {
+        u64 head = state.head.load(std::memory_order_relaxed);
+        if (SPEW_BUFFER_SIZE - (head - state.tail.load(std::memory_order_acquire)) < size)
+        {
+            return false;
+        }
+
+        usize begin = (usize)(head % SPEW_BUFFER_SIZE);
+        usize first = std::min(size, SPEW_BUFFER_SIZE - begin);
+        std::copy_n((const u8 *)data, first, state.ring.get() + begin);
+        std::copy_n((const u8 *)data + first, size - first, state.ring.get());
+
+        state.head.store(head + size, std::memory_order_release);
+        wake(state);
+
+        return true;
+    }
+
+    // Never blocks on anything but the pipe, so the engine's writes to it never block for long.
+    void read_output() noexcept
+    {
+        auto &&state = g_spew;
+
+        std::array<u8, 16384> chunk;
+        u64                   dropped{}; // Since the last notice.
+        while (true)
+        {
+            // Children inherit stdout, the pipe doesn't necessarily end when we put it back.
+            if (past_deadline(state))
+            {
+                break;
+            }
+
+            pollfd input{state.pipe_fd, POLLIN, 0};
+            if (poll(&input, 1, POLL_INTERVAL_MS) <= 0)
+            {
+                continue;
+            }
+
+            isize size = read(state.pipe_fd, chunk.data(), chunk.size());
+            if (size < 0 && (errno == EINTR || errno == EAGAIN))
+            {
+                continue;
+            }
+
+            // Every write end is closed.
+            if (size <= 0)
+            {
+                break;
+            }
+
+            if (dropped != 0)
+            {
+                auto notice = fmt::format("[Tickrate] [warn] Console output dropped: {} bytes.\n", dropped);
+                if (push(state, notice.data(), notice.size()))
+                {
+                    dropped = 0;
+                }
+            }
+
+            if (dropped != 0 || !push(state, chunk.data(), (usize)size))
+            {
+                if (dropped == 0)
+                {
+                    state.overflows.fetch_add(1, std::memory_order_relaxed);
+                }
+
+                dropped += (u64)size;
+                state.dropped_bytes.fetch_add((u64)size, std::memory_order_relaxed);
+            }
+        }
+
+        state.reader_done.store(true, std::memory_order_release);
+        wake(state);
+    }
+
+    void write_output() noexcept
+    {
+        auto &&state = g_spew;
+
+        u64 tail = state.tail.load(std::memory_order_relaxed);
+        while (true)
+        {
+            // Before the head, the reader is done after its last push.
+            bool done = state.reader_done.load(std::memory_order_acquire);
+            u64  head = state.head.load(std::memory_order_acquire);
+            if (tail == head)
+            {
+                if (done)
+                {
+                    break;
+                }
+
+                pollfd wait{state.wake_fd, POLLIN, 0};
+                if (poll(&wait, 1, POLL_INTERVAL_MS) > 0)
+                {
+                    u64 count;
+                    (void)!read(state.wake_fd, &count, sizeof(count));
+                }
+
+                continue;
+            }
+
+            // Polled first, stdout may be a terminal or a pipe shared with other processes and isn't ours to make non-blocking.
+            pollfd output{state.stdout_fd, POLLOUT, 0};
+            if (!past_deadline(state) && poll(&output, 1, POLL_INTERVAL_MS) <= 0)
+            {
+                continue;
+            }
+
+            usize begin = (usize)(tail % SPEW_BUFFER_SIZE);
+            usize size  = (usize)std::min<u64>(head - tail, SPEW_BUFFER_SIZE - begin);
+
+            isize written = -1;
+            if (!past_deadline(state))
+            {
+                written = write(state.stdout_fd, state.ring.get() + begin, size);
+                if (written < 0 && (errno == EINTR || errno == EAGAIN))
+                {
+                    continue;
+                }
+            }
+
+            if (written > 0)
+            {
+                tail += (u64)written;
+                state.bytes.fetch_add((u64)written, std::memory_order_relaxed);
+            }
+            else
+            {
+                // Out of time, or stdout is gone.
+                state.dropped_bytes.fetch_add(head - tail, std::memory_order_relaxed);
+                tail = head;
+            }
+
+            state.tail.store(tail, std::memory_order_release);
+        }
+    }
+
+    // Closes the pipe's last write end (unless a child inherited one), the reader sees its end once it's drained.
+    void restore_stdout(const State &state) noexcept
+    {
+        std::fflush(stdout);
+        dup2(state.stdout_fd, STDOUT_FILENO);
+    }
+
+    // Until the buffered output is written, or the timeout.
+    void wait_written(const State &state, u64 timeout_ns) noexcept
+    {
+        u64 deadline = timing_now_ns() + timeout_ns;
+        while (timing_now_ns() < deadline)
+        {
+            if (state.reader_done.load(std::memory_order_acquire) &&
+                state.tail.load(std::memory_order_acquire) == state.head.load(std::memory_order_acquire))
+            {
+                return;
+            }
+
+            timespec delay{0, 1000000};
+            nanosleep(&delay, nullptr);
+        }
+    }
+
+    SpewRetval_t TR_CCALL spew_output(SpewType_t type, cstr message) noexcept
+    {
+        auto &&state = g_spew;
+        if (!state.active.load(std::memory_order_acquire))
+        {
+            return state.original(type, message);
+        }
+
+        if (type == SPEW_ERROR)
+        {
+            // What's buffered goes first, then the error straight to stdout. The process ends after it.
+            restore_stdout(state);
+            wait_written(state, DRAIN_TIMEOUT_NS);
+        }
+        else if (type != SPEW_ASSERT && !state.filtered_groups.empty())
+        {
+            cstr group = state.get_group();
+            if (group != nullptr && std::find(state.filtered_groups.begin(), state.filtered_groups.end(), std::string_view{group}) !=
+                                        state.filtered_groups.end())
+            {
+                state.filtered.fetch_add(1, std::memory_order_relaxed);
+                return SPEW_CONTINUE;
+            }
+        }
+
+        state.messages.fetch_add(1, std::memory_order_relaxed);
+        return state.original(type, message);
+    }
+
+    void close_fds(State &state) noexcept
+    {
+        for (int *fd : {&state.stdout_fd, &state.pipe_fd, &state.wake_fd})
+        {
+            if (*fd != -1)
+            {
+                close(*fd);
+                *fd = -1;
+            }
+        }
+    }
+#endif
+} // namespace
+
+tl::expected<void, SpewError> spew_start([[maybe_unused]] std::vector<std::string> filtered_groups) noexcept
+{
+#if TR_OS_LINUX
+    spew_stop();
+
+    auto &&state = g_spew;
+
+    u8 *tier0 = iface_get_default_module("tier0");
+    if (tier0 == nullptr)
+    {
+        return tl::unexpected{SpewError{SpewError::NO_TIER0}};
+    }
+
+    auto set_func  = os_get_procedure<SetSpewOutputFuncFn>(tier0, "SpewOutputFunc");
+    auto get_func  = os_get_procedure<GetSpewOutputFuncFn>(tier0, "GetSpewOutputFunc");
+    auto get_group = os_get_procedure<GetSpewOutputGroupFn>(tier0, "GetSpewOutputGroup");
+    if (set_func == nullptr || get_func == nullptr || get_group == nullptr || get_func() == nullptr)
+    {
+        return tl::unexpected{SpewError{SpewError::NO_SPEW_FUNC}};
+    }
+
+    auto fail = [&]() noexcept
+    {
+        close_fds(state);
+        return tl::unexpected{SpewError{SpewError::FAILED_TO_REDIRECT}};
+    };
+
+    int pipe_fds[2];
+    if (pipe2(pipe_fds, O_CLOEXEC) != 0)
+    {
+        return fail();
+    }
+
+    state.pipe_fd   = pipe_fds[0];
+    state.wake_fd   = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    state.stdout_fd = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+    if (state.wake_fd == -1 || state.stdout_fd == -1)
+    {
+        close(pipe_fds[1]);
+        return fail();
+    }
+
+    // Room for bursts while the reader is off the CPU, the default is 64 KiB. Capped by `/proc/sys/fs/pipe-max-size`.
+    fcntl(pipe_fds[1], F_SETPIPE_SZ, 1024 * 1024);
+
+    if (state.ring == nullptr)
+    {
+        state.ring = std::make_unique<u8[]>(SPEW_BUFFER_SIZE);
+    }
+
+    state.head.store(0, std::memory_order_relaxed);
+    state.tail.store(0, std::memory_order_relaxed);
+    state.reader_done.store(false, std::memory_order_relaxed);
+    state.deadline_ns.store(0, std::memory_order_relaxed);
+    state.messages.store(0, std::memory_order_relaxed);
+    state.filtered.store(0, std::memory_order_relaxed);
+    state.bytes.store(0, std::memory_order_relaxed);
+    state.dropped_bytes.store(0, std::memory_order_relaxed);
+    state.overflows.store(0, std::memory_order_relaxed);
+
+    // Whatever the engine buffered goes out before the switch.
+    std::fflush(stdout);
+    if (dup2(pipe_fds[1], STDOUT_FILENO) == -1)
+    {
+        close(pipe_fds[1]);
+        return fail();
+    }
+
+    close(pipe_fds[1]);
+
+    state.reader = std::thread{read_output};
+    state.writer = std::thread{write_output};
+
+    state.set_func        = set_func;
+    state.get_func        = get_func;
+    state.get_group       = get_group;
+    state.original        = get_func();
+    state.filtered_groups = std::move(filtered_groups);
+    state.active.store(true, std::memory_order_release);
+    set_func(spew_output);
+
+    state.running = true;
+
+    return {};
+#else
+    return tl::unexpected{SpewError{SpewError::UNSUPPORTED}};
+#endif
+}
+
+void spew_stop() noexcept
+{
+#if TR_OS_LINUX
+    auto &&state = g_spew;
+    if (!state.running)
+    {
+        return;
+    }
+
+    state.active.store(false, std::memory_order_release);
+    if (state.get_func() == spew_output)
+    {
+        state.set_func(state.original);
+    }
+    else
+    {
+        // Someone chained theirs after ours and keeps calling it, it passes everything on from now on.
+        (void)os_pin_module((u8 *)&spew_stop);
+    }
+
+    restore_stdout(state);
+
+    state.deadline_ns.store(timing_now_ns() + DRAIN_TIMEOUT_NS, std::memory_order_release);
+    state.reader.join();
+    state.writer.join();
+
+    close_fds(state);
+    state.running = false;
+#endif
+}
+
+[[nodiscard]] bool spew_is_running() noexcept
+{
+#if TR_OS_LINUX
+    return g_spew.running;
+#else
+    return false;
+#endif
+}
+
+[[nodiscard]] SpewStats spew_stats() noexcept
+{
+#if TR_OS_LINUX
+    auto &&state = g_spew;
+
+    SpewStats stats{};
+    stats.messages      = state.messages.load(std::memory_order_relaxed);
+    stats.filtered      = state.filtered.load(std::memory_order_relaxed);
+    stats.bytes         = state.bytes.load(std::memory_order_relaxed);
+    stats.dropped_bytes = state.dropped_bytes.load(std::memory_order_relaxed);
+    stats.overflows     = state.overflows.load(std::memory_order_relaxed);
+
+    return stats;
+#else
+    return {};
+#endif
+}
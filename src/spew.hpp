@@ -0,0 +1,47 @@
+#pragma once
+
+#include "type.hpp"
+#include <string>
+#include <vector>
+#include <tl/expected.hpp>
+
+// Asynchronous console output. The engine's spew function (behind `Msg`, `Warning`, `DevMsg`, ...) feeds the console, rcon replies
+// and `con_logfile`, and then writes to stdout on the calling thread, usually the main thread. When whatever reads the server's output
+// falls behind, that write blocks the tick.
+// stdout is replaced with a pipe that a background thread drains into a ring buffer, a second one writes the ring to the real stdout.
+// Everything written to stdout (spew or not) keeps its order. When the ring is full, output is dropped, counted, and a notice takes its
+// place once there's room again.
+// A spew function installed through tier0's `SpewOutputFunc` drops messages of filtered groups before the engine sees them, and puts
+// stdout back before errors (which end the process) so they aren't lost in the buffer.
+
+constexpr usize SPEW_BUFFER_SIZE = 4 * 1024 * 1024;
+
+struct SpewError
+{
+    enum Type : u8
+    {
+        UNSUPPORTED,
+        NO_TIER0,
+        NO_SPEW_FUNC,       // tier0 doesn't export `SpewOutputFunc`, `GetSpewOutputFunc` or `GetSpewOutputGroup`.
+        FAILED_TO_REDIRECT, // Creating the pipe or the background threads, or replacing stdout failed.
+    } type;
+};
+
+struct SpewStats
+{
+    u64 messages{};      // Passed on to the engine's spew function.
+    u64 filtered{};      // Dropped because of their group.
+    u64 bytes{};         // Written to stdout.
+    u64 dropped_bytes{}; // The ring had no room for, or stdout refused.
+    u64 overflows{};     // Times the ring filled up.
+};
+
+// Must be called from the main thread. Messages of `filtered_groups` (spew groups, i.e. `developer`) are dropped.
+tl::expected<void, SpewError> spew_start(std::vector<std::string> filtered_groups) noexcept;
+
+// Puts stdout back and writes what's buffered, for up to a second.
+void spew_stop() noexcept;
+
+[[nodiscard]] bool spew_is_running() noexcept;
+
+[[nodiscard]] SpewStats spew_stats() noexcept;
@@ -0,0 +1,311 @@
+#include "stagger.hpp"
+#include "common.hpp"
+#include "clock.hpp"
+#include "log.hpp"
+#include <atomic>
+#if TR_OS_LINUX
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+namespace
+{
+#if TR_OS_LINUX
+    // Opened directly instead of through `shm_open`, which needs librt on older glibc.
+    constexpr cstr  SEGMENT_PATH     = "/dev/shm/source-tickrate-stagger";
+    constexpr u32   SEGMENT_MAGIC    = 0x53525454; // "TTRS"
+    constexpr u32   SEGMENT_VERSION  = 1;
+    constexpr usize MAX_MEMBERS      = 64;
+    constexpr u64   REAP_INTERVAL_NS = 5000000000;
+
+    struct Member
+    {
+        u32 pid;
+        u32 reserved;
+        u64 interval_ns;
+    };
+
+    // Only `epoch` is read without holding the lock.
+    struct Segment
+    {
+        u32              magic;
+        u32              version;
+        std::atomic<u32> epoch;
+        u32              reserved;
+        Member           members[MAX_MEMBERS];
+    };
+
+    static_assert(std::atomic<u32>::is_always_lock_free, "The epoch is shared between processes.");
+
+    struct State
+    {
+        int      fd{-1};
+        Segment *segment{};
+        usize    slot{};
+        u64      interval_ns{};
+        u32      epoch{};
+        u64      next_reap_ns{};
+    } g_stagger{};
+
+    class SegmentLock
+    {
+    public:
+        explicit SegmentLock(int fd, bool blocking = true) noexcept : m_fd{fd}
+        {
+            while ((m_locked = flock(fd, LOCK_EX | (blocking ? 0 : LOCK_NB)) == 0) == false && errno == EINTR) {}
+        }
+
+        SegmentLock(const SegmentLock &)            = delete;
+        SegmentLock &operator=(const SegmentLock &) = delete;
+
+        ~SegmentLock() noexcept
+        {
+            if (m_locked)
+            {
+                flock(m_fd, LOCK_UN);
+            }
+        }
+
+        explicit operator bool() const noexcept
+        {
+            return m_locked;
+        }
+
+    private:
+        int  m_fd{};
+        bool m_locked{};
+    };
+
+    // NOTE: PIDs are only meaningful inside one PID namespace, containers sharing `/dev/shm` must also share that.
+    [[nodiscard]] bool is_alive(u32 pid) noexcept
+    {
+        return kill((pid_t)pid, 0) == 0 || errno != ESRCH;
+    }
+
+    // Drops members whose process is gone, the lock must be held. Returns true if anything changed.
+    bool reap(Segment *segment) noexcept
+    {
+        bool changed{};
+        for (auto &&member : segment->members)
+        {
+            if (member.pid != 0 && !is_alive(member.pid))
+            {
+                member = {};
+                changed = true;
+            }
+        }
+
+        if (changed)
+        {
+            segment->epoch.fetch_add(1, std::memory_order_release);
+        }
+
+        return changed;
+    }
+
+    // Recomputes our phase target from the current membership. Runs on the main thread, so it doesn't wait for another instance that
+    // holds the lock, the epoch is left as is and the next update tries again.
+    void retarget() noexcept
+    {
+        auto &&state = g_stagger;
+
+        usize index{};
+        usize count{};
+        {
+            SegmentLock lock{state.fd, false};
+            if (!lock)
+            {
+                return;
+            }
+
+            (void)reap(state.segment);
+
+            // Slot order is stable, so joins and leaves only move the instances after them.
+            for (usize i{}; i < MAX_MEMBERS; ++i)
+            {
+                auto &&member = state.segment->members[i];
+                if (member.pid == 0 || member.interval_ns != state.interval_ns)
+                {
+                    continue;
+                }
+
+                if (i == state.slot)
+                {
+                    index = count;
+                }
+
+                ++count;
+            }
+
+            state.epoch = state.segment->epoch.load(std::memory_order_acquire);
+        }
+
+        if (count == 0)
+        {
+            return;
+        }
+
+        u64 target_ns = state.interval_ns * index / count;
+        clock_set_phase_target(state.interval_ns, target_ns);
+
+        info(
+            "Tick phase: instance {} of {}, {:.3f} ms into each {:.3f} ms tick.\n",
+            index + 1,
+            count,
+            (f64)target_ns / 1e6,
+            (f64)state.interval_ns / 1e6);
+    }
+#endif
+} // namespace
+
+tl::expected<void, StaggerError> stagger_join([[maybe_unused]] u64 interval_ns) noexcept
+{
+#if TR_OS_LINUX
+    if (g_stagger.segment != nullptr)
+    {
+        stagger_leave();
+    }
+
+    int fd = open(SEGMENT_PATH, O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+    if (fd < 0)
+    {
+        return tl::unexpected{StaggerError{StaggerError::FAILED_TO_OPEN}};
+    }
+
+    // Servers often run as different users, don't let the umask lock the others out (only the creator can change it).
+    (void)fchmod(fd, 0666);
+
+    auto fail = [fd](StaggerError::Type type) noexcept
+    {
+        close(fd);
+        return tl::unexpected{StaggerError{type}};
+    };
+
+    SegmentLock lock{fd};
+    if (!lock)
+    {
+        return fail(StaggerError::FAILED_TO_OPEN);
+    }
+
+    struct stat st{};
+    if (fstat(fd, &st) != 0 || ((usize)st.st_size < sizeof(Segment) && ftruncate(fd, sizeof(Segment)) != 0))
+    {
+        return fail(StaggerError::FAILED_TO_OPEN);
+    }
+
+    void *mapping = mmap(nullptr, sizeof(Segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED)
+    {
+        return fail(StaggerError::FAILED_TO_OPEN);
+    }
+
+    // A new file is zero filled, which is a valid empty segment once it's stamped.
+    auto *segment = (Segment *)mapping;
+    if (segment->magic == 0)
+    {
+        segment->magic   = SEGMENT_MAGIC;
+        segment->version = SEGMENT_VERSION;
+    }
+    else if (segment->magic != SEGMENT_MAGIC || segment->version != SEGMENT_VERSION)
+    {
+        munmap(mapping, sizeof(Segment));
+        return fail(StaggerError::BAD_SEGMENT);
+    }
+
+    (void)reap(segment);
+
+    auto pid = (u32)getpid();
+
+    usize slot = MAX_MEMBERS;
+    for (usize i{}; i < MAX_MEMBERS; ++i)
+    {
+        // A previous load in this process may not have left (i.e. the plugin was reloaded after a crash in `Unload`).
+        if (segment->members[i].pid == pid || (slot == MAX_MEMBERS && segment->members[i].pid == 0))
+        {
+            slot = i;
+        }
+    }
+
+    if (slot == MAX_MEMBERS)
+    {
+        munmap(mapping, sizeof(Segment));
+        return fail(StaggerError::FULL);
+    }
+
+    segment->members[slot] = {pid, 0, interval_ns};
+    segment->epoch.fetch_add(1, std::memory_order_release);
+
+    g_stagger.fd          = fd;
+    g_stagger.segment     = segment;
+    g_stagger.slot        = slot;
+    g_stagger.interval_ns = interval_ns;
+
+    // Force a retarget on the first update, outside of this lock.
+    g_stagger.epoch = segment->epoch.load(std::memory_order_relaxed) - 1;
+
+    return {};
+#else
+    return tl::unexpected{StaggerError{StaggerError::UNSUPPORTED}};
+#endif
+}
+
+void stagger_leave() noexcept
+{
+#if TR_OS_LINUX
+    auto &&state = g_stagger;
+    if (state.segment == nullptr)
+    {
+        return;
+    }
+
+    {
+        SegmentLock lock{state.fd};
+
+        auto &&member = state.segment->members[state.slot];
+        if (member.pid == (u32)getpid())
+        {
+            member = {};
+            state.segment->epoch.fetch_add(1, std::memory_order_release);
+        }
+    }
+
+    munmap(state.segment, sizeof(Segment));
+    close(state.fd);
+    state = {};
+
+    clock_clear_phase_target();
+#endif
+}
+
+void stagger_update([[maybe_unused]] u64 now_ns) noexcept
+{
+#if TR_OS_LINUX
+    auto &&state = g_stagger;
+    if (state.segment == nullptr)
+    {
+        return;
+    }
+
+    if (state.segment->epoch.load(std::memory_order_acquire) != state.epoch)
+    {
+        retarget();
+        return;
+    }
+
+    // Nobody leaves cleanly when they crash, so someone has to look. Skip it if another instance holds the lock.
+    if (now_ns >= state.next_reap_ns)
+    {
+        state.next_reap_ns = now_ns + REAP_INTERVAL_NS;
+
+        if (SegmentLock lock{state.fd, false}; lock)
+        {
+            (void)reap(state.segment);
+        }
+    }
+#endif
+}
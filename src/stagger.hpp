@@ -0,0 +1,27 @@
+#pragma once
+
+#include "type.hpp"
+#include <tl/expected.hpp>
+
+// Spreads the ticks of every plugin instance on the host evenly across the tick period, so 20 servers don't all wake up and hit
+// memory in the same microseconds. Instances register in a shared memory segment (`/dev/shm/source-tickrate-stagger`), get a slot
+// among the instances with the same interval and slew their clock to `slot * interval / count` (see `clock_set_phase_target`).
+// Membership changes are serialized with `flock` on the segment, so a crashed instance can't leave it locked. Instances that died
+// without leaving are dropped the next time anyone checks.
+
+struct StaggerError
+{
+    enum Type : u8
+    {
+        UNSUPPORTED,
+        FAILED_TO_OPEN,
+        BAD_SEGMENT, // Created by an incompatible version.
+        FULL,
+    } type;
+};
+
+tl::expected<void, StaggerError> stagger_join(u64 interval_ns) noexcept;
+void                             stagger_leave() noexcept;
+
+// Called from `GameFrame`. Picks up membership changes and updates the phase target (cheap unless something changed).
+void stagger_update(u64 now_ns) noexcept;
@@ -0,0 +1,164 @@
+#include "tickstats.hpp"
+#include <algorithm>
+#include <array>
+#include <vector>
+
+namespace
+{
+    constexpr u64 SUMMARY_INTERVAL_NS = 1000000000;
+
+    struct Window
+    {
+        std::array<f64, TICKSTATS_WINDOW> samples{}; // Ring buffer, microseconds.
+        usize                             count{};
+        usize                             next{};
+        TickDurations                     durations{};
+    };
+
+    struct State
+    {
+        u64 interval_ns{};
+        u64 last_tick_ns{};
+        u64 work_begin_ns{}; // Start of the tick the game is running, 0 once its end was seen.
+        u64 ticks{};
+        u64 overruns{};
+        u64 catch_up_ticks{};
+
+        Window spacing{};
+        Window work{};
+
+        std::vector<f64> scratch{}; // Sorted copy for the summary, allocated once.
+        u64              next_summary_ns{};
+    } g_ticks{};
+
+    void add_sample(Window &window, u64 duration_ns) noexcept
+    {
+        f64 us = (f64)duration_ns / 1000.0;
+
+        window.samples[window.next] = us;
+        window.next                 = (window.next + 1) % TICKSTATS_WINDOW;
+        window.count                = std::min(window.count + 1, TICKSTATS_WINDOW);
+
+        ++window.durations.count;
+        window.durations.sum += us;
+    }
+
+    void summarize(Window &window, std::vector<f64> &scratch) noexcept
+    {
+        scratch.assign(window.samples.begin(), window.samples.begin() + (isize)window.count);
+        window.durations.window = timing_summarize(scratch);
+    }
+} // namespace
+
+void tickstats_reset(u64 interval_ns) noexcept
+{
+    auto &&state = g_ticks;
+
+    state.interval_ns     = interval_ns;
+    state.last_tick_ns    = 0;
+    state.work_begin_ns   = 0;
+    state.ticks           = 0;
+    state.overruns        = 0;
+    state.catch_up_ticks  = 0;
+    state.spacing         = {};
+    state.work            = {};
+    state.next_summary_ns = 0;
+    state.scratch.reserve(TICKSTATS_WINDOW);
+}
+
+TickSample tickstats_on_tick(u64 now_ns) noexcept
+{
+    auto &&state = g_ticks;
+
+    TickSample sample{};
+    sample.begin_ns = state.last_tick_ns;
+
+    const u64 last      = state.last_tick_ns;
+    state.last_tick_ns  = now_ns;
+    state.work_begin_ns = now_ns;
+    ++state.ticks;
+
+    if (last == 0 || state.interval_ns == 0)
+    {
+        sample.begin_ns = now_ns;
+        return sample;
+    }
+
+    sample.duration_ns = now_ns - last;
+    sample.catch_up    = sample.duration_ns < state.interval_ns / 2;
+    sample.overrun     = (f64)sample.duration_ns >= (f64)state.interval_ns * TICK_OVERRUN_FACTOR;
+
+    if (sample.overrun)
+    {
+        ++state.overruns;
+    }
+
+    if (sample.catch_up)
+    {
+        ++state.catch_up_ticks;
+    }
+    else
+    {
+        add_sample(state.spacing, sample.duration_ns);
+    }
+
+    // Sorting a few thousand samples costs tens of microseconds, don't do it every tick.
+    if (now_ns >= state.next_summary_ns)
+    {
+        state.next_summary_ns = now_ns + SUMMARY_INTERVAL_NS;
+
+        summarize(state.spacing, state.scratch);
+        summarize(state.work, state.scratch);
+    }
+
+    return sample;
+}
+
+void tickstats_on_tick_end(u64 now_ns) noexcept
+{
+    auto &&state = g_ticks;
+
+    if (state.work_begin_ns == 0 || now_ns < state.work_begin_ns)
+    {
+        return;
+    }
+
+    add_sample(state.work, now_ns - state.work_begin_ns);
+    state.work_begin_ns = 0;
+}
+
+void tickstats_on_idle() noexcept
+{
+    g_ticks.last_tick_ns  = 0;
+    g_ticks.work_begin_ns = 0;
+}
+
+[[nodiscard]] u64 tickstats_interval_ns() noexcept
+{
+    return g_ticks.interval_ns;
+}
+
+[[nodiscard]] u64 tickstats_ticks() noexcept
+{
+    return g_ticks.ticks;
+}
+
+[[nodiscard]] u64 tickstats_overruns() noexcept
+{
+    return g_ticks.overruns;
+}
+
+[[nodiscard]] u64 tickstats_catch_up_ticks() noexcept
+{
+    return g_ticks.catch_up_ticks;
+}
+
+[[nodiscard]] const TickDurations &tickstats_spacing() noexcept
+{
+    return g_ticks.spacing.durations;
+}
+
+[[nodiscard]] const TickDurations &tickstats_work() noexcept
+{
+    return g_ticks.work.durations;
+}
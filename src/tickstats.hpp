@@ -0,0 +1,49 @@
+#pragma once
+
+#include "type.hpp"
+#include "timing.hpp"
+
+// Tick timing as seen from `GameFrame`, two views of it:
+// - Spacing, the time between the starts of two simulated ticks. The engine can't start a tick before the previous one is done, so a
+//   tick that blew its budget shows up as a long gap. Catch-up ticks (run back to back after a long frame) are counted but kept out
+//   of it, they'd only hide the long one. This is what `TickSample` and overruns are about.
+// - Work, from our `GameFrame` to the end of the game's (entities, physics, game rules), what a tick costs regardless of pacing.
+//   Sending snapshots to clients comes after it and isn't included.
+
+// A tick is an overrun when it took this many intervals or more (small overshoots are just timer jitter).
+constexpr f64   TICK_OVERRUN_FACTOR = 1.5;
+constexpr usize TICKSTATS_WINDOW    = 4096;
+
+struct TickSample
+{
+    u64  begin_ns{};    // Start of the tick that just ended.
+    u64  duration_ns{}; // 0 for the first tick after `tickstats_on_idle`.
+    bool catch_up{};
+    bool overrun{};
+};
+
+struct TickDurations
+{
+    TimingSummary window{}; // Microseconds over the last `TICKSTATS_WINDOW` ticks, refreshed about once a second.
+    u64           count{};  // Every tick since `tickstats_reset`.
+    f64           sum{};    // Microseconds, of those ticks.
+};
+
+void tickstats_reset(u64 interval_ns) noexcept;
+
+// Called from `GameFrame` on every simulated tick, returns the tick that just ended.
+TickSample tickstats_on_tick(u64 now_ns) noexcept;
+
+// Called when the game's `GameFrame` returns from a simulated tick, ends the work of the tick `tickstats_on_tick` started.
+void tickstats_on_tick_end(u64 now_ns) noexcept;
+
+// Called when the server stops simulating (hibernation, map changes), so the gap isn't taken for a slow tick.
+void tickstats_on_idle() noexcept;
+
+[[nodiscard]] u64 tickstats_interval_ns() noexcept;
+[[nodiscard]] u64 tickstats_ticks() noexcept;
+[[nodiscard]] u64 tickstats_overruns() noexcept;
+[[nodiscard]] u64 tickstats_catch_up_ticks() noexcept;
+
+[[nodiscard]] const TickDurations &tickstats_spacing() noexcept;
+[[nodiscard]] const TickDurations &tickstats_work() noexcept; // Empty unless the game's `GameFrame` is hooked.
@@ -0,0 +1,265 @@
+#include "timing.hpp"
+#include "common.hpp"
+#include <algorithm>
+#include <array>
+#include <utility>
+#if TR_OS_WINDOWS
+#include <Windows.h>
+#include <intrin.h>
+#else
+#include <sys/timerfd.h>
+#include <cerrno>
+#include <ctime>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    inline void cpu_relax() noexcept
+    {
+#if TR_COMPILER_MSVC
+        _mm_pause();
+#else
+        __builtin_ia32_pause();
+#endif
+    }
+
+#if TR_OS_WINDOWS
+    [[nodiscard]] u64 qpc_frequency() noexcept
+    {
+        static const u64 frequency = []() noexcept
+        {
+            LARGE_INTEGER result;
+            QueryPerformanceFrequency(&result);
+            return (u64)result.QuadPart;
+        }();
+
+        return frequency;
+    }
+
+    void sleep_ns(u64 ns) noexcept
+    {
+        // Sleep rounds down to the scheduler tick, the remainder is left to the caller.
+        Sleep((DWORD)(ns / 1000000));
+    }
+#else
+    [[nodiscard]] timespec to_timespec(u64 ns) noexcept
+    {
+        timespec result{};
+        result.tv_sec  = (time_t)(ns / 1000000000);
+        result.tv_nsec = (long)(ns % 1000000000);
+        return result;
+    }
+
+    void sleep_ns(u64 ns) noexcept
+    {
+        auto ts = to_timespec(ns);
+        while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {}
+    }
+
+    void sleep_until_ns(u64 deadline_ns) noexcept
+    {
+        auto ts = to_timespec(deadline_ns);
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {}
+    }
+#endif
+} // namespace
+
+[[nodiscard]] u64 timing_now_ns() noexcept
+{
+#if TR_OS_WINDOWS
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+
+    // Split to avoid overflowing `counter * 1e9`.
+    u64 frequency = qpc_frequency();
+    u64 ticks     = (u64)counter.QuadPart;
+    return ticks / frequency * 1000000000 + ticks % frequency * 1000000000 / frequency;
+#else
+    timespec ts{};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000 + (u64)ts.tv_nsec;
+#endif
+}
+
+[[nodiscard]] std::string_view timing_strategy_str(TimingStrategy strategy) noexcept
+{
+    constexpr std::array<std::string_view, TIMING_STRATEGY_COUNT> strings = {
+        "sleep_relative",
+        "sleep_absolute",
+        "timerfd",
+        "sleep_spin",
+    };
+
+    return strategy < TIMING_STRATEGY_COUNT ? strings[strategy] : "unknown";
+}
+
+[[nodiscard]] tl::expected<TickTimer, TickTimer::Error> TickTimer::create(TimingStrategy strategy, u64 spin_ns) noexcept
+{
+    if (strategy >= TIMING_STRATEGY_COUNT)
+    {
+        return tl::unexpected{Error{Error::UNSUPPORTED}};
+    }
+
+    TickTimer timer{};
+    timer.m_strategy = strategy;
+    timer.m_spin_ns  = spin_ns;
+
+    if (strategy == TIMING_TIMERFD)
+    {
+#if TR_OS_WINDOWS
+        HANDLE handle = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+        if (handle == nullptr)
+        {
+            return tl::unexpected{Error{Error::FAILED_TO_CREATE}};
+        }
+
+        timer.m_handle = (isize)handle;
+#else
+        int fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+        if (fd < 0)
+        {
+            return tl::unexpected{Error{Error::FAILED_TO_CREATE}};
+        }
+
+        timer.m_handle = fd;
+#endif
+    }
+
+    return timer;
+}
+
+TickTimer::TickTimer(TickTimer &&other) noexcept
+{
+    *this = std::move(other);
+}
+
+TickTimer &TickTimer::operator=(TickTimer &&other) noexcept
+{
+    if (this != &other)
+    {
+        destroy();
+
+        m_strategy = other.m_strategy;
+        m_spin_ns  = other.m_spin_ns;
+        m_handle   = std::exchange(other.m_handle, -1);
+    }
+
+    return *this;
+}
+
+TickTimer::~TickTimer() noexcept
+{
+    destroy();
+}
+
+void TickTimer::destroy() noexcept
+{
+    if (m_handle == -1)
+    {
+        return;
+    }
+
+#if TR_OS_WINDOWS
+    CloseHandle((HANDLE)m_handle);
+#else
+    close((int)m_handle);
+#endif
+
+    m_handle = -1;
+}
+
+void TickTimer::wait_until(u64 deadline_ns) noexcept
+{
+    u64 now = timing_now_ns();
+    if (now >= deadline_ns)
+    {
+        return;
+    }
+
+    switch (m_strategy)
+    {
+        case TIMING_SLEEP_RELATIVE:
+            sleep_ns(deadline_ns - now);
+            break;
+
+        case TIMING_SLEEP_ABSOLUTE:
+#if TR_OS_WINDOWS
+            sleep_ns(deadline_ns - now);
+#else
+            sleep_until_ns(deadline_ns);
+#endif
+            break;
+
+        case TIMING_TIMERFD:
+        {
+#if TR_OS_WINDOWS
+            // Negative due times are relative, in 100ns units.
+            LARGE_INTEGER due;
+            due.QuadPart = -(LONGLONG)((deadline_ns - now) / 100);
+            if (SetWaitableTimer((HANDLE)m_handle, &due, 0, nullptr, nullptr, FALSE) != FALSE)
+            {
+                WaitForSingleObject((HANDLE)m_handle, INFINITE);
+            }
+#else
+            itimerspec spec{};
+            spec.it_value = to_timespec(deadline_ns);
+
+            u64 expirations;
+            if (timerfd_settime((int)m_handle, TFD_TIMER_ABSTIME, &spec, nullptr) == 0)
+            {
+                while (read((int)m_handle, &expirations, sizeof(expirations)) < 0 && errno == EINTR) {}
+            }
+#endif
+            break;
+        }
+
+        case TIMING_SLEEP_SPIN:
+            if (deadline_ns - now > m_spin_ns)
+            {
+#if TR_OS_WINDOWS
+                sleep_ns(deadline_ns - now - m_spin_ns);
+#else
+                sleep_until_ns(deadline_ns - m_spin_ns);
+#endif
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    // The spin strategy wakes up early on purpose and Windows sleeps round down, finish with a busy wait.
+    while (timing_now_ns() < deadline_ns)
+    {
+        cpu_relax();
+    }
+}
+
+[[nodiscard]] TimingSummary timing_summarize(std::vector<f64> &samples) noexcept
+{
+    TimingSummary summary{};
+    if (samples.empty())
+    {
+        return summary;
+    }
+
+    std::sort(samples.begin(), samples.end());
+
+    auto percentile = [&](f64 p) noexcept { return samples[std::min(samples.size() - 1, (usize)(p * (f64)samples.size()))]; };
+
+    f64 sum{};
+    for (f64 sample : samples)
+    {
+        sum += sample;
+    }
+
+    summary.count = samples.size();
+    summary.mean  = sum / (f64)samples.size();
+    summary.p50   = percentile(0.50);
+    summary.p99   = percentile(0.99);
+    summary.p999  = percentile(0.999);
+    summary.max   = samples.back();
+
+    return summary;
+}
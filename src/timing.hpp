@@ -0,0 +1,71 @@
+#pragma once
+
+#include "type.hpp"
+#include <tl/expected.hpp>
+#include <string_view>
+#include <vector>
+
+// Monotonic clock in nanoseconds (`CLOCK_MONOTONIC` on Linux, `QueryPerformanceCounter` on Windows).
+[[nodiscard]] u64 timing_now_ns() noexcept;
+
+// How a `TickTimer` waits for its deadline.
+enum TimingStrategy : u8
+{
+    TIMING_SLEEP_RELATIVE, // `nanosleep` for the remaining time (what a naive frame limiter does).
+    TIMING_SLEEP_ABSOLUTE, // `clock_nanosleep(TIMER_ABSTIME)`, immune to the time spent computing the remaining time.
+    TIMING_TIMERFD,        // Absolute `timerfd` (Windows: high resolution waitable timer).
+    TIMING_SLEEP_SPIN,     // Absolute sleep until `spin_ns` before the deadline, then busy wait.
+    TIMING_STRATEGY_COUNT,
+};
+
+[[nodiscard]] std::string_view timing_strategy_str(TimingStrategy strategy) noexcept;
+
+class TickTimer final
+{
+public:
+    struct Error
+    {
+        enum Type : u8
+        {
+            UNSUPPORTED,
+            FAILED_TO_CREATE,
+        } type;
+    };
+
+    [[nodiscard]] static tl::expected<TickTimer, Error> create(TimingStrategy strategy, u64 spin_ns = 0) noexcept;
+
+    TickTimer() noexcept         = default;
+    TickTimer(const TickTimer &) = delete;
+    TickTimer(TickTimer &&other) noexcept;
+    TickTimer &operator=(const TickTimer &) = delete;
+    TickTimer &operator=(TickTimer &&other) noexcept;
+    ~TickTimer() noexcept;
+
+    // Blocks until `timing_now_ns() >= deadline_ns` (returns immediately if it already passed).
+    void wait_until(u64 deadline_ns) noexcept;
+
+    [[nodiscard]] TimingStrategy strategy() const noexcept
+    {
+        return m_strategy;
+    }
+
+private:
+    TimingStrategy m_strategy{TIMING_SLEEP_ABSOLUTE};
+    u64            m_spin_ns{};
+    isize          m_handle{-1}; // timerfd or waitable timer handle.
+
+    void destroy() noexcept;
+};
+
+struct TimingSummary
+{
+    usize count{};
+    f64   mean{};
+    f64   p50{};
+    f64   p99{};
+    f64   p999{};
+    f64   max{};
+};
+
+// Sorts the samples in place and summarizes them (units are whatever the samples are in).
+[[nodiscard]] TimingSummary timing_summarize(std::vector<f64> &samples) noexcept;
@@ -0,0 +1,259 @@
+#include "trace.hpp"
+#include "common.hpp"
+#include "os.hpp"
+#include "log.hpp"
+#include "timing.hpp"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+namespace
+{
+    // About half a minute at 128 tick, 64 KiB per write.
+    constexpr usize BUFFER_RECORDS = 4096;
+
+    // Full buffers are written by the writer thread, the main thread only swaps them. `pending` belongs to the main thread while
+    // `busy` is clear and to the writer while it's set, a buffer that fills up in the meantime keeps growing.
+    struct State
+    {
+        FILE                    *file{}; // Writer only while running.
+        std::string              path{};
+        u64                      start_ns{};
+        bool                     idle{true}; // The first tick isn't preceded by an idle record.
+        std::vector<TraceRecord> buffer{};
+        std::vector<TraceRecord> pending{};
+        std::thread              writer{};
+        std::mutex               mutex{};
+        std::condition_variable  wake{};
+        bool                     has_work{}; // Guarded by `mutex`.
+        bool                     stopping{}; // Guarded by `mutex`.
+        std::atomic<bool>        busy{};
+        std::atomic<bool>        failed{};
+        std::atomic<u64>         records{};
+    } g_trace{};
+
+    void write(State &state) noexcept
+    {
+        if (state.failed.load(std::memory_order_relaxed))
+        {
+            return;
+        }
+
+        bool written = std::fwrite(state.pending.data(), sizeof(TraceRecord), state.pending.size(), state.file) == state.pending.size()
+                       && std::fflush(state.file) == 0;
+
+        state.records.fetch_add(state.pending.size(), std::memory_order_relaxed);
+
+        if (!written)
+        {
+            warn("Tick trace stopped: failed to write `{}`.\n", state.path);
+            state.failed.store(true, std::memory_order_relaxed);
+        }
+    }
+
+    void write_buffers() noexcept
+    {
+        auto &&state = g_trace;
+
+        while (true)
+        {
+            {
+                std::unique_lock lock{state.mutex};
+                state.wake.wait(lock, [&state] { return state.has_work || state.stopping; });
+
+                // A buffer handed over before stopping is still written.
+                if (!state.has_work)
+                {
+                    break;
+                }
+
+                state.has_work = false;
+            }
+
+            write(state);
+            state.pending.clear();
+            state.busy.store(false, std::memory_order_release);
+        }
+    }
+
+    // Hands the buffer to the writer and takes its empty one.
+    void flush(State &state) noexcept
+    {
+        if (state.buffer.empty() || state.busy.load(std::memory_order_acquire))
+        {
+            return;
+        }
+
+        std::swap(state.buffer, state.pending);
+
+        state.busy.store(true, std::memory_order_relaxed);
+        {
+            std::lock_guard lock{state.mutex};
+            state.has_work = true;
+        }
+
+        state.wake.notify_one();
+    }
+
+    void record(State &state, u64 now_ns, u32 duration_us, u32 players, u8 flags) noexcept
+    {
+        if (state.failed.load(std::memory_order_relaxed))
+        {
+            return;
+        }
+
+        TraceRecord record{};
+        record.time_ns     = now_ns - state.start_ns;
+        record.duration_us = duration_us;
+        record.players     = (u16)std::min<u32>(players, 0xFFFF);
+        record.flags       = flags;
+
+        state.buffer.push_back(record);
+        if (state.buffer.size() >= BUFFER_RECORDS)
+        {
+            flush(state);
+        }
+    }
+} // namespace
+
+tl::expected<void, TraceError> trace_open(const std::string &path, u64 interval_ns) noexcept
+{
+    trace_close();
+
+    auto &&state = g_trace;
+
+#if TR_OS_WINDOWS
+    if (fopen_s(&state.file, path.c_str(), "wb") != 0)
+    {
+        state.file = nullptr;
+    }
+#else
+    state.file = std::fopen(path.c_str(), "wb");
+#endif
+    if (state.file == nullptr)
+    {
+        return tl::unexpected{TraceError{TraceError::FAILED_TO_OPEN}};
+    }
+
+    state.path     = path;
+    state.start_ns = timing_now_ns();
+    state.idle     = true;
+    state.buffer.clear();
+    state.pending.clear();
+    state.buffer.reserve(BUFFER_RECORDS);
+    state.pending.reserve(BUFFER_RECORDS);
+
+    TraceHeader header{};
+    header.magic       = TRACE_MAGIC;
+    header.version     = TRACE_VERSION;
+    header.interval_ns = interval_ns;
+    header.start_ns    = state.start_ns;
+
+    if (std::fwrite(&header, sizeof(header), 1, state.file) != 1)
+    {
+        std::fclose(state.file);
+        state.file = nullptr;
+
+        return tl::unexpected{TraceError{TraceError::FAILED_TO_OPEN}};
+    }
+
+    state.has_work = false;
+    state.stopping = false;
+    state.busy.store(false, std::memory_order_relaxed);
+    state.failed.store(false, std::memory_order_relaxed);
+    state.records.store(0, std::memory_order_relaxed);
+    state.writer = std::thread{write_buffers};
+
+    return {};
+}
+
+void trace_close() noexcept
+{
+    auto &&state = g_trace;
+    if (state.file == nullptr)
+    {
+        return;
+    }
+
+    // The writer finishes the buffer it has, then takes the last one.
+    {
+        std::lock_guard lock{state.mutex};
+        state.stopping = true;
+    }
+
+    state.wake.notify_one();
+    state.writer.join();
+
+    if (!state.buffer.empty())
+    {
+        std::swap(state.buffer, state.pending);
+        write(state);
+        state.pending.clear();
+        state.buffer.clear();
+    }
+
+    std::fclose(state.file);
+    state.file = nullptr;
+
+    if (!state.failed.load(std::memory_order_relaxed))
+    {
+        info("Tick trace: {} records written to `{}`.\n", state.records.load(std::memory_order_relaxed), state.path);
+    }
+}
+
+void trace_record_tick(u64 now_ns, const TickSample &tick, u32 players) noexcept
+{
+    auto &&state = g_trace;
+    if (state.file == nullptr)
+    {
+        return;
+    }
+
+    u8 flags = TRACE_SIMULATED;
+    flags   |= tick.catch_up ? TRACE_CATCH_UP : 0;
+    flags   |= tick.overrun ? TRACE_OVERRUN : 0;
+
+    state.idle = false;
+    record(state, now_ns, (u32)std::min<u64>(tick.duration_ns / 1000, 0xFFFFFFFF), players, flags);
+}
+
+void trace_record_idle(u64 now_ns) noexcept
+{
+    auto &&state = g_trace;
+    if (state.file == nullptr || state.idle)
+    {
+        return;
+    }
+
+    state.idle = true;
+    record(state, now_ns, 0, 0, 0);
+}
+
+tl::expected<std::vector<TraceRecord>, TraceError> trace_read(const std::string &path, TraceHeader &header) noexcept
+{
+    auto data = os_read_binary_file(path);
+    if (data.empty())
+    {
+        return tl::unexpected{TraceError{TraceError::FAILED_TO_OPEN}};
+    }
+
+    if (data.size() < sizeof(header))
+    {
+        return tl::unexpected{TraceError{TraceError::BAD_HEADER}};
+    }
+
+    std::memcpy(&header, data.data(), sizeof(header));
+    if (header.magic != TRACE_MAGIC || header.version != TRACE_VERSION)
+    {
+        return tl::unexpected{TraceError{TraceError::BAD_HEADER}};
+    }
+
+    std::vector<TraceRecord> records((data.size() - sizeof(header)) / sizeof(TraceRecord));
+    std::memcpy(records.data(), data.data() + sizeof(header), records.size() * sizeof(TraceRecord));
+
+    return records;
+}
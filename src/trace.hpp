@@ -0,0 +1,66 @@
+#pragma once
+
+#include "type.hpp"
+#include "tickstats.hpp"
+#include <tl/expected.hpp>
+#include <string>
+#include <vector>
+
+// Tick timing trace (`-tickrate_trace`), for replaying a server's ticks through the pacing policies offline (see `tools/replay.cpp`).
+// A `TraceHeader` followed by one `TraceRecord` per simulated tick, and one when the server stops simulating (hibernation, map
+// changes). Records are buffered and written a few thousand at a time by a background thread.
+// The layout is shared between 32 and 64-bit builds and byte order is the host's, bump `TRACE_VERSION` when it changes.
+
+constexpr u32 TRACE_MAGIC   = 0x43525454; // "TTRC"
+constexpr u32 TRACE_VERSION = 1;
+
+enum TraceFlags : u8
+{
+    TRACE_SIMULATED = 1 << 0, // Not set for the first idle frame after simulating.
+    TRACE_CATCH_UP  = 1 << 1,
+    TRACE_OVERRUN   = 1 << 2,
+};
+
+struct TraceHeader
+{
+    u32 magic;
+    u32 version;
+    u64 interval_ns;
+    u64 start_ns; // Monotonic clock (`timing_now_ns`) of the first record.
+};
+
+struct TraceRecord
+{
+    u64 time_ns;     // Since `start_ns`.
+    u32 duration_us; // Since the previous simulated tick (`TickSample::duration_ns`), 0 after idle.
+    u16 players;
+    u8  flags;
+    u8  reserved;
+};
+
+static_assert(sizeof(TraceHeader) == 24, "The trace layout must be the same on every architecture.");
+static_assert(sizeof(TraceRecord) == 16, "The trace layout must be the same on every architecture.");
+
+struct TraceError
+{
+    enum Type : u8
+    {
+        FAILED_TO_OPEN,
+        BAD_HEADER, // Not a trace, or written by an incompatible version.
+    } type;
+};
+
+// Truncates `path`. Must be called from the main thread.
+tl::expected<void, TraceError> trace_open(const std::string &path, u64 interval_ns) noexcept;
+
+// Writes what's buffered.
+void trace_close() noexcept;
+
+// Called from `GameFrame` on every simulated tick.
+void trace_record_tick(u64 now_ns, const TickSample &tick, u32 players) noexcept;
+
+// Called from `GameFrame` when the server isn't simulating, only the first idle frame is recorded.
+void trace_record_idle(u64 now_ns) noexcept;
+
+// Reads a whole trace, a record cut short at the end (the server was killed) is left out.
+tl::expected<std::vector<TraceRecord>, TraceError> trace_read(const std::string &path, TraceHeader &header) noexcept;
@@ -0,0 +1,325 @@
+#include "vmt.hpp"
+#include "common.hpp"
+#include <safetyhook/safetyhook.hpp>
+#include <algorithm>
+#include <array>
+#include <utility>
+#include <vector>
+
+namespace
+{
+#if TR_COMPILER_MSVC
+    // Complete object locator.
+    constexpr usize VMT_PREFIX_COUNT = 1;
+#else
+    // Offset-to-top and typeinfo (Itanium ABI).
+    constexpr usize VMT_PREFIX_COUNT = 2;
+#endif
+
+    // Every live `SharedVmtHook`. There's only ever a handful, so a vector is fine.
+    std::vector<SharedVmtHook *> g_shared_vmt_hooks{};
+
+    // Writes a pointer into memory that's (probably) read-only and restores the old protection.
+    [[nodiscard]] bool write_protected(u8 **address, u8 *value) noexcept
+    {
+        auto old_protect = safetyhook::vm_protect((u8 *)address, sizeof(u8 *), safetyhook::VM_ACCESS_RW);
+        if (!old_protect)
+        {
+            return false;
+        }
+
+        *address = value;
+
+        (void)safetyhook::vm_protect((u8 *)address, sizeof(u8 *), *old_protect);
+
+        return true;
+    }
+} // namespace
+
+[[nodiscard]] usize vmt_count_methods(u8 **vmt) noexcept
+{
+    if (vmt == nullptr)
+    {
+        return 0;
+    }
+
+    // Methods usually live in one or two regions (the module's code and `__cxa_pure_virtual`), so cache what we've seen.
+    std::array<safetyhook::VmBasicInfo, 4> regions{};
+    usize                                  region_count{};
+
+    auto is_code = [&](u8 *address) noexcept
+    {
+        for (usize i{}; i < region_count; ++i)
+        {
+            if (address >= regions[i].address && address < regions[i].address + regions[i].size)
+            {
+                return regions[i].access.execute;
+            }
+        }
+
+        auto result = safetyhook::vm_query(address);
+        if (!result)
+        {
+            return false;
+        }
+
+        regions[region_count % regions.size()] = *result;
+        region_count                           = std::min(region_count + 1, regions.size());
+
+        return result->access.execute;
+    };
+
+    usize count{};
+    while (vmt[count] != nullptr && is_code(vmt[count]))
+    {
+        ++count;
+    }
+
+    return count;
+}
+
+[[nodiscard]] tl::expected<VmtSlotHook, VmtSlotHook::Error> VmtSlotHook::create_raw(u8 **vmt, usize index, u8 *fn) noexcept
+{
+    if (vmt == nullptr || vmt[index] == nullptr)
+    {
+        return tl::unexpected{Error{Error::BAD_VMT}};
+    }
+
+    VmtSlotHook hook{};
+    hook.m_entry    = &vmt[index];
+    hook.m_original = vmt[index];
+    hook.m_new      = fn;
+
+    if (!write_protected(hook.m_entry, hook.m_new))
+    {
+        hook.m_entry = nullptr;
+        return tl::unexpected{Error{Error::FAILED_TO_UNPROTECT}};
+    }
+
+    return hook;
+}
+
+VmtSlotHook::VmtSlotHook(VmtSlotHook &&other) noexcept
+{
+    *this = std::move(other);
+}
+
+VmtSlotHook &VmtSlotHook::operator=(VmtSlotHook &&other) noexcept
+{
+    if (this != &other)
+    {
+        reset();
+        m_entry    = std::exchange(other.m_entry, nullptr);
+        m_original = std::exchange(other.m_original, nullptr);
+        m_new      = std::exchange(other.m_new, nullptr);
+    }
+
+    return *this;
+}
+
+VmtSlotHook::~VmtSlotHook() noexcept
+{
+    reset();
+}
+
+void VmtSlotHook::reset() noexcept
+{
+    if (m_entry == nullptr)
+    {
+        return;
+    }
+
+    // Don't clobber whoever hooked the slot after us.
+    if (*m_entry == m_new)
+    {
+        (void)write_protected(m_entry, m_original);
+    }
+
+    m_entry    = nullptr;
+    m_original = nullptr;
+    m_new      = nullptr;
+}
+
+[[nodiscard]] tl::expected<std::unique_ptr<SharedVmtHook>, SharedVmtHook::Error> SharedVmtHook::create(
+    void *object, usize method_count) noexcept
+{
+    if (object == nullptr || *(u8 ***)object == nullptr)
+    {
+        return tl::unexpected{Error{Error::BAD_OBJECT}};
+    }
+
+    u8 **original_vmt = *(u8 ***)object;
+
+    if (method_count == 0)
+    {
+        method_count = vmt_count_methods(original_vmt);
+    }
+
+    if (method_count == 0)
+    {
+        return tl::unexpected{Error{Error::BAD_METHOD_COUNT}};
+    }
+
+    std::unique_ptr<SharedVmtHook> hook{new SharedVmtHook{}};
+
+    // Keep the prefix the ABI expects in front of the methods so RTTI and `dynamic_cast` still work on hooked objects.
+    hook->m_new_vmt_storage = std::make_unique<u8 *[]>(method_count + VMT_PREFIX_COUNT);
+    std::copy(original_vmt - VMT_PREFIX_COUNT, original_vmt + method_count, &hook->m_new_vmt_storage[0]);
+
+    hook->m_original_vmt = original_vmt;
+    hook->m_new_vmt      = &hook->m_new_vmt_storage[VMT_PREFIX_COUNT];
+    hook->m_method_count = method_count;
+
+    g_shared_vmt_hooks.push_back(hook.get());
+
+    return hook;
+}
+
+SharedVmtHook::~SharedVmtHook() noexcept
+{
+    reset();
+
+    g_shared_vmt_hooks.erase(std::remove(g_shared_vmt_hooks.begin(), g_shared_vmt_hooks.end(), this), g_shared_vmt_hooks.end());
+}
+
+void SharedVmtHook::apply(void *object, const void *owner) noexcept
+{
+    if (object == nullptr)
+    {
+        return;
+    }
+
+    // The clone only has the methods of the class it was made from, another class (even a derived one) would lose its overrides.
+    u8 **&vmt = *(u8 ***)object;
+    if (vmt != m_original_vmt)
+    {
+        return;
+    }
+
+    if (owner != nullptr)
+    {
+        // The owner (edict) was reused without being freed first, the previous object is gone.
+        if (auto *previous = m_owners.find(owner); previous != nullptr && *previous != object)
+        {
+            m_objects.erase(*previous);
+        }
+
+        m_owners.insert(owner, object);
+    }
+
+    m_objects.insert(object, Entry{vmt, owner});
+
+    vmt = m_new_vmt;
+}
+
+void SharedVmtHook::apply(void *const *objects, usize count, const void *const *owners) noexcept
+{
+    for (usize i{}; i < count; ++i)
+    {
+        apply(objects[i], owners != nullptr ? owners[i] : nullptr);
+    }
+}
+
+void SharedVmtHook::remove(void *object) noexcept
+{
+    auto *entry = m_objects.find(object);
+    if (entry == nullptr)
+    {
+        return;
+    }
+
+    auto copy = *entry;
+
+    restore(object, copy);
+    m_objects.erase(object);
+    if (copy.owner != nullptr)
+    {
+        m_owners.erase(copy.owner);
+    }
+}
+
+void SharedVmtHook::remove(void *const *objects, usize count) noexcept
+{
+    for (usize i{}; i < count; ++i)
+    {
+        remove(objects[i]);
+    }
+}
+
+void SharedVmtHook::forget(void *object) noexcept
+{
+    auto *entry = m_objects.find(object);
+    if (entry == nullptr)
+    {
+        return;
+    }
+
+    if (entry->owner != nullptr)
+    {
+        m_owners.erase(entry->owner);
+    }
+
+    m_objects.erase(object);
+}
+
+void SharedVmtHook::forget_owner(const void *owner) noexcept
+{
+    auto *object = m_owners.find(owner);
+    if (object == nullptr)
+    {
+        return;
+    }
+
+    m_objects.erase(*object);
+    m_owners.erase(owner);
+}
+
+void SharedVmtHook::reset() noexcept
+{
+    m_objects.for_each([this](const void *object, const Entry &entry) noexcept { restore((void *)object, entry); });
+    m_objects.clear();
+    m_owners.clear();
+}
+
+void SharedVmtHook::unhook_method(usize index) noexcept
+{
+    if (index < m_method_count)
+    {
+        m_new_vmt[index] = m_original_vmt[index];
+    }
+}
+
+tl::expected<u8 *, SharedVmtHook::Error> SharedVmtHook::hook_method_raw(usize index, u8 *fn) noexcept
+{
+    if (index >= m_method_count)
+    {
+        return tl::unexpected{Error{Error::BAD_INDEX}};
+    }
+
+    m_new_vmt[index] = fn;
+
+    return m_original_vmt[index];
+}
+
+void SharedVmtHook::restore(void *object, const Entry &entry) noexcept
+{
+    // Only restore objects that still point at our VMT, something else may have swapped it since.
+    u8 **&vmt = *(u8 ***)object;
+    if (vmt == m_new_vmt)
+    {
+        vmt = entry.original_vmt;
+    }
+}
+
+void vmt_forget_owner(const void *owner) noexcept
+{
+    if (owner == nullptr)
+    {
+        return;
+    }
+
+    for (auto *hook : g_shared_vmt_hooks)
+    {
+        hook->forget_owner(owner);
+    }
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include "type.hpp"
+#include "flat_map.hpp"
+#include <tl/expected.hpp>
+#include <memory>
+
+// Counts the virtual method pointers in a VMT. Only queries memory protection when an entry leaves the last known code region.
+[[nodiscard]] usize vmt_count_methods(u8 **vmt) noexcept;
+
+// Replaces a single method pointer inside a VMT itself (usually in read-only data), so every object of the class is affected.
+// Same idea as `safetyhook::VmHook`, but without cloning the VMT: it's one protected pointer write, no code is patched and no
+// executable memory is allocated.
+class VmtSlotHook final
+{
+public:
+    struct Error
+    {
+        enum Type : u8
+        {
+            BAD_VMT,
+            FAILED_TO_UNPROTECT,
+        } type;
+    };
+
+    template <class T>
+    [[nodiscard]] static tl::expected<VmtSlotHook, Error> create(u8 **vmt, usize index, T fn) noexcept
+    {
+        return create_raw(vmt, index, (u8 *)fn);
+    }
+
+    VmtSlotHook() noexcept           = default;
+    VmtSlotHook(const VmtSlotHook &) = delete;
+    VmtSlotHook(VmtSlotHook &&other) noexcept;
+    VmtSlotHook &operator=(const VmtSlotHook &) = delete;
+    VmtSlotHook &operator=(VmtSlotHook &&other) noexcept;
+    ~VmtSlotHook() noexcept;
+
+    // Restores the original method pointer.
+    void reset() noexcept;
+
+    template <class T>
+    [[nodiscard]] T original() const noexcept
+    {
+        return (T)m_original;
+    }
+
+    explicit operator bool() const noexcept
+    {
+        return m_entry != nullptr;
+    }
+
+private:
+    u8 **m_entry{};
+    u8  *m_original{};
+    u8  *m_new{};
+
+    [[nodiscard]] static tl::expected<VmtSlotHook, Error> create_raw(u8 **vmt, usize index, u8 *fn) noexcept;
+};
+
+// A single cloned VMT shared by many objects (i.e. every entity of a class).
+// Unlike `safetyhook::VmtHook`, objects are kept in a flat table and are never protection-queried: they're expected to be heap
+// objects that stay alive while tracked. Objects can be tagged with an owner (their edict) so they're dropped when the engine frees
+// it, see `vmt_forget_owner`.
+class SharedVmtHook final
+{
+public:
+    struct Error
+    {
+        enum Type : u8
+        {
+            BAD_OBJECT,
+            BAD_METHOD_COUNT,
+            BAD_INDEX,
+        } type;
+    };
+
+    // Clones the VMT of `object`. `method_count` is counted automatically when it's zero.
+    // NOTE: This doesn't apply the hook to `object`.
+    [[nodiscard]] static tl::expected<std::unique_ptr<SharedVmtHook>, Error> create(void *object, usize method_count = 0) noexcept;
+
+    SharedVmtHook(const SharedVmtHook &)            = delete;
+    SharedVmtHook(SharedVmtHook &&)                 = delete;
+    SharedVmtHook &operator=(const SharedVmtHook &) = delete;
+    SharedVmtHook &operator=(SharedVmtHook &&)      = delete;
+    ~SharedVmtHook() noexcept;
+
+    // Swaps the VMT of an object. Objects that already use the shared VMT, or whose VMT isn't the one that was cloned (objects of
+    // other classes, derived ones included), are ignored.
+    void apply(void *object, const void *owner = nullptr) noexcept;
+    void apply(void *const *objects, usize count, const void *const *owners = nullptr) noexcept;
+
+    // Restores the original VMT of an object.
+    void remove(void *object) noexcept;
+    void remove(void *const *objects, usize count) noexcept;
+
+    // Stops tracking an object without touching its memory (i.e. it was freed).
+    void forget(void *object) noexcept;
+    void forget_owner(const void *owner) noexcept;
+
+    // Restores the original VMT of every tracked object.
+    void reset() noexcept;
+
+    // Replaces a method in the shared VMT and returns the original.
+    template <class T>
+    [[nodiscard]] tl::expected<u8 *, Error> hook_method(usize index, T fn) noexcept
+    {
+        return hook_method_raw(index, (u8 *)fn);
+    }
+
+    void unhook_method(usize index) noexcept;
+
+    [[nodiscard]] u8 *original(usize index) const noexcept
+    {
+        return index < m_method_count ? m_original_vmt[index] : nullptr;
+    }
+
+    [[nodiscard]] usize object_count() const noexcept
+    {
+        return m_objects.size();
+    }
+
+private:
+    struct Entry
+    {
+        u8        **original_vmt{};
+        const void *owner{};
+    };
+
+    // Object -> its original VMT (always `m_original_vmt`) and owner.
+    FlatPtrMap<Entry>  m_objects{};
+    FlatPtrMap<void *> m_owners{};
+
+    u8                   **m_original_vmt{};
+    std::unique_ptr<u8 *[]> m_new_vmt_storage{};
+    u8                   **m_new_vmt{};
+    usize                  m_method_count{};
+
+    SharedVmtHook() noexcept = default;
+
+    tl::expected<u8 *, Error> hook_method_raw(usize index, u8 *fn) noexcept;
+    void                      restore(void *object, const Entry &entry) noexcept;
+};
+
+// Called from `IServerPluginCallbacks::OnEdictFreed`. Drops the objects owned by `owner` from every live `SharedVmtHook`.
+void vmt_forget_owner(const void *owner) noexcept;
@@ -0,0 +1,260 @@
+// Benchmark for the size-class allocator behind `-tickrate_alloc`, against the C runtime's `malloc` (which is what tier0's allocator
+// ends up calling on Linux).
+// Every thread keeps a working set of `-allocbench_live` blocks and replaces a random one per operation with a new block of a random
+// size up to `-allocbench_maxsize` bytes (small sizes are more likely, like in the engine). Every `-allocbench_handoff`th block is
+// freed by the next thread instead, like the engine's job threads freeing what the main thread built.
+// Runs with one thread and then with `-allocbench_threads`, and reports ns per alloc + free pair and the total rate.
+//
+// Usage: tickrate_allocbench [-allocbench_threads 4] [-allocbench_ops 2000000] [-allocbench_live 4096] [-allocbench_maxsize 2048]
+//                            [-allocbench_handoff 64]
+
+#include "type.hpp"
+#include "alloc.hpp"
+#include "timing.hpp"
+#include <fmt/format.h>
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    struct Options
+    {
+        u32 threads{4};
+        u32 ops{2000000};
+        u32 live{4096};
+        u32 max_size{2048};
+        u32 handoff{64};
+    };
+
+    template <class T>
+    void parse_option(std::string_view value, T &out) noexcept
+    {
+        T result{};
+        if (auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), result); ec == std::errc{})
+        {
+            out = result;
+        }
+    }
+
+    [[nodiscard]] Options parse_options(int argc, char **argv) noexcept
+    {
+        Options options{};
+
+        for (int i = 1; i + 1 < argc; ++i)
+        {
+            std::string_view arg   = argv[i];
+            std::string_view value = argv[i + 1];
+
+            if (arg == "-allocbench_threads")
+            {
+                parse_option(value, options.threads);
+            }
+            else if (arg == "-allocbench_ops")
+            {
+                parse_option(value, options.ops);
+            }
+            else if (arg == "-allocbench_live")
+            {
+                parse_option(value, options.live);
+            }
+            else if (arg == "-allocbench_maxsize")
+            {
+                parse_option(value, options.max_size);
+            }
+            else if (arg == "-allocbench_handoff")
+            {
+                parse_option(value, options.handoff);
+            }
+        }
+
+        options.threads  = std::max<u32>(options.threads, 1);
+        options.ops      = std::max<u32>(options.ops, 1);
+        options.live     = std::max<u32>(options.live, 1);
+        options.max_size = std::max<u32>(options.max_size, 1);
+
+        return options;
+    }
+
+    struct Allocator
+    {
+        std::string_view name;
+        void *(*allocate)(usize size) noexcept;
+        void (*free)(void *block) noexcept;
+    };
+
+    void *crt_allocate(usize size) noexcept
+    {
+        return std::malloc(size);
+    }
+
+    void crt_free(void *block) noexcept
+    {
+        std::free(block);
+    }
+
+    // Blocks one thread hands to the next to free.
+    struct Mailbox
+    {
+        std::mutex          mutex{};
+        std::vector<void *> blocks{};
+    };
+
+    [[nodiscard]] u32 xorshift(u32 &state) noexcept
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+
+    void churn(const Options &options, const Allocator &allocator, u32 seed, Mailbox &outbox, Mailbox &inbox) noexcept
+    {
+        std::vector<void *> live(options.live, nullptr);
+        std::vector<void *> pending{};
+        std::vector<void *> received{};
+
+        u32 rng = seed * 2654435761u + 1;
+        for (u32 i{}; i < options.ops; ++i)
+        {
+            auto &&slot = live[xorshift(rng) % live.size()];
+            if (slot != nullptr)
+            {
+                if (options.handoff != 0 && i % options.handoff == 0)
+                {
+                    pending.push_back(slot);
+                }
+                else
+                {
+                    allocator.free(slot);
+                }
+            }
+
+            // The product of two uniforms, small blocks are a lot more common than large ones.
+            usize size = (usize)xorshift(rng) % options.max_size * (xorshift(rng) % options.max_size) / options.max_size + 1;
+            slot       = allocator.allocate(size);
+            std::memset(slot, 0, std::min<usize>(size, 64));
+
+            if (pending.size() >= 64)
+            {
+                std::lock_guard lock{outbox.mutex};
+                outbox.blocks.insert(outbox.blocks.end(), pending.begin(), pending.end());
+                pending.clear();
+            }
+
+            if (i % 1024 == 0)
+            {
+                {
+                    std::lock_guard lock{inbox.mutex};
+                    received.swap(inbox.blocks);
+                }
+
+                for (void *block : received)
+                {
+                    allocator.free(block);
+                }
+
+                received.clear();
+            }
+        }
+
+        for (void *block : live)
+        {
+            allocator.free(block);
+        }
+
+        for (void *block : pending)
+        {
+            allocator.free(block);
+        }
+    }
+
+    // Returns the wall time of the run in nanoseconds.
+    [[nodiscard]] u64 run(const Options &options, const Allocator &allocator, u32 threads) noexcept
+    {
+        std::vector<Mailbox> mailboxes(threads);
+
+        u64 start = timing_now_ns();
+
+        std::vector<std::thread> workers{};
+        for (u32 i{}; i < threads; ++i)
+        {
+            workers.emplace_back([&, i]() noexcept { churn(options, allocator, i, mailboxes[i], mailboxes[(i + 1) % threads]); });
+        }
+
+        for (auto &&worker : workers)
+        {
+            worker.join();
+        }
+
+        u64 elapsed = timing_now_ns() - start;
+
+        // Whatever was handed off at the very end.
+        for (auto &&mailbox : mailboxes)
+        {
+            for (void *block : mailbox.blocks)
+            {
+                allocator.free(block);
+            }
+        }
+
+        return elapsed;
+    }
+} // namespace
+
+int main(int argc, char **argv)
+{
+    auto options = parse_options(argc, argv);
+
+    fmt::print(
+        "{} ops per thread on {} live blocks of 1-{} bytes, every {}th freed by another thread.\n\n",
+        options.ops,
+        options.live,
+        options.max_size,
+        options.handoff);
+
+    fmt::print("{:<10} {:>8} {:>10} {:>12}\n", "allocator", "threads", "ns/op", "Mops/s");
+
+    constexpr std::array<Allocator, 2> allocators = {{
+        {"malloc", crt_allocate, crt_free},
+        {"sizeclass", alloc_allocate, alloc_free},
+    }};
+
+    for (u32 threads : {1u, options.threads})
+    {
+        for (auto &&allocator : allocators)
+        {
+            u64 elapsed = run(options, allocator, threads);
+            f64 ops     = (f64)options.ops * (f64)threads;
+
+            fmt::print(
+                "{:<10} {:>8} {:>10.1f} {:>12.1f}\n",
+                allocator.name,
+                threads,
+                (f64)elapsed * (f64)threads / ops,
+                ops / ((f64)elapsed / 1e3));
+        }
+
+        if (options.threads == 1)
+        {
+            break;
+        }
+    }
+
+    auto stats = alloc_stats();
+    fmt::print(
+        "\nsizeclass: {} chunks ({} MiB), {} refills, {} flushes, {} large.\n",
+        stats.chunks,
+        stats.chunks * ALLOC_CHUNK_SIZE / (1024 * 1024),
+        stats.refills,
+        stats.flushes,
+        stats.large);
+
+    return 0;
+}
@@ -0,0 +1,726 @@
+// Micro-benchmarks for the hooking, memory and parsing primitives the plugin is built on.
+// Results are printed as JSON so runs from different compilers and 32/64-bit builds can be diffed.
+//
+// Usage: tickrate_bench [-bench_iterations 1000000] [-bench_output results.json]
+
+#include "common.hpp"
+#include "type.hpp"
+#include "string.hpp"
+#include "os.hpp"
+#include "disasm.hpp"
+#include "vmt.hpp"
+#include <safetyhook/safetyhook.hpp>
+#include <fmt/format.h>
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#if TR_OS_WINDOWS
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+    using AddFn = i32(TR_CCALL *)(i32);
+
+    struct Result
+    {
+        std::string name{};
+        u64         iterations{};
+        f64         ns_per_op{};
+        f64         p50{};
+        f64         p99{};
+        f64         min{};
+        std::string extra{}; // Additional JSON members, without the leading comma.
+    };
+
+    std::vector<Result> g_results{};
+
+    [[nodiscard]] f64 elapsed_ns(Clock::time_point start, Clock::time_point end) noexcept
+    {
+        return std::chrono::duration<f64, std::nano>(end - start).count();
+    }
+
+    // Builds a result out of per-operation (or per-batch average) samples.
+    void add_result(std::string name, std::vector<f64> samples, u64 iterations, std::string extra = {}) noexcept
+    {
+        if (samples.empty())
+        {
+            return;
+        }
+
+        std::sort(samples.begin(), samples.end());
+
+        auto percentile = [&](f64 p) noexcept { return samples[std::min(samples.size() - 1, (usize)(p * (f64)samples.size()))]; };
+
+        f64 sum{};
+        for (f64 sample : samples)
+        {
+            sum += sample;
+        }
+
+        Result result{};
+        result.name       = std::move(name);
+        result.iterations = iterations;
+        result.ns_per_op  = sum / (f64)samples.size();
+        result.p50        = percentile(0.50);
+        result.p99        = percentile(0.99);
+        result.min        = samples.front();
+        result.extra      = std::move(extra);
+
+        g_results.push_back(std::move(result));
+    }
+
+    void add_skipped(std::string name, std::string_view reason) noexcept
+    {
+        Result result{};
+        result.name  = std::move(name);
+        result.extra = fmt::format("\"skipped\": \"{}\"", reason);
+
+        g_results.push_back(std::move(result));
+    }
+
+    // Runs `fn` in batches and returns the average cost of one call per batch. Batching hides the clock's own overhead.
+    template <class Fn>
+    [[nodiscard]] std::vector<f64> measure_batches(u64 iterations, Fn &&fn) noexcept
+    {
+        constexpr u64 batch_count = 50;
+
+        u64 per_batch = std::max<u64>(iterations / batch_count, 1);
+
+        std::vector<f64> samples{};
+        samples.reserve(batch_count);
+
+        // Warm up caches and branch predictors.
+        for (u64 i{}; i < per_batch; ++i)
+        {
+            fn();
+        }
+
+        for (u64 batch{}; batch < batch_count; ++batch)
+        {
+            auto start = Clock::now();
+            for (u64 i{}; i < per_batch; ++i)
+            {
+                fn();
+            }
+            auto end = Clock::now();
+
+            samples.push_back(elapsed_ns(start, end) / (f64)per_batch);
+        }
+
+        return samples;
+    }
+
+    // `mov eax, <first argument>; add eax, 1; nop x3 (15 bytes); ret`.
+    // Hand assembled so the inline/mid hook targets are identical no matter where they're placed, and long enough for any jump type.
+#if TR_ARCH_X86_64 && TR_OS_WINDOWS
+    constexpr u8 ADD_ONE_CODE[] = {0x89, 0xC8, 0x83, 0xC0, 0x01, 0x0F, 0x1F, 0x44, 0x00, 0x00, 0x0F, 0x1F, 0x44, 0x00, 0x00, 0x0F, 0x1F, 0x44, 0x00, 0x00, 0xC3};
+#elif TR_ARCH_X86_64
+    constexpr u8 ADD_ONE_CODE[] = {0x89, 0xF8, 0x83, 0xC0, 0x01, 0x0F, 0x1F, 0x44, 0x00, 0x00, 0x0F, 0x1F, 0x44, 0x00, 0x00, 0x0F, 0x1F, 0x44, 0x00, 0x00, 0xC3};
+#else
+    constexpr u8 ADD_ONE_CODE[] = {0x8B, 0x44, 0x24, 0x04, 0x83, 0xC0, 0x01, 0x0F, 0x1F, 0x44, 0x00, 0x00, 0x0F, 0x1F, 0x44, 0x00, 0x00, 0x0F, 0x1F, 0x44, 0x00, 0x00, 0xC3};
+#endif
+
+    // Executable pages holding copies of `ADD_ONE_CODE`. With `isolated` set, the page sits in the middle of a 4 GiB inaccessible
+    // reservation so nothing can be allocated within rel32 range of it, which forces SafetyHook into its `ff` (absolute) jump.
+    class CodePage
+    {
+    public:
+        CodePage(const CodePage &)            = delete;
+        CodePage &operator=(const CodePage &) = delete;
+
+        [[nodiscard]] static std::unique_ptr<CodePage> create(bool isolated) noexcept
+        {
+            if (isolated && sizeof(void *) == 4)
+            {
+                return nullptr;
+            }
+
+            auto  page      = std::unique_ptr<CodePage>{new CodePage{}};
+            usize page_size = safetyhook::system_info().allocation_granularity;
+
+            page->m_size = isolated ? (usize)(0x1'0000'0000ull + page_size * 2) : page_size;
+
+#if TR_OS_WINDOWS
+            page->m_base = (u8 *)VirtualAlloc(nullptr, page->m_size, MEM_RESERVE, PAGE_NOACCESS);
+            if (page->m_base == nullptr)
+            {
+                return nullptr;
+            }
+
+            page->m_code = page->m_base + (page->m_size / 2 & ~(usize)(page_size - 1));
+            if (VirtualAlloc(page->m_code, page_size, MEM_COMMIT, PAGE_EXECUTE_READWRITE) == nullptr)
+            {
+                return nullptr;
+            }
+#else
+            void *base = mmap(nullptr, page->m_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+            if (base == MAP_FAILED)
+            {
+                return nullptr;
+            }
+
+            page->m_base = (u8 *)base;
+            page->m_code = page->m_base + (page->m_size / 2 & ~(usize)(page_size - 1));
+            if (mprotect(page->m_code, page_size, PROT_READ | PROT_WRITE | PROT_EXEC) != 0)
+            {
+                return nullptr;
+            }
+#endif
+
+            // One copy per 64 bytes, every hook gets its own target.
+            for (usize offset{}; offset + 64 <= page_size; offset += 64)
+            {
+                std::memcpy(page->m_code + offset, ADD_ONE_CODE, sizeof(ADD_ONE_CODE));
+            }
+
+            page->m_page_size = page_size;
+
+            return page;
+        }
+
+        ~CodePage() noexcept
+        {
+            if (m_base == nullptr)
+            {
+                return;
+            }
+
+#if TR_OS_WINDOWS
+            VirtualFree(m_base, 0, MEM_RELEASE);
+#else
+            munmap(m_base, m_size);
+#endif
+        }
+
+        [[nodiscard]] AddFn function(usize index) const noexcept
+        {
+            return (AddFn)(m_code + (index * 64) % m_page_size);
+        }
+
+    private:
+        u8   *m_base{};
+        u8   *m_code{};
+        usize m_size{};
+        usize m_page_size{};
+
+        CodePage() noexcept = default;
+    };
+
+    // Prevents the compiler from seeing through function pointers and object types.
+    template <class T>
+    [[nodiscard]] T launder(T value) noexcept
+    {
+        T volatile result = value;
+        return result;
+    }
+
+    volatile i32 g_sink{};
+
+    AddFn g_add_original{};
+
+    i32 TR_CCALL hooked_add(i32 value) noexcept
+    {
+        return g_add_original(value);
+    }
+
+    u64 g_mid_hits{};
+
+    void mid_hook_destination(SafetyHookContext &) noexcept
+    {
+        ++g_mid_hits;
+    }
+
+    [[nodiscard]] cstr jump_type(AddFn fn) noexcept
+    {
+        auto *code = (const u8 *)fn;
+        if (code[0] == 0xE9)
+        {
+            return "e9";
+        }
+
+        if (code[0] == 0xFF && code[1] == 0x25)
+        {
+            return "ff";
+        }
+
+        return "unknown";
+    }
+
+    void bench_inline_hook_lifecycle(const CodePage &page) noexcept
+    {
+        constexpr usize count = 256;
+
+        std::vector<f64> create{};
+        std::vector<f64> enable{};
+        std::vector<f64> disable{};
+        std::vector<f64> reset{};
+
+        for (usize i{}; i < count; ++i)
+        {
+            AddFn target = page.function(i);
+
+            auto t0   = Clock::now();
+            auto hook = SafetyHookInline::create(target, hooked_add, SafetyHookInline::StartDisabled);
+            auto t1   = Clock::now();
+            if (!hook)
+            {
+                add_skipped("inline_hook.create", "InlineHook::create failed");
+                return;
+            }
+
+            (void)hook->enable();
+            auto t2 = Clock::now();
+            (void)hook->disable();
+            auto t3 = Clock::now();
+            hook->reset();
+            auto t4 = Clock::now();
+
+            create.push_back(elapsed_ns(t0, t1));
+            enable.push_back(elapsed_ns(t1, t2));
+            disable.push_back(elapsed_ns(t2, t3));
+            reset.push_back(elapsed_ns(t3, t4));
+        }
+
+        add_result("inline_hook.create", std::move(create), count);
+        add_result("inline_hook.enable", std::move(enable), count);
+        add_result("inline_hook.disable", std::move(disable), count);
+        add_result("inline_hook.reset", std::move(reset), count);
+    }
+
+    void bench_inline_call(std::string name, AddFn target, u64 iterations) noexcept
+    {
+        auto hook = SafetyHookInline::create(target, hooked_add);
+        if (!hook)
+        {
+            add_skipped(std::move(name), "InlineHook::create failed");
+            return;
+        }
+
+        g_add_original = hook->original<AddFn>();
+
+        AddFn fn    = launder(target);
+        auto  extra = fmt::format("\"jump\": \"{}\"", jump_type(target));
+        add_result(std::move(name), measure_batches(iterations, [&]() noexcept { g_sink = fn(g_sink); }), iterations, std::move(extra));
+    }
+
+    void bench_inline_calls(const CodePage &near_page, const CodePage *isolated_page, u64 iterations) noexcept
+    {
+        AddFn baseline = launder(near_page.function(0));
+        add_result("call.baseline", measure_batches(iterations, [&]() noexcept { g_sink = baseline(g_sink); }), iterations);
+
+        bench_inline_call("call.inline_hook_e9", near_page.function(1), iterations);
+
+        if (isolated_page != nullptr)
+        {
+            bench_inline_call("call.inline_hook_ff", isolated_page->function(0), iterations);
+        }
+        else
+        {
+            add_skipped("call.inline_hook_ff", TR_ARCH_X86_64 ? "failed to reserve an isolated page" : "x86-32 only has e9 hooks");
+        }
+    }
+
+    class BenchObject
+    {
+    public:
+        virtual ~BenchObject() noexcept = default;
+
+        virtual i32 add(i32 value) noexcept
+        {
+            return value + 1;
+        }
+    };
+
+    // The method right after the destructor(s).
+    constexpr usize BENCH_ADD_INDEX = TR_COMPILER_MSVC ? 1 : 2;
+
+    using VirtualAddFn = i32(TR_THISCALL *)(BenchObject *, i32);
+
+    VirtualAddFn g_virtual_original{};
+
+    class Hooked_BenchObject : public BenchObject
+    {
+    public:
+        static i32 TR_THISCALL hooked_add(BenchObject *object, i32 value) noexcept
+        {
+            return g_virtual_original(object, value);
+        }
+    };
+
+    void bench_virtual_calls(u64 iterations) noexcept
+    {
+        auto *object = launder(new BenchObject{});
+        auto  call   = [&]() noexcept { g_sink = object->add(g_sink); };
+
+        add_result("call.virtual_baseline", measure_batches(iterations, call), iterations);
+
+        // Our VMT slot patch (the class VMT itself).
+        if (auto hook = VmtSlotHook::create(*(u8 ***)object, BENCH_ADD_INDEX, Hooked_BenchObject::hooked_add); hook)
+        {
+            g_virtual_original = hook->original<VirtualAddFn>();
+            add_result("call.vmt_slot_hook", measure_batches(iterations, call), iterations);
+        }
+        else
+        {
+            add_skipped("call.vmt_slot_hook", "VmtSlotHook::create failed");
+        }
+
+        // SafetyHook: the object gets a cloned VMT, then one method of the clone is replaced.
+        if (auto vmt = SafetyHookVmt::create(object); vmt)
+        {
+            add_result("call.vmt_hook_unhooked_method", measure_batches(iterations, call), iterations);
+
+            if (auto vm = vmt->hook_method(BENCH_ADD_INDEX, Hooked_BenchObject::hooked_add); vm)
+            {
+                g_virtual_original = vm->original<VirtualAddFn>();
+                add_result("call.vm_hook", measure_batches(iterations, call), iterations);
+            }
+            else
+            {
+                add_skipped("call.vm_hook", "VmtHook::hook_method failed");
+            }
+        }
+        else
+        {
+            add_skipped("call.vmt_hook_unhooked_method", "VmtHook::create failed");
+            add_skipped("call.vm_hook", "VmtHook::create failed");
+        }
+
+        // Our shared VMT clone.
+        if (auto shared = SharedVmtHook::create(object); shared)
+        {
+            auto &&hook = *shared;
+            if (auto original = hook->hook_method(BENCH_ADD_INDEX, Hooked_BenchObject::hooked_add); original)
+            {
+                hook->apply(object);
+                g_virtual_original = (VirtualAddFn)*original;
+                add_result("call.shared_vmt_hook", measure_batches(iterations, call), iterations);
+                hook->remove(object);
+            }
+        }
+        else
+        {
+            add_skipped("call.shared_vmt_hook", "SharedVmtHook::create failed");
+        }
+
+        delete object;
+    }
+
+    void bench_mid_hook(const CodePage &page, u64 iterations) noexcept
+    {
+        AddFn target = page.function(2);
+
+        auto hook = SafetyHookMid::create(target, mid_hook_destination);
+        if (!hook)
+        {
+            add_skipped("call.mid_hook", "MidHook::create failed");
+            return;
+        }
+
+        AddFn fn = launder(target);
+        add_result("call.mid_hook", measure_batches(iterations, [&]() noexcept { g_sink = fn(g_sink); }), iterations);
+    }
+
+    void bench_allocate_near(const CodePage &page) noexcept
+    {
+        constexpr usize fill_count  = 4096;
+        constexpr usize timed_count = 1024;
+
+        auto allocator = safetyhook::Allocator::create();
+
+        std::vector<u8 *> desired{(u8 *)page.function(3)};
+
+        // Fill, then free every other allocation so the free lists are as fragmented as they get.
+        std::vector<safetyhook::Allocation> allocations{};
+        allocations.reserve(fill_count);
+        for (usize i{}; i < fill_count; ++i)
+        {
+            if (auto allocation = allocator->allocate_near(desired, 16 + (i * 37) % 240); allocation)
+            {
+                allocations.push_back(std::move(*allocation));
+            }
+        }
+
+        for (usize i{}; i < allocations.size(); i += 2)
+        {
+            allocations[i].free();
+        }
+
+        std::vector<f64>                    samples{};
+        std::vector<safetyhook::Allocation> timed{};
+        samples.reserve(timed_count);
+        timed.reserve(timed_count);
+
+        for (usize i{}; i < timed_count; ++i)
+        {
+            auto start      = Clock::now();
+            auto allocation = allocator->allocate_near(desired, 16 + (i * 53) % 496);
+            auto end        = Clock::now();
+
+            if (!allocation)
+            {
+                add_skipped("allocator.allocate_near_fragmented", "Allocator::allocate_near failed");
+                return;
+            }
+
+            samples.push_back(elapsed_ns(start, end));
+            timed.push_back(std::move(*allocation));
+        }
+
+        add_result("allocator.allocate_near_fragmented", std::move(samples), timed_count, fmt::format("\"live_allocations\": {}", fill_count / 2));
+    }
+
+    void bench_vm_query(const CodePage &page, u64 iterations) noexcept
+    {
+        static i32 data{};
+        i32        stack{};
+        auto       heap = std::make_unique<i32>();
+
+        u8 *addresses[] = {(u8 *)page.function(0), (u8 *)&bench_vm_query, (u8 *)&data, (u8 *)&stack, (u8 *)heap.get()};
+
+        // `vm_query` reads `/proc/self/maps` on Linux, so use far fewer iterations than the call benchmarks.
+        u64   count = std::max<u64>(iterations / 1000, 100);
+        usize index{};
+
+        add_result(
+            "vm_query",
+            measure_batches(
+                count,
+                [&]() noexcept
+                {
+                    auto result = safetyhook::vm_query(addresses[index++ % std::size(addresses)]);
+                    g_sink      = result ? (i32)result->size : 0;
+                }),
+            count);
+    }
+
+    void bench_disasm() noexcept
+    {
+        constexpr usize max_bytes = 4 * 1024 * 1024;
+
+        u8 *begin{};
+        u8 *end{};
+        for (auto &&segment : os_get_module_segments(os_get_module(std::string_view{})))
+        {
+            if (segment.executable && !segment.relro)
+            {
+                begin = segment.begin;
+                end   = segment.begin + std::min<usize>(segment.end - segment.begin, max_bytes);
+                break;
+            }
+        }
+
+        if (begin == nullptr)
+        {
+            add_skipped("disasm_for_each", "no executable segment found");
+            return;
+        }
+
+        constexpr usize passes = 10;
+
+        std::vector<f64> samples{};
+        u64              instructions{};
+        u64              bytes{};
+
+        for (usize pass{}; pass < passes; ++pass)
+        {
+            instructions = 0;
+            bytes        = 0;
+
+            auto start = Clock::now();
+            for (u8 *ip = begin; ip < end;)
+            {
+                u8 *next = ip;
+                (void)disasm_for_each(
+                    ip,
+                    end - ip,
+                    [&](const Disasm &result) noexcept
+                    {
+                        ++instructions;
+                        bytes += result.ix.length;
+                        next = result.ip + result.ix.length;
+                        return false;
+                    });
+
+                // Decoding stops at the end or at an undecodable byte (padding, inline data), skip it.
+                ip = next < end ? next + 1 : end;
+            }
+            auto finish = Clock::now();
+
+            samples.push_back(elapsed_ns(start, finish) / (f64)std::max<u64>(instructions, 1));
+        }
+
+        f64 ns_per_instruction = *std::min_element(samples.begin(), samples.end());
+        f64 mb_per_second      = (f64)bytes / (ns_per_instruction * (f64)instructions) * 1e9 / (1024.0 * 1024.0);
+
+        add_result(
+            "disasm_for_each",
+            std::move(samples),
+            instructions,
+            fmt::format("\"instructions\": {}, \"bytes\": {}, \"mb_per_s\": {:.2f}", instructions, bytes, mb_per_second));
+    }
+
+    void bench_strings(u64 iterations) noexcept
+    {
+        // A long-ish `srcds` command line.
+        std::string cmdline = "./srcds_linux";
+        for (std::string_view arg : {"-game", "cstrike", "-console", "-usercon", "+ip", "0.0.0.0", "-port", "27015", "+maxplayers", "32",
+                                     "+map", "de_dust2", "-tickrate", "128", "-nohltv", "-nobots", "+sv_pure", "1", "-threads", "4"})
+        {
+            cmdline += '\0';
+            cmdline += arg;
+        }
+
+        u64 count = std::max<u64>(iterations / 100, 1000);
+        add_result(
+            "str_split",
+            measure_batches(count, [&]() noexcept { g_sink = (i32)str_split(cmdline, '\0').size(); }),
+            count,
+            fmt::format("\"bytes\": {}", cmdline.size()));
+
+        count = std::max<u64>(iterations / 1000, 100);
+        add_result("os_get_command_line", measure_batches(count, []() noexcept { g_sink = (i32)os_get_command_line().size(); }), count);
+    }
+
+    [[nodiscard]] std::string json_escape(std::string_view str) noexcept
+    {
+        std::string result{};
+        for (char c : str)
+        {
+            if (c == '"' || c == '\\')
+            {
+                result += '\\';
+            }
+
+            result += c;
+        }
+
+        return result;
+    }
+
+    [[nodiscard]] std::string to_json(u64 iterations) noexcept
+    {
+#if TR_COMPILER_MSVC
+        auto compiler = fmt::format("msvc {}", _MSC_FULL_VER);
+#elif TR_COMPILER_CLANG
+        auto compiler = fmt::format("clang {}", __clang_version__);
+#else
+        auto compiler = fmt::format("gcc {}", __VERSION__);
+#endif
+
+#if defined(NDEBUG)
+        constexpr bool optimized = true;
+#else
+        constexpr bool optimized = false;
+#endif
+
+        std::string out{};
+        out += "{\n";
+        out += fmt::format("  \"compiler\": \"{}\",\n", json_escape(compiler));
+        out += fmt::format("  \"arch\": \"{}\",\n", TR_ARCH_X86_64 ? "x86-64" : "x86-32");
+        out += fmt::format("  \"os\": \"{}\",\n", TR_OS_WINDOWS ? "windows" : "linux");
+        out += fmt::format("  \"ndebug\": {},\n", optimized);
+        out += fmt::format("  \"iterations\": {},\n", iterations);
+        out += "  \"results\": [\n";
+
+        for (usize i{}; i < g_results.size(); ++i)
+        {
+            auto &&result = g_results[i];
+
+            out += fmt::format("    {{\"name\": \"{}\"", json_escape(result.name));
+            if (result.iterations != 0)
+            {
+                out += fmt::format(
+                    ", \"iterations\": {}, \"ns_per_op\": {:.3f}, \"p50_ns\": {:.3f}, \"p99_ns\": {:.3f}, \"min_ns\": {:.3f}",
+                    result.iterations,
+                    result.ns_per_op,
+                    result.p50,
+                    result.p99,
+                    result.min);
+            }
+
+            if (!result.extra.empty())
+            {
+                out += ", ";
+                out += result.extra;
+            }
+
+            out += i + 1 < g_results.size() ? "},\n" : "}\n";
+        }
+
+        out += "  ]\n";
+        out += "}\n";
+
+        return out;
+    }
+} // namespace
+
+int main(int argc, char **argv)
+{
+    u64  iterations = 1000000;
+    cstr output{};
+
+    for (int i = 1; i + 1 < argc; ++i)
+    {
+        std::string_view arg   = argv[i];
+        std::string_view value = argv[i + 1];
+
+        if (arg == "-bench_iterations")
+        {
+            (void)std::from_chars(value.data(), value.data() + value.size(), iterations);
+        }
+        else if (arg == "-bench_output")
+        {
+            output = argv[i + 1];
+        }
+    }
+
+    auto near_page     = CodePage::create(false);
+    auto isolated_page = TR_ARCH_X86_64 ? CodePage::create(true) : nullptr;
+    if (near_page == nullptr)
+    {
+        std::fprintf(stderr, "Failed to allocate executable memory.\n");
+        return EXIT_FAILURE;
+    }
+
+    bench_inline_hook_lifecycle(*near_page);
+    bench_inline_calls(*near_page, isolated_page.get(), iterations);
+    bench_virtual_calls(iterations);
+    bench_mid_hook(*near_page, iterations);
+    bench_allocate_near(*near_page);
+    bench_vm_query(*near_page, iterations);
+    bench_disasm();
+    bench_strings(iterations);
+
+    auto json = to_json(iterations);
+
+    if (output == nullptr)
+    {
+        std::fputs(json.c_str(), stdout);
+        return EXIT_SUCCESS;
+    }
+
+    auto *file = std::fopen(output, "wb");
+    if (file == nullptr)
+    {
+        std::fprintf(stderr, "Failed to open `%s`.\n", output);
+        return EXIT_FAILURE;
+    }
+
+    std::fputs(json.c_str(), file);
+    std::fclose(file);
+
+    return EXIT_SUCCESS;
+}
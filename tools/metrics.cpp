@@ -0,0 +1,240 @@
+// Prints the metrics pages of every server on this host (`-tickrate_metrics`) in the Prometheus text format.
+// It only maps the pages read-only, the servers never notice. Point node_exporter's textfile collector at its output or serve it
+// from anything that can run a command per scrape.
+//
+// Usage: tickrate_metrics [page...] (default: every `/dev/shm/source-tickrate-*.metrics`)
+
+#include "type.hpp"
+#include "metrics.hpp"
+#include "timing.hpp"
+#include <fmt/format.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace
+{
+    // A server that hasn't ticked for this long is reported as down (a hibernating server doesn't tick either).
+    constexpr f64 STALE_SECONDS = 5.0;
+
+    struct Instance
+    {
+        std::string   name{}; // The port for pages created by the plugin.
+        MetricsValues values{};
+        f64           age{};
+        bool          up{};
+    };
+
+    [[nodiscard]] std::vector<std::string> find_pages() noexcept
+    {
+        std::vector<std::string> result{};
+
+        DIR *dir = opendir(METRICS_DIR);
+        if (dir == nullptr)
+        {
+            return result;
+        }
+
+        constexpr std::string_view prefix = METRICS_PREFIX;
+        constexpr std::string_view suffix = METRICS_SUFFIX;
+
+        while (auto *entry = readdir(dir))
+        {
+            std::string_view name = entry->d_name;
+            if (name.size() > prefix.size() + suffix.size() && name.substr(0, prefix.size()) == prefix
+                && name.substr(name.size() - suffix.size()) == suffix)
+            {
+                result.push_back(fmt::format("{}/{}", METRICS_DIR, name));
+            }
+        }
+
+        closedir(dir);
+
+        return result;
+    }
+
+    [[nodiscard]] std::string instance_name(std::string_view path) noexcept
+    {
+        constexpr std::string_view prefix = METRICS_PREFIX;
+        constexpr std::string_view suffix = METRICS_SUFFIX;
+
+        if (auto slash = path.rfind('/'); slash != std::string_view::npos)
+        {
+            path.remove_prefix(slash + 1);
+        }
+
+        if (path.substr(0, prefix.size()) == prefix)
+        {
+            path.remove_prefix(prefix.size());
+        }
+
+        if (path.size() >= suffix.size() && path.substr(path.size() - suffix.size()) == suffix)
+        {
+            path.remove_suffix(suffix.size());
+        }
+
+        return std::string{path};
+    }
+
+    [[nodiscard]] bool read_page(const std::string &path, Instance &out) noexcept
+    {
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            return false;
+        }
+
+        struct stat st{};
+        void       *mapping = MAP_FAILED;
+        if (fstat(fd, &st) == 0 && (usize)st.st_size >= sizeof(MetricsPage))
+        {
+            mapping = mmap(nullptr, sizeof(MetricsPage), PROT_READ, MAP_SHARED, fd, 0);
+        }
+
+        close(fd);
+
+        if (mapping == MAP_FAILED)
+        {
+            return false;
+        }
+
+        const auto *page = (const MetricsPage *)mapping;
+
+        out.name = instance_name(path);
+
+        bool ok = metrics_read(page, out.values);
+        if (ok)
+        {
+            // Same clock as the server, so the age is exact.
+            u64 now = timing_now_ns();
+            out.age = now > out.values.updated_ns ? (f64)(now - out.values.updated_ns) / 1e9 : 0.0;
+
+            bool alive = kill((pid_t)page->pid, 0) == 0 || errno != ESRCH;
+            out.up     = alive && out.values.updated_ns != 0 && out.age < STALE_SECONDS;
+        }
+
+        munmap(mapping, sizeof(MetricsPage));
+
+        return ok;
+    }
+
+    struct Metric
+    {
+        cstr name;
+        cstr type;
+        cstr help;
+        f64 (*value)(const Instance &);
+    };
+
+    constexpr Metric METRICS[] = {
+        {"tickrate_up", "gauge", "Whether the server is alive and ticked recently.",
+         [](const Instance &i) { return i.up ? 1.0 : 0.0; }},
+        {"tickrate_metrics_age_seconds", "gauge", "Time since the server last updated its metrics.",
+         [](const Instance &i) { return i.age; }},
+        {"tickrate_desired_ticks_per_second", "gauge", "The `-tickrate` the server runs at.",
+         [](const Instance &i) { return i.values.tickrate; }},
+        {"tickrate_ticks_total", "counter", "Simulated ticks.",
+         [](const Instance &i) { return (f64)i.values.ticks; }},
+        {"tickrate_overruns_total", "counter", "Ticks that took 1.5 intervals or more.",
+         [](const Instance &i) { return (f64)i.values.overruns; }},
+        {"tickrate_catch_up_ticks_total", "counter", "Ticks run back to back to catch up after a slow frame.",
+         [](const Instance &i) { return (f64)i.values.catch_up_ticks; }},
+        {"tickrate_catch_up_limited_total", "counter", "Stalls the catch-up limit (`-tickrate_maxticks`) was applied to.",
+         [](const Instance &i) { return (f64)i.values.catch_up_limited; }},
+        {"tickrate_catch_up_dropped_ticks_total", "counter", "Ticks the catch-up limit dropped.",
+         [](const Instance &i) { return (f64)i.values.catch_up_dropped; }},
+        {"tickrate_players", "gauge", "Active players.",
+         [](const Instance &i) { return (f64)i.values.players; }},
+        {"tickrate_max_players", "gauge", "Player slots.",
+         [](const Instance &i) { return (f64)i.values.max_players; }},
+        {"tickrate_resident_memory_bytes", "gauge", "Resident set size of the server.",
+         [](const Instance &i) { return (f64)i.values.rss_bytes; }},
+    };
+
+    // Quantiles cover the last few thousand ticks, `_sum` and `_count` the server's whole run.
+    void print_summary(const std::vector<Instance> &instances, cstr name, cstr help, MetricsDurations MetricsValues::*field) noexcept
+    {
+        fmt::print("# HELP {} {}\n# TYPE {} summary\n", name, help, name);
+
+        for (auto &&instance : instances)
+        {
+            auto &&durations = instance.values.*field;
+            fmt::print("{}{{port=\"{}\",quantile=\"0.5\"}} {}\n", name, instance.name, durations.p50_us);
+            fmt::print("{}{{port=\"{}\",quantile=\"0.99\"}} {}\n", name, instance.name, durations.p99_us);
+            fmt::print("{}{{port=\"{}\",quantile=\"0.999\"}} {}\n", name, instance.name, durations.p999_us);
+            fmt::print("{}{{port=\"{}\",quantile=\"1\"}} {}\n", name, instance.name, durations.max_us);
+            fmt::print("{}_sum{{port=\"{}\"}} {}\n", name, instance.name, durations.sum_us);
+            fmt::print("{}_count{{port=\"{}\"}} {}\n", name, instance.name, durations.count);
+        }
+    }
+
+    void print_hook_calls(const std::vector<Instance> &instances) noexcept
+    {
+        constexpr cstr name = "tickrate_hook_calls_total";
+
+        fmt::print("# HELP {} Calls through the plugin's hooks.\n# TYPE {} counter\n", name, name);
+
+        for (auto &&instance : instances)
+        {
+            fmt::print("{}{{port=\"{}\",hook=\"GetTickInterval\"}} {}\n", name, instance.name, instance.values.get_tick_interval_calls);
+            fmt::print("{}{{port=\"{}\",hook=\"Plat_FloatTime\"}} {}\n", name, instance.name, instance.values.plat_floattime_calls);
+        }
+    }
+} // namespace
+
+int main(int argc, char **argv)
+{
+    std::vector<std::string> paths{};
+    for (int i = 1; i < argc; ++i)
+    {
+        paths.emplace_back(argv[i]);
+    }
+
+    if (paths.empty())
+    {
+        paths = find_pages();
+    }
+
+    std::vector<Instance> instances{};
+    for (auto &&path : paths)
+    {
+        Instance instance{};
+        if (read_page(path, instance))
+        {
+            instances.push_back(std::move(instance));
+        }
+        else
+        {
+            fmt::print(stderr, "Skipping `{}`: not a metrics page (or its server died mid-update).\n", path);
+        }
+    }
+
+    for (auto &&metric : METRICS)
+    {
+        fmt::print("# HELP {} {}\n# TYPE {} {}\n", metric.name, metric.help, metric.name, metric.type);
+        for (auto &&instance : instances)
+        {
+            fmt::print("{}{{port=\"{}\"}} {}\n", metric.name, instance.name, metric.value(instance));
+        }
+    }
+
+    print_summary(instances,
+        "tickrate_tick_spacing_microseconds",
+        "Time between the starts of two simulated ticks, catch-up ticks left out.",
+        &MetricsValues::tick_spacing);
+    print_summary(instances,
+        "tickrate_tick_work_microseconds",
+        "Time from the start of a simulated tick to the end of the game's GameFrame, what it costs regardless of pacing.",
+        &MetricsValues::tick_work);
+    print_hook_calls(instances);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,532 @@
+// Minimal stand-in for a Source dedicated server, used to load and benchmark the plugin without a game install.
+// It exports `CreateInterface` and `s_pInterfaceRegs` itself (like `server.so`), provides a `CServerGameDLL` whose real
+// `GetTickInterval` sits at VMT index 10 and a `VEngineCvar004` with the rate ConVars, then drives `IServerPluginCallbacks` through
+// a fixed-interval tick loop the same way the engine does.
+//
+// Usage: tickrate_mockhost <plugin path> -tickrate 128 [-mockhost_ticks 2000] [-mockhost_maxplayers 32] [-mockhost_calls 1000000]
+//                           [-mockhost_timer sleep_relative|sleep_absolute|timerfd|sleep_spin]
+
+#include "common.hpp"
+#include "type.hpp"
+#include "engine.hpp"
+#include "timing.hpp"
+#include <fmt/format.h>
+#include <dlfcn.h>
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace
+{
+    constexpr f32 DEFAULT_TICK_INTERVAL = 0.015f;
+
+    // Same layout as the engine's `IServerGameDLL` up to `GetTickInterval`. Arguments don't matter, the host never calls the others.
+    class MockServerGameDLL
+    {
+    public:
+        virtual bool DLLInit(void *, void *, void *, void *)
+        {
+            return true;
+        }
+
+        virtual bool ReplayInit(void *)
+        {
+            return true;
+        }
+
+        virtual bool GameInit()
+        {
+            return true;
+        }
+
+        virtual bool LevelInit(cstr, cstr, cstr, cstr, bool, bool)
+        {
+            return true;
+        }
+
+        virtual void ServerActivate(edict_t *, i32, i32) {}
+
+        // Index 5, `GetTickInterval` minus 5 like the engine's.
+        virtual void GameFrame(bool simulating)
+        {
+            m_frames += simulating ? 1 : 0;
+        }
+
+        virtual void PreClientUpdate(bool) {}
+
+        virtual void LevelShutdown() {}
+
+        virtual void GameShutdown() {}
+
+        virtual void DLLShutdown() {}
+
+        // Index 10. Leaf constant getter like the CS:S/TF2 one, so the plugin's detection runs against real compiler output.
+        virtual f32 GetTickInterval() const
+        {
+            return DEFAULT_TICK_INTERVAL;
+        }
+
+        virtual void *GetAllServerClasses()
+        {
+            return nullptr;
+        }
+
+        virtual cstr GetGameDescription()
+        {
+            return "Mock";
+        }
+
+        virtual void CreateNetworkStringTables() {}
+
+    private:
+        u64 m_frames{};
+    };
+
+    class MockConVar final : public ConVar
+    {
+    public:
+        MockConVar(cstr name, f32 value, bool has_min = false, f32 min = 0.0f, bool has_max = false, f32 max = 0.0f) noexcept
+        {
+            m_pNext           = nullptr;
+            m_bRegistered     = true;
+            m_pszName         = name;
+            m_pszHelpString   = "";
+            m_nFlags          = 0;
+            m_pParent         = nullptr;
+            m_pszDefaultValue = "";
+            m_pszString       = m_buffer;
+            m_StringLength    = sizeof(m_buffer);
+            m_bHasMin         = has_min;
+            m_fMinVal         = min;
+            m_bHasMax         = has_max;
+            m_fMaxVal         = max;
+
+            MockConVar::SetValue(value);
+        }
+
+        // `m_pszString` points into the object itself.
+        MockConVar(const MockConVar &)            = delete;
+        MockConVar &operator=(const MockConVar &) = delete;
+
+        void SetValue(cstr value) override
+        {
+            SetValue((f32)std::strtod(value, nullptr));
+        }
+
+        void SetValue(f32 value) override
+        {
+            if (m_bHasMin)
+            {
+                value = std::max(value, m_fMinVal);
+            }
+
+            if (m_bHasMax)
+            {
+                value = std::min(value, m_fMaxVal);
+            }
+
+            m_fValue = value;
+            m_nValue = (i32)value;
+
+            auto result = fmt::format_to_n(m_buffer, sizeof(m_buffer) - 1, "{}", value);
+            *result.out = '\0';
+        }
+
+        void SetValue(i32 value) override
+        {
+            SetValue((f32)value);
+        }
+
+        cstr GetName() const override
+        {
+            return m_pszName;
+        }
+
+        bool IsFlagSet(i32 flag) const override
+        {
+            return (m_nFlags & flag) != 0;
+        }
+
+    private:
+        char m_buffer[32]{};
+    };
+
+    class MockCvar final : public ICvar
+    {
+    public:
+        bool Connect(CreateInterfaceFn) override
+        {
+            return true;
+        }
+
+        void Disconnect() override {}
+
+        void *QueryInterface(cstr) override
+        {
+            return nullptr;
+        }
+
+        InitReturnVal_t Init() override
+        {
+            return INIT_OK;
+        }
+
+        void Shutdown() override {}
+
+        CVarDLLIdentifier_t AllocateDLLIdentifier() override
+        {
+            return 0;
+        }
+
+        void RegisterConCommand(ConCommandBase *) override {}
+
+        void UnregisterConCommand(ConCommandBase *) override {}
+
+        void UnregisterConCommands(CVarDLLIdentifier_t) override {}
+
+        cstr GetCommandLineValue(cstr) override
+        {
+            return nullptr;
+        }
+
+        ConCommandBase *FindCommandBase(cstr name) override
+        {
+            return FindVar(name);
+        }
+
+        const ConCommandBase *FindCommandBase(cstr name) const override
+        {
+            return FindVar(name);
+        }
+
+        ConVar *FindVar(cstr name) override
+        {
+            for (auto &&var : m_vars)
+            {
+                if (std::strcmp(var.m_pszName, name) == 0)
+                {
+                    return &var;
+                }
+            }
+
+            return nullptr;
+        }
+
+        const ConVar *FindVar(cstr name) const override
+        {
+            return const_cast<MockCvar *>(this)->FindVar(name);
+        }
+
+        [[nodiscard]] const std::array<MockConVar, 7> &vars() const noexcept
+        {
+            return m_vars;
+        }
+
+    private:
+        // Stock CS:S values.
+        std::array<MockConVar, 7> m_vars{{
+            {"sv_maxupdaterate", 66.0f},
+            {"sv_minupdaterate", 10.0f},
+            {"sv_maxcmdrate", 66.0f},
+            {"sv_mincmdrate", 0.0f},
+            {"sv_maxrate", 0.0f, true, 0.0f, true, 1048576.0f},
+            {"sv_minrate", 3500.0f, true, 0.0f, true, 1048576.0f},
+            {"net_splitpacket_maxrate", 15000.0f, true, 1000.0f, true, 1048576.0f},
+        }};
+    };
+
+    MockServerGameDLL g_servergame{};
+    MockCvar          g_cvar{};
+
+    void *create_servergame() noexcept
+    {
+        return &g_servergame;
+    }
+
+    void *create_cvar() noexcept
+    {
+        return &g_cvar;
+    }
+
+    InterfaceReg g_cvar_reg{create_cvar, "VEngineCvar004", nullptr};
+    InterfaceReg g_servergame_reg{create_servergame, "ServerGameDLL010", &g_cvar_reg};
+
+    struct Options
+    {
+        cstr           plugin_path{};
+        usize          ticks{2000};
+        i32            maxplayers{32};
+        usize          calls{1000000};
+        TimingStrategy timer{TIMING_SLEEP_ABSOLUTE};
+    };
+
+    template <class T>
+    void parse_option(std::string_view value, T &out) noexcept
+    {
+        T result{};
+        if (auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), result); ec == std::errc{})
+        {
+            out = result;
+        }
+    }
+
+    // The plugin reads its own options (`-tickrate`, ...) from the process command line, they're simply passed through.
+    [[nodiscard]] Options parse_options(int argc, char **argv) noexcept
+    {
+        Options options{};
+        if (argc < 2 || argv[1][0] == '-')
+        {
+            return options;
+        }
+
+        options.plugin_path = argv[1];
+
+        for (int i = 2; i < argc; ++i)
+        {
+            std::string_view arg   = argv[i];
+            std::string_view value = i + 1 < argc ? argv[i + 1] : "";
+
+            if (arg == "-mockhost_ticks")
+            {
+                parse_option(value, options.ticks);
+            }
+            else if (arg == "-mockhost_maxplayers")
+            {
+                parse_option(value, options.maxplayers);
+            }
+            else if (arg == "-mockhost_calls")
+            {
+                parse_option(value, options.calls);
+            }
+            else if (arg == "-mockhost_timer")
+            {
+                for (u8 strategy{}; strategy < TIMING_STRATEGY_COUNT; ++strategy)
+                {
+                    if (value == timing_strategy_str((TimingStrategy)strategy))
+                    {
+                        options.timer = (TimingStrategy)strategy;
+                    }
+                }
+            }
+        }
+
+        return options;
+    }
+
+    [[nodiscard]] f64 to_us(u64 ns) noexcept
+    {
+        return (f64)ns / 1000.0;
+    }
+
+    // The engine only ever calls it through the VMT, so do the same (a direct call would bypass the hook).
+    [[nodiscard]] f32 call_GetTickInterval(const MockServerGameDLL *servergame) noexcept
+    {
+        using Fn = f32(TR_THISCALL *)(const MockServerGameDLL *);
+        return (*(Fn **)servergame)[10](servergame);
+    }
+
+    // Through the VMT as well, the plugin hooks it to time the tick's work.
+    void call_GameFrame(MockServerGameDLL *servergame, bool simulating) noexcept
+    {
+        using Fn = void(TR_THISCALL *)(MockServerGameDLL *, bool);
+        (*(Fn **)servergame)[5](servergame, simulating);
+    }
+
+    // Average cost of a `GetTickInterval` call through the VMT, in nanoseconds.
+    [[nodiscard]] f64 measure_GetTickInterval(usize calls) noexcept
+    {
+        // Launder the object so the compiler can't devirtualize or hoist the calls.
+        auto *volatile servergame = &g_servergame;
+
+        volatile f32 sink{};
+        u64          start = timing_now_ns();
+        for (usize i{}; i < calls; ++i)
+        {
+            sink = call_GetTickInterval(servergame);
+        }
+        u64 end = timing_now_ns();
+
+        (void)sink;
+
+        return (f64)(end - start) / (f64)std::max<usize>(calls, 1);
+    }
+
+    void print_summary(cstr name, std::vector<f64> &samples) noexcept
+    {
+        auto summary = timing_summarize(samples);
+        fmt::print(
+            "  {:<20} mean {:>9.2f}  p50 {:>9.2f}  p99 {:>9.2f}  p99.9 {:>9.2f}  max {:>9.2f} (us)\n",
+            name,
+            summary.mean,
+            summary.p50,
+            summary.p99,
+            summary.p999,
+            summary.max);
+    }
+} // namespace
+
+extern "C"
+{
+    TR_DLLEXPORT InterfaceReg *s_pInterfaceRegs = &g_servergame_reg;
+}
+
+// Serves as both the engine and the server factory, every mock interface is in the one list.
+extern "C" TR_DLLEXPORT void *TR_CCALL CreateInterface(cstr name, i32 *return_code)
+{
+    for (auto *reg = s_pInterfaceRegs; reg != nullptr; reg = reg->m_pNext)
+    {
+        if (std::strcmp(reg->m_pName, name) == 0)
+        {
+            if (return_code != nullptr)
+            {
+                *return_code = IFACE_OK;
+            }
+
+            return reg->m_CreateFn();
+        }
+    }
+
+    if (return_code != nullptr)
+    {
+        *return_code = IFACE_FAILED;
+    }
+
+    return nullptr;
+}
+
+int main(int argc, char **argv)
+{
+    auto options = parse_options(argc, argv);
+    if (options.plugin_path == nullptr)
+    {
+        fmt::print(
+            stderr,
+            "Usage: {} <plugin path> -tickrate <tickrate> [-mockhost_ticks N] [-mockhost_maxplayers N] [-mockhost_calls N] "
+            "[-mockhost_timer <strategy>]\n",
+            argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    u64 load_start = timing_now_ns();
+
+    void *plugin_module = dlopen(options.plugin_path, RTLD_NOW | RTLD_LOCAL);
+    if (plugin_module == nullptr)
+    {
+        fmt::print(stderr, "Failed to load `{}`: {}\n", options.plugin_path, dlerror());
+        return EXIT_FAILURE;
+    }
+
+    auto plugin_createinterface = (CreateInterfaceFn)dlsym(plugin_module, "CreateInterface");
+    auto *plugin = plugin_createinterface != nullptr ? (IServerPluginCallbacks *)plugin_createinterface("ISERVERPLUGINCALLBACKS003", nullptr) : nullptr;
+    if (plugin == nullptr)
+    {
+        fmt::print(stderr, "`{}` doesn't export `ISERVERPLUGINCALLBACKS003`.\n", options.plugin_path);
+        dlclose(plugin_module);
+        return EXIT_FAILURE;
+    }
+
+    u64 dlopen_end = timing_now_ns();
+
+    f64 original_call_ns = measure_GetTickInterval(options.calls);
+
+    u64  plugin_load_start = timing_now_ns();
+    bool loaded            = plugin->Load(CreateInterface, CreateInterface);
+    u64  plugin_load_end   = timing_now_ns();
+
+    if (!loaded)
+    {
+        fmt::print(stderr, "`IServerPluginCallbacks::Load` failed.\n");
+        dlclose(plugin_module);
+        return EXIT_FAILURE;
+    }
+
+    f64 hooked_call_ns = measure_GetTickInterval(options.calls);
+
+    // The engine reads the interval once when the server spawns.
+    f32 interval = call_GetTickInterval(&g_servergame);
+    u64 period   = (u64)((f64)interval * 1e9);
+
+    // Only used by `sleep_spin`, same default as `tickrate_timerprobe`.
+    constexpr u64 spin_ns = 200000;
+
+    auto timer = TickTimer::create(options.timer, spin_ns);
+    if (!timer)
+    {
+        fmt::print(stderr, "Failed to create a `{}` timer.\n", timing_strategy_str(options.timer));
+        plugin->Unload();
+        dlclose(plugin_module);
+        return EXIT_FAILURE;
+    }
+
+    plugin->LevelInit("de_mock");
+    plugin->ServerActivate(nullptr, 0, options.maxplayers);
+
+    std::vector<f64> lateness{};
+    std::vector<f64> frame_cost{};
+    lateness.reserve(options.ticks);
+    frame_cost.reserve(options.ticks);
+
+    usize overruns{};
+    u64   loop_start = timing_now_ns();
+    u64   deadline   = loop_start + period;
+
+    for (usize tick{}; tick < options.ticks; ++tick)
+    {
+        timer->wait_until(deadline);
+
+        u64 frame_start = timing_now_ns();
+        lateness.push_back(to_us(frame_start - deadline));
+
+        // Plugins first, like the engine.
+        plugin->GameFrame(true);
+        call_GameFrame(&g_servergame, true);
+
+        u64 frame_end = timing_now_ns();
+        frame_cost.push_back(to_us(frame_end - frame_start));
+
+        // Like the engine, a late tick doesn't move the schedule, the following ticks run back to back until it catches up.
+        deadline += period;
+        if (frame_end > deadline)
+        {
+            ++overruns;
+        }
+    }
+
+    u64 loop_end = timing_now_ns();
+
+    plugin->LevelShutdown();
+
+    u64 unload_start = timing_now_ns();
+    plugin->Unload();
+    u64 unload_end = timing_now_ns();
+
+    f64 restored_call_ns = measure_GetTickInterval(options.calls);
+
+    dlclose(plugin_module);
+
+    f64 loop_seconds = (f64)(loop_end - loop_start) / 1e9;
+
+    fmt::print("\nMock host results ({}):\n", options.plugin_path);
+    fmt::print("  dlopen + CreateInterface {:>10.2f} us\n", to_us(dlopen_end - load_start));
+    fmt::print("  Load                     {:>10.2f} us\n", to_us(plugin_load_end - plugin_load_start));
+    fmt::print("  Unload                   {:>10.2f} us\n", to_us(unload_end - unload_start));
+    fmt::print("  GetTickInterval          {:>10.2f} ns original, {:.2f} ns hooked, {:.2f} ns after unload\n", original_call_ns, hooked_call_ns, restored_call_ns);
+    fmt::print("  Tick interval            {:>10.6f} s ({:.2f} ticks/s)\n", interval, 1.0 / (f64)interval);
+    fmt::print("  Achieved                 {:>10.2f} ticks/s over {} ticks, {} overruns\n", (f64)options.ticks / loop_seconds, options.ticks, overruns);
+    fmt::print("  Timer                    {}\n", timing_strategy_str(options.timer));
+    print_summary("Wake-up lateness", lateness);
+    print_summary("GameFrame cost", frame_cost);
+
+    for (auto &&var : g_cvar.vars())
+    {
+        fmt::print("  {:<24} {}\n", var.m_pszName, var.m_pszString);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,439 @@
+// Replays a tick trace recorded with `-tickrate_trace` through the plugin's catch-up limiter (`-tickrate_maxticks`), faster than
+// real time, and reports the tick jitter and frame budget each policy would have produced on that server.
+// The engine is modeled as a loop that reads the clock once per frame and runs as many ticks as the clock says it's behind. Every
+// tick costs `-replay_tickcost` microseconds (by default the median gap between catch-up ticks in the trace, which is what a tick
+// really costs), except the ticks that overran in the trace: the stall is replayed on the first simulated tick that starts at or after
+// the one that stalled. Idle stretches (hibernation, map changes) are left out, like the engine leaves them out.
+// The `recorded` row is the trace itself, `none` (no limit) should come close to it if the model fits the server.
+// Only catch-up policies are replayed. The plugin has no governor, and its pacing (the phase slewing of `-tickrate_stagger` and
+// `-tickrate_align`) follows targets set by the other servers and by client packet arrivals, neither of which a trace records.
+//
+// Usage: tickrate_replay <trace> [-replay_maxticks 1,2,4,8] [-replay_tickcost 1500]
+
+#include "type.hpp"
+#include "string.hpp"
+#include "clock.hpp"
+#include "tickstats.hpp"
+#include "timing.hpp"
+#include "trace.hpp"
+#include <fmt/format.h>
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace
+{
+    // Catch-up gaps needed to trust their median as the cost of a tick.
+    constexpr usize MIN_COST_SAMPLES = 16;
+
+    // Without them, a tick is taken to use this much of its interval.
+    constexpr f64 DEFAULT_COST_FRACTION = 0.25;
+
+    struct Options
+    {
+        std::string      path{};
+        std::vector<u32> max_ticks{1, 2, 4, 8};
+        u64              tick_cost_us{}; // 0 to take it from the trace.
+    };
+
+    template <class T>
+    void parse_option(std::string_view value, T &out) noexcept
+    {
+        T result{};
+        if (auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), result); ec == std::errc{})
+        {
+            out = result;
+        }
+    }
+
+    [[nodiscard]] Options parse_options(int argc, char **argv) noexcept
+    {
+        Options options{};
+        if (argc > 1)
+        {
+            options.path = argv[1];
+        }
+
+        for (int i = 2; i + 1 < argc; ++i)
+        {
+            std::string_view arg   = argv[i];
+            std::string_view value = argv[i + 1];
+
+            if (arg == "-replay_maxticks")
+            {
+                options.max_ticks.clear();
+                for (auto &&str : str_split(value, ','))
+                {
+                    u32 max_ticks{};
+                    parse_option(std::string_view{str}, max_ticks);
+                    if (max_ticks != 0)
+                    {
+                        options.max_ticks.push_back(max_ticks);
+                    }
+                }
+            }
+            else if (arg == "-replay_tickcost")
+            {
+                parse_option(value, options.tick_cost_us);
+            }
+        }
+
+        std::sort(options.max_ticks.begin(), options.max_ticks.end());
+        options.max_ticks.erase(std::unique(options.max_ticks.begin(), options.max_ticks.end()), options.max_ticks.end());
+
+        return options;
+    }
+
+    // A tick that ran long in the trace, in seconds since the start of the trace.
+    struct Stall
+    {
+        f64 begin{};
+        f64 length{};
+    };
+
+    // Simulated ticks between two idle records.
+    struct Stretch
+    {
+        f64                begin{};
+        f64                end{};
+        std::vector<Stall> stalls{};
+    };
+
+    struct Result
+    {
+        std::string      name{};
+        u64              ticks{};
+        u64              overruns{};
+        u64              late_frames{}; // Frames whose ticks took longer than an interval.
+        f64              over_budget{}; // Seconds past the interval, summed over the late frames.
+        u32              max_burst{};   // Most ticks run back to back.
+        f64              dropped{};     // Ticks never simulated.
+        std::vector<f64> gaps{};        // Microseconds between the starts of ticks that aren't catch-up ticks.
+        TimingSummary    summary{};
+        bool             frames{};      // Whether the frame columns are known.
+    };
+
+    [[nodiscard]] std::vector<Stretch> split(const std::vector<TraceRecord> &records) noexcept
+    {
+        std::vector<Stretch> stretches{};
+
+        bool simulating{};
+        for (auto &&record : records)
+        {
+            f64 time = (f64)record.time_ns / 1e9;
+            if ((record.flags & TRACE_SIMULATED) == 0)
+            {
+                if (simulating)
+                {
+                    stretches.back().end = time;
+                }
+
+                simulating = false;
+                continue;
+            }
+
+            if (!simulating)
+            {
+                stretches.push_back(Stretch{time, time, {}});
+                simulating = true;
+            }
+
+            auto &&stretch = stretches.back();
+            stretch.end    = time;
+
+            if ((record.flags & TRACE_OVERRUN) != 0)
+            {
+                f64 length = (f64)record.duration_us / 1e6;
+                stretch.stalls.push_back(Stall{time - length, length});
+            }
+        }
+
+        return stretches;
+    }
+
+    [[nodiscard]] Result recorded(const std::vector<TraceRecord> &records) noexcept
+    {
+        Result result{};
+        result.name = "recorded";
+
+        u32 burst{};
+        for (auto &&record : records)
+        {
+            if ((record.flags & TRACE_SIMULATED) == 0)
+            {
+                burst = 0;
+                continue;
+            }
+
+            ++result.ticks;
+            result.overruns += (record.flags & TRACE_OVERRUN) != 0 ? 1 : 0;
+
+            if ((record.flags & TRACE_CATCH_UP) != 0)
+            {
+                result.max_burst = std::max(result.max_burst, ++burst);
+                continue;
+            }
+
+            burst            = 1;
+            result.max_burst = std::max(result.max_burst, burst);
+            if (record.duration_us != 0)
+            {
+                result.gaps.push_back((f64)record.duration_us);
+            }
+        }
+
+        return result;
+    }
+
+    [[nodiscard]] Result simulate(
+        const std::vector<Stretch> &stretches, f64 interval, f64 tick_cost, u32 max_ticks, ClockCatchUpMode mode, std::string name) noexcept
+    {
+        Result result{};
+        result.name   = std::move(name);
+        result.frames = true;
+
+        CatchUpLimiter limiter{};
+        limiter.configure((u64)(interval * 1e9), max_ticks, mode);
+
+        f64 offset{}; // What the hook adds to `Plat_FloatTime`.
+        for (auto &&stretch : stretches)
+        {
+            limiter.on_idle();
+
+            f64   now        = stretch.begin;
+            f64   last_clock = now + offset;
+            f64   pending{}; // The engine's accumulated frame time.
+            f64   last_tick  = -1.0;
+            usize next_stall{};
+            u32   burst{};
+            u32   previous_burst{};
+
+            while (now < stretch.end)
+            {
+                if (limiter.enabled())
+                {
+                    offset -= limiter.on_read(now);
+                }
+
+                f64 clock   = now + offset;
+                pending    += clock - last_clock;
+                last_clock  = clock;
+
+                auto ticks = (u32)std::floor(pending / interval);
+                if (ticks == 0)
+                {
+                    // Sleeps until the next tick is due.
+                    now += interval - pending + 1e-9;
+                    continue;
+                }
+
+                pending -= (f64)ticks * interval;
+
+                f64 frame_begin = now;
+                for (u32 i{}; i < ticks; ++i)
+                {
+                    burst = 1;
+                    if (last_tick >= 0.0)
+                    {
+                        f64 gap = now - last_tick;
+                        if (gap >= interval * TICK_OVERRUN_FACTOR)
+                        {
+                            ++result.overruns;
+                        }
+
+                        if (gap >= interval / 2.0)
+                        {
+                            result.gaps.push_back(gap * 1e6);
+                        }
+                        else
+                        {
+                            burst = previous_burst + 1;
+                        }
+                    }
+
+                    previous_burst   = burst;
+                    result.max_burst = std::max(result.max_burst, burst);
+
+                    last_tick = now;
+                    ++result.ticks;
+
+                    f64 cost = tick_cost;
+                    if (next_stall < stretch.stalls.size() && stretch.stalls[next_stall].begin <= now)
+                    {
+                        cost = std::max(cost, stretch.stalls[next_stall].length);
+                        ++next_stall;
+                    }
+
+                    offset += limiter.on_tick();
+                    now    += cost;
+                }
+
+                if (f64 work = now - frame_begin; work > interval)
+                {
+                    ++result.late_frames;
+                    result.over_budget += work - interval;
+                }
+            }
+        }
+
+        result.dropped = limiter.stats().dropped_ticks;
+
+        return result;
+    }
+
+    void print_result(Result &result) noexcept
+    {
+        result.summary = timing_summarize(result.gaps);
+
+        auto &&summary = result.summary;
+        if (!result.frames)
+        {
+            fmt::print(
+                "{:<10} {:>9} {:>8} {:>6} {:>6} {:>10} {:>8} {:>8.2f} {:>8.2f} {:>8.2f} {:>8.2f}\n",
+                result.name,
+                result.ticks,
+                result.overruns,
+                "-",
+                result.max_burst,
+                "-",
+                "-",
+                summary.p50 / 1000.0,
+                summary.p99 / 1000.0,
+                summary.p999 / 1000.0,
+                summary.max / 1000.0);
+            return;
+        }
+
+        fmt::print(
+            "{:<10} {:>9} {:>8} {:>6} {:>6} {:>10.1f} {:>8.0f} {:>8.2f} {:>8.2f} {:>8.2f} {:>8.2f}\n",
+            result.name,
+            result.ticks,
+            result.overruns,
+            result.late_frames,
+            result.max_burst,
+            result.over_budget * 1000.0,
+            result.dropped,
+            summary.p50 / 1000.0,
+            summary.p99 / 1000.0,
+            summary.p999 / 1000.0,
+            summary.max / 1000.0);
+    }
+} // namespace
+
+int main(int argc, char **argv)
+{
+    auto options = parse_options(argc, argv);
+    if (options.path.empty())
+    {
+        fmt::print(stderr, "Usage: tickrate_replay <trace> [-replay_maxticks 1,2,4,8] [-replay_tickcost <us>]\n");
+        return 1;
+    }
+
+    TraceHeader header{};
+    auto        records = trace_read(options.path, header);
+    if (!records)
+    {
+        fmt::print(
+            stderr,
+            "Failed to read `{}`: {}.\n",
+            options.path,
+            records.error().type == TraceError::FAILED_TO_OPEN ? "Missing or empty" : "Not a trace, or from another version");
+        return 1;
+    }
+
+    if (header.interval_ns == 0 || records->empty())
+    {
+        fmt::print(stderr, "`{}` has no ticks.\n", options.path);
+        return 1;
+    }
+
+    const f64 interval = (f64)header.interval_ns / 1e9;
+
+    // What a tick costs when it doesn't have to wait for anything: the gap between ticks run back to back.
+    std::vector<f64> costs{};
+    u32              max_players{};
+    for (auto &&record : *records)
+    {
+        if ((record.flags & TRACE_CATCH_UP) != 0)
+        {
+            costs.push_back((f64)record.duration_us);
+        }
+
+        max_players = std::max<u32>(max_players, record.players);
+    }
+
+    f64  tick_cost = interval * DEFAULT_COST_FRACTION;
+    cstr source    = "default";
+    if (options.tick_cost_us != 0)
+    {
+        tick_cost = (f64)options.tick_cost_us / 1e6;
+        source    = "-replay_tickcost";
+    }
+    else if (costs.size() >= MIN_COST_SAMPLES)
+    {
+        tick_cost = timing_summarize(costs).p50 / 1e6;
+        source    = "median catch-up gap";
+    }
+
+    auto stretches = split(*records);
+
+    f64 simulated{};
+    for (auto &&stretch : stretches)
+    {
+        simulated += stretch.end - stretch.begin;
+    }
+
+    fmt::print(
+        "{} records, {:.1f} s simulated in {} stretch(es) at {:.1f} tick, up to {} players. A tick costs {:.2f} ms ({}).\n\n",
+        records->size(),
+        simulated,
+        stretches.size(),
+        1.0 / interval,
+        max_players,
+        tick_cost * 1000.0,
+        source);
+
+    fmt::print(
+        "{:<10} {:>9} {:>8} {:>6} {:>6} {:>10} {:>8} {:>8} {:>8} {:>8} {:>8}\n",
+        "policy",
+        "ticks",
+        "overruns",
+        "late",
+        "burst",
+        "over ms",
+        "dropped",
+        "p50 ms",
+        "p99 ms",
+        "p99.9 ms",
+        "max ms");
+
+    u64 start = timing_now_ns();
+
+    auto baseline = recorded(*records);
+    print_result(baseline);
+
+    auto unlimited = simulate(stretches, interval, tick_cost, 0, CLOCK_CATCHUP_DROP, "none");
+    print_result(unlimited);
+
+    for (auto mode : {CLOCK_CATCHUP_DROP, CLOCK_CATCHUP_DILATE})
+    {
+        for (u32 max_ticks : options.max_ticks)
+        {
+            auto name   = fmt::format("{} {}", mode == CLOCK_CATCHUP_DROP ? "drop" : "dilate", max_ticks);
+            auto result = simulate(stretches, interval, tick_cost, max_ticks, mode, std::move(name));
+            print_result(result);
+        }
+    }
+
+    f64 elapsed = (f64)(timing_now_ns() - start) / 1e9;
+    fmt::print(
+        "\nlate: frames whose ticks took longer than an interval, over ms: their time past it, burst: most ticks run back to back.\n"
+        "Tick gaps leave out catch-up ticks. Replayed in {:.2f} s ({:.0f}x real time).\n",
+        elapsed,
+        simulated * (f64)(1 + 2 * options.max_ticks.size()) / std::max(elapsed, 1e-9));
+
+    return 0;
+}
@@ -0,0 +1,247 @@
+// Benchmark and self-test for the engine time source behind `-tickrate_fasttime`.
+// Calibrates `-timebench_calibrations` times and prints the TSC rate and self-test error of each, then the cost per call, resolution
+// and backward steps of every clock over `-timebench_calls` calls, then the drift of the calibrated clock against `CLOCK_MONOTONIC`
+// (and tier0's `Plat_FloatTime`) over `-timebench_seconds`.
+// With `-timebench_tier0 path/to/libtier0_srv.so`, tier0's own `Plat_FloatTime` is measured too, and again through the hooks.
+//
+// Usage: tickrate_timebench [-timebench_calibrations 5] [-timebench_calls 10000000] [-timebench_seconds 10]
+//                           [-timebench_tier0 libtier0_srv.so]
+
+#include "type.hpp"
+#include "fasttime.hpp"
+#include "timing.hpp"
+#include <fmt/format.h>
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <dlfcn.h>
+#include <sys/time.h>
+
+namespace
+{
+    using Plat_FloatTimeFn = f64 (*)();
+
+    struct Options
+    {
+        u32              calibrations{5};
+        u32              calls{10000000};
+        u32              seconds{10};
+        std::string_view tier0{};
+    };
+
+    template <class T>
+    void parse_option(std::string_view value, T &out) noexcept
+    {
+        T result{};
+        if (auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), result); ec == std::errc{})
+        {
+            out = result;
+        }
+    }
+
+    [[nodiscard]] Options parse_options(int argc, char **argv) noexcept
+    {
+        Options options{};
+
+        for (int i = 1; i + 1 < argc; ++i)
+        {
+            std::string_view arg   = argv[i];
+            std::string_view value = argv[i + 1];
+
+            if (arg == "-timebench_calibrations")
+            {
+                parse_option(value, options.calibrations);
+            }
+            else if (arg == "-timebench_calls")
+            {
+                parse_option(value, options.calls);
+            }
+            else if (arg == "-timebench_seconds")
+            {
+                parse_option(value, options.seconds);
+            }
+            else if (arg == "-timebench_tier0")
+            {
+                options.tier0 = value;
+            }
+        }
+
+        options.calls = std::max<u32>(options.calls, 1);
+
+        return options;
+    }
+
+    Plat_FloatTimeFn g_Plat_FloatTime{};
+
+    [[nodiscard]] u64 gettimeofday_ns() noexcept
+    {
+        timeval tv{};
+        gettimeofday(&tv, nullptr);
+        return (u64)tv.tv_sec * 1000000000 + (u64)tv.tv_usec * 1000;
+    }
+
+    [[nodiscard]] u64 Plat_FloatTime_ns() noexcept
+    {
+        return (u64)std::llround(g_Plat_FloatTime() * 1e9);
+    }
+
+    struct Clock
+    {
+        std::string_view name;
+        u64 (*read)() noexcept;
+    };
+
+    void measure(const Options &options, const Clock &clock) noexcept
+    {
+        u64 resolution = ~0ull;
+        u64 backwards{};
+        u64 last = clock.read();
+
+        u64 start = timing_now_ns();
+        for (u32 i{}; i < options.calls; ++i)
+        {
+            u64 now = clock.read();
+            if (now < last)
+            {
+                ++backwards;
+            }
+            else if (now != last)
+            {
+                resolution = std::min(resolution, now - last);
+            }
+
+            last = now;
+        }
+
+        u64 elapsed = timing_now_ns() - start;
+
+        fmt::print(
+            "{:<26} {:>8.1f} {:>13} {:>10}\n",
+            clock.name,
+            (f64)elapsed / options.calls,
+            resolution == ~0ull ? std::string{"-"} : fmt::format("{}", resolution),
+            backwards);
+    }
+
+    // Deviation of `fasttime_now_ns` from `reference` over `seconds`, sampled every 100 ms.
+    void drift(const Options &options, std::string_view name, u64 (*reference)() noexcept) noexcept
+    {
+        u64 fast_start      = fasttime_now_ns();
+        u64 reference_start = reference();
+        f64 max_deviation{};
+        f64 deviation{};
+        u64 elapsed{};
+
+        for (u32 i{}; i < options.seconds * 10; ++i)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds{100});
+
+            u64 fast  = fasttime_now_ns() - fast_start;
+            elapsed   = reference() - reference_start;
+            deviation = (f64)(i64)(fast - elapsed);
+
+            max_deviation = std::max(max_deviation, std::fabs(deviation));
+        }
+
+        if (elapsed == 0)
+        {
+            return;
+        }
+
+        fmt::print(
+            "{:<26} {:>10.2f} {:>14.1f}\n",
+            name,
+            deviation / (f64)elapsed * 1e6,
+            max_deviation / 1e3);
+    }
+} // namespace
+
+int main(int argc, char **argv)
+{
+    auto options = parse_options(argc, argv);
+
+    if (!options.tier0.empty())
+    {
+        // Leaked, `fasttime_install` finds it by its file name.
+        void *tier0 = dlopen(std::string{options.tier0}.c_str(), RTLD_NOW);
+        if (tier0 == nullptr || (g_Plat_FloatTime = (Plat_FloatTimeFn)dlsym(tier0, "Plat_FloatTime")) == nullptr)
+        {
+            fmt::print("Failed to load `Plat_FloatTime` from `{}`: {}\n", options.tier0, dlerror());
+            return 1;
+        }
+    }
+
+    fmt::print("{:<6} {:>12} {:>12} {:>10}  {}\n", "source", "TSC GHz", "error ppm", "self-test", "TSC");
+
+    for (u32 i{}; i < std::max<u32>(options.calibrations, 1); ++i)
+    {
+        auto calibration = fasttime_calibrate();
+        if (!calibration)
+        {
+            fmt::print(
+                "Calibration failed: {}.\n",
+                calibration.error().type == FastTimeError::NO_CLOCK ? "No `CLOCK_MONOTONIC_RAW`" : "Not supported on this platform");
+            return 1;
+        }
+
+        fmt::print(
+            "{:<6} {:>12.6f} {:>12.2f} {:>10}  {}\n",
+            fasttime_source_str(calibration->source),
+            calibration->tsc_hz / 1e9,
+            calibration->error_ppm,
+            calibration->error_ppm <= FASTTIME_MAX_ERROR_PPM ? "pass" : "FAIL",
+            fasttime_tsc_status_str(calibration->tsc_status));
+    }
+
+    std::vector<Clock> clocks = {
+        {"fasttime", fasttime_now_ns},
+        {"vDSO CLOCK_MONOTONIC_RAW", fasttime_raw_now_ns},
+        {"clock_gettime MONOTONIC", timing_now_ns},
+        {"gettimeofday", gettimeofday_ns},
+    };
+
+    if (g_Plat_FloatTime != nullptr)
+    {
+        clocks.push_back({"Plat_FloatTime", Plat_FloatTime_ns});
+    }
+
+    fmt::print("\n{} calls per clock.\n{:<26} {:>8} {:>13} {:>10}\n", options.calls, "clock", "ns/call", "resolution ns", "backwards");
+    for (auto &&clock : clocks)
+    {
+        measure(options, clock);
+    }
+
+    if (options.seconds != 0)
+    {
+        fmt::print("\nDrift of fasttime over {} s.\n{:<26} {:>10} {:>14}\n", options.seconds, "against", "ppm", "max dev us");
+        drift(options, "clock_gettime MONOTONIC", timing_now_ns);
+        drift(options, "vDSO CLOCK_MONOTONIC_RAW", fasttime_raw_now_ns);
+
+        if (g_Plat_FloatTime != nullptr)
+        {
+            drift(options, "Plat_FloatTime", Plat_FloatTime_ns);
+        }
+    }
+
+    // What the engine pays per call with the hooks in.
+    if (g_Plat_FloatTime != nullptr)
+    {
+        if (auto result = fasttime_install(); !result)
+        {
+            fmt::print("\nFailed to hook `Plat_FloatTime`.\n");
+        }
+        else
+        {
+            fmt::print("\n{:<26} {:>8} {:>13} {:>10}\n", "clock", "ns/call", "resolution ns", "backwards");
+            measure(options, {"Plat_FloatTime (hooked)", Plat_FloatTime_ns});
+        }
+    }
+
+    fasttime_uninstall();
+
+    return 0;
+}
@@ -0,0 +1,222 @@
+// Measures how accurately this machine can wake up on a fixed tick schedule, using the plugin's own `TickTimer`.
+// Every strategy runs at every tickrate, the wake-up lateness (time past the deadline) is reported and the highest tickrate that
+// stays within `-probe_margin` of its interval at p99.9 without missed ticks is recommended, with the strategy that did best.
+// The engine can't busy wait for its frames, `sleep_spin` is only measured for comparison and never recommended.
+//
+// Usage: tickrate_timerprobe [-probe_seconds 1] [-probe_spin_us 200] [-probe_margin 0.25] [-probe_tickrates 66,100,128]
+
+#include "type.hpp"
+#include "string.hpp"
+#include "engine.hpp"
+#include "timing.hpp"
+#include <fmt/format.h>
+#include <algorithm>
+#include <charconv>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace
+{
+    struct Options
+    {
+        f64              seconds{1.0};
+        u64              spin_us{200};
+        f64              margin{0.25};
+        std::vector<u32> tickrates{33, 66, 100, 128, 200, 256, 333, 500, 1000};
+    };
+
+    template <class T>
+    void parse_option(std::string_view value, T &out) noexcept
+    {
+        T result{};
+        if (auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), result); ec == std::errc{})
+        {
+            out = result;
+        }
+    }
+
+    [[nodiscard]] Options parse_options(int argc, char **argv) noexcept
+    {
+        Options options{};
+
+        for (int i = 1; i + 1 < argc; ++i)
+        {
+            std::string_view arg   = argv[i];
+            std::string_view value = argv[i + 1];
+
+            if (arg == "-probe_seconds")
+            {
+                // `from_chars` for floating point isn't available everywhere yet.
+                options.seconds = std::strtod(argv[i + 1], nullptr);
+            }
+            else if (arg == "-probe_spin_us")
+            {
+                parse_option(value, options.spin_us);
+            }
+            else if (arg == "-probe_margin")
+            {
+                options.margin = std::strtod(argv[i + 1], nullptr);
+            }
+            else if (arg == "-probe_tickrates")
+            {
+                options.tickrates.clear();
+                for (auto &&str : str_split(value, ','))
+                {
+                    u32 tickrate{};
+                    parse_option(std::string_view{str}, tickrate);
+                    if (tickrate != 0)
+                    {
+                        options.tickrates.push_back(tickrate);
+                    }
+                }
+            }
+        }
+
+        std::sort(options.tickrates.begin(), options.tickrates.end());
+        options.tickrates.erase(std::unique(options.tickrates.begin(), options.tickrates.end()), options.tickrates.end());
+
+        return options;
+    }
+
+    struct ProbeResult
+    {
+        TimingStrategy strategy{};
+        TimingSummary  lateness{}; // Microseconds.
+        usize          missed{};   // Wake-ups later than a whole interval.
+        bool           ok{};
+    };
+
+    [[nodiscard]] ProbeResult probe(TimingStrategy strategy, u32 tickrate, const Options &options) noexcept
+    {
+        ProbeResult result{};
+        result.strategy = strategy;
+
+        auto timer = TickTimer::create(strategy, options.spin_us * 1000);
+        if (!timer)
+        {
+            return result;
+        }
+
+        const u64   interval_ns = 1000000000 / tickrate;
+        const usize count       = std::max<usize>((usize)(options.seconds * (f64)tickrate), 10);
+
+        std::vector<f64> lateness{};
+        lateness.reserve(count);
+
+        u64 deadline = timing_now_ns() + interval_ns;
+        for (usize i{}; i < count; ++i)
+        {
+            timer->wait_until(deadline);
+
+            u64 now = timing_now_ns();
+            lateness.push_back((f64)(now - deadline) / 1000.0);
+
+            deadline += interval_ns;
+
+            // A whole interval late means a tick was lost, start a new schedule so one stall doesn't skew every later sample.
+            if (now >= deadline)
+            {
+                ++result.missed;
+                deadline = now + interval_ns;
+            }
+        }
+
+        result.lateness = timing_summarize(lateness);
+        result.ok       = true;
+
+        return result;
+    }
+
+    [[nodiscard]] bool engine_can_use(TimingStrategy strategy) noexcept
+    {
+        return strategy != TIMING_SLEEP_SPIN;
+    }
+} // namespace
+
+int main(int argc, char **argv)
+{
+    auto options = parse_options(argc, argv);
+
+    // Same bound the plugin enforces on `-tickrate`.
+    const u32 max_tickrate = (u32)(1.0f / MINIMUM_TICK_INTERVAL) + 1;
+
+    fmt::print(
+        "Probing {} tickrate(s) x {} strategies, {:.1f}s each (spin window {} us, margin {:.0f}% of the interval at p99.9).\n\n",
+        options.tickrates.size(),
+        (usize)TIMING_STRATEGY_COUNT,
+        options.seconds,
+        options.spin_us,
+        options.margin * 100.0);
+
+    fmt::print("{:>8}  {:<15} {:>10} {:>10} {:>10} {:>10} {:>7}\n", "tickrate", "strategy", "p50 us", "p99 us", "p99.9 us", "max us", "missed");
+
+    u32            recommended{};
+    TimingStrategy recommended_strategy{};
+
+    for (u32 tickrate : options.tickrates)
+    {
+        if (tickrate > max_tickrate)
+        {
+            fmt::print("{:>8}  skipped, above the engine's limit of {} (`MINIMUM_TICK_INTERVAL`)\n", tickrate, max_tickrate);
+            continue;
+        }
+
+        const f64 budget_us = options.margin * 1000000.0 / (f64)tickrate;
+
+        const ProbeResult *best{};
+        ProbeResult        results[TIMING_STRATEGY_COUNT]{};
+
+        for (u8 i{}; i < TIMING_STRATEGY_COUNT; ++i)
+        {
+            auto &&result = results[i] = probe((TimingStrategy)i, tickrate, options);
+            if (!result.ok)
+            {
+                fmt::print("{:>8}  {:<15} unsupported\n", tickrate, timing_strategy_str(result.strategy));
+                continue;
+            }
+
+            auto &&lateness = result.lateness;
+            fmt::print(
+                "{:>8}  {:<15} {:>10.1f} {:>10.1f} {:>10.1f} {:>10.1f} {:>7}{}\n",
+                tickrate,
+                timing_strategy_str(result.strategy),
+                lateness.p50,
+                lateness.p99,
+                lateness.p999,
+                lateness.max,
+                result.missed,
+                engine_can_use(result.strategy) ? "" : "  (not applicable to the engine)");
+
+            // Only strategies that keep up count, the best of them is the one with the lowest p99.9.
+            if (!engine_can_use(result.strategy) || result.missed != 0 || lateness.p999 > budget_us)
+            {
+                continue;
+            }
+
+            if (best == nullptr || lateness.p999 < best->lateness.p999)
+            {
+                best = &result;
+            }
+        }
+
+        if (best != nullptr)
+        {
+            recommended          = tickrate;
+            recommended_strategy = best->strategy;
+        }
+    }
+
+    fmt::print("\n");
+
+    if (recommended == 0)
+    {
+        fmt::print("None of the tested tickrates can be paced within the margin on this machine.\n");
+        return EXIT_FAILURE;
+    }
+
+    fmt::print("Recommended: -tickrate {} (best with {}).\n", recommended, timing_strategy_str(recommended_strategy));
+
+    return EXIT_SUCCESS;
+}
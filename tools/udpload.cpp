@@ -0,0 +1,406 @@
+// Local UDP load generator for the batched receive and send paths (`NET_RECV_BATCH`, `NET_SEND_BATCH`).
+// A sender thread plays `-udpload_clients` clients, each sending a `-udpload_size` byte datagram `-udpload_rate` times a second
+// to a loopback socket. The main thread drains that socket once per tick like the engine does (read until it would block), first
+// with plain `recvfrom`, then through `net_recvfrom` with batching. Syscalls per tick, datagrams per syscall, main thread CPU time
+// per datagram and the time a drain takes are reported for both.
+// Then the main thread sends every client a datagram per tick like the engine sends snapshots, with plain `sendto` and through
+// `net_sendto` with a `net_flush` at the end of the tick.
+//
+// Usage: tickrate_udpload [-udpload_clients 64] [-udpload_rate 128] [-udpload_size 96] [-udpload_tickrate 128] [-udpload_seconds 5]
+
+#include "type.hpp"
+#include "net.hpp"
+#include "timing.hpp"
+#include <fmt/format.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <cstdlib>
+#include <ctime>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    struct Options
+    {
+        u32 clients{64};
+        u32 rate{128};
+        u32 size{96};
+        u32 tickrate{128};
+        f64 seconds{5.0};
+    };
+
+    template <class T>
+    void parse_option(std::string_view value, T &out) noexcept
+    {
+        T result{};
+        if (auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), result); ec == std::errc{})
+        {
+            out = result;
+        }
+    }
+
+    [[nodiscard]] Options parse_options(int argc, char **argv) noexcept
+    {
+        Options options{};
+
+        for (int i = 1; i + 1 < argc; ++i)
+        {
+            std::string_view arg   = argv[i];
+            std::string_view value = argv[i + 1];
+
+            if (arg == "-udpload_clients")
+            {
+                parse_option(value, options.clients);
+            }
+            else if (arg == "-udpload_rate")
+            {
+                parse_option(value, options.rate);
+            }
+            else if (arg == "-udpload_size")
+            {
+                parse_option(value, options.size);
+            }
+            else if (arg == "-udpload_tickrate")
+            {
+                parse_option(value, options.tickrate);
+            }
+            else if (arg == "-udpload_seconds")
+            {
+                // `from_chars` for floating point isn't available everywhere yet.
+                options.seconds = std::strtod(argv[i + 1], nullptr);
+            }
+        }
+
+        options.clients  = std::max<u32>(options.clients, 1);
+        options.rate     = std::max<u32>(options.rate, 1);
+        options.size     = std::clamp<u32>(options.size, 4, NET_MAX_DATAGRAM);
+        options.tickrate = std::max<u32>(options.tickrate, 1);
+
+        return options;
+    }
+
+    [[nodiscard]] u64 thread_cpu_ns() noexcept
+    {
+        timespec ts{};
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+        return (u64)ts.tv_sec * 1000000000 + (u64)ts.tv_nsec;
+    }
+
+    [[nodiscard]] int open_socket(sockaddr_in &address) noexcept
+    {
+        int fd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (fd < 0)
+        {
+            return -1;
+        }
+
+        address                 = {};
+        address.sin_family      = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        // A full second of load, so nothing is dropped by the kernel while a tick runs late.
+        int buffer = 8 * 1024 * 1024;
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &buffer, sizeof(buffer));
+
+        socklen_t size = sizeof(address);
+        if (bind(fd, (sockaddr *)&address, sizeof(address)) != 0 || getsockname(fd, (sockaddr *)&address, &size) != 0)
+        {
+            close(fd);
+            return -1;
+        }
+
+        return fd;
+    }
+
+    // Sends `rate` datagrams a second per client, in round robin so the clients' datagrams interleave like they would on a server.
+    void send_load(const Options &options, const sockaddr_in &target, const std::atomic<bool> &stop) noexcept
+    {
+        std::vector<int> sockets(options.clients, -1);
+        for (auto &&fd : sockets)
+        {
+            fd = socket(AF_INET, SOCK_DGRAM, 0);
+        }
+
+        // Netchan sequence numbers, never -1 (connectionless).
+        std::vector<u8> payload(options.size, 0x2A);
+
+        const f64 per_ns = (f64)options.clients * (f64)options.rate / 1e9;
+        const u64 start  = timing_now_ns();
+        u64       sent{};
+
+        while (!stop.load(std::memory_order_relaxed))
+        {
+            auto due = (u64)((f64)(timing_now_ns() - start) * per_ns);
+            for (; sent < due; ++sent)
+            {
+                int fd = sockets[sent % sockets.size()];
+                sendto(fd, payload.data(), payload.size(), 0, (const sockaddr *)&target, sizeof(target));
+            }
+
+            timespec ts{0, 200000};
+            nanosleep(&ts, nullptr);
+        }
+
+        for (int fd : sockets)
+        {
+            close(fd);
+        }
+    }
+
+    struct RunResult
+    {
+        u64           ticks{};
+        u64           datagrams{};
+        u64           syscalls{};
+        u64           cpu_ns{};
+        TimingSummary duration{}; // Of a drain or a send, in microseconds.
+    };
+
+    [[nodiscard]] RunResult run(const Options &options, bool batched) noexcept
+    {
+        RunResult result{};
+
+        sockaddr_in address{};
+        int         fd = open_socket(address);
+        if (fd < 0)
+        {
+            return result;
+        }
+
+        // The engine's sockets are non-blocking.
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+        if (batched)
+        {
+            net_enable(NET_RECV_BATCH);
+        }
+
+        std::atomic<bool> stop{};
+        std::thread       sender{[&]() noexcept { send_load(options, address, stop); }};
+
+        auto timer = TickTimer::create(TIMING_SLEEP_ABSOLUTE);
+
+        const u64   interval_ns = 1000000000 / options.tickrate;
+        const usize count       = std::max<usize>((usize)(options.seconds * (f64)options.tickrate), 10);
+        const auto  stats_start = net_stats();
+
+        std::array<u8, NET_MAX_DATAGRAM> buf{};
+        std::vector<f64>                 drain{};
+        drain.reserve(count);
+
+        u64 deadline = timing_now_ns() + interval_ns;
+        for (usize i{}; i < count; ++i)
+        {
+            timer->wait_until(deadline);
+            deadline += interval_ns;
+
+            u64 begin     = timing_now_ns();
+            u64 cpu_begin = thread_cpu_ns();
+
+            while (true)
+            {
+                sockaddr_in from{};
+                u32         from_size = sizeof(from);
+
+                isize size = batched ? net_recvfrom(fd, buf.data(), buf.size(), 0, &from, &from_size)
+                                     : recvfrom(fd, buf.data(), buf.size(), 0, (sockaddr *)&from, &from_size);
+                if (!batched)
+                {
+                    ++result.syscalls;
+                }
+
+                if (size < 0)
+                {
+                    break;
+                }
+
+                ++result.datagrams;
+            }
+
+            result.cpu_ns += thread_cpu_ns() - cpu_begin;
+            drain.push_back((f64)(timing_now_ns() - begin) / 1000.0);
+        }
+
+        stop.store(true, std::memory_order_relaxed);
+        sender.join();
+
+        if (batched)
+        {
+            result.syscalls = net_stats().syscalls - stats_start.syscalls;
+            net_disable(NET_RECV_BATCH);
+        }
+
+        close(fd);
+
+        result.ticks    = count;
+        result.duration = timing_summarize(drain);
+
+        return result;
+    }
+
+    [[nodiscard]] RunResult run_send(const Options &options, bool batched) noexcept
+    {
+        RunResult result{};
+
+        sockaddr_in      address{};
+        int              fd = open_socket(address);
+        std::vector<int> clients(options.clients, -1);
+
+        // Every client gets its own address, datagrams pile up on them unread.
+        std::vector<sockaddr_in> targets(options.clients);
+        for (usize i{}; i < clients.size(); ++i)
+        {
+            clients[i] = open_socket(targets[i]);
+        }
+
+        auto close_all = [&]() noexcept
+        {
+            for (int client : clients)
+            {
+                if (client >= 0)
+                {
+                    close(client);
+                }
+            }
+
+            if (fd >= 0)
+            {
+                close(fd);
+            }
+        };
+
+        if (fd < 0 || std::find(clients.begin(), clients.end(), -1) != clients.end())
+        {
+            close_all();
+            return result;
+        }
+
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+        if (batched)
+        {
+            net_enable(NET_SEND_BATCH);
+        }
+
+        auto timer = TickTimer::create(TIMING_SLEEP_ABSOLUTE);
+
+        const u64   interval_ns = 1000000000 / options.tickrate;
+        const usize count       = std::max<usize>((usize)(options.seconds * (f64)options.tickrate), 10);
+        const auto  stats_start = net_stats();
+
+        std::vector<u8>  payload(options.size, 0x2A);
+        std::vector<f64> send{};
+        send.reserve(count);
+
+        u64 deadline = timing_now_ns() + interval_ns;
+        for (usize i{}; i < count; ++i)
+        {
+            timer->wait_until(deadline);
+            deadline += interval_ns;
+
+            u64 begin     = timing_now_ns();
+            u64 cpu_begin = thread_cpu_ns();
+
+            for (auto &&target : targets)
+            {
+                isize size = batched ? net_sendto(fd, payload.data(), payload.size(), 0, &target, sizeof(target))
+                                     : sendto(fd, payload.data(), payload.size(), 0, (const sockaddr *)&target, sizeof(target));
+                if (size >= 0)
+                {
+                    ++result.datagrams;
+                }
+            }
+
+            // The end of the engine's frame.
+            if (batched)
+            {
+                net_flush();
+            }
+            else
+            {
+                result.syscalls += targets.size();
+            }
+
+            result.cpu_ns += thread_cpu_ns() - cpu_begin;
+            send.push_back((f64)(timing_now_ns() - begin) / 1000.0);
+        }
+
+        if (batched)
+        {
+            auto stats = net_stats();
+
+            result.syscalls  = stats.send_syscalls - stats_start.send_syscalls;
+            result.datagrams -= stats.failed_sends - stats_start.failed_sends;
+            net_disable(NET_SEND_BATCH);
+        }
+
+        close_all();
+
+        result.ticks    = count;
+        result.duration = timing_summarize(send);
+
+        return result;
+    }
+
+    void print_result(std::string_view mode, const RunResult &result) noexcept
+    {
+        if (result.ticks == 0)
+        {
+            fmt::print("{:<9} failed to open the loopback sockets\n", mode);
+            return;
+        }
+
+        fmt::print(
+            "{:<9} {:>10} {:>14.1f} {:>16.1f} {:>15.0f} {:>13.1f} {:>13.1f}\n",
+            mode,
+            result.datagrams,
+            (f64)result.syscalls / (f64)result.ticks,
+            (f64)result.datagrams / (f64)std::max<u64>(result.syscalls, 1),
+            (f64)result.cpu_ns / (f64)std::max<u64>(result.datagrams, 1),
+            result.duration.p50,
+            result.duration.p99);
+    }
+} // namespace
+
+int main(int argc, char **argv)
+{
+    auto options = parse_options(argc, argv);
+
+    fmt::print(
+        "{} clients x {} datagrams/s of {} bytes, drained at {} tick for {:.1f}s per mode.\n\n",
+        options.clients,
+        options.rate,
+        options.size,
+        options.tickrate,
+        options.seconds);
+
+    fmt::print(
+        "{:<9} {:>10} {:>14} {:>16} {:>15} {:>13} {:>13}\n",
+        "mode",
+        "datagrams",
+        "syscalls/tick",
+        "datagrams/call",
+        "cpu ns/dgram",
+        "p50 us",
+        "p99 us");
+
+    for (bool batched : {false, true})
+    {
+        print_result(batched ? "recvmmsg" : "recvfrom", run(options, batched));
+    }
+
+    for (bool batched : {false, true})
+    {
+        print_result(batched ? "sendmmsg" : "sendto", run_send(options, batched));
+    }
+
+    return 0;
+}